@@ -68,6 +68,10 @@
 //  final application design.
 #define DEMO_BOARD PIC32_MACRO_KEYBOARD
 
+/** CLOCK **********************************************************/
+// SYS_FREQ and the configuration bits both come from the profile
+#include "clock_profile.h"
+
 //the entire LED function can be removed, because it is specific to the 
 //dev board this project was originally built on
 /** LED ***********************************************************
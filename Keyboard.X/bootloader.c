@@ -0,0 +1,397 @@
+/** INCLUDES *******************************************************/
+#include <string.h>
+#include "bootloader.h"
+#include "nvm.h"
+#include "crc32.h"
+
+/** DEFINITIONS ****************************************************/
+// What crt0's reset handler may start with: j/jal _startup, or la/jr
+#define MIPS_OPCODE(w)          ((w) >> 26)
+#define MIPS_J                  0x02
+#define MIPS_JAL                0x03
+#define MIPS_LUI_K0             0x3C1A0000
+#define MIPS_ADDIU_K0           0x275A0000
+#define MIPS_ORI_K0             0x375A0000
+#define MIPS_JR_K0              0x03400008
+#define NO_OFFSET               0xFFFFFFFF
+
+/** VARIABLES ******************************************************/
+typedef struct
+{
+    uint32_t addr;                  // Physical address of the row
+    bool     used;                  // Holds data not yet queued for programming
+    uint8_t  data[NVM_ROW_SIZE] __attribute__ ((aligned(4)));
+} BOOT_ROW;
+
+BOOT_RESPONSE bootResponse;
+
+static BOOT_ROW rows[BOOT_ROW_BUFFERS];
+static uint8_t rowHead;             // Oldest row waiting for the NVM controller
+static uint8_t rowsPending;         // Rows queued behind rowHead; the next one fills
+
+static uint32_t stageBase;
+static uint32_t stageSize;
+static uint32_t imageLength;        // From BEGIN
+static uint32_t nextOffset;         // PROGRAM offsets only move forward
+static uint32_t erasedPages;        // Staging pages erased so far, from the bottom
+static uint8_t  sessionStatus;      // First error of the session, sticky
+
+static BOOT_PACKET deferredCmd;     // VERIFY/COMMIT/BEGIN waiting for the flash
+static bool deferred;
+static bool stalled;                // Caller is holding a status stage for us
+static bool resetRequested;
+
+/** PRIVATE PROTOTYPES *********************************************/
+static void Respond(const BOOT_PACKET *pkt, uint8_t status, uint32_t arg);
+static bool Ready(void);
+static void RowQueue(void);
+static void RowAppend(uint32_t offset, const uint8_t *src, uint8_t len);
+static bool RunDeferred(void);
+static bool EntryValid(uint32_t base, uint32_t length);
+
+/** DECLARATIONS ***************************************************/
+
+// Leaves stalled alone: BEGIN calls this with a status stage held
+static void SessionReset(void)
+{
+    imageLength = 0;
+    nextOffset = 0;
+    erasedPages = 0;
+    sessionStatus = BOOT_OK;
+    rowHead = 0;
+    rowsPending = 0;
+    memset(rows, 0, sizeof(rows));
+}
+
+void BootInit(uint32_t base, uint32_t size)
+{
+    stageBase = base;
+    stageSize = size;
+    SessionReset();
+    deferred = false;
+    stalled = false;
+    resetRequested = false;
+}
+
+bool BootResetRequested(void)
+{
+    return resetRequested;
+}
+
+// NVM work queued, or a status stage held for it
+bool BootBusy(void)
+{
+    return rowsPending != 0 || deferred || stalled;
+}
+
+static void Respond(const BOOT_PACKET *pkt, uint8_t status, uint32_t arg)
+{
+    memset(&bootResponse, 0, sizeof(bootResponse));
+    bootResponse.reportId = pkt->reportId;
+    bootResponse.cmd = pkt->cmd;
+    bootResponse.seq = pkt->seq;
+    bootResponse.status = status;
+    bootResponse.arg = arg;
+    bootResponse.version = BOOT_PROTOCOL_VERSION;
+}
+
+// Another packet can be taken once it cannot run out of row buffers
+static bool Ready(void)
+{
+    return !deferred && rowsPending <= BOOT_ROW_BUFFERS - 3;
+}
+
+static BOOT_ROW *RowFilling(void)
+{
+    return &rows[(rowHead + rowsPending) % BOOT_ROW_BUFFERS];
+}
+
+static void RowQueue(void)
+{
+    if (RowFilling()->used) rowsPending++;
+}
+
+static void RowAppend(uint32_t offset, const uint8_t *src, uint8_t len)
+{
+    BOOT_ROW *row;
+    uint32_t rowAddr, col, n;
+
+    while (len) {
+        rowAddr = stageBase + (offset & ~(NVM_ROW_SIZE - 1));
+        col = offset & (NVM_ROW_SIZE - 1);
+
+        row = RowFilling();
+        if (row->used && row->addr != rowAddr) {
+            RowQueue();             // Offset skipped ahead: write what we have
+            row = RowFilling();
+        }
+        if (!row->used) {
+            row->addr = rowAddr;
+            row->used = true;
+            memset(row->data, 0xFF, NVM_ROW_SIZE);
+        }
+
+        n = NVM_ROW_SIZE - col;
+        if (n > len) n = len;
+        memcpy(&row->data[col], src, n);
+        if (col + n == NVM_ROW_SIZE) RowQueue();
+
+        offset += n;
+        src += n;
+        len -= n;
+    }
+}
+
+/********************************************************************
+ * Function:        bool BootProcessPacket(const BOOT_PACKET *pkt)
+ *
+ * Overview:        Handles one SET_REPORT.  Returns false if the
+ *                  caller must hold the status stage until BootTasks()
+ *                  returns true.
+ *******************************************************************/
+bool BootProcessPacket(const BOOT_PACKET *pkt)
+{
+    switch (pkt->cmd)
+    {
+        case BOOT_CMD_QUERY:
+            Respond(pkt, BOOT_OK, stageSize);
+            break;
+
+        case BOOT_CMD_PROGRAM:
+            // No addr + len: a host could wrap it past the bank
+            if (pkt->len > BOOT_DATA_SIZE || pkt->addr > imageLength ||
+                pkt->len > imageLength - pkt->addr) {
+                Respond(pkt, BOOT_ERR_RANGE, nextOffset);
+                break;
+            }
+            if (pkt->addr < nextOffset) {
+                Respond(pkt, BOOT_ERR_SEQUENCE, nextOffset);
+                break;
+            }
+            RowAppend(pkt->addr, pkt->data, pkt->len);
+            nextOffset = pkt->addr + pkt->len;
+            Respond(pkt, sessionStatus, nextOffset);
+            break;
+
+        case BOOT_CMD_BEGIN:
+            if (pkt->addr <= BOOT_IMG_APP || pkt->addr > stageSize) {
+                Respond(pkt, BOOT_ERR_RANGE, stageSize);
+                break;
+            }
+            // Like VERIFY and COMMIT, waits for the flash to be idle
+            /* fall through */
+        case BOOT_CMD_VERIFY:
+        case BOOT_CMD_COMMIT:
+            RowQueue();
+            deferredCmd = *pkt;
+            deferred = true;
+            Respond(pkt, BOOT_PENDING, 0);
+            break;
+
+        case BOOT_CMD_RESET:
+            resetRequested = true;
+            Respond(pkt, BOOT_OK, 0);
+            break;
+
+        default:
+            Respond(pkt, BOOT_ERR_COMMAND, 0);
+            break;
+    }
+
+    stalled = !Ready();
+    return !stalled;
+}
+
+// Finishes a deferred command if the flash has caught up
+static bool RunDeferred(void)
+{
+    const BOOT_PACKET *pkt = &deferredCmd;
+    BOOT_HEADER hdr;
+    uint32_t crc, len;
+
+    if (rowsPending) return false;
+
+    switch (pkt->cmd)
+    {
+        case BOOT_CMD_BEGIN:
+            // Forget any earlier commit before the staging bank changes
+            if (!NVMErasePage(FLASH_BOOT_HDR_BASE)) {
+                Respond(pkt, BOOT_ERR_FLASH, 0);
+                break;
+            }
+            SessionReset();
+            imageLength = pkt->addr;
+            Respond(pkt, BOOT_OK, stageSize);
+            break;
+
+        case BOOT_CMD_VERIFY:
+            if ((pkt->addr & (NVM_PAGE_SIZE - 1)) || pkt->addr >= imageLength) {
+                Respond(pkt, BOOT_ERR_RANGE, 0);
+                break;
+            }
+            crc = CRC32Final(CRC32Update(CRC32_INIT, NVMReadUncached(stageBase + pkt->addr), NVM_PAGE_SIZE));
+            Respond(pkt, sessionStatus != BOOT_OK ? sessionStatus :
+                         crc == pkt->arg ? BOOT_OK : BOOT_ERR_CRC, crc);
+            break;
+
+        case BOOT_CMD_COMMIT:
+            len = pkt->addr;
+            if (len != imageLength) {
+                Respond(pkt, BOOT_ERR_RANGE, imageLength);
+                break;
+            }
+            // Gaps the host never wrote must read as erased
+            if (erasedPages * NVM_PAGE_SIZE < len) {
+                NVMErasePage(stageBase + erasedPages * NVM_PAGE_SIZE);
+                erasedPages++;
+                return false;
+            }
+            crc = CRC32Final(CRC32Update(CRC32_INIT, NVMReadUncached(stageBase), len));
+            if (sessionStatus != BOOT_OK || crc != pkt->arg) {
+                Respond(pkt, sessionStatus != BOOT_OK ? sessionStatus : BOOT_ERR_CRC, crc);
+                break;
+            }
+            if (!EntryValid(stageBase, len)) {
+                Respond(pkt, BOOT_ERR_ENTRY, crc);
+                break;
+            }
+            hdr.magic = BOOT_HDR_MAGIC;
+            hdr.length = len;
+            hdr.crc = crc;
+            hdr.hdrCrc = CRC32Final(CRC32Update(CRC32_INIT, &hdr, 12));
+            if (!NVMWriteWord(FLASH_BOOT_HDR_BASE + 0, hdr.magic) ||
+                !NVMWriteWord(FLASH_BOOT_HDR_BASE + 4, hdr.length) ||
+                !NVMWriteWord(FLASH_BOOT_HDR_BASE + 8, hdr.crc) ||
+                !NVMWriteWord(FLASH_BOOT_HDR_BASE + 12, hdr.hdrCrc)) {
+                Respond(pkt, BOOT_ERR_FLASH, crc);
+                break;
+            }
+            Respond(pkt, BOOT_OK, crc);
+            break;
+    }
+
+    deferred = false;
+    return true;
+}
+
+/********************************************************************
+ * Function:        bool BootTasks(void)
+ *
+ * Overview:        Runs at most one NVM operation per call: the next
+ *                  page erase or row write, or a deferred command.
+ *                  Returns true when a held status stage can go.
+ *******************************************************************/
+bool BootTasks(void)
+{
+    BOOT_ROW *row;
+    uint32_t page;
+
+    if (rowsPending) {
+        row = &rows[rowHead];
+        page = (row->addr - stageBase) / NVM_PAGE_SIZE;
+
+        // Pages are erased in order just ahead of the data
+        if (page >= erasedPages) {
+            if (!NVMErasePage(stageBase + erasedPages * NVM_PAGE_SIZE)) {
+                sessionStatus = BOOT_ERR_FLASH;
+            }
+            erasedPages++;
+        } else {
+            if (!NVMWriteRow(row->addr, row->data)) {
+                sessionStatus = BOOT_ERR_FLASH;
+            }
+            row->used = false;
+            rowHead = (rowHead + 1) % BOOT_ROW_BUFFERS;
+            rowsPending--;
+        }
+    } else if (deferred) {
+        RunDeferred();
+    }
+
+    if (stalled && Ready()) {
+        stalled = false;
+        return true;
+    }
+    return false;
+}
+
+// Offset of a physical address in the staged image, if the image has it
+static uint32_t ImageOffset(uint32_t phys, uint32_t length)
+{
+    uint32_t off;
+
+    if (phys - FLASH_STARTUP_BASE < FLASH_STARTUP_SIZE) {
+        off = BOOT_IMG_STARTUP + (phys - FLASH_STARTUP_BASE);
+    } else if (phys - FLASH_APP_BASE < FLASH_APP_SIZE) {
+        off = BOOT_IMG_APP + (phys - FLASH_APP_BASE);
+    } else {
+        return NO_OFFSET;
+    }
+    return off + 4 <= length ? off : NO_OFFSET;
+}
+
+/*
+ * The reset vector must jump to code the image itself programs: an
+ * image built without its startup code, or for another memory map,
+ * would leave the part with nothing to run after the copy.
+ */
+static bool EntryValid(uint32_t base, uint32_t length)
+{
+    const uint32_t *code = NVMReadUncached(base + BOOT_IMG_STARTUP);
+    uint32_t target, off;
+
+    if (MIPS_OPCODE(code[0]) == MIPS_J || MIPS_OPCODE(code[0]) == MIPS_JAL) {
+        // 256 MB region of the delay slot
+        target = ((FLASH_RESET_VECTOR + 4) & 0xF0000000) | (code[0] & 0x03FFFFFF) << 2;
+    } else if ((code[0] & 0xFFFF0000) == MIPS_LUI_K0 && code[2] == MIPS_JR_K0 &&
+               (code[1] & 0xFFFF0000) == MIPS_ADDIU_K0) {
+        target = (code[0] << 16) + (uint32_t)(int16_t)code[1];
+    } else if ((code[0] & 0xFFFF0000) == MIPS_LUI_K0 && code[2] == MIPS_JR_K0 &&
+               (code[1] & 0xFFFF0000) == MIPS_ORI_K0) {
+        target = (code[0] << 16) | (code[1] & 0xFFFF);
+    } else {
+        return false;
+    }
+
+    off = ImageOffset(target & 0x1FFFFFFF, length);
+    return off != NO_OFFSET && *(const uint32_t*)NVMReadUncached(base + off) != 0xFFFFFFFF;
+}
+
+/********************************************************************
+ * Function:        void BootApplyStagedImage(void)
+ *
+ * Overview:        Called first thing in main().  If a committed image
+ *                  is waiting, still matches its CRC and starts in its
+ *                  own startup code, the startup code, vectors and
+ *                  application are copied over the installed ones and
+ *                  the part resets into them.  Otherwise returns and
+ *                  the current image runs.
+ *******************************************************************/
+void BootApplyStagedImage(void)
+{
+    const BOOT_HEADER *hdr = NVMReadUncached(FLASH_BOOT_HDR_BASE);
+    NVM_COPY copy[3];
+    uint32_t crc;
+
+    if (hdr->magic != BOOT_HDR_MAGIC) return;
+    if (hdr->hdrCrc != CRC32Final(CRC32Update(CRC32_INIT, hdr, 12))) return;
+    if (hdr->length <= BOOT_IMG_APP || hdr->length > FLASH_STAGE_SIZE) return;
+
+    crc = CRC32Final(CRC32Update(CRC32_INIT, NVMReadUncached(FLASH_STAGE_BASE), hdr->length));
+    if (crc != hdr->crc || !EntryValid(FLASH_STAGE_BASE, hdr->length)) {
+        NVMErasePage(FLASH_BOOT_HDR_BASE);  // Never try this image again
+        return;
+    }
+
+    // The application first, then what points into it
+    copy[0].dst = FLASH_APP_BASE;
+    copy[0].src = FLASH_STAGE_BASE + BOOT_IMG_APP;
+    copy[0].length = hdr->length - BOOT_IMG_APP;
+    copy[1].dst = FLASH_VECTOR_BASE;
+    copy[1].src = FLASH_STAGE_BASE + BOOT_IMG_VECTORS;
+    copy[1].length = FLASH_VECTOR_SIZE;
+    copy[2].dst = FLASH_STARTUP_BASE;
+    copy[2].src = FLASH_STAGE_BASE + BOOT_IMG_STARTUP;
+    copy[2].length = FLASH_STARTUP_SIZE;
+    NVMCopyDownAndReset(copy, 3, FLASH_BOOT_HDR_BASE);
+}
@@ -0,0 +1,114 @@
+/********************************************************************
+ FileName:      bootloader.h
+ Dependencies:  nvm.h
+ Processor:     PIC32MX270F256D, or a Linux host (simulated NVM)
+
+ Firmware update over HID feature reports, so no host driver is
+ needed.  The host writes BOOT_PACKETs with SET_REPORT and reads the
+ BOOT_RESPONSE to the last command with GET_REPORT.
+
+ An update is written to the staging bank, never over the running
+ image.  Each page can be checked by CRC as it completes, and COMMIT
+ checks the whole image before it records a boot header.  At the next
+ reset BootApplyStagedImage() re-checks the staged image and only then
+ copies it over the application.
+
+ The image carries more than the application bank.  The reset code
+ and crt0 in boot flash, and the exception vectors, hold absolute
+ addresses into the application, so a relinked application needs its
+ own copies of them.  They lead the image (BOOT_IMG_*) and are copied
+ with it.  The configuration words page is never written.  Before
+ COMMIT records an image, and again before it is applied, the reset
+ vector must jump into the image's own startup code.
+
+ Data is written behind the USB transfers.  PROGRAM packets fill one
+ of BOOT_ROW_BUFFERS row buffers and are acknowledged straight away.
+ Full rows are programmed from the main loop by BootTasks().  When
+ no row buffer is free, BootProcessPacket() returns false and the
+ caller holds the control transfer's status stage until BootTasks()
+ reports that one has been freed.
+ *******************************************************************/
+#ifndef BOOTLOADER_H
+#define BOOTLOADER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nvm.h"
+
+/** DEFINITIONS ****************************************************/
+#define BOOT_PROTOCOL_VERSION   2
+#define BOOT_PACKET_SIZE        64      // Feature report, report ID included
+#define BOOT_DATA_SIZE          56
+#define BOOT_ROW_BUFFERS        4       // Filling, being written, and room for a
+                                        // packet that straddles two rows
+
+// Commands
+#define BOOT_CMD_QUERY          0x01    // Response arg = staging bank size
+#define BOOT_CMD_BEGIN          0x02    // addr = image length; resets the session
+#define BOOT_CMD_PROGRAM        0x03    // addr = image offset, len bytes of data
+#define BOOT_CMD_VERIFY         0x04    // addr = page offset, arg = page CRC-32
+#define BOOT_CMD_COMMIT         0x05    // addr = image length, arg = image CRC-32
+#define BOOT_CMD_RESET          0x06    // Reset and apply a committed image
+
+// Status
+#define BOOT_OK                 0x00
+#define BOOT_ERR_COMMAND        0x01
+#define BOOT_ERR_RANGE          0x02
+#define BOOT_ERR_SEQUENCE       0x03    // Offset went backwards
+#define BOOT_ERR_FLASH          0x04    // NVM controller reported an error
+#define BOOT_ERR_CRC            0x05
+#define BOOT_ERR_ENTRY          0x06    // Reset vector does not reach the startup code
+#define BOOT_PENDING            0xFF    // Response not ready yet
+
+// Staged image layout, as offsets from the start of the staging bank
+#define BOOT_IMG_STARTUP        0                                       // To FLASH_STARTUP_BASE
+#define BOOT_IMG_VECTORS        (BOOT_IMG_STARTUP + FLASH_STARTUP_SIZE) // To FLASH_VECTOR_BASE
+#define BOOT_IMG_APP            (BOOT_IMG_VECTORS + FLASH_VECTOR_SIZE)  // To FLASH_APP_BASE
+
+typedef struct __attribute__ ((packed))
+{
+    uint8_t  reportId;
+    uint8_t  cmd;
+    uint8_t  seq;                   // Echoed in the response
+    uint8_t  len;
+    uint32_t addr;
+    union {
+        uint8_t  data[BOOT_DATA_SIZE];
+        uint32_t arg;
+    };
+} BOOT_PACKET;
+
+typedef struct __attribute__ ((packed))
+{
+    uint8_t  reportId;
+    uint8_t  cmd;
+    uint8_t  seq;
+    uint8_t  status;
+    uint32_t arg;
+    uint8_t  version;
+    uint8_t  reserved[BOOT_PACKET_SIZE - 9];
+} BOOT_RESPONSE;
+
+// Written to FLASH_BOOT_HDR_BASE by COMMIT
+#define BOOT_HDR_MAGIC          0x424F4F54  // "BOOT"
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t length;
+    uint32_t crc;
+    uint32_t hdrCrc;                // CRC-32 of the three words above
+} BOOT_HEADER;
+
+/** PUBLIC VARIABLES ***********************************************/
+extern BOOT_RESPONSE bootResponse;
+
+/** PUBLIC PROTOTYPES **********************************************/
+void BootInit(uint32_t stageBase, uint32_t stageSize);
+bool BootProcessPacket(const BOOT_PACKET *pkt);
+bool BootTasks(void);
+bool BootBusy(void);
+bool BootResetRequested(void);
+void BootApplyStagedImage(void);
+
+#endif // BOOTLOADER_H
@@ -0,0 +1,167 @@
+/** INCLUDES *******************************************************/
+#include "clock.h"
+
+#if defined(__PIC32MX__)
+#include "Compiler.h"
+#include "tick.h"
+#endif
+
+/** DEFINITIONS ****************************************************/
+#define OSC_FRC                 0       // OSCCON.NOSC
+#define OSC_PRIPLL              3
+#define PFMWS_RESET             7       // CHECON.PFMWS out of reset
+#define PREFEN_ALL              3       // CHECON.PREFEN: cacheable and non-cacheable regions
+#define K0_MASK                 0x7     // CP0 Config.K0
+#define K0_UNCACHED             2       // Out of reset
+#define K0_CACHEABLE            3
+
+/** VARIABLES ******************************************************/
+uint32_t sysClock = CLOCK_FULL_HZ;
+uint32_t clockSwitches;
+uint32_t clockFullMs;
+uint32_t clockLowMs;
+
+static uint32_t target = CLOCK_FULL_HZ; // sysClock, or what a switch under way goes to
+static uint32_t lastUs;
+static uint32_t partUs;                 // Not yet counted in whole milliseconds
+static uint32_t busyUs;                 // Last pass that needed full speed
+#if !defined(__PIC32MX__)
+static uint32_t startUs;                // When the simulated switch began
+#endif
+
+/** PRIVATE PROTOTYPES *********************************************/
+static void Start(uint32_t hz, uint32_t nowUs);
+static bool Done(uint32_t nowUs);
+static void Changed(void);
+
+/** DECLARATIONS ***************************************************/
+#if defined(__PIC32MX__)
+
+// Asks for the other oscillator; OSWEN clears once the switch is done
+static void Start(uint32_t hz, uint32_t nowUs)
+{
+    if (hz > sysClock) CHECONbits.PFMWS = CLOCK_FLASH_WS(hz);  // Before flash gets faster reads
+    SYSKEY = 0;
+    SYSKEY = 0xAA996655;
+    SYSKEY = 0x556699AA;
+    OSCCONbits.NOSC = hz == CLOCK_LOW_HZ ? OSC_FRC : OSC_PRIPLL;
+    OSCCONSET = _OSCCON_OSWEN_MASK;
+    SYSKEY = 0;
+}
+
+static bool Done(uint32_t nowUs)
+{
+    return !(OSCCON & _OSCCON_OSWEN_MASK);
+}
+
+// Counts up to here were at the old clock
+static void Changed(void)
+{
+    TickUs();
+    if (target < sysClock) CHECONbits.PFMWS = CLOCK_FLASH_WS(target);
+    sysClock = target;
+    clockSwitches++;
+}
+
+#else   // Host simulation
+
+static void Start(uint32_t hz, uint32_t nowUs)
+{
+    (void)hz;
+    startUs = nowUs;
+}
+
+static bool Done(uint32_t nowUs)
+{
+    return target == CLOCK_LOW_HZ || (int32_t)(nowUs - startUs) >= CLOCK_LOCK_US;
+}
+
+static void Changed(void)
+{
+    sysClock = target;
+    clockSwitches++;
+}
+
+#endif
+
+void ClockInit(void)
+{
+    sysClock = target = CLOCK_FULL_HZ;
+    clockSwitches = clockFullMs = clockLowMs = 0;
+    lastUs = partUs = busyUs = 0;
+}
+
+/********************************************************************
+ * Function:        void ClockTasks(bool busy, uint32_t nowUs)
+ *
+ * Overview:        Call once per main loop pass; busy says something
+ *                  needs full speed now.  Starts and finishes
+ *                  switches as the file header says, and keeps the
+ *                  time spent at each clock.
+ *******************************************************************/
+void ClockTasks(bool busy, uint32_t nowUs)
+{
+    partUs += nowUs - lastUs;
+    lastUs = nowUs;
+    if (sysClock == CLOCK_FULL_HZ) clockFullMs += partUs / 1000;
+    else clockLowMs += partUs / 1000;
+    partUs %= 1000;
+
+    if (busy) busyUs = nowUs;
+    if (target != sysClock) {
+        if (Done(nowUs)) Changed();
+    } else if (busy && sysClock != CLOCK_FULL_HZ) {
+        target = CLOCK_FULL_HZ;
+        Start(target, nowUs);           // Runs on at 8 MHz until the PLL locks
+    } else if (!busy && sysClock == CLOCK_FULL_HZ &&
+               (int32_t)(nowUs - busyUs) >= (int32_t)CLOCK_IDLE_MS * 1000) {
+        target = CLOCK_LOW_HZ;
+        Start(target, nowUs);
+        while (!Done(nowUs));           // The FRC is always ready
+        Changed();
+    }
+}
+
+/********************************************************************
+ * Function:        void ClockFlashInit(bool tuned)
+ *
+ * Overview:        Flash reads for the clock now: the fewest wait
+ *                  states it allows, predictive prefetch, and KSEG0
+ *                  cacheable so the prefetch module keeps the lines it
+ *                  fetched.  Call once at startup, before anything
+ *                  that has to be fast.  tuned = false puts back the
+ *                  state out of reset (7 wait states, no prefetch,
+ *                  KSEG0 uncached), for the startup benchmark only.
+ *******************************************************************/
+void ClockFlashInit(bool tuned)
+{
+#if defined(__PIC32MX__)
+    if (tuned) {
+        CHECONbits.PFMWS = CLOCK_FLASH_WS(sysClock);
+        CHECONbits.PREFEN = PREFEN_ALL;
+        _CP0_SET_CONFIG((_CP0_GET_CONFIG() & ~K0_MASK) | K0_CACHEABLE);
+    } else {
+        CHECONbits.PFMWS = PFMWS_RESET;
+        CHECONbits.PREFEN = 0;
+        _CP0_SET_CONFIG((_CP0_GET_CONFIG() & ~K0_MASK) | K0_UNCACHED);
+    }
+#else
+    (void)tuned;                    // The host has no flash to tune
+#endif
+}
+
+/********************************************************************
+ * Function:        void ClockSettle(void)
+ *
+ * Overview:        Finishes a switch under way, waiting for the PLL
+ *                  if it has to, so that a busy wait on the core
+ *                  timer that follows runs at one clock.
+ *******************************************************************/
+void ClockSettle(void)
+{
+    if (target == sysClock) return;
+#if defined(__PIC32MX__)
+    while (!Done(0));
+#endif
+    Changed();
+}
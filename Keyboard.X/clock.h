@@ -0,0 +1,61 @@
+/********************************************************************
+ FileName:      clock.h
+ Dependencies:  HardwareProfile.h
+ Processor:     PIC32MX270F256D, or a Linux host (simulated switch)
+
+ Run-time CPU clock.  The part boots on the primary oscillator and
+ PLL at SYS_FREQ; while nothing needs the speed, it runs from the
+ 8 MHz FRC instead.  USB does not notice: the USB module is clocked by
+ its own PLL off the primary oscillator, which keeps running for it.
+
+ ClockTasks() decides, once per main loop pass.  Macro playback asks
+ for full speed at once; CLOCK_IDLE_MS without it drops the clock
+ again.  This board has no display and no analog inputs to scan, so
+ macros are all that needs it.  Going down is a switch to the FRC,
+ done in a few cycles.  Going up has to wait for the PLL to lock,
+ up to CLOCK_LOCK_US: the switch is started and the CPU carries on at
+ 8 MHz, and ClockTasks() notices when it is done.
+
+ sysClock is the clock now, and everything in tick.h is derived from
+ it.  ClockTasks() brings TickUs() up to date before it changes, so
+ microsecond timestamps stay right across a switch, to within one
+ main loop pass for a switch up (the hardware switches when the PLL
+ locks, ClockTasks() only sees it on its next pass).  Raw TICK
+ intervals are not: keep them to busy waits, and call ClockSettle()
+ before one so the clock cannot change under it.
+
+ Flash reads follow the clock too.  Out of reset the part runs with
+ the most wait states, no prefetch and KSEG0 uncached; ClockFlashInit()
+ sets CLOCK_FLASH_WS() for the clock, turns on predictive prefetch and
+ makes KSEG0 cacheable, and each switch moves the wait states with the
+ clock: up before a switch up, down after a switch down.
+
+ Building without __PIC32MX__ (host tools) swaps the oscillator for
+ a simulation in which a switch up takes CLOCK_LOCK_US.
+ *******************************************************************/
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "HardwareProfile.h"
+
+/** DEFINITIONS ****************************************************/
+#define CLOCK_FULL_HZ           SYS_FREQ    // POSC + PLL, the profile in clock_profile.h
+#define CLOCK_LOW_HZ            8000000     // FRC
+#define CLOCK_IDLE_MS           100         // No macros this long before dropping
+#define CLOCK_LOCK_US           2000        // PLL lock, TLOCK at its maximum
+
+/** PUBLIC VARIABLES ***********************************************/
+extern uint32_t sysClock;           // CPU clock now, Hz
+extern uint32_t clockSwitches;
+extern uint32_t clockFullMs;        // Time at each clock, for the energy estimate
+extern uint32_t clockLowMs;
+
+/** PUBLIC PROTOTYPES **********************************************/
+void ClockInit(void);
+void ClockTasks(bool busy, uint32_t nowUs);
+void ClockSettle(void);
+void ClockFlashInit(bool tuned);
+
+#endif // CLOCK_H
@@ -0,0 +1,154 @@
+/********************************************************************
+ FileName:      clock_profile.h
+ Dependencies:  None
+ Processor:     PIC32MX270F256D
+
+ The clock tree, from one selection.  CLOCK_PROFILE names a set of
+ oscillator and PLL settings; everything else follows from it:
+
+   - the configuration bits (CLOCK_CONFIG_BITS(), placed in mouse.c),
+   - SYS_FREQ and the peripheral bus clock,
+   - the core timer rate behind tick.h,
+   - the flash wait states, CLOCK_FLASH_WS(), for any system clock.
+
+ The checks below reject a profile the part cannot run: a PLL input
+ outside 4-5 MHz, a VCO outside 60-120 MHz, a USB PLL input that is
+ not 4 MHz (USB needs exactly 48 MHz), or a system clock above what
+ the part is rated for.
+
+ Profiles:
+
+   CLOCK_PROFILE_40MHZ   8 MHz crystal, 4 MHz x 20 / 2
+   CLOCK_PROFILE_48MHZ   8 MHz crystal, 4 MHz x 24 / 2
+   CLOCK_PROFILE_50MHZ   20 MHz crystal, 5 MHz x 20 / 2
+
+ With the 8 MHz crystal on this board, 48 MHz is the fastest a PLL
+ multiplier (15-24) and a 4 MHz input reach; 50 MHz needs a 5 MHz PLL
+ input, and the only crystals that give both that and the USB PLL's
+ 4 MHz are multiples of 20 MHz.  Selecting it without changing
+ CLOCK_BOARD_POSC_HZ is an error.
+
+ CLOCK_PART_MAX_HZ is the speed grade.  The default is the standard
+ 40 MHz part, run at 40 MHz.  Only the -50 parts (PIC32MX270F256D-50)
+ are rated above that: defining CLOCK_PART_50 on the command line, for
+ a board that has one, raises the limit to 50 MHz and the default
+ profile to 48 MHz.  Nothing else selects them.
+
+ Define CLOCK_PROFILE on the command line to override the default.
+ *******************************************************************/
+#ifndef CLOCK_PROFILE_H
+#define CLOCK_PROFILE_H
+
+/** DEFINITIONS ****************************************************/
+#define CLOCK_PROFILE_40MHZ     1
+#define CLOCK_PROFILE_48MHZ     2
+#define CLOCK_PROFILE_50MHZ     3
+
+#define CLOCK_BOARD_POSC_HZ     8000000     // The crystal fitted
+
+#if defined(CLOCK_PART_50)
+    #define CLOCK_PART_MAX_HZ   50000000    // PIC32MX270F256D-50, opted in
+    #ifndef CLOCK_PROFILE
+    #define CLOCK_PROFILE       CLOCK_PROFILE_48MHZ
+    #endif
+#else
+    #define CLOCK_PART_MAX_HZ   40000000    // PIC32MX270F256D
+    #ifndef CLOCK_PROFILE
+    #define CLOCK_PROFILE       CLOCK_PROFILE_40MHZ
+    #endif
+#endif
+
+// Profile: crystal, system PLL, USB PLL input divider
+#if CLOCK_PROFILE == CLOCK_PROFILE_40MHZ
+    #define CLOCK_POSC_HZ       8000000
+    #define CLOCK_FPLLIDIV      2
+    #define CLOCK_FPLLMUL       20
+    #define CLOCK_FPLLODIV      2
+    #define CLOCK_UPLLIDIV      2
+#elif CLOCK_PROFILE == CLOCK_PROFILE_48MHZ
+    #define CLOCK_POSC_HZ       8000000
+    #define CLOCK_FPLLIDIV      2
+    #define CLOCK_FPLLMUL       24
+    #define CLOCK_FPLLODIV      2
+    #define CLOCK_UPLLIDIV      2
+#elif CLOCK_PROFILE == CLOCK_PROFILE_50MHZ
+    #define CLOCK_POSC_HZ       20000000
+    #define CLOCK_FPLLIDIV      4
+    #define CLOCK_FPLLMUL       20
+    #define CLOCK_FPLLODIV      2
+    #define CLOCK_UPLLIDIV      5
+#else
+    #error Unknown CLOCK_PROFILE.  See clock_profile.h
+#endif
+
+#define CLOCK_FPBDIV            1           // Peripheral bus at the system clock
+
+// Derived
+#define CLOCK_PLL_IN_HZ         (CLOCK_POSC_HZ / CLOCK_FPLLIDIV)
+#define CLOCK_VCO_HZ            (CLOCK_PLL_IN_HZ * CLOCK_FPLLMUL)
+#define SYS_FREQ                (CLOCK_VCO_HZ / CLOCK_FPLLODIV)
+#define CLOCK_PB_HZ             (SYS_FREQ / CLOCK_FPBDIV)
+#define CLOCK_CORE_TIMER_HZ     (SYS_FREQ / 2)
+#define CLOCK_UPLL_IN_HZ        (CLOCK_POSC_HZ / CLOCK_UPLLIDIV)
+
+// Flash: one wait state (CHECON.PFMWS) per CLOCK_FLASH_MAX_HZ started
+#define CLOCK_FLASH_MAX_HZ      30000000    // Fastest read at 0 wait states
+#define CLOCK_FLASH_WS(hz)      (((hz) - 1) / CLOCK_FLASH_MAX_HZ)
+
+// Checks
+#if CLOCK_POSC_HZ != CLOCK_BOARD_POSC_HZ
+    #error CLOCK_PROFILE needs another crystal than the board has.  See clock_profile.h
+#endif
+#if CLOCK_POSC_HZ % CLOCK_FPLLIDIV != 0 || CLOCK_POSC_HZ % CLOCK_UPLLIDIV != 0
+    #error A PLL input divider does not divide the crystal evenly
+#endif
+#define CLOCK_IDIV_OK(d)        (((d) >= 1 && (d) <= 6) || (d) == 10 || (d) == 12)
+#if !CLOCK_IDIV_OK(CLOCK_FPLLIDIV) || !CLOCK_IDIV_OK(CLOCK_UPLLIDIV)
+    #error No such PLL input divider
+#endif
+#if CLOCK_FPLLODIV != 1 && CLOCK_FPLLODIV != 2 && CLOCK_FPLLODIV != 4 && CLOCK_FPLLODIV != 8 && \
+    CLOCK_FPLLODIV != 16 && CLOCK_FPLLODIV != 32 && CLOCK_FPLLODIV != 256
+    #error No such FPLLODIV
+#endif
+#if CLOCK_FPBDIV != 1 && CLOCK_FPBDIV != 2 && CLOCK_FPBDIV != 4 && CLOCK_FPBDIV != 8
+    #error No such FPBDIV
+#endif
+#if CLOCK_PLL_IN_HZ < 4000000 || CLOCK_PLL_IN_HZ > 5000000
+    #error System PLL input outside 4-5 MHz
+#endif
+#if CLOCK_FPLLMUL < 15 || CLOCK_FPLLMUL > 24
+    #error FPLLMUL outside 15-24
+#endif
+#if CLOCK_VCO_HZ < 60000000 || CLOCK_VCO_HZ > 120000000
+    #error System PLL VCO outside 60-120 MHz
+#endif
+#if CLOCK_UPLL_IN_HZ != 4000000
+    #error USB PLL input must be 4 MHz for a 48 MHz USB clock
+#endif
+#if SYS_FREQ > CLOCK_PART_MAX_HZ
+    #error SYS_FREQ above the speed grade of the part
+#endif
+#if CLOCK_FLASH_WS(SYS_FREQ) > 7
+    #error More flash wait states than PFMWS holds
+#endif
+#if CLOCK_CORE_TIMER_HZ % 1000000 != 0
+    #error Core timer rate not a whole number of MHz: TICKS_PER_US would be off
+#endif
+
+// Configuration bit values, by token pasting
+#define CLOCK_PASTE_(a, b)      a##b
+#define CLOCK_PASTE(a, b)       CLOCK_PASTE_(a, b)
+#define CLOCK_PRAGMA_(x)        _Pragma(#x)
+#define CLOCK_PRAGMA(x)         CLOCK_PRAGMA_(x)
+
+#define CLOCK_CONFIG_BITS()                                                      \
+    CLOCK_PRAGMA(config POSCMOD  = HS)                                           \
+    CLOCK_PRAGMA(config FNOSC    = PRIPLL)                                       \
+    CLOCK_PRAGMA(config FPLLIDIV = CLOCK_PASTE(DIV_, CLOCK_FPLLIDIV))            \
+    CLOCK_PRAGMA(config FPLLMUL  = CLOCK_PASTE(MUL_, CLOCK_FPLLMUL))             \
+    CLOCK_PRAGMA(config FPLLODIV = CLOCK_PASTE(DIV_, CLOCK_FPLLODIV))            \
+    CLOCK_PRAGMA(config UPLLEN   = ON)                                           \
+    CLOCK_PRAGMA(config UPLLIDIV = CLOCK_PASTE(DIV_, CLOCK_UPLLIDIV))            \
+    CLOCK_PRAGMA(config FPBDIV   = CLOCK_PASTE(DIV_, CLOCK_FPBDIV))
+
+#endif // CLOCK_PROFILE_H
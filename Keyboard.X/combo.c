@@ -0,0 +1,200 @@
+/** INCLUDES *******************************************************/
+#include <stddef.h>
+#include "combo.h"
+#include "taphold.h"
+
+/** VARIABLES ******************************************************/
+typedef struct
+{
+    uint32_t time;                  // Microseconds
+    uint8_t  key;
+} PRESS;
+
+typedef struct
+{
+    uint64_t keys;                  // Keys still down
+    uint8_t  key;
+    bool     down;                  // The combo key itself
+} ACTIVE_COMBO;
+
+static const COMBO_TABLE *combos;
+static uint32_t comboTermUs;
+
+// Presses held back while they may still become a combo
+static PRESS waiting[COMBO_MAX_KEYS];
+static uint8_t waitingCount;
+static uint64_t waitingKeys;
+static uint32_t waitingSince;
+static const COMBO *match;          // Complete combo among them, if any
+static uint8_t matchIndex;          // The press that completed it
+
+static ACTIVE_COMBO active[COMBO_ACTIVE];
+static uint64_t swallowed;          // Keys of fired combos
+
+/** PRIVATE PROTOTYPES *********************************************/
+static bool Fire(const COMBO *c, uint32_t timeUs);
+static void Flush(void);
+static void Release(uint8_t key, uint32_t timeUs);
+
+/** DECLARATIONS ***************************************************/
+
+void ComboInit(const COMBO_TABLE *table, uint32_t termUs)
+{
+    uint8_t i;
+
+    combos = table;
+    comboTermUs = termUs;
+    waitingCount = 0;
+    waitingKeys = 0;
+    match = NULL;
+    swallowed = 0;
+    for (i = 0; i < COMBO_ACTIVE; i++) active[i].keys = 0;
+}
+
+/********************************************************************
+ * Function:        const COMBO *ComboLookup(uint64_t keys)
+ *
+ * Overview:        Binary search of the sorted table: the entry for
+ *                  exactly these keys, or NULL if no combo contains
+ *                  them all.  The halving has no data-dependent
+ *                  branch, so it compiles to conditional moves.
+ *******************************************************************/
+const COMBO *ComboLookup(uint64_t keys)
+{
+    const COMBO *base = combos->table;
+    uint16_t n = combos->count, half;
+
+    if (n == 0) return NULL;
+    while (n > 1) {
+        half = n / 2;
+        base = base[half].keys <= keys ? base + half : base;
+        n -= half;
+    }
+    return base->keys == keys ? base : NULL;
+}
+
+static bool Fire(const COMBO *c, uint32_t timeUs)
+{
+    uint8_t i;
+
+    for (i = 0; i < COMBO_ACTIVE; i++) {
+        if (active[i].keys != 0) continue;
+        active[i].keys = c->keys;
+        active[i].key = c->key;
+        active[i].down = true;
+        swallowed |= c->keys;
+        TapHoldEvent(c->key, true, timeUs);
+        return true;
+    }
+    return false;
+}
+
+// Passes the waiting presses on, with the combo in place of its keys
+static void Flush(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < waitingCount; i++) {
+        if (match != NULL && i == matchIndex && !Fire(match, waiting[i].time)) {
+            match = NULL;           // No slot free: the keys go through as they are
+        }
+        if (match != NULL && (match->keys & (1ull << waiting[i].key))) continue;
+        TapHoldEvent(waiting[i].key, true, waiting[i].time);
+    }
+    waitingCount = 0;
+    waitingKeys = 0;
+    match = NULL;
+}
+
+// The first key up releases the combo; the rest just go away
+static void Release(uint8_t key, uint32_t timeUs)
+{
+    uint64_t bit = 1ull << key;
+    uint8_t i;
+
+    swallowed &= ~bit;
+    for (i = 0; i < COMBO_ACTIVE; i++) {
+        if (!(active[i].keys & bit)) continue;
+        if (active[i].down) {
+            active[i].down = false;
+            TapHoldEvent(active[i].key, false, timeUs);
+        }
+        active[i].keys &= ~bit;
+    }
+}
+
+/********************************************************************
+ * Function:        void ComboEvent(uint8_t key, bool down,
+ *                                  uint32_t timeUs)
+ *
+ * Overview:        Takes a key edge from the scanner.  Keys in no combo
+ *                  pass straight to TapHoldEvent().
+ *******************************************************************/
+void ComboEvent(uint8_t key, bool down, uint32_t timeUs)
+{
+    const COMBO *c;
+    uint64_t bit;
+
+    if (combos == NULL || key >= 64) {
+        TapHoldEvent(key, down, timeUs);
+        return;
+    }
+    bit = 1ull << key;
+
+    if (!down) {
+        if (waitingKeys & bit) Flush();
+        if (swallowed & bit) {
+            Release(key, timeUs);
+        } else {
+            TapHoldEvent(key, false, timeUs);
+        }
+        return;
+    }
+
+    // Anything that cannot join the waiting keys settles them first
+    if (waitingCount != 0 && (!(combos->members & bit) ||
+        (int32_t)(timeUs - waitingSince) >= (int32_t)comboTermUs)) {
+        Flush();
+    }
+    if (!(combos->members & bit)) {
+        TapHoldEvent(key, true, timeUs);
+        return;
+    }
+
+    if (waitingCount != 0) {
+        c = waitingCount < COMBO_MAX_KEYS ? ComboLookup(waitingKeys | bit) : NULL;
+        if (c == NULL) {
+            Flush();
+        } else {
+            waiting[waitingCount].key = key;
+            waiting[waitingCount].time = timeUs;
+            waitingKeys |= bit;
+            if (c->flags & COMBO_FIRES) {
+                match = c;
+                matchIndex = waitingCount;
+            }
+            waitingCount++;
+            if (!(c->flags & COMBO_PREFIX)) Flush();    // Nothing larger to wait for
+            return;
+        }
+    }
+
+    waiting[0].key = key;
+    waiting[0].time = timeUs;
+    waitingCount = 1;
+    waitingKeys = bit;
+    waitingSince = timeUs;
+}
+
+// The term runs from the first waiting key
+void ComboTasks(uint32_t nowUs)
+{
+    if (waitingCount != 0 && (int32_t)(nowUs - waitingSince) >= (int32_t)comboTermUs) {
+        Flush();
+    }
+}
+
+bool ComboBusy(void)
+{
+    return waitingCount != 0;
+}
@@ -0,0 +1,58 @@
+/********************************************************************
+ FileName:      combo.h
+ Dependencies:  None
+ Processor:     PIC32MX270F256D, or a Linux host
+
+ Combos: keys pressed together within COMBO_TERM_MS act as another
+ keymap key.  A combo's key is usually one past the physical keys, so
+ the keymap gives it layers, tap-hold and macros like any other.
+
+ Key sets are 64-bit masks of key numbers.  tools/macroc writes the
+ combo table sorted by mask, with an entry for every set of two or
+ more keys that some combo contains, so one binary search answers
+ both "is this a combo" and "can it still become one".
+
+ Keys in no combo go straight on to taphold.c.  A key that is in a
+ combo waits until its combo is complete, cannot be completed, or the
+ term runs out.
+ *******************************************************************/
+#ifndef COMBO_H
+#define COMBO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** DEFINITIONS ****************************************************/
+#define COMBO_TERM_MS           30      // From the first key to the last
+#define COMBO_MAX_KEYS          4       // Keys in one combo
+#define COMBO_ACTIVE            4       // Combos held down at once
+
+// COMBO.flags
+#define COMBO_FIRES             0x01    // These keys are a combo
+#define COMBO_PREFIX            0x02    // A larger combo contains these keys
+
+typedef struct
+{
+    uint64_t keys;                  // Ascending through the table
+    uint8_t  key;                   // Keymap key the combo acts as
+    uint8_t  flags;
+} COMBO;
+
+typedef struct
+{
+    uint16_t count;
+    uint64_t members;               // Every key that is in some combo
+    const COMBO *table;
+} COMBO_TABLE;
+
+/** PUBLIC VARIABLES ***********************************************/
+extern const COMBO_TABLE comboDefault;  // macros_default.c
+
+/** PUBLIC PROTOTYPES **********************************************/
+void ComboInit(const COMBO_TABLE *table, uint32_t termUs);
+const COMBO *ComboLookup(uint64_t keys);
+void ComboEvent(uint8_t key, bool down, uint32_t timeUs);
+void ComboTasks(uint32_t nowUs);
+bool ComboBusy(void);
+
+#endif // COMBO_H
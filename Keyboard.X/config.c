@@ -0,0 +1,430 @@
+/** INCLUDES *******************************************************/
+#include <stddef.h>
+#include <string.h>
+#include "config.h"
+#include "crc32.h"
+#include "keymap.h"
+#include "macro_vm.h"
+#include "macro_image.h"
+#include "leader.h"
+#include "typematic.h"
+
+/** VARIABLES ******************************************************/
+uint32_t configCommits;
+uint32_t configFailures;
+uint32_t configCheckedBytes;
+uint8_t configSource;
+
+#define SLOT_KEYMAP             0
+#define SLOT_MACROS             1
+#define SLOT_LEADER             2
+#define WRITING_NONE            -1
+#define WRITING_HEADER          CONFIG_SLOTS
+
+static const uint16_t slotTags[CONFIG_SLOTS] = {
+    CONFIG_TAG_KEYMAP, CONFIG_TAG_MACROS, CONFIG_TAG_LEADER
+};
+
+// What the header in flash says
+static bool present[CONFIG_SLOTS];
+static uint8_t bank[CONFIG_SLOTS];      // Its key is CONFIG_KEY(slot, bank)
+static uint16_t sectionLength[CONFIG_SLOTS];
+static uint32_t sectionCrc[CONFIG_SLOTS];
+static CONFIG_SECTION foreign[CONFIG_SECTIONS_MAX];    // Tags this firmware does not know
+static uint8_t foreignCount;
+
+#if defined(CONFIG_WRITES)
+// Word aligned: a keymap is read from it in place
+static uint32_t shadow[CONFIG_SLOTS][(FSTORE_VALUE_MAX + 3) / 4];
+static uint16_t shadowLength[CONFIG_SLOTS];
+static bool shadowUsed[CONFIG_SLOTS];   // Read from the shadow, not flash
+static bool dirty[CONFIG_SLOTS];        // Flash does not have it yet
+static bool staged[CONFIG_SLOTS];       // In the other bank, waiting for the header
+static uint16_t stagedLength[CONFIG_SLOTS];
+static uint32_t stagedCrc[CONFIG_SLOTS];
+static uint32_t header[(sizeof(CONFIG_HEADER) + CONFIG_SECTIONS_MAX * sizeof(CONFIG_SECTION) + 3) / 4];
+static uint16_t headerLength;
+static int8_t writing = WRITING_NONE;   // Slot, or the header, being written
+static uint32_t idleSince;
+#endif
+
+/** PRIVATE PROTOTYPES *********************************************/
+static uint8_t Slot(uint16_t tag);
+static bool SectionValid(uint8_t slot, const void *data, uint16_t length);
+static uint8_t Load(void);
+static const void *Current(uint8_t slot, uint16_t *length);
+static void Apply(void);
+#if defined(CONFIG_WRITES)
+static void BuildHeader(void);
+static bool Matches(const void *stored, uint16_t length, const void *data, uint16_t dataLength);
+static bool Step(bool mayErase);
+#endif
+
+/** DECLARATIONS ***************************************************/
+
+// CONFIG_SLOTS if this firmware does not know the tag
+static uint8_t Slot(uint16_t tag)
+{
+    uint8_t slot;
+
+    for (slot = 0; slot < CONFIG_SLOTS && slotTags[slot] != tag; slot++);
+    return slot;
+}
+
+static bool SectionValid(uint8_t slot, const void *data, uint16_t length)
+{
+    KEYMAP map;
+
+    switch (slot) {
+    case SLOT_KEYMAP:
+        return KeymapFromBlob(&map, data, length);
+    case SLOT_MACROS:
+        return MacroImageValid(data, length);
+    default:
+        return LeaderTrieValid(data, length);
+    }
+}
+
+/*
+ * Checks the image in flash in one pass: the header and its CRC, then
+ * each section as the table lists it, its CRC and its contents.  Fills
+ * in what the header says, which is only to be used if this returns
+ * CONFIG_SOURCE_STORED.
+ */
+static uint8_t Load(void)
+{
+    const CONFIG_HEADER *hdr;
+    const CONFIG_SECTION *sec;
+    const void *data;
+    uint16_t length = 0, dataLength = 0;
+    uint32_t crc;
+    uint8_t i, slot;
+
+    hdr = FlashStoreRead(FSTORE_KEY_CONFIG, &length);
+    if (hdr == NULL) return CONFIG_SOURCE_DEFAULT;
+    configCheckedBytes += length;
+    if (length < sizeof(CONFIG_HEADER) || hdr->magic != CONFIG_MAGIC || hdr->major != CONFIG_MAJOR
+        || hdr->sections > CONFIG_SECTIONS_MAX
+        || length != sizeof(CONFIG_HEADER) + hdr->sections * sizeof(CONFIG_SECTION)) {
+        return CONFIG_SOURCE_INVALID;
+    }
+    sec = (const CONFIG_SECTION*)(hdr + 1);
+    crc = CRC32Update(CRC32_INIT, hdr, offsetof(CONFIG_HEADER, crc));
+    if (CRC32Final(CRC32Update(crc, sec, length - sizeof(CONFIG_HEADER))) != hdr->crc) {
+        return CONFIG_SOURCE_INVALID;
+    }
+
+    for (i = 0; i < hdr->sections; i++, sec++) {
+        slot = Slot(sec->tag);
+        if (slot == CONFIG_SLOTS) {
+            // A newer firmware's: kept in the headers this one writes
+            if ((sec->flags & CONFIG_SECTION_REQUIRED) || sec->key < CONFIG_KEY(CONFIG_SLOTS, 0)) {
+                return CONFIG_SOURCE_INVALID;
+            }
+            foreign[foreignCount++] = *sec;
+            continue;
+        }
+        if (present[slot] || (sec->key != CONFIG_KEY(slot, 0) && sec->key != CONFIG_KEY(slot, 1))) {
+            return CONFIG_SOURCE_INVALID;
+        }
+        data = FlashStoreRead(sec->key, &dataLength);
+        if (data == NULL || dataLength != sec->length) return CONFIG_SOURCE_INVALID;
+        configCheckedBytes += dataLength;
+        if (CRC32Final(CRC32Update(CRC32_INIT, data, dataLength)) != sec->crc
+            || !SectionValid(slot, data, dataLength)) {
+            return CONFIG_SOURCE_INVALID;
+        }
+        present[slot] = true;
+        bank[slot] = sec->key - CONFIG_KEY(slot, 0);
+        sectionLength[slot] = dataLength;
+        sectionCrc[slot] = sec->crc;
+    }
+    return CONFIG_SOURCE_STORED;
+}
+
+static const void *Current(uint8_t slot, uint16_t *length)
+{
+#if defined(CONFIG_WRITES)
+    if (shadowUsed[slot]) {
+        *length = shadowLength[slot];
+        return shadow[slot];
+    }
+#endif
+    if (!present[slot]) return NULL;
+    return FlashStoreRead(CONFIG_KEY(slot, bank[slot]), length);
+}
+
+/*
+ * Starts the keymap, macros and leader sequences from the current
+ * sections, the built-in ones for any the image does not have.  The
+ * built-in leader trie names built-in macros, so it is only used with
+ * the built-in macro image.
+ */
+static void Apply(void)
+{
+    KEYMAP map = keymapDefault;
+    const uint8_t *image, *trie;
+    const void *blob;
+    uint16_t length = 0;
+
+    image = Current(SLOT_MACROS, &length);
+    if (image == NULL) image = macroImageDefault;
+    trie = Current(SLOT_LEADER, &length);
+    if (trie == NULL && image == macroImageDefault) trie = leaderTrieDefault;
+    blob = Current(SLOT_KEYMAP, &length);
+    if (blob != NULL) KeymapFromBlob(&map, blob, length);
+
+    // Nothing may go on running from the old values
+    MacroInit();
+    TypematicCancel();
+    KeymapInit(&map, image);
+    LeaderInit(trie, image);
+}
+
+/********************************************************************
+ * Function:        void ConfigInit(void)
+ *
+ * Overview:        Mounts the flash store, checks the configuration
+ *                  image in it and starts the keymap, macros and
+ *                  leader sequences from it, or from the built-in
+ *                  ones if there is none or it does not check out.
+ *                  Sections are used where they are in flash, not
+ *                  copied to RAM.
+ *******************************************************************/
+void ConfigInit(void)
+{
+    FlashStoreInit();
+    memset(present, 0, sizeof(present));
+    memset(bank, 0, sizeof(bank));
+#if defined(CONFIG_WRITES)
+    memset(shadowUsed, 0, sizeof(shadowUsed));
+    memset(dirty, 0, sizeof(dirty));
+    memset(staged, 0, sizeof(staged));
+    writing = WRITING_NONE;
+#endif
+    foreignCount = 0;
+    configCheckedBytes = 0;
+
+    configSource = Load();
+    if (configSource != CONFIG_SOURCE_STORED) {
+        memset(present, 0, sizeof(present));
+        memset(bank, 0, sizeof(bank));
+        foreignCount = 0;
+    }
+    Apply();
+}
+
+#if defined(CONFIG_WRITES)
+
+/********************************************************************
+ * Function:        bool ConfigSet(uint16_t tag, const void *data,
+ *                                 uint16_t length)
+ *
+ * Overview:        Makes data, word aligned, the section with this
+ *                  tag now and queues it for flash.  Returns false,
+ *                  changing nothing, if the tag is not one this
+ *                  firmware knows or data is not a valid section.
+ *******************************************************************/
+bool ConfigSet(uint16_t tag, const void *data, uint16_t length)
+{
+    uint8_t slot = Slot(tag), other;
+    const void *now;
+    uint16_t nowLength = 0;
+
+    if (slot == CONFIG_SLOTS || length == 0 || length > FSTORE_VALUE_MAX) return false;
+    if (!SectionValid(slot, data, length)) return false;
+    now = Current(slot, &nowLength);
+    if (now != NULL && nowLength == length && memcmp(now, data, length) == 0) return true;
+
+    // Writes are about to move records: run from RAM from now on
+    for (other = 0; other < CONFIG_SLOTS; other++) {
+        now = Current(other, &nowLength);
+        if (shadowUsed[other] || now == NULL) continue;
+        memcpy(shadow[other], now, nowLength);
+        shadowLength[other] = nowLength;
+        shadowUsed[other] = true;
+    }
+    memcpy(shadow[slot], data, length);
+    shadowLength[slot] = length;
+    shadowUsed[slot] = true;
+    dirty[slot] = true;
+    Apply();
+    return true;
+}
+
+bool ConfigPending(void)
+{
+    uint8_t slot;
+
+    for (slot = 0; slot < CONFIG_SLOTS; slot++) {
+        if (dirty[slot] || staged[slot]) return true;
+    }
+    return writing != WRITING_NONE;
+}
+
+// The header naming the staged sections in place of the current ones
+static void BuildHeader(void)
+{
+    CONFIG_HEADER *hdr = (CONFIG_HEADER*)header;
+    CONFIG_SECTION *sec = (CONFIG_SECTION*)(hdr + 1);
+    uint8_t slot, i;
+
+    hdr->magic = CONFIG_MAGIC;
+    hdr->major = CONFIG_MAJOR;
+    hdr->minor = CONFIG_MINOR;
+    hdr->sections = 0;
+    hdr->reserved = 0;
+    for (slot = 0; slot < CONFIG_SLOTS; slot++) {
+        if (!staged[slot] && !present[slot]) continue;
+        sec->tag = slotTags[slot];
+        sec->flags = 0;
+        sec->reserved = 0;
+        if (staged[slot]) {
+            sec->key = CONFIG_KEY(slot, !bank[slot]);
+            sec->length = stagedLength[slot];
+            sec->crc = stagedCrc[slot];
+        } else {
+            sec->key = CONFIG_KEY(slot, bank[slot]);
+            sec->length = sectionLength[slot];
+            sec->crc = sectionCrc[slot];
+        }
+        sec++;
+        hdr->sections++;
+    }
+    for (i = 0; i < foreignCount && hdr->sections < CONFIG_SECTIONS_MAX; i++) {
+        *sec++ = foreign[i];
+        hdr->sections++;
+    }
+    headerLength = sizeof(CONFIG_HEADER) + hdr->sections * sizeof(CONFIG_SECTION);
+    hdr->crc = CRC32Final(CRC32Update(CRC32Update(CRC32_INIT, hdr, offsetof(CONFIG_HEADER, crc)),
+                                      hdr + 1, headerLength - sizeof(CONFIG_HEADER)));
+}
+
+static bool Matches(const void *stored, uint16_t length, const void *data, uint16_t dataLength)
+{
+    return stored != NULL && length == dataLength && memcmp(stored, data, length) == 0;
+}
+
+/*
+ * One step of the commit: the dirty sections to their other bank, one
+ * by one, then the header.  Starting a write, each flash store step,
+ * and checking what a finished write left in flash are separate steps.
+ * A section that ends up not matching its shadow, because the write
+ * failed or the shadow changed under it, is written again; so is a
+ * header that did not make it.
+ */
+static bool Step(bool mayErase)
+{
+    const void *stored;
+    uint16_t length = 0;
+    uint8_t slot;
+
+    if (writing == WRITING_NONE) {
+        for (slot = 0; slot < CONFIG_SLOTS && !dirty[slot]; slot++);
+        if (slot < CONFIG_SLOTS) {
+            staged[slot] = false;       // The bank is about to be overwritten
+            if (!FlashStoreBegin(CONFIG_KEY(slot, !bank[slot]), shadow[slot], shadowLength[slot])) {
+                dirty[slot] = false;    // Does not fit: the shadow keeps it until reset
+                configFailures++;
+                return ConfigPending();
+            }
+        } else {
+            for (slot = 0; slot < CONFIG_SLOTS && !staged[slot]; slot++);
+            if (slot == CONFIG_SLOTS) return false;
+            BuildHeader();
+            if (!FlashStoreBegin(FSTORE_KEY_CONFIG, header, headerLength)) {
+                memset(staged, 0, sizeof(staged));
+                configFailures++;
+                return ConfigPending();
+            }
+            slot = WRITING_HEADER;
+        }
+        writing = slot;
+        return true;
+    }
+    if (FlashStoreBusy()) {
+        FlashStoreStep(mayErase);
+        return true;
+    }
+
+    slot = writing;
+    writing = WRITING_NONE;
+    if (slot < CONFIG_SLOTS) {
+        stored = FlashStoreRead(CONFIG_KEY(slot, !bank[slot]), &length);
+        if (Matches(stored, length, shadow[slot], shadowLength[slot])) {
+            dirty[slot] = false;
+            staged[slot] = true;
+            stagedLength[slot] = length;
+            stagedCrc[slot] = CRC32Final(CRC32Update(CRC32_INIT, stored, length));
+        } else if (!FlashStoreDone()) {
+            configFailures++;
+        }
+        return ConfigPending();
+    }
+
+    stored = FlashStoreRead(FSTORE_KEY_CONFIG, &length);
+    if (Matches(stored, length, header, headerLength)) {
+        for (slot = 0; slot < CONFIG_SLOTS; slot++) {
+            if (!staged[slot]) continue;
+            staged[slot] = false;
+            present[slot] = true;
+            bank[slot] = !bank[slot];
+            sectionLength[slot] = stagedLength[slot];
+            sectionCrc[slot] = stagedCrc[slot];
+        }
+        configCommits++;
+    } else if (!FlashStoreDone()) {
+        configFailures++;
+    }
+    return ConfigPending();
+}
+
+/********************************************************************
+ * Function:        void ConfigTasks(const KEY_SET *keys,
+ *                                   bool frameStart, uint32_t nowUs)
+ *
+ * Overview:        Call once per main loop pass with the keymap's key
+ *                  set; frameStart says a USB frame has just begun.
+ *                  Runs the flash write as the file header says.
+ *******************************************************************/
+void ConfigTasks(const KEY_SET *keys, bool frameStart, uint32_t nowUs)
+{
+    if (!ConfigPending() || keys->modifiers != 0 || keys->keys[0] != USAGE_NONE || MacroBusy()) {
+        idleSince = nowUs;
+    }
+    if (!ConfigPending()) return;
+
+    if ((int32_t)(nowUs - idleSince) >= (int32_t)CONFIG_IDLE_MS * 1000) Step(true);
+    else if (frameStart) Step(false);
+}
+
+/********************************************************************
+ * Function:        bool ConfigCommitTasks(void)
+ *
+ * Overview:        One step of the flash write, erases included, for
+ *                  while the bus is suspended.  Returns true while
+ *                  there is more to do.
+ *******************************************************************/
+bool ConfigCommitTasks(void)
+{
+    if (!ConfigPending()) return false;
+    return Step(true);
+}
+
+#else   // No writes: the configuration is what ConfigInit() loaded
+
+bool ConfigPending(void)
+{
+    return false;
+}
+
+void ConfigTasks(const KEY_SET *keys, bool frameStart, uint32_t nowUs)
+{
+}
+
+bool ConfigCommitTasks(void)
+{
+    return false;
+}
+
+#endif
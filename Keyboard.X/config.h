@@ -0,0 +1,133 @@
+/********************************************************************
+ FileName:      config.h
+ Dependencies:  flashstore.h, keyset.h, keymap.h, macro_vm.h,
+                macro_image.h, leader.h, typematic.h, crc32.h
+ Processor:     PIC32MX270F256D, or a Linux host (simulated NVM)
+
+ The configuration that can change at run time: the keymap (a
+ KEYMAP_BLOB), the macro image and the leader trie, each a section of
+ one versioned configuration image in the flash store.
+
+ Image format, little endian:
+
+   CONFIG_HEADER                 flash store key FSTORE_KEY_CONFIG
+   CONFIG_SECTION x sections     tag, flash store key, length, CRC-32
+   section data                  each in the flash store key it names
+
+ The header's CRC covers its own fields and the section table; each
+ section's CRC covers its data.  A firmware skips a section whose tag
+ it does not know unless the section is CONFIG_SECTION_REQUIRED, so
+ newer images still load.  Any other mismatch (magic, major version,
+ a CRC, a section that does not check out) throws the whole image
+ away for the built-in configuration: half of one and half of the
+ other would leave leader sequences and keymap entries pointing at the
+ wrong macros.
+
+ ConfigInit() mounts the flash store and checks the image in one pass,
+ header first, then each section as the table lists it, and starts
+ the keymap from it in place.
+ The time from reset to that point is DIAG_REPORT.configReadyUs;
+ kbsim's boot command holds the worst case under CONFIG_READY_BUDGET_US,
+ well inside the time a host gives a new device before it asks for
+ descriptors.
+
+ Every section has two flash store keys, A and B.  A change is written
+ to the key the header does not name, and the header, naming it, is
+ written last: that write is the commit, so a reset at any point loads
+ either the old configuration or the new one, never a mix.
+
+ ConfigSet() takes effect at once, from a RAM shadow of the value.
+ Writing it to flash waits: ConfigTasks() runs one flash store step
+ per main loop pass, and only
+
+   - at the start of a USB frame while keys are in use, and then only
+     steps that program words (at most FSTORE_STEP_WORDS, 640 us), so
+     the stall ends well before the next frame, or
+   - any step, page erases included (20 ms), once the keyboard has
+     been idle for CONFIG_IDLE_MS or while the bus is suspended
+     (ConfigCommitTasks()).
+
+ The first ConfigSet() copies every section to its shadow, and the
+ keyboard reads the shadows until the next reset, so the flash store
+ can move records while it writes.  A change made while the last one
+ is still being written is written again once that write ends.
+
+ ConfigSet() and its shadows (about 3 KB of RAM) are only built with
+ CONFIG_WRITES.  The host tools define it; the device has no request
+ that changes a section yet, so its build leaves them out, and
+ ConfigTasks(), ConfigPending() and ConfigCommitTasks() have nothing
+ to do.
+ *******************************************************************/
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyset.h"
+#include "flashstore.h"
+
+/** DEFINITIONS ****************************************************/
+#define CONFIG_MAGIC            0x4746434B  // "KCFG"
+#define CONFIG_MAJOR            1       // Readers reject another major version
+#define CONFIG_MINOR            0       // Added optional sections; readers ignore it
+#define CONFIG_SECTIONS_MAX     8       // Table entries, unknown tags included
+#define CONFIG_IDLE_MS          2000    // No keys and no macros before a page erase
+#define CONFIG_READY_BUDGET_US  10000   // Reset to a ready keymap, full flash store
+
+#if !defined(__PIC32MX__) && !defined(CONFIG_WRITES)
+#define CONFIG_WRITES                   // Host tools set sections
+#endif
+
+// Section tags
+#define CONFIG_TAG_KEYMAP       0x4D4B  // "KM": KEYMAP_BLOB, see keymap.h
+#define CONFIG_TAG_MACROS       0x434D  // "MC": MACRO_IMAGE, see macro_image.h
+#define CONFIG_TAG_LEADER       0x544C  // "LT": LEADER_TRIE, see leader.h
+
+// CONFIG_SECTION.flags
+#define CONFIG_SECTION_REQUIRED 0x01    // Not loadable without it
+
+// Flash store keys of the sections this firmware knows
+#define CONFIG_SLOTS            3       // Keymap, macros, leader trie
+#define CONFIG_KEY(slot, bank)  (FSTORE_KEY_SECTIONS + 2 * (slot) + (bank))
+
+// configSource
+#define CONFIG_SOURCE_DEFAULT   0       // No image in the store
+#define CONFIG_SOURCE_STORED    1
+#define CONFIG_SOURCE_INVALID   2       // An image that did not check out: defaults
+
+typedef struct __attribute__ ((packed))
+{
+    uint32_t magic;                 // CONFIG_MAGIC
+    uint8_t  major;
+    uint8_t  minor;
+    uint8_t  sections;              // CONFIG_SECTION entries that follow
+    uint8_t  reserved;
+    uint32_t crc;                   // CRC-32 of the above, then the section table
+} CONFIG_HEADER;
+
+typedef struct __attribute__ ((packed))
+{
+    uint16_t tag;                   // CONFIG_TAG_*
+    uint8_t  flags;
+    uint8_t  key;                   // Flash store key holding the data
+    uint16_t length;
+    uint16_t reserved;
+    uint32_t crc;                   // CRC-32 of the data
+} CONFIG_SECTION;
+
+/** PUBLIC VARIABLES ***********************************************/
+extern uint32_t configCommits;      // Changes that reached flash
+extern uint32_t configFailures;     // Writes that failed or did not fit
+extern uint32_t configCheckedBytes; // Image bytes ConfigInit() read
+extern uint8_t configSource;        // CONFIG_SOURCE_*
+
+/** PUBLIC PROTOTYPES **********************************************/
+void ConfigInit(void);
+#if defined(CONFIG_WRITES)
+bool ConfigSet(uint16_t tag, const void *data, uint16_t length);
+#endif
+bool ConfigPending(void);
+void ConfigTasks(const KEY_SET *keys, bool frameStart, uint32_t nowUs);
+bool ConfigCommitTasks(void);
+
+#endif // CONFIG_H
@@ -0,0 +1,24 @@
+/** INCLUDES *******************************************************/
+#include "crc32.h"
+
+/** CONSTANTS ******************************************************/
+// Nibble table: 64 bytes of flash instead of 1 KB for the byte table
+static const uint32_t crcNibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/** DECLARATIONS ***************************************************/
+uint32_t CRC32Update(uint32_t crc, const void *data, uint32_t len)
+{
+    const uint8_t *p = data;
+
+    while (len--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ crcNibble[crc & 0x0F];
+        crc = (crc >> 4) ^ crcNibble[crc & 0x0F];
+    }
+    return crc;
+}
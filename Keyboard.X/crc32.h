@@ -0,0 +1,18 @@
+/********************************************************************
+ FileName:      crc32.h
+ Dependencies:  None
+
+ CRC-32 (IEEE 802.3, reflected, as used by zlib).  Start with
+ CRC32_INIT, feed any number of blocks, then CRC32Final().
+ *******************************************************************/
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+
+#define CRC32_INIT              0xFFFFFFFFUL
+#define CRC32Final(crc)         ((uint32_t)~(crc))
+
+uint32_t CRC32Update(uint32_t crc, const void *data, uint32_t len);
+
+#endif // CRC32_H
@@ -0,0 +1,98 @@
+/** INCLUDES *******************************************************/
+#include "usb.h"
+#include "usb_function_hid.h"
+#include "diagnostics.h"
+#include "hid_reports.h"
+#include "report_queue.h"
+
+/** VARIABLES ******************************************************/
+DIAG_REPORT diagReport;
+
+// EP0 sends straight out of this buffer, so the counters are copied
+// here first to give the host one consistent snapshot.
+static DIAG_REPORT diagSnapshot;
+
+// Periodic input report, see DIAG_REQ_SET_INTERVAL
+static uint16_t diagIntervalMs;
+static uint32_t diagLastPost;           // TickUs()
+
+/** DECLARATIONS ***************************************************/
+
+void DiagInit(void)
+{
+    memset(&diagReport, 0, sizeof(diagReport));
+    diagReport.version = DIAG_REPORT_VERSION;
+    diagReport.size = sizeof(DIAG_REPORT);
+}
+
+void DiagRecordUSBErrors(uint8_t flags)
+{
+    if(flags & USB_EIR_PIDEF)   diagReport.pidErrors++;
+    if(flags & USB_EIR_CRC5EF)  diagReport.crc5Errors++;
+    if(flags & USB_EIR_CRC16EF) diagReport.crc16Errors++;
+    if(flags & USB_EIR_DFN8EF)  diagReport.dataFieldErrors++;
+    if(flags & USB_EIR_BTOEF)   diagReport.busTimeouts++;
+    if(flags & USB_EIR_DMAEF)   diagReport.dmaErrors++;
+    if(flags & USB_EIR_BMXEF)   diagReport.bmxErrors++;
+    if(flags & USB_EIR_BTSEF)   diagReport.bitStuffErrors++;
+}
+
+/********************************************************************
+ * Function:        bool DiagCheckRequest(void)
+ *
+ * Overview:        Claims the diagnostic vendor requests from the
+ *                  current SETUP packet.  Returns true if the request
+ *                  was handled so other class handlers can be skipped.
+ *******************************************************************/
+bool DiagCheckRequest(void)
+{
+    if(SetupPkt.RequestType != USB_SETUP_TYPE_VENDOR_BITFIELD) return false;
+    if(SetupPkt.Recipient != USB_SETUP_RECIPIENT_DEVICE_BITFIELD) return false;
+
+    switch(SetupPkt.bRequest)
+    {
+        case DIAG_REQ_GET_REPORT:
+            if(SetupPkt.DataDir != USB_SETUP_DEVICE_TO_HOST_BITFIELD) return false;
+            diagSnapshot = diagReport;
+            // The stack trims the data stage to wLength
+            USBEP0SendRAMPtr((uint8_t*)&diagSnapshot, sizeof(diagSnapshot), USB_EP0_NO_OPTIONS);
+            return true;
+        case DIAG_REQ_CLEAR:
+            DiagInit();
+            USBEP0Transmit(USB_EP0_NO_DATA);
+            return true;
+        case DIAG_REQ_SET_INTERVAL:
+            diagIntervalMs = SetupPkt.W_Value.Val;
+            diagLastPost = TickUs();
+            USBEP0Transmit(USB_EP0_NO_DATA);
+            return true;
+        default:
+            return false;
+    }
+}
+
+/********************************************************************
+ * Function:        void DiagTasks(void)
+ *
+ * Overview:        Posts DIAG_REPORT as a REPORT_ID_DIAGNOSTICS input
+ *                  report every diagIntervalMs.  It is a bulk report:
+ *                  longer than one packet, and it yields to key
+ *                  reports.  Only sent in report protocol.
+ *******************************************************************/
+void DiagTasks(void)
+{
+    struct __attribute__ ((packed))
+    {
+        uint8_t reportId;
+        DIAG_REPORT report;
+    } input;
+
+    if(diagIntervalMs == 0 || hidProtocol != RPT_PROTOCOL) return;
+    if(TickUsSince(diagLastPost) < diagIntervalMs * 1000ul) return;
+
+    input.reportId = REPORT_ID_DIAGNOSTICS;
+    input.report = diagReport;
+    if(ReportQueuePost(REPORT_PRIO_BULK, &input, sizeof(input))) {
+        diagLastPost = TickUs();
+    }
+}
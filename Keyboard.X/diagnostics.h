@@ -0,0 +1,131 @@
+/********************************************************************
+ FileName:      diagnostics.h
+ Dependencies:  usb.h
+ Processor:     PIC32MX270F256D
+
+ Runtime counters that are exported to the host through a vendor
+ request on EP0, or as a periodic input report once the host has
+ asked for one with DIAG_REQ_SET_INTERVAL.  The layout of DIAG_REPORT is part of the host
+ interface: only ever append fields and bump DIAG_REPORT_VERSION.
+ *******************************************************************/
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** DEFINITIONS ****************************************************/
+#define DIAG_REPORT_VERSION     12
+
+// Vendor requests, recipient = device
+#define DIAG_REQ_GET_REPORT     0x01    // IN:  returns DIAG_REPORT
+#define DIAG_REQ_CLEAR          0x02    // OUT: zero all counters, no data stage
+#define DIAG_REQ_SET_INTERVAL   0x04    // OUT: wValue = ms between DIAG_REPORT input
+                                        // reports on the HID endpoint, 0 = off
+
+// U1EIR error flags
+#define USB_EIR_PIDEF           0x01    // PID check failure
+#define USB_EIR_CRC5EF          0x02    // CRC5 host error / EOF error
+#define USB_EIR_CRC16EF         0x04    // CRC16 failure
+#define USB_EIR_DFN8EF          0x08    // Data field size not a multiple of 8 bits
+#define USB_EIR_BTOEF           0x10    // Bus turnaround time-out
+#define USB_EIR_DMAEF           0x20    // DMA error
+#define USB_EIR_BMXEF           0x40    // Bus matrix error
+#define USB_EIR_BTSEF           0x80    // Bit stuff error
+
+// Errors the SIE cannot retry on its own; the endpoint is re-armed at once
+#define USB_EIR_FATAL           (USB_EIR_DMAEF | USB_EIR_BMXEF)
+
+typedef struct __attribute__ ((packed))
+{
+    uint8_t  version;               // DIAG_REPORT_VERSION
+    uint16_t size;                  // sizeof(DIAG_REPORT); one byte before version 12,
+                                    // its low byte is still at offset 1
+    uint8_t  reserved;
+
+    /* USB bus errors, one counter per U1EIR flag */
+    uint32_t pidErrors;
+    uint32_t crc5Errors;
+    uint32_t crc16Errors;
+    uint32_t dataFieldErrors;
+    uint32_t busTimeouts;
+    uint32_t dmaErrors;
+    uint32_t bmxErrors;
+    uint32_t bitStuffErrors;
+
+    /* Recovery */
+    uint32_t endpointRearms;        // HID endpoint cancelled and re-enabled
+    uint32_t reportResyncs;         // Report state re-sent after a recovery
+
+    /* Remote wakeup */
+    uint32_t remoteWakeups;         // RESUME signals driven by the device
+    uint32_t wakeLatencyLastUs;     // Key press to start of RESUME
+    uint32_t wakeLatencyMaxUs;
+
+    /* Telemetry (telemetry.h) */
+    uint32_t telemetryWrites;
+    uint32_t telemetryDrops;        // Records lost to a full ring
+    uint32_t telemetryBytesLogged;
+    uint32_t telemetryBytesSent;    // Host throughput = delta / elapsed time
+    uint32_t telemetryWriteCycles;  // Sum of CPU cycles spent in TelemetryWrite()
+    uint32_t telemetryWriteCyclesMax;
+
+    /* Input report queue (report_queue.h) */
+    uint32_t reportDrops;           // Posts refused by a full queue
+    uint32_t reportPackets;         // Packets armed on the HID endpoint
+    uint32_t reportBulkTransfers;
+    uint32_t reportKeyWaitMaxUs;    // Longest a key report sat in the queue
+
+    /* Macro interpreter (macro_vm.h) */
+    uint32_t macroSteps;            // Bytecode instructions executed
+    uint32_t macroCycles;           // CPU cycles in MacroTasks(); / macroSteps
+    uint32_t macroCyclesMax;        // Longest single MacroTasks() call
+
+    /* Macro recorder (recorder.h) */
+    uint16_t recordArenaUsed;       // Bytes of the current or last recording
+    uint16_t recordArenaSize;
+    uint32_t recordOverflows;       // Recordings cut short by a full arena
+    uint32_t recordCommits;         // Recordings written to flash
+
+    /* Configuration (config.h) */
+    uint32_t configReadyUs;         // Reset to a ready keymap
+    uint8_t  configSource;          // CONFIG_SOURCE_*
+    uint8_t  configReserved[3];
+    uint32_t configCommits;         // Changes that reached flash
+    uint32_t configFailures;
+
+    /* Suspend */
+    uint32_t suspendSleeps;         // Times the CPU went to Sleep
+    uint32_t resumeLastUs;          // Leaving Sleep to scanning again
+    uint32_t resumeMaxUs;
+
+    /* CPU clock (clock.h) */
+    uint32_t clockSwitches;
+    uint32_t clockFullMs;           // Time at CLOCK_FULL_HZ
+    uint32_t clockLowMs;            // Time at CLOCK_LOW_HZ
+
+    /* Idle (idle.h) */
+    uint32_t idleWaits;
+    uint32_t idleWaitMs;            // Time in WAIT
+    uint8_t  idleBusyPercent;       // Awake, over the last IDLE_WINDOW_MS
+    uint8_t  idleReserved[3];
+    uint32_t idleWakeLastUs;        // Core timer wake to running
+    uint32_t idleWakeMaxUs;
+
+    /* Startup benchmark, CPU cycles: flash out of reset, then tuned (clock.h) */
+    uint32_t benchPassBefore;       // A scanning pass with nothing to do
+    uint32_t benchPassAfter;
+    uint32_t benchMacroBefore;      // A macro instruction
+    uint32_t benchMacroAfter;
+} DIAG_REPORT;
+
+/** PUBLIC VARIABLES ***********************************************/
+extern DIAG_REPORT diagReport;
+
+/** PUBLIC PROTOTYPES **********************************************/
+void DiagInit(void);
+void DiagRecordUSBErrors(uint8_t flags);
+bool DiagCheckRequest(void);
+void DiagTasks(void);
+
+#endif // DIAGNOSTICS_H
@@ -0,0 +1,427 @@
+/** INCLUDES *******************************************************/
+#include <stddef.h>
+#include <string.h>
+#include "flashstore.h"
+#include "crc32.h"
+
+/** DEFINITIONS ****************************************************/
+#define FREE_WORD               0xFFFFFFFFul
+#define RECORD_SIZE(len)        (FSTORE_RECORD_OVERHEAD + (((len) + 3) & ~3u))
+#define PAGE_ADDR(page)         (FSTORE_BASE + (uint32_t)(page) * NVM_PAGE_SIZE)
+#define NEXT_PAGE(page)         ((page) + 1 < FSTORE_PAGES ? (page) + 1 : 0)
+#define NO_PAGE                 0xFF
+
+// pageState[]
+#define PAGE_DIRTY              0       // No valid header: erase before use
+#define PAGE_FREE               1       // Erased, header written, no sequence yet
+#define PAGE_USED               2
+
+// job
+#define JOB_IDLE                0
+#define JOB_ROOM                1       // Room at the head for the record?
+#define JOB_OPEN                2       // Move the head to the erased page
+#define JOB_COLLECT             3       // Start copying the victim's next current record
+#define JOB_COPY                4
+#define JOB_RECLAIM             5       // Erase the victim
+#define JOB_ABANDON             6       // Erase a head that only holds copies
+#define JOB_APPEND              7       // Program the record
+
+/** VARIABLES ******************************************************/
+uint32_t flashStoreUserBytes;
+uint32_t flashStoreFlashBytes;
+uint32_t flashStoreErases;
+uint32_t flashStoreMountBytes;
+uint32_t flashStoreLiveBytes;
+
+static uint32_t newest[FSTORE_KEYS];    // Address of each key's current record, 0 if none
+static uint8_t pageState[FSTORE_PAGES];
+static uint32_t pageSequence[FSTORE_PAGES];
+static uint32_t pageErases[FSTORE_PAGES];
+static uint32_t nextSequence;
+static uint8_t head = NO_PAGE;          // Page records are appended to
+static uint16_t headUsed;
+
+// The write in progress, FlashStoreBegin() to the last FlashStoreStep()
+static uint8_t job;
+static uint8_t jobTurns;                // Pages the head moved on for it
+static bool jobOk;
+static uint8_t jobKey;
+static const uint8_t *jobData;
+static uint16_t jobLength;
+static uint8_t victim;                  // Page being collected
+static uint16_t victimAt;               // Where its next record starts
+
+// The record being programmed: the write's own, or a copy
+static uint32_t recAddr;
+static uint8_t recKey;
+static const uint8_t *recData;
+static uint16_t recLength;
+static uint16_t recWord;                // Next word to program
+static uint32_t recCrc;
+
+/** PRIVATE PROTOTYPES *********************************************/
+static bool RecordValid(uint32_t addr, uint16_t length);
+static uint16_t Scan(uint8_t page);
+static void SetNewest(uint8_t key, uint32_t addr, uint16_t length);
+static bool ErasePage(uint8_t page);
+static bool OpenHead(void);
+static void RecordStart(uint8_t key, const void *data, uint16_t length);
+static int8_t RecordStep(void);
+static bool NextCurrent(void);
+static bool Finish(bool ok);
+
+/** DECLARATIONS ***************************************************/
+
+static bool RecordValid(uint32_t addr, uint16_t length)
+{
+    uint32_t crc = CRC32Update(CRC32_INIT, NVMRead(addr), 4 + length);
+
+    return *(const uint32_t*)NVMRead(addr + RECORD_SIZE(length) - 4) == CRC32Final(crc);
+}
+
+static void SetNewest(uint8_t key, uint32_t addr, uint16_t length)
+{
+    uint32_t old = newest[key];
+
+    if (old != 0) flashStoreLiveBytes -= RECORD_SIZE(*(const uint32_t*)NVMRead(old) >> 16);
+    newest[key] = length != 0 ? addr : 0;
+    if (length != 0) flashStoreLiveBytes += RECORD_SIZE(length);
+}
+
+/*
+ * Indexes the records of one page and returns where its free space
+ * starts.  A length that cannot be right means the page was not
+ * written by us; nothing after it is trusted or appended to.
+ */
+static uint16_t Scan(uint8_t page)
+{
+    uint32_t base = PAGE_ADDR(page), word;
+    uint16_t at = FSTORE_HEADER_SIZE, key, length;
+
+    while (at + FSTORE_RECORD_OVERHEAD <= NVM_PAGE_SIZE) {
+        word = *(const uint32_t*)NVMRead(base + at);
+        if (word == FREE_WORD) break;
+        key = (uint16_t)word;
+        length = word >> 16;
+        if (length > FSTORE_VALUE_MAX || at + RECORD_SIZE(length) > NVM_PAGE_SIZE) {
+            at = NVM_PAGE_SIZE;
+            break;
+        }
+        if (key < FSTORE_KEYS && RecordValid(base + at, length)) {
+            SetNewest(key, base + at, length);
+        }
+        at += RECORD_SIZE(length);
+    }
+    flashStoreMountBytes += at;
+    return at;
+}
+
+/********************************************************************
+ * Function:        void FlashStoreInit(void)
+ *
+ * Overview:        Builds the index: page headers first, then one
+ *                  pass over the records, oldest page first, so a
+ *                  later record of a key replaces an earlier one.
+ *                  A collection cut short by a reset is undone first.
+ *******************************************************************/
+void FlashStoreInit(void)
+{
+    const FSTORE_PAGE *hdr;
+    uint8_t order[FSTORE_PAGES], used = 0, page, i;
+    uint16_t end = NVM_PAGE_SIZE;
+
+    memset(newest, 0, sizeof(newest));
+    flashStoreLiveBytes = 0;
+    flashStoreMountBytes = 0;
+    nextSequence = 1;
+    head = NO_PAGE;
+    job = JOB_IDLE;
+
+    for (page = 0; page < FSTORE_PAGES; page++) {
+        hdr = NVMRead(PAGE_ADDR(page));
+        flashStoreMountBytes += FSTORE_HEADER_SIZE;
+        if (hdr->magic != FSTORE_PAGE_MAGIC) {
+            pageState[page] = PAGE_DIRTY;
+            pageErases[page] = 0;
+            continue;
+        }
+        pageErases[page] = hdr->erases;
+        pageSequence[page] = hdr->sequence;
+        if (hdr->sequence == FREE_WORD) {
+            pageState[page] = PAGE_FREE;
+            continue;
+        }
+        pageState[page] = PAGE_USED;
+        if (hdr->sequence >= nextSequence) nextSequence = hdr->sequence + 1;
+
+        // Insertion sort by sequence; there are only FSTORE_PAGES
+        for (i = used++; i > 0 && pageSequence[order[i - 1]] > hdr->sequence; i--) {
+            order[i] = order[i - 1];
+        }
+        order[i] = page;
+    }
+
+    // The oldest page still in use after the head: a collection was cut short
+    if (used > 1 && pageState[NEXT_PAGE(order[used - 1])] == PAGE_USED) {
+        ErasePage(order[--used]);
+    }
+
+    for (i = 0; i < used; i++) end = Scan(order[i]);
+    if (used != 0) {
+        head = order[used - 1];
+        headUsed = end;
+    }
+}
+
+const void *FlashStoreRead(uint8_t key, uint16_t *length)
+{
+    if (key >= FSTORE_KEYS || newest[key] == 0) return NULL;
+    if (length != NULL) *length = *(const uint32_t*)NVMRead(newest[key]) >> 16;
+    return NVMRead(newest[key] + 4);
+}
+
+// Erases a page and writes the first half of its header
+static bool ErasePage(uint8_t page)
+{
+    uint32_t addr = PAGE_ADDR(page);
+    bool ok;
+
+    pageErases[page]++;
+    flashStoreErases++;
+    ok = NVMErasePage(addr);
+    ok = ok && NVMWriteWord(addr + offsetof(FSTORE_PAGE, magic), FSTORE_PAGE_MAGIC);
+    ok = ok && NVMWriteWord(addr + offsetof(FSTORE_PAGE, erases), pageErases[page]);
+    flashStoreFlashBytes += 8;
+    pageState[page] = ok ? PAGE_FREE : PAGE_DIRTY;
+    return ok;
+}
+
+// Gives the erased page after the head a sequence number and moves onto it
+static bool OpenHead(void)
+{
+    uint8_t page = head == NO_PAGE ? 0 : NEXT_PAGE(head);
+
+    if (!NVMWriteWord(PAGE_ADDR(page) + offsetof(FSTORE_PAGE, sequence), nextSequence)) return false;
+    flashStoreFlashBytes += 4;
+    pageState[page] = PAGE_USED;
+    pageSequence[page] = nextSequence++;
+    head = page;
+    headUsed = FSTORE_HEADER_SIZE;
+    return true;
+}
+
+/*
+ * Claims room for a record at the head, which has it.  The space is
+ * used up even if programming fails, so a bad word is never written
+ * twice.  data must stay as it is until the record is done.
+ */
+static void RecordStart(uint8_t key, const void *data, uint16_t length)
+{
+    uint32_t word = (uint32_t)length << 16 | key;
+
+    recAddr = PAGE_ADDR(head) + headUsed;
+    recKey = key;
+    recData = data;
+    recLength = length;
+    recWord = 0;
+    recCrc = CRC32Final(CRC32Update(CRC32Update(CRC32_INIT, &word, 4), data, length));
+    headUsed += RECORD_SIZE(length);
+    flashStoreFlashBytes += RECORD_SIZE(length);
+}
+
+/*
+ * Programs up to FSTORE_STEP_WORDS words of the record, key/length
+ * word first and CRC word last.  Returns 1 while there is more, 0 once
+ * the record reads back right and is current, -1 if it failed.
+ */
+static int8_t RecordStep(void)
+{
+    uint16_t words = RECORD_SIZE(recLength) / 4, n, at;
+    uint32_t word;
+
+    for (n = 0; n < FSTORE_STEP_WORDS && recWord < words; n++, recWord++) {
+        if (recWord == 0) {
+            word = (uint32_t)recLength << 16 | recKey;
+        } else if (recWord == words - 1) {
+            word = recCrc;
+        } else {
+            at = (recWord - 1) * 4;
+            word = FREE_WORD;
+            memcpy(&word, recData + at, recLength - at < 4 ? recLength - at : 4);
+        }
+        if (!NVMWriteWord(recAddr + recWord * 4, word)) return -1;
+    }
+    if (recWord < words) return 1;
+    if (!RecordValid(recAddr, recLength)) return -1;
+
+    SetNewest(recKey, recAddr, recLength);
+    return 0;
+}
+
+/*
+ * Starts the copy of the victim's next record that is still current.
+ * Deletions are dropped: every record they hid is older still, so
+ * already gone.
+ */
+static bool NextCurrent(void)
+{
+    uint32_t base = PAGE_ADDR(victim), word;
+    uint16_t at, key, length;
+
+    while (victimAt + FSTORE_RECORD_OVERHEAD <= NVM_PAGE_SIZE) {
+        word = *(const uint32_t*)NVMReadUncached(base + victimAt);
+        if (word == FREE_WORD) break;
+        key = (uint16_t)word;
+        length = word >> 16;
+        if (length > FSTORE_VALUE_MAX) break;
+        at = victimAt;
+        victimAt += RECORD_SIZE(length);
+        if (key < FSTORE_KEYS && newest[key] == base + at) {
+            RecordStart(key, NVMReadUncached(base + at + 4), length);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool Finish(bool ok)
+{
+    jobOk = ok;
+    job = JOB_IDLE;
+    return false;
+}
+
+/********************************************************************
+ * Function:        bool FlashStoreBegin(uint8_t key, const void *data,
+ *                                       uint16_t length)
+ *
+ * Overview:        Starts making data the value of key; length 0
+ *                  deletes it.  Nothing is written until
+ *                  FlashStoreStep(), and data must stay as it is
+ *                  until the last step.  Returns false if a write is
+ *                  already going or the value does not fit.  Writing
+ *                  the value a key already has costs nothing.
+ *******************************************************************/
+bool FlashStoreBegin(uint8_t key, const void *data, uint16_t length)
+{
+    uint16_t oldLength = 0;
+    const void *old = FlashStoreRead(key, &oldLength);
+
+    if (job != JOB_IDLE || key >= FSTORE_KEYS || length > FSTORE_VALUE_MAX) return false;
+    jobOk = true;
+    if (old == NULL ? length == 0 : oldLength == length && memcmp(old, data, length) == 0) return true;
+    if (length != 0 && flashStoreLiveBytes - (old ? RECORD_SIZE(oldLength) : 0) + RECORD_SIZE(length) > FSTORE_CAPACITY) {
+        return false;
+    }
+
+    flashStoreUserBytes += length;
+    jobKey = key;
+    jobData = data;
+    jobLength = length;
+    jobTurns = 0;
+    job = JOB_ROOM;
+    return true;
+}
+
+/********************************************************************
+ * Function:        bool FlashStoreStep(bool mayErase)
+ *
+ * Overview:        One step of the write: programs at most
+ *                  FSTORE_STEP_WORDS words, or erases one page.  With
+ *                  mayErase false a step that would erase waits.
+ *                  Returns true while there is more to do; then
+ *                  FlashStoreDone() says whether it worked.
+ *******************************************************************/
+bool FlashStoreStep(bool mayErase)
+{
+    uint8_t page;
+    int8_t r;
+
+    for (;;) {
+        switch (job) {
+        case JOB_ROOM:
+            if (head != NO_PAGE && headUsed + RECORD_SIZE(jobLength) <= NVM_PAGE_SIZE) {
+                RecordStart(jobKey, jobData, jobLength);
+                job = JOB_APPEND;
+            } else if (jobTurns++ < FSTORE_PAGES - 1) {
+                job = JOB_OPEN;
+            } else {
+                return Finish(false);       // Full, even after going round
+            }
+            continue;
+
+        case JOB_OPEN:
+            page = head == NO_PAGE ? 0 : NEXT_PAGE(head);
+            if (pageState[page] == PAGE_DIRTY) {
+                if (!mayErase) return true;
+                return ErasePage(page) ? true : Finish(false);
+            }
+            if (!OpenHead()) return Finish(false);
+            victim = NEXT_PAGE(head);
+            victimAt = FSTORE_HEADER_SIZE;
+            job = pageState[victim] == PAGE_USED ? JOB_COLLECT : JOB_ROOM;
+            return true;
+
+        case JOB_COLLECT:
+            job = NextCurrent() ? JOB_COPY : JOB_RECLAIM;
+            continue;
+
+        case JOB_COPY:
+            r = RecordStep();
+            if (r > 0) return true;
+            job = r == 0 ? JOB_COLLECT : JOB_ABANDON;
+            return true;
+
+        case JOB_RECLAIM:
+            if (!mayErase) return true;
+            job = ErasePage(victim) ? JOB_ROOM : JOB_ABANDON;
+            return true;
+
+        case JOB_ABANDON:
+            // As after a reset: the victim keeps its records
+            if (!mayErase) return true;
+            ErasePage(head);
+            FlashStoreInit();
+            return Finish(false);
+
+        case JOB_APPEND:
+            r = RecordStep();
+            if (r > 0) return true;
+            return Finish(r == 0);
+
+        default:
+            return false;
+        }
+    }
+}
+
+bool FlashStoreBusy(void)
+{
+    return job != JOB_IDLE;
+}
+
+// Whether the last write finished with its value current
+bool FlashStoreDone(void)
+{
+    return job == JOB_IDLE && jobOk;
+}
+
+// Every step at once: stalls for as long as the write takes
+bool FlashStoreWrite(uint8_t key, const void *data, uint16_t length)
+{
+    if (length == 0 || !FlashStoreBegin(key, data, length)) return false;
+    while (FlashStoreStep(true));
+    return jobOk;
+}
+
+bool FlashStoreDelete(uint8_t key)
+{
+    if (!FlashStoreBegin(key, NULL, 0)) return false;
+    while (FlashStoreStep(true));
+    return jobOk;
+}
+
+uint32_t FlashStorePageErases(uint8_t page)
+{
+    return page < FSTORE_PAGES ? pageErases[page] : 0;
+}
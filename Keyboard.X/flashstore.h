@@ -0,0 +1,90 @@
+/********************************************************************
+ FileName:      flashstore.h
+ Dependencies:  nvm.h, crc32.h
+ Processor:     PIC32MX270F256D, or a Linux host (simulated NVM)
+
+ Log-structured key/value store in the FLASH_DATA pages, for
+ configuration that changes without a reflash: keymaps, macro
+ libraries.  A write appends a new record; the newest record of a
+ key is its value, and a record of length 0 deletes it.
+
+ Each page starts with a header: magic, erase count, and the sequence
+ number it was given when it last became the head of the log (all
+ ones while it is free).  Records follow, word aligned:
+
+   key (uint16) | length (uint16)   written first
+   data, padded to a word
+   CRC-32 of the two above          written last: the commit
+
+ A record whose CRC word is missing or wrong was cut off by a reset;
+ its length still says where the next one starts, so it is skipped.
+
+ FlashStoreInit() reads the page headers, then every record once in
+ sequence order, keeping the address of the newest one per key.
+
+ The pages form a ring, and the page after the head is always erased.
+ When the head is full the log moves onto that page, and the one after
+ it, the oldest, is collected: its records that are still current are
+ copied to the new head, and it is erased.  They came out of one page,
+ so they always fit.  A reset in the middle leaves the oldest page in
+ use right after the head; FlashStoreInit() then erases the head,
+ which only held copies, and the next write collects again.  Going
+ round the ring erases every page once per turn, cold records
+ included, so wear is even.
+
+ Programming stalls the CPU (see nvm.h), so a write can also run in
+ steps: FlashStoreBegin(), then FlashStoreStep() until it returns
+ false.  A step programs at most FSTORE_STEP_WORDS words or erases one
+ page, and the caller can hold erases back for a quieter moment.
+ FlashStoreWrite() and FlashStoreDelete() run every step at once.
+ *******************************************************************/
+#ifndef FLASHSTORE_H
+#define FLASHSTORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nvm.h"
+
+/** DEFINITIONS ****************************************************/
+#define FSTORE_BASE             FLASH_DATA_BASE
+#define FSTORE_PAGES            (FLASH_DATA_SIZE / NVM_PAGE_SIZE)
+#define FSTORE_PAGE_MAGIC       0x31534C46  // "FLS1"
+#define FSTORE_KEYS             32
+#define FSTORE_HEADER_SIZE      sizeof(FSTORE_PAGE)
+#define FSTORE_RECORD_OVERHEAD  8       // Key/length word and CRC word
+#define FSTORE_STEP_WORDS       32      // A row's worth: 640 us of word programming
+#define FSTORE_VALUE_MAX        (NVM_PAGE_SIZE - FSTORE_HEADER_SIZE - FSTORE_RECORD_OVERHEAD)
+// Live records fit in all but two pages: the erased one and the one collected into
+#define FSTORE_CAPACITY         ((FSTORE_PAGES - 2) * (NVM_PAGE_SIZE - FSTORE_HEADER_SIZE))
+
+// Keys
+#define FSTORE_KEY_CONFIG       0       // CONFIG_HEADER, see config.h
+#define FSTORE_KEY_SECTIONS     1       // Its sections, two keys each from here
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t erases;                // Including the one that wrote this header
+    uint32_t sequence;              // 0xFFFFFFFF while free
+    uint32_t reserved;
+} FSTORE_PAGE;
+
+/** PUBLIC VARIABLES ***********************************************/
+extern uint32_t flashStoreUserBytes;    // Value bytes callers have written
+extern uint32_t flashStoreFlashBytes;   // Bytes programmed for them, copies and headers included
+extern uint32_t flashStoreErases;
+extern uint32_t flashStoreMountBytes;   // Read by the last FlashStoreInit()
+extern uint32_t flashStoreLiveBytes;    // Current records, overhead included
+
+/** PUBLIC PROTOTYPES **********************************************/
+void FlashStoreInit(void);
+const void *FlashStoreRead(uint8_t key, uint16_t *length);
+bool FlashStoreBegin(uint8_t key, const void *data, uint16_t length);
+bool FlashStoreStep(bool mayErase);
+bool FlashStoreBusy(void);
+bool FlashStoreDone(void);
+bool FlashStoreWrite(uint8_t key, const void *data, uint16_t length);
+bool FlashStoreDelete(uint8_t key);
+uint32_t FlashStorePageErases(uint8_t page);
+
+#endif // FLASHSTORE_H
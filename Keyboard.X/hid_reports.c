@@ -0,0 +1,94 @@
+/** INCLUDES *******************************************************/
+#include "usb.h"
+#include "usb_function_hid.h"
+#include "hid_reports.h"
+#include "bootloader.h"
+#include "nvm.h"
+
+/** VARIABLES ******************************************************/
+uint8_t hidProtocol = RPT_PROTOCOL;
+
+static BOOT_PACKET bootPacket;      // EP0 OUT data stage lands here
+
+/** DECLARATIONS ***************************************************/
+
+// HID 1.11 7.2.6: report protocol is the default after configuration
+void HIDReportsInit(void)
+{
+    hidProtocol = RPT_PROTOCOL;
+    BootInit(FLASH_STAGE_BASE, FLASH_STAGE_SIZE);
+}
+
+// EP0 OUT completion for SET_REPORT(Feature, REPORT_ID_BOOTLOADER)
+static void BootReportReceived(void)
+{
+    if (!BootProcessPacket(&bootPacket)) {
+        USBDeferStatusStage();      // Released from HIDReportsTasks()
+    }
+}
+
+/********************************************************************
+ * Function:        bool HIDReportsCheckRequest(void)
+ *
+ * Overview:        Claims the HID interface requests listed in the
+ *                  file header.  Anything else falls through to
+ *                  USBCheckHIDRequest().
+ *******************************************************************/
+bool HIDReportsCheckRequest(void)
+{
+    if (SetupPkt.Recipient != USB_SETUP_RECIPIENT_INTERFACE_BITFIELD) return false;
+    if (SetupPkt.bIntfID != HID_INTF_ID) return false;
+
+    if (SetupPkt.RequestType == USB_SETUP_TYPE_STANDARD_BITFIELD) {
+        if (SetupPkt.bRequest == USB_REQUEST_GET_DESCRIPTOR &&
+            SetupPkt.W_Value.byte.HB == DSC_RPT) {
+            USBEP0SendROMPtr((ROM uint8_t*)&hid_rpt01, sizeof(hid_rpt01), USB_EP0_INCLUDE_ZERO);
+            return true;
+        }
+        return false;
+    }
+
+    if (SetupPkt.RequestType != USB_SETUP_TYPE_CLASS_BITFIELD) return false;
+
+    switch (SetupPkt.bRequest)
+    {
+        case GET_PROTOCOL:
+            USBEP0SendRAMPtr(&hidProtocol, 1, USB_EP0_NO_OPTIONS);
+            return true;
+        case SET_PROTOCOL:
+            hidProtocol = SetupPkt.W_Value.byte.LB;
+            USBEP0Transmit(USB_EP0_NO_DATA);
+            return true;
+        case SET_REPORT:
+            if (SetupPkt.W_Value.byte.HB == HID_REPORT_FEATURE &&
+                SetupPkt.W_Value.byte.LB == REPORT_ID_BOOTLOADER) {
+                USBEP0Receive((uint8_t*)&bootPacket, sizeof(bootPacket), BootReportReceived);
+                return true;
+            }
+            return false;
+        case GET_REPORT:
+            if (SetupPkt.W_Value.byte.HB == HID_REPORT_FEATURE &&
+                SetupPkt.W_Value.byte.LB == REPORT_ID_BOOTLOADER) {
+                bootResponse.reportId = REPORT_ID_BOOTLOADER;
+                USBEP0SendRAMPtr((uint8_t*)&bootResponse, sizeof(bootResponse), USB_EP0_NO_OPTIONS);
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+/********************************************************************
+ * Function:        void HIDReportsTasks(void)
+ *
+ * Overview:        Main loop work for feature reports: programs the
+ *                  next flash row of a firmware update and lets a held
+ *                  SET_REPORT finish once a row buffer is free.
+ *******************************************************************/
+void HIDReportsTasks(void)
+{
+    if (BootTasks()) {
+        USBCtrlEPAllowStatusStage();
+    }
+}
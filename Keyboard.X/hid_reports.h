@@ -0,0 +1,50 @@
+/********************************************************************
+ FileName:      hid_reports.h
+ Dependencies:  usb.h, usb_function_hid.h, diagnostics.h
+ Processor:     PIC32MX270F256D
+
+ HID class requests that the precompiled stack does not cover: the
+ report descriptor is served from here because the library was built
+ for a different descriptor size, the boot/report protocol switch is
+ tracked here, and feature reports are routed to their owners.
+ *******************************************************************/
+#ifndef HID_REPORTS_H
+#define HID_REPORTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "diagnostics.h"
+
+/** DEFINITIONS ****************************************************/
+// Report IDs, report protocol only.  In boot protocol the keyboard
+// report goes out without its ID byte.
+#define REPORT_ID_KEYBOARD      0x01
+#define REPORT_ID_BOOTLOADER    0x02    // Feature, see bootloader.h
+#define REPORT_ID_DIAGNOSTICS   0x03    // Input, DIAG_REPORT, see diagnostics.h
+#define REPORT_ID_STENO         0x50    // Input, STENO_REPORT; fixed by the Plover HID protocol
+
+// Longest input report in hid_rpt01, ID byte included.  The host reads
+// this much per interrupt transfer.
+#define HID_INPUT_REPORT_MAX    (1 + sizeof(DIAG_REPORT))
+
+#define HID_REPORT_INPUT        0x01    // wValue high byte of GET/SET_REPORT
+#define HID_REPORT_OUTPUT       0x02
+#define HID_REPORT_FEATURE      0x03
+
+typedef struct __attribute__ ((packed))
+{
+    uint8_t reportId;
+    uint8_t modifiers;
+    uint8_t reserved;
+    uint8_t keys[6];
+} KEYBOARD_REPORT;
+
+/** PUBLIC VARIABLES ***********************************************/
+extern uint8_t hidProtocol;         // BOOT_PROTOCOL or RPT_PROTOCOL
+
+/** PUBLIC PROTOTYPES **********************************************/
+void HIDReportsInit(void);
+bool HIDReportsCheckRequest(void);
+void HIDReportsTasks(void);
+
+#endif // HID_REPORTS_H
@@ -0,0 +1,176 @@
+/** INCLUDES *******************************************************/
+#include "idle.h"
+#include "macro_vm.h"
+#include "taphold.h"
+#include "combo.h"
+#include "leader.h"
+#include "typematic.h"
+#include "steno.h"
+#include "recorder.h"
+#include "config.h"
+
+#if defined(__PIC32MX__)
+#include "Compiler.h"
+#include "tick.h"
+#endif
+
+/** VARIABLES ******************************************************/
+uint32_t idleWaits;
+uint32_t idleWaitMs;
+uint8_t idleBusyPercent;
+uint32_t idleWakeLastUs;
+uint32_t idleWakeMaxUs;
+bool idleWakeKeyPending;
+uint32_t idleWakeKeyUs;
+
+static uint32_t windowStartUs;
+static uint32_t windowWaitUs;       // Waited so far in this window
+static uint32_t partUs;             // Not yet counted in idleWaitMs
+static uint32_t suspendUs;          // When the bus was suspended
+
+/** PRIVATE PROTOTYPES *********************************************/
+static uint32_t Wait(uint32_t nowUs);
+
+/** DECLARATIONS ***************************************************/
+#if defined(__PIC32MX__)
+
+// WAIT until an event or the core timer bound; returns the time waited
+static uint32_t Wait(uint32_t nowUs)
+{
+    uint32_t untilUs = nowUs + IDLE_MAX_MS * 1000ul, late;
+
+    _CP0_SET_COMPARE(_CP0_GET_COUNT() + IDLE_MAX_MS * TICKS_PER_MS);
+    IFS0CLR = _IFS0_CTIF_MASK;
+    IPC0bits.CTIP = IDLE_WAKE_IPL;
+    IEC0SET = _IEC0_CTIE_MASK;
+
+    // A USB event the stack has not serviced yet sets USBIF again at once
+    IFS1CLR = _IFS1_USBIF_MASK;
+    IPC7bits.USBIP = IDLE_WAKE_IPL;
+    IEC1SET = _IEC1_USBIE_MASK;
+
+    CNCONBbits.ON = 1;
+    CNENBbits.CNIEB0 = 1;
+    (void)PORTB;                    // Takes the current level as the reference
+    IFS1CLR = _IFS1_CNBIF_MASK;
+    IPC8bits.CNIP = IDLE_WAKE_IPL;
+    IEC1SET = _IEC1_CNBIE_MASK;
+
+    _wait();                        // Idle: SLPEN is only set by SuspendSleep()
+
+    if (IFS0 & _IFS0_CTIF_MASK) {
+        late = (uint32_t)(TickUs() - untilUs);
+        if ((int32_t)late < 0) late = 0;
+        idleWakeLastUs = late;
+        if (late > idleWakeMaxUs) idleWakeMaxUs = late;
+    }
+
+    IEC0CLR = _IEC0_CTIE_MASK;
+    IEC1CLR = _IEC1_USBIE_MASK | _IEC1_CNBIE_MASK;
+    IFS0CLR = _IFS0_CTIF_MASK;
+    IFS1CLR = _IFS1_USBIF_MASK | _IFS1_CNBIF_MASK;
+    CNENBbits.CNIEB0 = 0;
+    CNCONBbits.ON = 0;
+
+    return TickUs() - nowUs;
+}
+
+#else   // Host simulation
+
+// kbsim runs the time between events itself
+static uint32_t Wait(uint32_t nowUs)
+{
+    (void)nowUs;
+    return 0;
+}
+
+#endif
+
+void IdleInit(void)
+{
+    idleWaits = idleWaitMs = 0;
+    idleBusyPercent = 100;
+    idleWakeLastUs = idleWakeMaxUs = 0;
+    windowStartUs = windowWaitUs = partUs = 0;
+}
+
+/********************************************************************
+ * Function:        bool IdleReady(void)
+ *
+ * Overview:        True when none of the engines has timed work
+ *                  pending, so the next thing that can happen is an
+ *                  event.  The main loop adds its own conditions: the
+ *                  report queue, the bootloader, recovery.
+ *******************************************************************/
+bool IdleReady(void)
+{
+    return !MacroBusy() && !TapHoldBusy() && !ComboBusy() && !LeaderActive() &&
+           !TypematicBusy() && !StenoBusy() && !RecorderPending() && !ConfigPending();
+}
+
+/********************************************************************
+ * Function:        void IdleTasks(bool ready, uint32_t nowUs)
+ *
+ * Overview:        Call at the end of each main loop pass.  If ready,
+ *                  waits for the next event as the file header says.
+ *                  Keeps idleBusyPercent either way.
+ *******************************************************************/
+void IdleTasks(bool ready, uint32_t nowUs)
+{
+    uint32_t waited = 0;
+
+    if (ready) {
+        idleWaits++;
+        waited = Wait(nowUs);
+        partUs += waited;
+        idleWaitMs += partUs / 1000;
+        partUs %= 1000;
+    }
+
+    windowWaitUs += waited;
+    nowUs += waited;
+    if ((uint32_t)(nowUs - windowStartUs) >= IDLE_WINDOW_MS * 1000ul) {
+        idleBusyPercent = 100 - (uint8_t)((uint64_t)windowWaitUs * 100 / (nowUs - windowStartUs));
+        windowStartUs = nowUs;
+        windowWaitUs = 0;
+    }
+}
+
+// From USBCBSuspend(): the bus idle time counts from here
+void IdleSuspendStart(uint32_t nowUs)
+{
+    suspendUs = nowUs;
+}
+
+// From USBCBWakeFromSuspend(), whoever resumed
+void IdleSuspendEnd(void)
+{
+    idleWakeKeyPending = false;
+}
+
+/********************************************************************
+ * Function:        uint8_t IdleSuspendTasks(bool keyDown,
+ *                                           bool remoteWakeup,
+ *                                           uint32_t nowUs)
+ *
+ * Overview:        One main loop pass while the bus is suspended, as
+ *                  the file header says.  keyDown is the wake key,
+ *                  remoteWakeup whether the host allows it.  Returns
+ *                  IDLE_SUSPEND_*; the caller does the USB and the
+ *                  Sleep side.
+ *******************************************************************/
+uint8_t IdleSuspendTasks(bool keyDown, bool remoteWakeup, uint32_t nowUs)
+{
+    bool busIdle = (uint32_t)(nowUs - suspendUs) >= IDLE_RESUME_BUS_IDLE_MS * 1000ul;
+
+    if (!remoteWakeup) idleWakeKeyPending = false;
+    if (remoteWakeup && (keyDown || idleWakeKeyPending)) {
+        if (!idleWakeKeyPending) {
+            idleWakeKeyPending = true;
+            idleWakeKeyUs = nowUs;
+        }
+        return busIdle ? IDLE_SUSPEND_RESUME : IDLE_SUSPEND_AWAKE;
+    }
+    if (RecorderCommitTasks() || ConfigCommitTasks() || !busIdle) return IDLE_SUSPEND_AWAKE;
+    return IDLE_SUSPEND_SLEEP;
+}
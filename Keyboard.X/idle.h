@@ -0,0 +1,79 @@
+/********************************************************************
+ FileName:      idle.h
+ Dependencies:  tick.h, macro_vm.h, taphold.h, combo.h, leader.h,
+                typematic.h, steno.h, recorder.h, config.h
+ Processor:     PIC32MX270F256D, or a Linux host (no waiting)
+
+ Idle between events.  Most of the time nothing is typing: no macro
+ runs, no key waits on a timer, no report is on its way.  The main
+ loop then has nothing to do until the next event, and instead of
+ polling for it the CPU executes WAIT and stops until one of
+
+   - USB: a finished transaction, a bus reset or suspend, whatever
+     the stack enables in U1IE and U1OTGIE,
+   - the button (RB0) changing,
+   - the core timer, IDLE_MAX_MS after the wait began.
+
+ WAIT is Idle here, not Sleep: the oscillators and the core timer run
+ on, so leaving it takes a few cycles and TickUs() stays right.  With
+ interrupts globally off, as in this polling build, a wake source
+ only ends the WAIT; no handler runs, and the main loop carries on
+ with its next pass.  An event that came before the WAIT makes it
+ return at once, so none is lost between the last check and the WAIT.
+
+ The timed work of the engines (tap-hold and combo terms, leader
+ timeouts, typematic repeat, macro delays, flash writes on an idle
+ timer) does not wait: while any of it is pending IdleReady() is
+ false and the loop runs flat out as before, so no deadline moves.
+ The core timer bound only has to cover what looks at the time
+ without being an engine: the clock drop (clock.h) and TickUs()
+ itself, which must see every core timer wrap.
+
+ idleBusyPercent is the share of the last IDLE_WINDOW_MS the CPU was
+ awake.  idleWakeMaxUs is how late a core timer wake was, from the
+ compare match to the next pass.
+
+ While the host has the bus suspended the main loop runs none of the
+ above.  IdleSuspendTasks() decides each of its passes instead: finish
+ the recorder's and the configuration's flash writes, signal remote
+ wakeup for a key once the bus has been idle IDLE_RESUME_BUS_IDLE_MS
+ (USB 2.0 7.1.7.7), or, with nothing left, Sleep until the bus or the
+ key wakes the CPU.  A key seen inside that window is remembered and
+ wakes the host when the window ends; IdleSuspendEnd() forgets it when
+ the host resumes by itself.
+ *******************************************************************/
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** DEFINITIONS ****************************************************/
+#define IDLE_MAX_MS             100     // Longest wait without an event
+#define IDLE_WINDOW_MS          1000    // idleBusyPercent is over this
+#define IDLE_WAKE_IPL           1       // Above the CPU's priority 0, so they wake it
+#define IDLE_RESUME_BUS_IDLE_MS 5       // Bus idle before remote wakeup
+
+// IdleSuspendTasks()
+#define IDLE_SUSPEND_AWAKE      0       // Stay awake: flash writes, or the bus not idle long enough
+#define IDLE_SUSPEND_RESUME     1       // Signal remote wakeup now
+#define IDLE_SUSPEND_SLEEP      2       // Nothing to do until the bus or the key
+
+/** PUBLIC VARIABLES ***********************************************/
+extern uint32_t idleWaits;
+extern uint32_t idleWaitMs;         // Time spent in WAIT
+extern uint8_t idleBusyPercent;     // Awake, over the last IDLE_WINDOW_MS
+extern uint32_t idleWakeLastUs;     // Core timer wake to running
+extern uint32_t idleWakeMaxUs;
+extern bool idleWakeKeyPending;     // A key asked for remote wakeup ...
+extern uint32_t idleWakeKeyUs;      // ... at this TickUs()
+
+/** PUBLIC PROTOTYPES **********************************************/
+void IdleInit(void);
+bool IdleReady(void);
+void IdleTasks(bool ready, uint32_t nowUs);
+void IdleSuspendStart(uint32_t nowUs);
+void IdleSuspendEnd(void);
+uint8_t IdleSuspendTasks(bool keyDown, bool remoteWakeup, uint32_t nowUs);
+
+#endif // IDLE_H
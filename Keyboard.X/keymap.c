@@ -0,0 +1,240 @@
+/** INCLUDES *******************************************************/
+#include <string.h>
+#include "keymap.h"
+#include "macro_vm.h"
+#include "macro_image.h"
+#include "recorder.h"
+#include "leader.h"
+#include "steno.h"
+#include "typematic.h"
+
+/** VARIABLES ******************************************************/
+static KEYMAP keymap;               // The descriptor; its tables stay where they are
+static const uint8_t *keymapMacros;
+
+static uint32_t layerHeld;          // ACT_MO keys that are down
+static uint32_t layerToggled;
+static uint32_t layerOneShot;       // Cleared by the next key press
+
+static uint16_t keyAction[KEYMAP_MAX_KEYS]; // What each held key resolved to
+static KEY_SET keymapKeys;
+
+/** PRIVATE PROTOTYPES *********************************************/
+static void KeymapUpdateHeld(void);
+
+/** DECLARATIONS ***************************************************/
+
+void KeymapInit(const KEYMAP *map, const uint8_t *macroImage)
+{
+    if (map != NULL) keymap = *map;
+    else memset(&keymap, 0, sizeof(keymap));
+    keymapMacros = macroImage;
+    layerHeld = layerToggled = layerOneShot = 0;
+    memset(keyAction, 0, sizeof(keyAction));
+    KeySetClear(&keymapKeys);
+}
+
+/********************************************************************
+ * Function:        bool KeymapFromBlob(KEYMAP *map, const void *blob,
+ *                                      uint16_t length)
+ *
+ * Overview:        Points map at a word-aligned KEYMAP_BLOB if its
+ *                  size adds up and the base layer defines every key,
+ *                  which KeymapResolve() relies on.  A blob did not
+ *                  come with the firmware, so no defined bit and no
+ *                  layer action (MO, TG, OSL, LT) may name a layer it
+ *                  does not have: the layer masks shift by them.
+ *******************************************************************/
+bool KeymapFromBlob(KEYMAP *map, const void *blob, uint16_t length)
+{
+    const KEYMAP_BLOB *hdr = blob;
+    const uint32_t *defined = (const uint32_t*)(hdr + 1);
+    const uint16_t *actions;
+    uint32_t layerMask;
+    uint16_t i, action;
+    uint8_t key, layer;
+
+    if (blob == NULL || length < sizeof(KEYMAP_BLOB)) return false;
+    if (hdr->keys == 0 || hdr->keys > KEYMAP_MAX_KEYS) return false;
+    if (hdr->layers == 0 || hdr->layers > KEYMAP_MAX_LAYERS) return false;
+    if (length != KEYMAP_BLOB_SIZE(hdr->keys, hdr->layers)) return false;
+
+    layerMask = hdr->layers == 32 ? 0xFFFFFFFF : (1ul << hdr->layers) - 1;
+    for (key = 0; key < hdr->keys; key++) {
+        if (!(defined[key] & 1) || (defined[key] & ~layerMask)) return false;
+    }
+
+    actions = (const uint16_t*)(defined + hdr->keys);
+    for (i = 0; i < hdr->keys * hdr->layers; i++) {
+        action = actions[i];
+        switch (ACT_TYPE(action))
+        {
+            case ACT_MO(0):
+            case ACT_TG(0):
+            case ACT_OSL(0):
+                layer = ACT_ARG(action);
+                break;
+            case ACT_LT(0, 0):
+                layer = ACT_HOLD_ARG(action);
+                break;
+            default:
+                continue;
+        }
+        if (layer >= hdr->layers) return false;
+    }
+
+    map->keys = hdr->keys;
+    map->layers = hdr->layers;
+    map->defined = defined;
+    map->actions = actions;
+    return true;
+}
+
+/********************************************************************
+ * Function:        uint16_t KeymapResolve(uint8_t key)
+ *
+ * Overview:        The action key has under the current layers.  The
+ *                  base layer always defines every key, so the masked
+ *                  set is never empty and clz picks the top layer.
+ *******************************************************************/
+uint16_t KeymapResolve(uint8_t key)
+{
+    uint32_t layers;
+
+    if (key >= keymap.keys) return ACT_NO;
+
+    layers = (1 | layerHeld | layerToggled | layerOneShot) & keymap.defined[key];
+    if (layers == 0) return ACT_NO;
+    return keymap.actions[key * keymap.layers + (31 - __builtin_clz(layers))];
+}
+
+// A layer stays on while any key that holds it is down
+static void KeymapUpdateHeld(void)
+{
+    uint8_t key;
+
+    layerHeld = 0;
+    for (key = 0; key < KEYMAP_MAX_KEYS; key++) {
+        if (ACT_TYPE(keyAction[key]) == ACT_MO(0)) layerHeld |= 1ul << ACT_ARG(keyAction[key]);
+    }
+}
+
+/********************************************************************
+ * Function:        void KeymapPress(uint8_t key, uint16_t action)
+ *
+ * Overview:        Presses key as action, normally KeymapResolve(key).
+ *                  Key actions go into the keymap's key set, macros
+ *                  are started with the key number as their trigger.
+ *******************************************************************/
+void KeymapPress(uint8_t key, uint16_t action)
+{
+    const uint8_t *image;
+    uint16_t entry;
+
+    if (key >= KEYMAP_MAX_KEYS) return;
+    if (ACT_IS_TAP_HOLD(action)) action = ACT_KEY(ACT_ARG(action));
+    keyAction[key] = action;
+
+    switch (ACT_TYPE(action))
+    {
+        case ACT_KEY(0):
+            if (LeaderActive() && !USAGE_IS_MODIFIER(ACT_ARG(action))) {
+                LeaderKey(ACT_ARG(action));
+                keyAction[key] = ACT_NO;    // Its release has nothing to undo
+            } else {
+                KeySetPress(&keymapKeys, ACT_ARG(action));
+            }
+            layerOneShot = 0;
+            break;
+        case ACT_MO(0):
+            layerHeld |= 1ul << ACT_ARG(action);
+            break;
+        case ACT_TG(0):
+            layerToggled ^= 1ul << ACT_ARG(action);
+            break;
+        case ACT_OSL(0):
+            layerOneShot |= 1ul << ACT_ARG(action);
+            break;
+        case ACT_MACRO(0):
+        case ACT_MACRO_RPT(0):
+            entry = keymapMacros ? MacroImageEntry(keymapMacros, ACT_ARG(action)) : MACRO_NONE;
+            if (entry != MACRO_NONE) {
+                MacroStart(keymapMacros, entry, key);
+                if (ACT_TYPE(action) == ACT_MACRO_RPT(0)) TypematicPress(key, keymapMacros, entry);
+            }
+            layerOneShot = 0;
+            break;
+        case ACT_MODS(0):
+            keymapKeys.modifiers |= ACT_ARG(action);
+            break;
+        case ACT_RECORD(0):
+            RecorderToggle(ACT_ARG(action));
+            break;
+        case ACT_LEADER:
+            LeaderStart();
+            break;
+        case ACT_STENO(0):
+            StenoKey(ACT_ARG(action), true);
+            break;
+        case ACT_PLAY(0):
+            image = RecorderImage(ACT_ARG(action));
+            if (image != NULL) MacroStart(image, MacroImageEntry(image, 0), key);
+            layerOneShot = 0;
+            break;
+    }
+}
+
+// Undoes whatever the key was pressed as
+void KeymapRelease(uint8_t key)
+{
+    uint16_t action;
+
+    if (key >= KEYMAP_MAX_KEYS) return;
+    action = keyAction[key];
+    keyAction[key] = ACT_TRANSPARENT;
+
+    switch (ACT_TYPE(action))
+    {
+        case ACT_KEY(0):
+            KeySetRelease(&keymapKeys, ACT_ARG(action));
+            break;
+        case ACT_MO(0):
+            KeymapUpdateHeld();
+            break;
+        case ACT_MACRO_RPT(0):
+            TypematicRelease(key);
+            MacroTriggerUp(key);
+            break;
+        case ACT_MACRO(0):
+        case ACT_PLAY(0):
+            MacroTriggerUp(key);
+            break;
+        case ACT_MODS(0):
+            keymapKeys.modifiers &= ~ACT_ARG(action);
+            break;
+        case ACT_STENO(0):
+            StenoKey(ACT_ARG(action), false);
+            break;
+    }
+}
+
+// A key edge with no tap-hold decision in between
+void KeymapEvent(uint8_t key, bool down)
+{
+    if (down) {
+        KeymapPress(key, KeymapResolve(key));
+    } else {
+        KeymapRelease(key);
+    }
+}
+
+void KeymapMerge(KEY_SET *out)
+{
+    KeySetMerge(out, &keymapKeys);
+}
+
+// Active layer mask, base layer included
+uint32_t KeymapLayers(void)
+{
+    return 1 | layerHeld | layerToggled | layerOneShot;
+}
@@ -0,0 +1,103 @@
+/********************************************************************
+ FileName:      keymap.h
+ Dependencies:  keyset.h, macro_vm.h, recorder.h, leader.h, steno.h,
+                typematic.h
+ Processor:     PIC32MX270F256D, or a Linux host
+
+ Layered keymap.  Each physical key number has one action per layer;
+ the active layers are a 32-bit mask (bit 0, the base layer, is always
+ set) and the highest active layer that defines the key wins.
+
+ tools/macroc flattens the layers ahead of time: actions[] is indexed
+ by key * layers + layer, and defined[key] has a bit for every layer
+ where the key is not transparent.  Resolving a key is then one AND
+ and one count-leading-zeros (the MIPS32 clz instruction), whatever
+ the number of layers.
+
+ A keymap can also come from the flash store (flashstore.h) as a
+ KEYMAP_BLOB: the same two arrays laid out after a small header.
+ KeymapFromBlob() checks it and points a KEYMAP into it.
+
+ Nothing but the descriptor is copied: KeymapInit() keeps the KEYMAP
+ itself in RAM and the tables are read in place, built in or stored,
+ through cached KSEG0.  A lookup loads two words from flash, defined[]
+ and the action; a key's layers sit side by side in actions[], so the
+ keys of one row are a few sequential cache lines.
+
+ A key keeps the action it resolved to when it went down until it
+ comes up, even if the layers change in between.
+
+ Tap-hold actions (ACT_MT, ACT_LT) are decided by taphold.c, which
+ hands KeymapPress() the tap key or the hold action.  Pressed without
+ it they act as their tap key.
+
+ While a leader sequence is being typed, keys go to leader.c instead
+ of the report; modifiers still work as usual.  Steno keys always go
+ to steno.c.
+ *******************************************************************/
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyset.h"
+
+/** DEFINITIONS ****************************************************/
+#define KEYMAP_MAX_KEYS         64
+#define KEYMAP_MAX_LAYERS       32      // Bits in the layer mask
+
+// Actions: type in the top nibble, arguments below it
+#define ACT_TRANSPARENT         0x0000  // Whatever the layer below has
+#define ACT_KEY(usage)          (0x0000 | (usage))
+#define ACT_MO(layer)           (0x1000 | (layer))  // Layer on while held
+#define ACT_TG(layer)           (0x2000 | (layer))  // Layer on/off per press
+#define ACT_OSL(layer)          (0x3000 | (layer))  // Layer on for the next key
+#define ACT_MACRO(id)           (0x4000 | (id))     // macro_image.h id
+#define ACT_MT(mods, usage)     (0x5000 | ((mods) << 8) | (usage))  // Left mods (4 bits) on hold
+#define ACT_MT_R(mods, usage)   (0x6000 | ((mods) << 8) | (usage))  // Right mods on hold
+#define ACT_LT(layer, usage)    (0x7000 | ((layer) << 8) | (usage)) // Layer 0-15 on hold
+#define ACT_MODS(mods)          (0x8000 | (mods))   // Modifier byte bits while held
+#define ACT_RECORD(slot)        (0x9000 | (slot))   // Start/stop recording, recorder.h
+#define ACT_PLAY(slot)          (0xA000 | (slot))   // Play a recording
+#define ACT_LEADER              0xB000  // Start a leader sequence, leader.h
+#define ACT_STENO(key)          (0xC000 | (key))    // Steno key, steno.h
+#define ACT_MACRO_RPT(id)       (0xD000 | (id))     // Macro that repeats while held, typematic.h
+#define ACT_NO                  0xF000  // Nothing, and hides the layers below
+
+#define ACT_TYPE(a)             ((a) & 0xF000)
+#define ACT_ARG(a)              ((uint8_t)(a))
+#define ACT_HOLD_ARG(a)         (((a) >> 8) & 0x0F) // Mods or layer of a tap-hold action
+#define ACT_IS_TAP_HOLD(a)      (ACT_TYPE(a) >= ACT_MT(0, 0) && ACT_TYPE(a) <= ACT_LT(0, 0))
+
+typedef struct
+{
+    uint8_t keys;
+    uint8_t layers;
+    const uint32_t *defined;        // [key]: layers with a non-transparent action
+    const uint16_t *actions;        // [key * layers + layer]
+} KEYMAP;
+
+// Stored form: followed by uint32_t defined[keys], uint16_t actions[keys * layers]
+typedef struct
+{
+    uint8_t keys;
+    uint8_t layers;
+    uint16_t reserved;
+} KEYMAP_BLOB;
+
+#define KEYMAP_BLOB_SIZE(keys, layers)  (sizeof(KEYMAP_BLOB) + (keys) * 4u + (keys) * (layers) * 2u)
+
+/** PUBLIC VARIABLES ***********************************************/
+extern const KEYMAP keymapDefault;  // macros_default.c
+
+/** PUBLIC PROTOTYPES **********************************************/
+void KeymapInit(const KEYMAP *map, const uint8_t *macroImage);
+bool KeymapFromBlob(KEYMAP *map, const void *blob, uint16_t length);
+uint16_t KeymapResolve(uint8_t key);
+void KeymapPress(uint8_t key, uint16_t action);
+void KeymapRelease(uint8_t key);
+void KeymapEvent(uint8_t key, bool down);
+void KeymapMerge(KEY_SET *out);
+uint32_t KeymapLayers(void);
+
+#endif // KEYMAP_H
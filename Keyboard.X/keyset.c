@@ -0,0 +1,123 @@
+/** INCLUDES *******************************************************/
+#include <string.h>
+#include "keyset.h"
+
+/** CONSTANTS ******************************************************/
+// US layout, ' ' to '~'.  Bit 7 set = needs Shift.
+#define SHIFT   0x80
+static const uint8_t asciiUsage[95] = {
+    0x2C, 0x1E|SHIFT, 0x34|SHIFT, 0x20|SHIFT, 0x21|SHIFT, 0x22|SHIFT, 0x24|SHIFT, 0x34,        // space ! " # $ % & '
+    0x26|SHIFT, 0x27|SHIFT, 0x25|SHIFT, 0x2E|SHIFT, 0x36, 0x2D, 0x37, 0x38,                     // ( ) * + , - . /
+    0x27, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26,                                 // 0-9
+    0x33|SHIFT, 0x33, 0x36|SHIFT, 0x2E, 0x37|SHIFT, 0x38|SHIFT, 0x1F|SHIFT,                     // : ; < = > ? @
+    0x04|SHIFT, 0x05|SHIFT, 0x06|SHIFT, 0x07|SHIFT, 0x08|SHIFT, 0x09|SHIFT, 0x0A|SHIFT,         // A-G
+    0x0B|SHIFT, 0x0C|SHIFT, 0x0D|SHIFT, 0x0E|SHIFT, 0x0F|SHIFT, 0x10|SHIFT, 0x11|SHIFT,         // H-N
+    0x12|SHIFT, 0x13|SHIFT, 0x14|SHIFT, 0x15|SHIFT, 0x16|SHIFT, 0x17|SHIFT, 0x18|SHIFT,         // O-U
+    0x19|SHIFT, 0x1A|SHIFT, 0x1B|SHIFT, 0x1C|SHIFT, 0x1D|SHIFT,                                 // V-Z
+    0x2F, 0x31, 0x30, 0x23|SHIFT, 0x2D|SHIFT, 0x35,                                             // [ \ ] ^ _ `
+    0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10,               // a-m
+    0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D,               // n-z
+    0x2F|SHIFT, 0x31|SHIFT, 0x30|SHIFT, 0x35|SHIFT                                              // { | } ~
+};
+
+/** DECLARATIONS ***************************************************/
+
+void KeySetClear(KEY_SET *set)
+{
+    memset(set, 0, sizeof(*set));
+}
+
+/********************************************************************
+ * Function:        bool KeySetPress(KEY_SET *set, uint8_t usage)
+ *
+ * Overview:        Adds usage to the set.  Returns false if it was
+ *                  already held or all six slots are taken.
+ *******************************************************************/
+bool KeySetPress(KEY_SET *set, uint8_t usage)
+{
+    uint8_t i;
+
+    if (usage == USAGE_NONE) return false;
+    if (USAGE_IS_MODIFIER(usage)) {
+        if (set->modifiers & USAGE_MODIFIER_BIT(usage)) return false;
+        set->modifiers |= USAGE_MODIFIER_BIT(usage);
+        return true;
+    }
+    for (i = 0; i < KEYSET_KEYS; i++) {
+        if (set->keys[i] == usage) return false;
+        if (set->keys[i] == USAGE_NONE) {
+            set->keys[i] = usage;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Later keys move up so the set stays in press order
+bool KeySetRelease(KEY_SET *set, uint8_t usage)
+{
+    uint8_t i;
+
+    if (USAGE_IS_MODIFIER(usage)) {
+        if (!(set->modifiers & USAGE_MODIFIER_BIT(usage))) return false;
+        set->modifiers &= ~USAGE_MODIFIER_BIT(usage);
+        return true;
+    }
+    for (i = 0; i < KEYSET_KEYS; i++) {
+        if (set->keys[i] == usage) {
+            for (; i < KEYSET_KEYS - 1; i++) {
+                set->keys[i] = set->keys[i + 1];
+            }
+            set->keys[KEYSET_KEYS - 1] = USAGE_NONE;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool KeySetHas(const KEY_SET *set, uint8_t usage)
+{
+    uint8_t i;
+
+    if (USAGE_IS_MODIFIER(usage)) return (set->modifiers & USAGE_MODIFIER_BIT(usage)) != 0;
+    for (i = 0; i < KEYSET_KEYS; i++) {
+        if (set->keys[i] == usage) return usage != USAGE_NONE;
+    }
+    return false;
+}
+
+// Keys that do not fit are left out; the host sees the first six
+void KeySetMerge(KEY_SET *dst, const KEY_SET *src)
+{
+    uint8_t i;
+
+    dst->modifiers |= src->modifiers;
+    for (i = 0; i < KEYSET_KEYS && src->keys[i] != USAGE_NONE; i++) {
+        KeySetPress(dst, src->keys[i]);
+    }
+}
+
+/********************************************************************
+ * Function:        bool KeyFromAscii(char c, uint8_t *usage,
+ *                                    uint8_t *modifiers)
+ *
+ * Overview:        Usage and modifier byte that type c on a US layout.
+ *                  Returns false for characters with no key.
+ *******************************************************************/
+bool KeyFromAscii(char c, uint8_t *usage, uint8_t *modifiers)
+{
+    uint8_t u;
+
+    if (c == '\n') {
+        u = USAGE_ENTER;
+    } else if (c == '\t') {
+        u = USAGE_TAB;
+    } else if (c >= ' ' && c <= '~') {
+        u = asciiUsage[c - ' '];
+    } else {
+        return false;
+    }
+    *usage = u & ~SHIFT;
+    *modifiers = (u & SHIFT) ? USAGE_MODIFIER_BIT(USAGE_LEFT_SHIFT) : 0;
+    return true;
+}
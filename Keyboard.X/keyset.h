@@ -0,0 +1,54 @@
+/********************************************************************
+ FileName:      keyset.h
+ Dependencies:  None
+ Processor:     PIC32MX270F256D, or a Linux host
+
+ The keys one source wants held: a modifier byte and up to six other
+ usages, in the order they were pressed.  The report path merges the
+ key sets of every source into one keyboard report.
+ *******************************************************************/
+#ifndef KEYSET_H
+#define KEYSET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** DEFINITIONS ****************************************************/
+#define KEYSET_KEYS             6       // Boot keyboard report limit
+
+// Keyboard/Keypad page usages (HID Usage Tables, chapter 10)
+#define USAGE_NONE              0x00
+#define USAGE_A                 0x04
+#define USAGE_1                 0x1E
+#define USAGE_ENTER             0x28
+#define USAGE_ESCAPE            0x29
+#define USAGE_BACKSPACE         0x2A
+#define USAGE_TAB               0x2B
+#define USAGE_SPACE             0x2C
+#define USAGE_LEFT_CTRL         0xE0
+#define USAGE_LEFT_SHIFT        0xE1
+#define USAGE_LEFT_ALT          0xE2
+#define USAGE_LEFT_GUI          0xE3
+#define USAGE_RIGHT_CTRL        0xE4
+#define USAGE_RIGHT_SHIFT       0xE5
+#define USAGE_RIGHT_ALT         0xE6
+#define USAGE_RIGHT_GUI         0xE7
+
+#define USAGE_IS_MODIFIER(u)    ((u) >= USAGE_LEFT_CTRL && (u) <= USAGE_RIGHT_GUI)
+#define USAGE_MODIFIER_BIT(u)   (1 << ((u) - USAGE_LEFT_CTRL))
+
+typedef struct
+{
+    uint8_t modifiers;
+    uint8_t keys[KEYSET_KEYS];      // Unused entries are USAGE_NONE
+} KEY_SET;
+
+/** PUBLIC PROTOTYPES **********************************************/
+void KeySetClear(KEY_SET *set);
+bool KeySetPress(KEY_SET *set, uint8_t usage);
+bool KeySetRelease(KEY_SET *set, uint8_t usage);
+bool KeySetHas(const KEY_SET *set, uint8_t usage);
+void KeySetMerge(KEY_SET *dst, const KEY_SET *src);
+bool KeyFromAscii(char c, uint8_t *usage, uint8_t *modifiers);
+
+#endif // KEYSET_H
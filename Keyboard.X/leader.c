@@ -0,0 +1,149 @@
+/** INCLUDES *******************************************************/
+#include <stddef.h>
+#include "leader.h"
+#include "macro_vm.h"
+#include "macro_image.h"
+
+/** VARIABLES ******************************************************/
+uint32_t leaderFires;
+uint8_t leaderLastMacro = LEADER_NO_MACRO;
+
+static const uint8_t *leaderTrie;
+static const uint8_t *leaderMacros;
+static bool active;
+static bool restartTimer;           // A key came; LeaderTasks() takes the time
+static uint16_t node;
+static uint32_t lastKeyUs;
+
+/** PRIVATE PROTOTYPES *********************************************/
+static uint16_t Child(uint16_t at, uint8_t usage);
+static void Fire(uint8_t id);
+
+/** DECLARATIONS ***************************************************/
+
+void LeaderInit(const uint8_t *trie, const uint8_t *macroImage)
+{
+    const LEADER_TRIE *hdr = (const LEADER_TRIE*)trie;
+
+    leaderTrie = NULL;
+    if (trie != NULL && hdr->magic == LEADER_TRIE_MAGIC && hdr->size > LEADER_ROOT) {
+        leaderTrie = trie;
+    }
+    leaderMacros = macroImage;
+    active = false;
+}
+
+/********************************************************************
+ * Function:        bool LeaderTrieValid(const uint8_t *trie,
+ *                                       uint16_t length)
+ *
+ * Overview:        Checks a trie that did not come with the firmware:
+ *                  its nodes fill it exactly and every child offset
+ *                  is the start of a later node, so no walk leaves it.
+ *******************************************************************/
+bool LeaderTrieValid(const uint8_t *trie, uint16_t length)
+{
+    const LEADER_TRIE *hdr = (const LEADER_TRIE*)trie;
+    uint8_t starts[LEADER_CHECK_MAX / 8] = { 0 };
+    uint16_t at, child, end;
+    uint8_t i;
+
+    if (length <= LEADER_ROOT || length > LEADER_CHECK_MAX) return false;
+    if (hdr->magic != LEADER_TRIE_MAGIC || hdr->size != length) return false;
+
+    for (at = LEADER_ROOT; at < length; at = end) {
+        if (at + 2 > length) return false;
+        end = at + 2 + LEADER_EDGE_SIZE * trie[at];
+        if (end > length) return false;
+        starts[at / 8] |= 1 << (at % 8);
+    }
+    for (at = LEADER_ROOT; at < length; at = end) {
+        end = at + 2 + LEADER_EDGE_SIZE * trie[at];
+        for (i = 0; i < trie[at]; i++) {
+            child = trie[at + 3 + i * LEADER_EDGE_SIZE] | ((uint16_t)trie[at + 4 + i * LEADER_EDGE_SIZE] << 8);
+            if (child <= at || child >= length || !(starts[child / 8] & (1 << (child % 8)))) return false;
+        }
+    }
+    return true;
+}
+
+void LeaderStart(void)
+{
+    if (leaderTrie == NULL) return;
+    active = true;
+    restartTimer = true;
+    node = LEADER_ROOT;
+}
+
+bool LeaderActive(void)
+{
+    return active;
+}
+
+/*
+ * Offset of the child for usage, or 0 (the header) if there is none.
+ * Branch-free halving, as in ComboLookup().
+ */
+static uint16_t Child(uint16_t at, uint8_t usage)
+{
+    const uint8_t *edge = &leaderTrie[at + 2];
+    uint8_t n = leaderTrie[at], half;
+
+    if (n == 0) return 0;
+    while (n > 1) {
+        half = n / 2;
+        edge = edge[half * LEADER_EDGE_SIZE] <= usage ? edge + half * LEADER_EDGE_SIZE : edge;
+        n -= half;
+    }
+    if (edge[0] != usage) return 0;
+    return edge[1] | ((uint16_t)edge[2] << 8);
+}
+
+static void Fire(uint8_t id)
+{
+    uint16_t entry;
+
+    active = false;
+    if (id == LEADER_NO_MACRO || leaderMacros == NULL) return;
+    entry = MacroImageEntry(leaderMacros, id);
+    if (entry != MACRO_NONE) MacroStart(leaderMacros, entry, MACRO_NO_TRIGGER);
+    leaderFires++;
+    leaderLastMacro = id;
+}
+
+/********************************************************************
+ * Function:        void LeaderKey(uint8_t usage)
+ *
+ * Overview:        Takes a key the keymap would have pressed while
+ *                  the leader is active, and moves one node down.
+ *******************************************************************/
+void LeaderKey(uint8_t usage)
+{
+    uint16_t child;
+
+    if (!active) return;
+    child = Child(node, usage);
+    if (child == 0) {
+        active = false;
+        return;
+    }
+    node = child;
+    if (leaderTrie[node] == 0) {
+        Fire(leaderTrie[node + 1]);     // Nothing longer to wait for
+    } else {
+        restartTimer = true;
+    }
+}
+
+// The timeout fires the sequence typed so far, if it is one
+void LeaderTasks(uint32_t nowUs)
+{
+    if (!active) return;
+    if (restartTimer) {
+        restartTimer = false;
+        lastKeyUs = nowUs;
+    }
+    if ((int32_t)(nowUs - lastKeyUs) >= (int32_t)LEADER_TIMEOUT_MS * 1000) {
+        Fire(leaderTrie[node + 1]);
+    }
+}
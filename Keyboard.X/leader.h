@@ -0,0 +1,58 @@
+/********************************************************************
+ FileName:      leader.h
+ Dependencies:  macro_image.h, macro_vm.h
+ Processor:     PIC32MX270F256D, or a Linux host
+
+ Leader-key sequences.  The leader key (ACT_LEADER) is followed by a
+ few typed keys; a sequence that matches one defined in the macro
+ source starts its macro.  The keys of a sequence are not sent.
+
+ tools/macroc stores the sequences as a trie in flash: one node per
+ prefix, each with its children sorted by usage.  A key moves one
+ node down, so matching costs one binary search over at most 256
+ children per key, whatever the number of sequences.
+
+ A sequence fires as soon as nothing longer can match.  Where a longer
+ one could, it fires when no key comes for LEADER_TIMEOUT_MS.  A key
+ no sequence continues with ends the leader without firing.
+
+ Trie layout, little endian, offsets from the start of the trie:
+   LEADER_TRIE header, then nodes, the root first
+   node:  count (uint8), macro id or LEADER_NO_MACRO (uint8),
+          then count edges of usage (uint8) and child offset (uint16)
+ *******************************************************************/
+#ifndef LEADER_H
+#define LEADER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** DEFINITIONS ****************************************************/
+#define LEADER_TIMEOUT_MS       1000    // Between keys of a sequence
+#define LEADER_TRIE_MAGIC       0x544C  // "LT"
+#define LEADER_NO_MACRO         0xFF
+
+typedef struct __attribute__ ((packed))
+{
+    uint16_t magic;
+    uint16_t size;                  // Whole trie, header included
+} LEADER_TRIE;
+
+#define LEADER_ROOT             sizeof(LEADER_TRIE)
+#define LEADER_EDGE_SIZE        3
+#define LEADER_CHECK_MAX        1024    // Largest trie LeaderTrieValid() accepts
+
+/** PUBLIC VARIABLES ***********************************************/
+extern const uint8_t leaderTrieDefault[];  // macros_default.c
+extern uint32_t leaderFires;        // Sequences that started a macro
+extern uint8_t leaderLastMacro;     // The macro the last one started
+
+/** PUBLIC PROTOTYPES **********************************************/
+void LeaderInit(const uint8_t *trie, const uint8_t *macroImage);
+bool LeaderTrieValid(const uint8_t *trie, uint16_t length);
+void LeaderStart(void);
+bool LeaderActive(void);
+void LeaderKey(uint8_t usage);
+void LeaderTasks(uint32_t nowUs);
+
+#endif // LEADER_H
@@ -0,0 +1,54 @@
+/** INCLUDES *******************************************************/
+#include <stddef.h>
+#include "macro_image.h"
+#include "textstream.h"
+
+/** DECLARATIONS ***************************************************/
+
+/********************************************************************
+ * Function:        bool MacroImageValid(const uint8_t *image,
+ *                                       uint32_t length)
+ *
+ * Overview:        Checks the header, the pair table and that every
+ *                  entry point lies inside the image.  length is the
+ *                  space the image was read from.
+ *******************************************************************/
+bool MacroImageValid(const uint8_t *image, uint32_t length)
+{
+    const MACRO_IMAGE *hdr = (const MACRO_IMAGE*)image;
+    uint32_t codeStart;
+    uint8_t i;
+
+    if (length < sizeof(MACRO_IMAGE)) return false;
+    if (hdr->magic != MACRO_IMAGE_MAGIC || hdr->version != MACRO_IMAGE_VERSION) return false;
+
+    codeStart = sizeof(MACRO_IMAGE) + 2 * hdr->count;
+    if (hdr->size < codeStart || hdr->size > length) return false;
+    if (hdr->pairs != 0) {
+        if (hdr->pairs < codeStart || hdr->pairs >= hdr->size) return false;
+        if (!TextPairsValid(image + hdr->pairs, hdr->size - hdr->pairs)) return false;
+    }
+
+    for (i = 0; i < hdr->count; i++) {
+        if (hdr->offset[i] == MACRO_NONE) continue;
+        if (hdr->offset[i] < codeStart || hdr->offset[i] >= hdr->size) return false;
+    }
+    return true;
+}
+
+// MACRO_NONE if the image has no macro with this id
+uint16_t MacroImageEntry(const uint8_t *image, uint8_t id)
+{
+    const MACRO_IMAGE *hdr = (const MACRO_IMAGE*)image;
+
+    if (id >= hdr->count) return MACRO_NONE;
+    return hdr->offset[id];
+}
+
+// The table MOP_TEXT_PACKED text was packed with, NULL if none
+const uint8_t *MacroImagePairs(const uint8_t *image)
+{
+    const MACRO_IMAGE *hdr = (const MACRO_IMAGE*)image;
+
+    return hdr->pairs != 0 ? image + hdr->pairs : NULL;
+}
@@ -0,0 +1,50 @@
+/********************************************************************
+ FileName:      macro_image.h
+ Dependencies:  macro_vm.h, textstream.h
+ Processor:     PIC32MX270F256D, or a Linux host
+
+ Compiled macro library, as written by tools/macroc.  A header and a
+ table of entry offsets, one per macro id, followed by bytecode.  Code
+ shared between macros is stored once and reached with MOP_CALL; it
+ sits right after the first macro that uses it so a macro's code is
+ read front to back.
+
+ Stream text is stored plain (MOP_TEXT) or packed (MOP_TEXT_PACKED)
+ with the image's one pair table, see textstream.h.  macroc packs it
+ when that makes the image smaller.
+
+ All multi-byte fields are little endian, matching the PIC32.
+ *******************************************************************/
+#ifndef MACRO_IMAGE_H
+#define MACRO_IMAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** DEFINITIONS ****************************************************/
+#define MACRO_IMAGE_MAGIC       0x4D43  // "CM"
+#define MACRO_IMAGE_VERSION     2       // 2: pair table
+#define MACRO_NONE              0       // Entry offset of an undefined id
+
+typedef struct __attribute__ ((packed))
+{
+    uint16_t magic;
+    uint8_t  version;
+    uint8_t  count;                 // Entries in offset[]
+    uint16_t size;                  // Whole image, header included
+    uint16_t pairs;                 // Offset of the pair table, 0 if there is none
+    uint16_t offset[];              // Entry point of each macro id
+} MACRO_IMAGE;
+
+// Macro ids the default keymap (macros/default.mac) refers to
+#define MACRO_BUTTON            0       // Key 0, the RB0 button, on the base layer
+
+/** PUBLIC VARIABLES ***********************************************/
+extern const uint8_t macroImageDefault[];   // macros_default.c
+
+/** PUBLIC PROTOTYPES **********************************************/
+bool MacroImageValid(const uint8_t *image, uint32_t length);
+uint16_t MacroImageEntry(const uint8_t *image, uint8_t id);
+const uint8_t *MacroImagePairs(const uint8_t *image);
+
+#endif // MACRO_IMAGE_H
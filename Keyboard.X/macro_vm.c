@@ -0,0 +1,281 @@
+/** INCLUDES *******************************************************/
+#include <string.h>
+#include "macro_vm.h"
+#include "textstream.h"
+#include "macro_image.h"
+
+/** VARIABLES ******************************************************/
+typedef struct
+{
+    const uint8_t *image;
+    uint16_t pc;
+    bool     active;
+    bool     waiting;               // MOP_DELAY deadline pending
+    bool     tapDown;               // MOP_TAP has pressed, release is next
+    bool     triggerHeld;
+    bool     streaming;             // MOP_TEXT has begun
+    uint8_t  trigger;
+    uint8_t  loopDepth;
+    uint8_t  callDepth;
+    uint32_t waitUntil;             // Microseconds
+    uint16_t loopStart[MACRO_LOOP_DEPTH];
+    uint8_t  loopLeft[MACRO_LOOP_DEPTH];
+    uint16_t callReturn[MACRO_CALL_DEPTH];
+    KEY_SET  keys;
+    TEXT_STREAM text;
+} MACRO;
+
+uint32_t macroSteps;
+
+static MACRO macros[MACRO_SLOTS];
+static uint8_t macroNext;           // Round robin start
+
+/** PRIVATE PROTOTYPES *********************************************/
+static bool MacroRun(MACRO *m, uint32_t nowUs);
+
+/** DECLARATIONS ***************************************************/
+
+void MacroInit(void)
+{
+    memset(macros, 0, sizeof(macros));
+    macroNext = 0;
+}
+
+/********************************************************************
+ * Function:        int8_t MacroStart(const uint8_t *image,
+ *                                    uint16_t entry, uint8_t trigger)
+ *
+ * Overview:        Starts the macro at image + entry in a free slot.
+ *                  The image must stay put while it runs.  trigger is
+ *                  the key that started it, for MOP_WAIT_RELEASE, or
+ *                  MACRO_NO_TRIGGER.  Returns the slot, or -1 if all
+ *                  slots are busy.
+ *******************************************************************/
+int8_t MacroStart(const uint8_t *image, uint16_t entry, uint8_t trigger)
+{
+    MACRO *m;
+    int8_t i;
+
+    for (i = 0; i < MACRO_SLOTS; i++) {
+        m = &macros[i];
+        if (m->active) continue;
+
+        memset(m, 0, sizeof(*m));
+        m->image = image;
+        m->pc = entry;
+        m->active = true;
+        m->trigger = trigger;
+        m->triggerHeld = trigger != MACRO_NO_TRIGGER;
+        return i;
+    }
+    return -1;
+}
+
+void MacroTriggerUp(uint8_t trigger)
+{
+    uint8_t i;
+
+    for (i = 0; i < MACRO_SLOTS; i++) {
+        if (macros[i].trigger == trigger) macros[i].triggerHeld = false;
+    }
+}
+
+// Drops the macros started by trigger; their keys go up in the next report
+void MacroStop(uint8_t trigger)
+{
+    uint8_t i;
+
+    for (i = 0; i < MACRO_SLOTS; i++) {
+        if (macros[i].active && macros[i].trigger == trigger) {
+            macros[i].active = false;
+        }
+    }
+}
+
+// Drops the macros playing from image, before it is overwritten
+void MacroStopImage(const uint8_t *image)
+{
+    uint8_t i;
+
+    for (i = 0; i < MACRO_SLOTS; i++) {
+        if (macros[i].active && macros[i].image == image) {
+            macros[i].active = false;
+        }
+    }
+}
+
+// Runs one macro until it changes its keys, blocks or hits the step limit
+static bool MacroRun(MACRO *m, uint32_t nowUs)
+{
+    const uint8_t *op, *text;
+    uint8_t steps, top, mods;
+    uint16_t ms;
+
+    if (m->waiting) {
+        if ((int32_t)(nowUs - m->waitUntil) < 0) return false;
+        m->waiting = false;
+    }
+
+    for (steps = 0; steps < MACRO_STEP_LIMIT; steps++) {
+        op = &m->image[m->pc];
+        macroSteps++;
+
+        switch (op[0])
+        {
+            case MOP_PRESS:
+                m->pc += 2;
+                if (KeySetPress(&m->keys, op[1])) return true;
+                break;
+
+            case MOP_RELEASE:
+                m->pc += 2;
+                if (KeySetRelease(&m->keys, op[1])) return true;
+                break;
+
+            case MOP_TAP:
+                // Two reports: the same pc runs once for each half
+                if (!m->tapDown) {
+                    m->tapDown = true;
+                    KeySetPress(&m->keys, op[1]);
+                } else {
+                    m->tapDown = false;
+                    m->pc += 2;
+                    KeySetRelease(&m->keys, op[1]);
+                }
+                return true;
+
+            case MOP_DELAY:
+            case MOP_DELAY_SHORT:
+                if (op[0] == MOP_DELAY) {
+                    ms = op[1] | ((uint16_t)op[2] << 8);
+                    m->pc += 3;
+                } else {
+                    ms = op[1];
+                    m->pc += 2;
+                }
+                if (ms) {
+                    m->waitUntil = nowUs + (uint32_t)ms * 1000;
+                    m->waiting = true;
+                    return false;
+                }
+                break;
+
+            case MOP_REPEAT:
+                if (m->loopDepth == MACRO_LOOP_DEPTH) goto stop;
+                m->pc += 2;
+                m->loopStart[m->loopDepth] = m->pc;
+                m->loopLeft[m->loopDepth] = op[1];
+                m->loopDepth++;
+                break;
+
+            case MOP_NEXT:
+                if (m->loopDepth == 0) goto stop;
+                top = m->loopDepth - 1;
+                if (m->loopLeft[top] != 0 && --m->loopLeft[top] == 0) {
+                    m->loopDepth--;
+                    m->pc += 1;
+                } else {
+                    m->pc = m->loopStart[top];
+                }
+                break;
+
+            case MOP_WAIT_RELEASE:
+                if (m->triggerHeld) return false;
+                m->pc += 1;
+                break;
+
+            case MOP_MODS:
+                mods = m->keys.modifiers;
+                m->keys.modifiers = op[1];
+                m->pc += 2;
+                if (mods != op[1]) return true;
+                break;
+
+            case MOP_CALL:
+                if (m->callDepth == MACRO_CALL_DEPTH) goto stop;
+                m->callReturn[m->callDepth++] = m->pc + 3;
+                m->pc = op[1] | ((uint16_t)op[2] << 8);
+                break;
+
+            case MOP_RET:
+                if (m->callDepth == 0) goto stop;
+                m->pc = m->callReturn[--m->callDepth];
+                break;
+
+            case MOP_TEXT:
+            case MOP_TEXT_PACKED:
+                if (!m->streaming) {
+                    m->streaming = true;
+                    text = &m->image[op[1] | ((uint16_t)op[2] << 8)];
+                    if (op[0] == MOP_TEXT) TextStreamBegin(&m->text, (const char *)text, &m->keys);
+                    else TextStreamBeginPacked(&m->text, text, MacroImagePairs(m->image), &m->keys);
+                }
+                if (TextStreamStep(&m->text, &m->keys)) return true;
+                m->streaming = false;
+                m->pc += 3;
+                break;
+
+            case MOP_END:
+            default:
+                goto stop;
+        }
+    }
+    return false;
+
+stop:
+    // Unknown opcodes end the macro rather than run off into data
+    m->active = false;
+    return m->keys.modifiers != 0 || m->keys.keys[0] != USAGE_NONE;
+}
+
+/********************************************************************
+ * Function:        bool MacroTasks(uint32_t nowUs)
+ *
+ * Overview:        Advances the running macros until one of them
+ *                  changes its key set.  Returns true if the merged
+ *                  report has to be rebuilt and sent.
+ *******************************************************************/
+bool MacroTasks(uint32_t nowUs)
+{
+    uint8_t n, i;
+
+    for (n = 0; n < MACRO_SLOTS; n++) {
+        i = (macroNext + n) % MACRO_SLOTS;
+        if (!macros[i].active) continue;
+        if (MacroRun(&macros[i], nowUs)) {
+            // The next call starts with the macro after this one
+            macroNext = (i + 1) % MACRO_SLOTS;
+            return true;
+        }
+    }
+    return false;
+}
+
+void MacroMerge(KEY_SET *out)
+{
+    uint8_t i;
+
+    for (i = 0; i < MACRO_SLOTS; i++) {
+        if (macros[i].active) KeySetMerge(out, &macros[i].keys);
+    }
+}
+
+bool MacroBusy(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < MACRO_SLOTS; i++) {
+        if (macros[i].active) return true;
+    }
+    return false;
+}
+
+bool MacroRunning(uint8_t trigger)
+{
+    uint8_t i;
+
+    for (i = 0; i < MACRO_SLOTS; i++) {
+        if (macros[i].active && macros[i].trigger == trigger) return true;
+    }
+    return false;
+}
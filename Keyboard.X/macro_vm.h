@@ -0,0 +1,74 @@
+/********************************************************************
+ FileName:      macro_vm.h
+ Dependencies:  keyset.h, textstream.h
+ Processor:     PIC32MX270F256D, or a Linux host
+
+ Macro bytecode interpreter.  Up to MACRO_SLOTS macros run at once,
+ each with its own program counter, loop stack and held keys.  The
+ report path ORs their key sets together with MacroMerge().
+
+ MacroTasks() never waits: a delay records a deadline and the macro
+ is skipped until it passes.  Each call advances the macros, round
+ robin, until one of them changes its key set, so at most one new
+ report comes out per call.  The caller only calls it when the last
+ report has gone to the host.
+
+ Bytecode: one opcode byte followed by its operands.  Multi-byte
+ operands are little endian.  Program counters and MOP_CALL targets
+ are offsets into the image the macro was started from, so code that
+ several macros share is stored once (see macro_image.h).
+
+ MOP_TEXT hands the macro's key set to textstream.c until the string
+ is typed, several characters per report.  It starts from the keys
+ the macro holds and leaves nothing held.  MOP_TEXT_PACKED does the
+ same with text packed against the image's pair table.
+ *******************************************************************/
+#ifndef MACRO_VM_H
+#define MACRO_VM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyset.h"
+
+/** DEFINITIONS ****************************************************/
+#define MACRO_SLOTS             4       // Macros running at the same time
+#define MACRO_LOOP_DEPTH        2       // Nested MOP_REPEAT
+#define MACRO_CALL_DEPTH        2       // Nested MOP_CALL
+#define MACRO_STEP_LIMIT        32      // Instructions per macro per call, bounds
+                                        // a loop that never touches a key
+
+// Opcodes                              Operands
+#define MOP_END                 0x00    // -            release this macro's keys and stop
+#define MOP_PRESS               0x01    // usage
+#define MOP_RELEASE             0x02    // usage
+#define MOP_TAP                 0x03    // usage        press, release on the next report
+#define MOP_DELAY               0x04    // ms (16 bit)
+#define MOP_REPEAT              0x05    // count        run up to MOP_NEXT count times,
+                                        //              0 = until the macro is stopped
+#define MOP_NEXT                0x06    // -
+#define MOP_WAIT_RELEASE        0x07    // -            until the trigger key is let go
+#define MOP_MODS                0x08    // mask         this macro's modifier byte
+#define MOP_CALL                0x09    // offset (16)  run the code at image offset
+#define MOP_RET                 0x0A    // -            back to the instruction after the call
+#define MOP_TEXT                0x0B    // offset (16)  type the NUL-terminated string at
+                                        //              image offset, see textstream.h
+#define MOP_DELAY_SHORT         0x0C    // ms (8 bit)
+#define MOP_TEXT_PACKED         0x0D    // offset (16)  MOP_TEXT for packed text
+
+#define MACRO_NO_TRIGGER        0xFF
+
+/** PUBLIC VARIABLES ***********************************************/
+extern uint32_t macroSteps;         // Instructions executed, for cycles/instruction
+
+/** PUBLIC PROTOTYPES **********************************************/
+void MacroInit(void);
+int8_t MacroStart(const uint8_t *image, uint16_t entry, uint8_t trigger);
+void MacroTriggerUp(uint8_t trigger);
+void MacroStop(uint8_t trigger);
+void MacroStopImage(const uint8_t *image);
+bool MacroTasks(uint32_t nowUs);
+void MacroMerge(KEY_SET *out);
+bool MacroBusy(void);
+bool MacroRunning(uint8_t trigger);
+
+#endif // MACRO_VM_H
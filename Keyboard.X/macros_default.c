@@ -0,0 +1,30 @@
+/* Generated by tools/macroc from macros/default.mac.  Do not edit. */
+#include <stddef.h>
+#include "macro_image.h"
+#include "keymap.h"
+#include "combo.h"
+#include "leader.h"
+#include "steno.h"
+
+const uint8_t macroImageDefault[] __attribute__ ((aligned(4))) = {
+    0x43, 0x4D, 0x02, 0x01, 0x0E, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x01, 0x05,
+    0x07, 0x00,
+};
+
+const uint8_t leaderTrieDefault[] = {
+    0x4C, 0x54, 0x06, 0x00, 0x00, 0xFF,
+};
+
+const STENO_DICT stenoDefault = { 0, NULL, NULL, NULL };
+
+const COMBO_TABLE comboDefault = { 0, 0, NULL };
+
+static const uint32_t keymapDefined[1] = {
+    0x00000001,
+};
+
+static const uint16_t keymapActions[1] = {
+    0x4000,     // key 0
+};
+
+const KEYMAP keymapDefault = { 1, 1, keymapDefined, keymapActions };
@@ -2,25 +2,36 @@
 #include "usb.h"
 #include "HardwareProfile.h"
 #include "usb_function_hid.h"
+#include "diagnostics.h"
+#include "tick.h"
+#include "telemetry.h"
+#include "hid_reports.h"
+#include "bootloader.h"
+#include "report_queue.h"
+#include "keyset.h"
+#include "macro_vm.h"
+#include "macro_image.h"
+#include "keymap.h"
+#include "taphold.h"
+#include "combo.h"
+#include "recorder.h"
+#include "leader.h"
+#include "steno.h"
+#include "typematic.h"
+#include "config.h"
+#include "idle.h"
 #include <stdio.h>
 
 /** CONFIGURATION **************************************************/
 #ifndef OVERRIDE_CONFIG_BITS
         
-    #pragma config UPLLEN   = ON            // USB PLL Enabled
-    #pragma config FPLLMUL  = MUL_20        // PLL Multiplier
-    #pragma config UPLLIDIV = DIV_2         // USB PLL Input Divider
-    #pragma config FPLLIDIV = DIV_2         // PLL Input Divider
-    #pragma config FPLLODIV = DIV_2         // PLL Output Divider
-    #pragma config FPBDIV   = DIV_1         // Peripheral Clock divisor
+    CLOCK_CONFIG_BITS()                     // Oscillator, PLLs, PB divisor (clock_profile.h)
     #pragma config FWDTEN   = OFF           // Watchdog Timer 
     #pragma config WDTPS    = PS1           // Watchdog Timer Postscale
-    #pragma config FCKSM    = CSDCMD        // Clock Switching & Fail Safe Clock Monitor
+    #pragma config FCKSM    = CSECMD        // Clock Switching on (clock.h), Fail Safe Clock Monitor off
     #pragma config OSCIOFNC = OFF           // CLKO Enable
-    #pragma config POSCMOD  = HS            // Primary Oscillator
     #pragma config IESO     = OFF           // Internal/External Switch-over
     #pragma config FSOSCEN  = OFF           // Secondary Oscillator Enable
-    #pragma config FNOSC    = PRIPLL        // Oscillator Selection
     #pragma config CP       = OFF           // Code Protect
     #pragma config BWP      = OFF           // Boot Flash Write Protect
     #pragma config PWP      = OFF           // Program Flash Write Protect
@@ -31,24 +42,75 @@
 
 
 /** VARIABLES ******************************************************/
-#define SYS_FREQ 40000000
 bool pressFlag = true;
-uint8_t report[8];
-USB_HANDLE USBInHandle;
+KEYBOARD_REPORT keyboardReport;
+KEYBOARD_REPORT lastReport;             // Last key state handed to the report queue
 int count = 0 ;
 
+// Bus error recovery
+#define HID_TX_TIMEOUT_MS       50      // 50 missed polls at bInterval = 1 ms
+bool usbRecoverPending = false;         // Set by the error handler, serviced in main()
+bool reportResync = false;              // Report state must be re-sent after a recovery
+
+// Remote wakeup; when a key may start it is up to idle.c
+#define RESUME_SIGNAL_MS        7       // Drive RESUME for 1-15 ms
+
+// Suspend
+#define SUSPEND_WAKE_IPL        1       // Above the CPU's priority 0, so they wake it
+uint32_t sleepWakeUs;                   // When the CPU last left Sleep
+bool resumePending = false;             // Not scanning again since
+
+// Macros
+#define KEY_BUTTON              0       // RB0, the only key so far (keymap key 0)
+bool buttonDown = false;
+
+// Firmware update
+#define UPDATE_RESET_DELAY_MS   20      // Lets the RESET request's status stage finish
+uint32_t resetStart;
+bool resetPending = false;
+
+// Configuration
+uint32_t readyUs;                       // Reset to a ready keymap, see config.h
+
+// Startup benchmark, CPU cycles with flash as out of reset and tuned
+#define BENCH_PASSES            64
+uint32_t benchPassBefore, benchPassAfter;   // One scanning pass with nothing to do
+uint32_t benchMacroBefore, benchMacroAfter; // One macro instruction
+static const uint8_t benchMacro[] = {
+    MOP_TAP, USAGE_A, MOP_TAP, USAGE_A + 1, MOP_TAP, USAGE_A + 2, MOP_TAP, USAGE_A + 3,
+    MOP_TAP, USAGE_A + 4, MOP_TAP, USAGE_A + 5, MOP_TAP, USAGE_A + 6, MOP_TAP, USAGE_A + 7,
+    MOP_END,
+};
+
 /** PRIVATE PROTOTYPES *********************************************/
 void delay_ms(unsigned int ms);
 void copyArray(uint8_t* arr1, uint8_t* arr2, int size);
 static void InitializeSystem(void);
+static bool NewFrame(void);
+static void USBRecoverEndpoints(void);
+static void RunMacros(void);
+static void BuildReport(void);
+static void SendSteno(void);
+static void RecordKeys(void);
+static void SendReport(void);
+static void SoftReset(void);
+static void SuspendSleep(void);
+static void Benchmark(void);
 void ProcessIO(void);
 void UserInit(void);
+void USBCBSendResume(void);
+void USBCBWakeFromSuspend(void);
 void YourHighPriorityISRCode();
 void YourLowPriorityISRCode();
 
 
 int main(void)
 {
+    uint32_t latency;
+
+    // A committed firmware update replaces this image before anything runs
+    BootApplyStagedImage();
+
     InitializeSystem();
     TRISBbits.TRISB0 = 1; // Set RB0 as input
 
@@ -57,20 +119,92 @@ int main(void)
         #if defined(USB_POLLING)
         USBDeviceTasks();  // Maintain the USB stack if polling is used
         #endif
+        TickUs();          // The microsecond clock must see every core timer wrap
+        ClockTasks(MacroBusy(), TickUs());
+
+        // A key press while the host sleeps wakes it, if it allowed us to.
+        // The stack marks the bus suspended; USBIsDeviceSuspended() reads
+        // the transceiver's USUSPEND, which only SuspendSleep() sets.
+        if (USBIsBusSuspended()) {
+            switch (IdleSuspendTasks(PORTBbits.RB0 == 1, USBGetRemoteWakeupStatus(), TickUs()))
+            {
+                case IDLE_SUSPEND_RESUME:
+                    USBCBSendResume();
+                    break;
+                case IDLE_SUSPEND_SLEEP:
+                    SuspendSleep();     // Flash writes went first: nothing to type
+                    break;
+                default:
+                    break;
+            }
+            continue;
+        }
 
         // Ensure USB is in the configured state before sending reports
         if (USBGetDeviceState() == CONFIGURED_STATE) {
-            // Check if the previous transfer is complete and the button is pressed
-            if (!HIDTxHandleBusy(USBInHandle) && (PORTBbits.RB0 == 1)) {  // Button pressed (active-low)
-                // Prepare the report for button press (send "b")
-                uint8_t report[8] = { 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00 };
-                USBInHandle = HIDTxPacket(HID_EP, report, 8);  // Send the HID report
+            if (resumePending) {
+                resumePending = false;
+                latency = TickUsSince(sleepWakeUs);
+                diagReport.resumeLastUs = latency;
+                if (latency > diagReport.resumeMaxUs) {
+                    diagReport.resumeMaxUs = latency;
+                }
+            }
+
+            // A report that never leaves the endpoint means the endpoint is
+            // wedged; re-arm it without dropping off the bus
+            if (HIDTxHandleBusy(USBInHandle) && !USBIsBusSuspended() &&
+                TickUsSince(USBInStart) >= HID_TX_TIMEOUT_MS * 1000ul) {
+                usbRecoverPending = true;
+            }
+            if (usbRecoverPending) {
+                USBRecoverEndpoints();
+            }
+
+            // Key edges go through combos and the tap-hold resolver to
+            // the keymap, which may start macros
+            if (PORTBbits.RB0 != buttonDown) {  // Button pressed (active-low)
+                buttonDown = PORTBbits.RB0;
+                ComboEvent(KEY_BUTTON, buttonDown, TickUs());
+            }
+            ComboTasks(TickUs());
+            TapHoldTasks(TickUs());
+            LeaderTasks(TickUs());
+            TypematicTasks(TickUs());
+            SendSteno();
+
+            // One macro step per report: wait until the last one has gone
+            if (ReportQueueKeysPending() == 0) {
+                RunMacros();
+                StenoTasks();
             }
-            else if (!HIDTxHandleBusy(USBInHandle)) {
-                // Prepare the report for no button press (send nothing)
-                uint8_t report[8] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-                USBInHandle = HIDTxPacket(HID_EP, report, 8);  // Send the HID report
+
+            // Only changes are queued; the host repeats held keys itself
+            BuildReport();
+            if (reportResync || memcmp(&keyboardReport, &lastReport, sizeof(keyboardReport)) != 0) {
+                SendReport();
             }
+            ReportQueueTasks();
+            RecordKeys();
+            DiagTasks();
+
+            // Firmware update: program flash behind the feature reports
+            HIDReportsTasks();
+            if (BootResetRequested()) {
+                if (!resetPending) {
+                    resetPending = true;
+                    resetStart = TickUs();
+                }
+                else if (TickUsSince(resetStart) >= UPDATE_RESET_DELAY_MS * 1000ul) {
+                    USBSoftDetach();
+                    delay_ms(100);      // Long enough for the host to see the detach
+                    SoftReset();
+                }
+            }
+
+            // Nothing left to do before the next event: wait for it
+            IdleTasks(IdleReady() && ReportQueueIdle() && !reportResync &&
+                      !usbRecoverPending && !resetPending && !BootBusy(), TickUs());
         }
     }
 }
@@ -89,11 +223,242 @@ static void InitializeSystem(void)
     tris_self_power = INPUT_PIN;    // See HardwareProfile.h
     #endif
     
+    ClockInit();
+    ClockFlashInit(true);
+    IdleInit();
     UserInit();
+    DiagInit();
+    MacroInit();
+    RecorderInit();
+    ConfigInit();
+    readyUs = TickUs();
+    StenoInit(&stenoDefault, STENO_OUT_PLOVER);
+    TypematicInit(TYPEMATIC_DELAY_MS, TYPEMATIC_RATE_HZ);
+    TapHoldInit(TAPHOLD_TERM_MS * 1000ul, TAPHOLD_PERMISSIVE_HOLD);
+    ComboInit(&comboDefault, COMBO_TERM_MS * 1000ul);
+    TelemetryInit();
+    Benchmark();
 
     USBDeviceInit(); 
 }
 
+static uint32_t BenchPass(void)
+{
+    TICK start = TickGet();
+    uint8_t i;
+
+    for (i = 0; i < BENCH_PASSES; i++) {
+        ComboTasks(TickUs());
+        TapHoldTasks(TickUs());
+        LeaderTasks(TickUs());
+        TypematicTasks(TickUs());
+        BuildReport();
+        (void)memcmp(&keyboardReport, &lastReport, sizeof(keyboardReport));
+    }
+    return TickSince(start) * 2 / BENCH_PASSES;
+}
+
+static uint32_t BenchMacro(void)
+{
+    uint32_t steps = macroSteps, cycles;
+    TICK start;
+
+    MacroStart(benchMacro, 0, MACRO_NO_TRIGGER);
+    start = TickGet();
+    while (MacroBusy()) MacroTasks(TickUs());
+    cycles = TickSince(start) * 2;
+    steps = macroSteps - steps;
+    macroSteps -= steps;                // Not the user's macros
+    return steps ? cycles / steps : 0;
+}
+
+/********************************************************************
+ * Function:        static void Benchmark(void)
+ *
+ * Overview:        Times a scanning pass and the macro interpreter
+ *                  with flash as it comes out of reset, then as
+ *                  ClockFlashInit() sets it, for DIAG_REPORT.  Runs
+ *                  once, at the full clock, before USB starts.
+ *******************************************************************/
+static void Benchmark(void)
+{
+    ClockFlashInit(false);
+    benchPassBefore = BenchPass();
+    benchMacroBefore = BenchMacro();
+    ClockFlashInit(true);
+    benchPassAfter = BenchPass();
+    benchMacroAfter = BenchMacro();
+}
+
+/********************************************************************
+ * Function:        static void RunMacros(void)
+ *
+ * Overview:        Advances the macro interpreter and records its cost
+ *                  in CPU cycles.  The core timer counts at half the
+ *                  CPU clock.
+ *******************************************************************/
+static void RunMacros(void)
+{
+    TICK start;
+    uint32_t cycles;
+
+    if (!MacroBusy()) return;
+
+    start = TickGet();
+    MacroTasks(TickUs());
+    cycles = TickSince(start) * 2;
+
+    diagReport.macroSteps = macroSteps;
+    diagReport.macroCycles += cycles;
+    if (cycles > diagReport.macroCyclesMax) {
+        diagReport.macroCyclesMax = cycles;
+    }
+}
+
+// keyboardReport = the keys every source wants held right now
+static void BuildReport(void)
+{
+    KEY_SET keys;
+
+    KeySetClear(&keys);
+    KeymapMerge(&keys);
+    MacroMerge(&keys);
+    StenoMerge(&keys);
+
+    memset(&keyboardReport, 0, sizeof(keyboardReport));
+    keyboardReport.reportId = REPORT_ID_KEYBOARD;
+    keyboardReport.modifiers = keys.modifiers;
+    memcpy(keyboardReport.keys, keys.keys, sizeof(keyboardReport.keys));
+}
+
+/********************************************************************
+ * Function:        static void SendSteno(void)
+ *
+ * Overview:        Queues Plover HID reports in the pass that finished
+ *                  the stroke, so they leave on the next poll.  Boot
+ *                  protocol has no report IDs to carry them; strokes
+ *                  made then are dropped.
+ *******************************************************************/
+static void SendSteno(void)
+{
+    const STENO_REPORT *report;
+
+    while ((report = StenoPendingReport()) != NULL) {
+        if (hidProtocol != BOOT_PROTOCOL &&
+            !ReportQueuePost(REPORT_PRIO_KEY, report, sizeof(*report))) {
+            return;
+        }
+        StenoReportSent();
+    }
+}
+
+// The recorder and ConfigTasks() get the keymap's keys once the report has gone
+static void RecordKeys(void)
+{
+    KEY_SET keys;
+
+    KeySetClear(&keys);
+    KeymapMerge(&keys);
+    RecorderTasks(&keys, TickUs());
+    ConfigTasks(&keys, NewFrame(), TickUs());
+
+    diagReport.recordArenaUsed = recordArenaUsed;
+    diagReport.recordArenaSize = RECORD_ARENA_SIZE;
+    diagReport.recordOverflows = recordOverflows;
+    diagReport.recordCommits = recordCommits;
+    diagReport.configReadyUs = readyUs;
+    diagReport.configSource = configSource;
+    diagReport.configCommits = configCommits;
+    diagReport.configFailures = configFailures;
+    diagReport.clockSwitches = clockSwitches;
+    diagReport.clockFullMs = clockFullMs;
+    diagReport.clockLowMs = clockLowMs;
+    diagReport.idleWaits = idleWaits;
+    diagReport.idleWaitMs = idleWaitMs;
+    diagReport.idleBusyPercent = idleBusyPercent;
+    diagReport.idleWakeLastUs = idleWakeLastUs;
+    diagReport.idleWakeMaxUs = idleWakeMaxUs;
+    diagReport.telemetryWrites = telemetryWrites;
+    diagReport.telemetryDrops = telemetryDrops;
+    diagReport.telemetryBytesLogged = telemetryBytesLogged;
+    diagReport.telemetryBytesSent = telemetryBytesSent;
+    diagReport.telemetryWriteCycles = telemetryWriteCycles;
+    diagReport.telemetryWriteCyclesMax = telemetryWriteCyclesMax;
+    diagReport.benchPassBefore = benchPassBefore;
+    diagReport.benchPassAfter = benchPassAfter;
+    diagReport.benchMacroBefore = benchMacroBefore;
+    diagReport.benchMacroAfter = benchMacroAfter;
+}
+
+// True on the first call after a SOF: the frame number has moved on
+static bool NewFrame(void)
+{
+    static uint8_t lastFrame;
+    uint8_t frame = U1FRML;
+
+    if (frame == lastFrame) return false;
+    lastFrame = frame;
+    return true;
+}
+
+/********************************************************************
+ * Function:        static void SendReport(void)
+ *
+ * Overview:        Queues keyboardReport ahead of any bulk reports.
+ *                  If the queue is full, lastReport is left alone so
+ *                  the next pass tries again.
+ *******************************************************************/
+static void SendReport(void)
+{
+    bool queued;
+
+    if (hidProtocol == BOOT_PROTOCOL) {
+        // Boot reports have no ID byte
+        queued = ReportQueuePost(REPORT_PRIO_KEY, &keyboardReport.modifiers, sizeof(keyboardReport) - 1);
+    } else {
+        queued = ReportQueuePost(REPORT_PRIO_KEY, &keyboardReport, sizeof(keyboardReport));
+    }
+    if (!queued) return;
+
+    lastReport = keyboardReport;
+    if (reportResync) {
+        reportResync = false;
+        diagReport.reportResyncs++;
+    }
+}
+
+/********************************************************************
+ * Function:        static void USBRecoverEndpoints(void)
+ *
+ * Overview:        Drops whatever is queued on the HID endpoint and
+ *                  re-enables it.  The device stays configured, so the
+ *                  host does not need to re-enumerate; the next poll
+ *                  re-sends the current key state.
+ *******************************************************************/
+static void USBRecoverEndpoints(void)
+{
+    usbRecoverPending = false;
+
+    USBCancelIO(HID_EP);
+    USBEnableEndpoint(HID_EP,USB_IN_ENABLED|USB_HANDSHAKE_ENABLED|USB_DISALLOW_SETUP);
+    ReportQueueRestart();
+
+    reportResync = true;
+    diagReport.endpointRearms++;
+    TelemetryEvent(TLM_EP_REARM, 0, TickUs());
+}
+
+static void SoftReset(void)
+{
+    __builtin_disable_interrupts();
+    SYSKEY = 0;
+    SYSKEY = 0xAA996655;
+    SYSKEY = 0x556699AA;
+    RSWRSTSET = 1;
+    (void)RSWRST;
+    while (1);
+}
+
 void copyArray(uint8_t* arr1, uint8_t* arr2, int size){
     for(int i=0;i<size;i++){
         arr2[i]=arr1[i];
@@ -114,12 +479,92 @@ void ProcessIO(void)
 
 void USBCBSuspend(void)
 {
-    
+    IdleSuspendStart(TickUs());
+    TelemetryEvent(TLM_SUSPEND, 0, TickUs());
 }
 
 void USBCBWakeFromSuspend(void)
 {
-    
+    USBSuspendControl = 0;              // Transceiver back to full power
+    IdleSuspendEnd();                   // The host may have resumed by itself
+
+    // Whatever sat on the endpoint over the suspend is not a stall
+    USBInStart = TickUs();
+    TelemetryEvent(TLM_RESUME, 0, TickUs());
+}
+
+/********************************************************************
+ * Function:        static void SuspendSleep(void)
+ *
+ * Overview:        Puts the CPU to Sleep for the rest of a suspend.
+ *                  Called from the main loop, never from the stack's
+ *                  callbacks, once the flash writes are done and the
+ *                  bus has been idle long enough that a key may wake
+ *                  the host at once (IdleSuspendTasks()).
+ *
+ *                  The scanner: while the bus is suspended the main
+ *                  loop goes no further than IdleSuspendTasks(), so
+ *                  no key edge reaches the engines, no report is
+ *                  built and the engines' timers do not run; RB0 is
+ *                  only read as the wake key.  The LEDs: this board
+ *                  has none.  The dev board's LED macros are
+ *                  commented out in HardwareProfile.h and the 44-pin
+ *                  part has no PORTD, so no pin is left driving one.
+ *
+ *                  Two sources wake it: bus activity (the stack has
+ *                  set USBActivityIE) and, only if the host enabled
+ *                  remote wakeup, a change on the button.  With
+ *                  interrupts globally off, as in this polling build,
+ *                  an enabled source above the CPU's priority ends
+ *                  the WAIT without taking a handler, and the main
+ *                  loop picks up from there.  A source that fired
+ *                  before the WAIT makes it return at once.
+ *
+ *                  Sleep stops the system clock, the core timer
+ *                  included: TickUs() does not see the time asleep.
+ *                  By now the CPU runs from the FRC (clock.h), which
+ *                  restarts at once; the primary oscillator and the
+ *                  USB PLL have to start and lock again before USB
+ *                  can answer.  DIAG_REPORT.resumeLastUs is the time
+ *                  from leaving Sleep to the first scanning pass.
+ *******************************************************************/
+static void SuspendSleep(void)
+{
+    if (USBGetRemoteWakeupStatus()) {
+        CNCONBbits.ON = 1;
+        CNENBbits.CNIEB0 = 1;
+        (void)PORTB;                    // Takes the current level as the reference
+        IFS1CLR = _IFS1_CNBIF_MASK;
+        IPC8bits.CNIP = SUSPEND_WAKE_IPL;
+        IEC1SET = _IEC1_CNBIE_MASK;
+    }
+    IPC7bits.USBIP = SUSPEND_WAKE_IPL;
+    IFS1CLR = _IFS1_USBIF_MASK;
+    IEC1SET = _IEC1_USBIE_MASK;
+    USBSuspendControl = 1;              // Transceiver to low power
+
+    SYSKEY = 0;
+    SYSKEY = 0xAA996655;
+    SYSKEY = 0x556699AA;
+    OSCCONSET = _OSCCON_SLPEN_MASK;     // WAIT is Sleep, not Idle
+    SYSKEY = 0;
+
+    diagReport.suspendSleeps++;
+    _wait();
+    sleepWakeUs = TickUs();
+    resumePending = true;
+
+    SYSKEY = 0;
+    SYSKEY = 0xAA996655;
+    SYSKEY = 0x556699AA;
+    OSCCONCLR = _OSCCON_SLPEN_MASK;
+    SYSKEY = 0;
+
+    // The stack polls U1OTGIR itself; only the CPU's view is undone
+    IEC1CLR = _IEC1_USBIE_MASK | _IEC1_CNBIE_MASK;
+    IFS1CLR = _IFS1_USBIF_MASK | _IFS1_CNBIF_MASK;
+    CNENBbits.CNIEB0 = 0;
+    CNCONBbits.ON = 0;
 }
 
 void USBCB_SOF_Handler(void)
@@ -131,11 +576,24 @@ void USBCB_SOF_Handler(void)
 
 void USBCBErrorHandler(void)
 {
-    
+    // The stack clears U1EIR once this returns
+    uint8_t flags = (uint8_t)U1EIR;
+
+    DiagRecordUSBErrors(flags);
+    TelemetryEvent(TLM_USB_ERROR, flags, TickUs());
+
+    // CRC, bit-stuff and time-out errors are retried by the host.  DMA
+    // and bus matrix errors leave the BDT in an unknown state.
+    if (flags & USB_EIR_FATAL) {
+        usbRecoverPending = true;
+    }
 }
 
 void USBCBCheckOtherReq(void)
 {
+    if (DiagCheckRequest()) return;
+    if (TelemetryCheckRequest()) return;
+    if (HIDReportsCheckRequest()) return;
     USBCheckHIDRequest();
 }
 
@@ -148,28 +606,60 @@ void USBCBInitEP(void)
 {
     //enable the HID endpoint
     USBEnableEndpoint(HID_EP,USB_IN_ENABLED|USB_HANDSHAKE_ENABLED|USB_DISALLOW_SETUP);
+
+    // The stack leaves DMA and bus matrix errors masked
+    U1EIE |= USB_EIR_DMAEF | USB_EIR_BMXEF;
 }
 
+/********************************************************************
+ * Function:        void USBCBSendResume(void)
+ *
+ * Overview:        Signals remote wakeup.  Only legal once the host has
+ *                  enabled it with SET_FEATURE(DEVICE_REMOTE_WAKEUP)
+ *                  and the bus has been idle for IDLE_RESUME_BUS_IDLE_MS.
+ *                  The RESUME pulse is timed on the core timer so it
+ *                  stays inside the 1-15 ms window at either clock.
+ *******************************************************************/
 void USBCBSendResume(void)
 {
-    static uint16_t delay_count;
-    
+    TICK start;
+    uint32_t latency;
+    bool keyed;
+
+    if (!USBGetRemoteWakeupStatus() || !USBIsBusSuspended()) return;
+
+    // Taken before USBCBWakeFromSuspend() clears it
+    keyed = idleWakeKeyPending;
+    latency = TickUsSince(idleWakeKeyUs);
+
+    // The stack will not see our own K-state as host activity
+    USBCBWakeFromSuspend();
+    USBBusIsSuspended = false;
+
+    ClockSettle();
+    start = TickGet();
     USBResumeControl = 1;                // Start RESUME signaling
-    
-    delay_count = 1800U;                // Set RESUME line for 1-13 ms
-    do
-    {
-        delay_count--;
-    }while(delay_count);
+    while (!TickElapsed(start, RESUME_SIGNAL_MS * TICKS_PER_MS));
     USBResumeControl = 0;
-}
 
+    diagReport.remoteWakeups++;
+    if (keyed) {
+        diagReport.wakeLatencyLastUs = latency;
+        if (latency > diagReport.wakeLatencyMaxUs) {
+            diagReport.wakeLatencyMaxUs = latency;
+        }
+        TelemetryEvent(TLM_REMOTE_WAKEUP, latency, TickUs());
+    }
+}
 
 bool USER_USB_CALLBACK_EVENT_HANDLER(USB_EVENT event, void *pdata, uint16_t size)
 {
     switch(event)
     {
         case EVENT_CONFIGURED: 
+            HIDReportsInit();
+            ReportQueueInit();
+            memset(&lastReport, 0, sizeof(lastReport));     // Send the key state afresh
             USBCBInitEP();
             break;
         case EVENT_SET_DESCRIPTOR:
@@ -200,15 +690,10 @@ bool USER_USB_CALLBACK_EVENT_HANDLER(USB_EVENT event, void *pdata, uint16_t size
 }
 
 void delay_ms(unsigned int ms) {
-    unsigned int tWait, tStart;
+    TICK tStart;
 
-    // Convert milliseconds to core timer ticks
-    tWait = (SYS_FREQ / 2000) * ms; // Core timer increments at half the system clock speed
+    ClockSettle();
+    tStart = TickGet();
 
-    // Read the starting core timer value
-    tStart = _CP0_GET_COUNT();
-
-    // Wait until the required number of ticks have passed
-    while ((_CP0_GET_COUNT() - tStart) < tWait);
+    while (!TickElapsed(tStart, ms * TICKS_PER_MS));
 }
-
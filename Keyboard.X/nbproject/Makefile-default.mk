@@ -51,17 +51,17 @@ OBJECTDIR=build/${CND_CONF}/${IMAGE_TYPE}
 DISTDIR=dist/${CND_CONF}/${IMAGE_TYPE}
 
 # Source Files Quoted if spaced
-SOURCEFILES_QUOTED_IF_SPACED=mouse.c usb_descriptors.c
+SOURCEFILES_QUOTED_IF_SPACED=mouse.c usb_descriptors.c diagnostics.c telemetry.c nvm.c crc32.c bootloader.c hid_reports.c report_queue.c tick.c keyset.c macro_vm.c macro_image.c macros_default.c keymap.c taphold.c combo.c textstream.c recorder.c leader.c steno.c typematic.c flashstore.c config.c clock.c idle.c
 
 # Object Files Quoted if spaced
-OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/mouse.o ${OBJECTDIR}/usb_descriptors.o
-POSSIBLE_DEPFILES=${OBJECTDIR}/mouse.o.d ${OBJECTDIR}/usb_descriptors.o.d
+OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/mouse.o ${OBJECTDIR}/usb_descriptors.o ${OBJECTDIR}/diagnostics.o ${OBJECTDIR}/telemetry.o ${OBJECTDIR}/nvm.o ${OBJECTDIR}/crc32.o ${OBJECTDIR}/bootloader.o ${OBJECTDIR}/hid_reports.o ${OBJECTDIR}/report_queue.o ${OBJECTDIR}/tick.o ${OBJECTDIR}/keyset.o ${OBJECTDIR}/macro_vm.o ${OBJECTDIR}/macro_image.o ${OBJECTDIR}/macros_default.o ${OBJECTDIR}/keymap.o ${OBJECTDIR}/taphold.o ${OBJECTDIR}/combo.o ${OBJECTDIR}/textstream.o ${OBJECTDIR}/recorder.o ${OBJECTDIR}/leader.o ${OBJECTDIR}/steno.o ${OBJECTDIR}/typematic.o ${OBJECTDIR}/flashstore.o ${OBJECTDIR}/config.o ${OBJECTDIR}/clock.o ${OBJECTDIR}/idle.o
+POSSIBLE_DEPFILES=${OBJECTDIR}/mouse.o.d ${OBJECTDIR}/usb_descriptors.o.d ${OBJECTDIR}/diagnostics.o.d ${OBJECTDIR}/telemetry.o.d ${OBJECTDIR}/nvm.o.d ${OBJECTDIR}/crc32.o.d ${OBJECTDIR}/bootloader.o.d ${OBJECTDIR}/hid_reports.o.d ${OBJECTDIR}/report_queue.o.d ${OBJECTDIR}/tick.o.d ${OBJECTDIR}/keyset.o.d ${OBJECTDIR}/macro_vm.o.d ${OBJECTDIR}/macro_image.o.d ${OBJECTDIR}/macros_default.o.d ${OBJECTDIR}/keymap.o.d ${OBJECTDIR}/taphold.o.d ${OBJECTDIR}/combo.o.d ${OBJECTDIR}/textstream.o.d ${OBJECTDIR}/recorder.o.d ${OBJECTDIR}/leader.o.d ${OBJECTDIR}/steno.o.d ${OBJECTDIR}/typematic.o.d ${OBJECTDIR}/flashstore.o.d ${OBJECTDIR}/config.o.d ${OBJECTDIR}/clock.o.d ${OBJECTDIR}/idle.o.d
 
 # Object Files
-OBJECTFILES=${OBJECTDIR}/mouse.o ${OBJECTDIR}/usb_descriptors.o
+OBJECTFILES=${OBJECTDIR}/mouse.o ${OBJECTDIR}/usb_descriptors.o ${OBJECTDIR}/diagnostics.o ${OBJECTDIR}/telemetry.o ${OBJECTDIR}/nvm.o ${OBJECTDIR}/crc32.o ${OBJECTDIR}/bootloader.o ${OBJECTDIR}/hid_reports.o ${OBJECTDIR}/report_queue.o ${OBJECTDIR}/tick.o ${OBJECTDIR}/keyset.o ${OBJECTDIR}/macro_vm.o ${OBJECTDIR}/macro_image.o ${OBJECTDIR}/macros_default.o ${OBJECTDIR}/keymap.o ${OBJECTDIR}/taphold.o ${OBJECTDIR}/combo.o ${OBJECTDIR}/textstream.o ${OBJECTDIR}/recorder.o ${OBJECTDIR}/leader.o ${OBJECTDIR}/steno.o ${OBJECTDIR}/typematic.o ${OBJECTDIR}/flashstore.o ${OBJECTDIR}/config.o ${OBJECTDIR}/clock.o ${OBJECTDIR}/idle.o
 
 # Source Files
-SOURCEFILES=mouse.c usb_descriptors.c
+SOURCEFILES=mouse.c usb_descriptors.c diagnostics.c telemetry.c nvm.c crc32.c bootloader.c hid_reports.c report_queue.c tick.c keyset.c macro_vm.c macro_image.c macros_default.c keymap.c taphold.c combo.c textstream.c recorder.c leader.c steno.c typematic.c flashstore.c config.c clock.c idle.c
 
 
 
@@ -107,6 +107,150 @@ ${OBJECTDIR}/mouse.o: mouse.c  .generated_files/flags/default/8e87994e2170db4877
 	@${RM} ${OBJECTDIR}/mouse.o 
 	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/mouse.o.d" -o ${OBJECTDIR}/mouse.o mouse.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
 	
+${OBJECTDIR}/idle.o: idle.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/idle.o.d 
+	@${RM} ${OBJECTDIR}/idle.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/idle.o.d" -o ${OBJECTDIR}/idle.o idle.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/clock.o: clock.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/clock.o.d 
+	@${RM} ${OBJECTDIR}/clock.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/clock.o.d" -o ${OBJECTDIR}/clock.o clock.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/config.o: config.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/config.o.d 
+	@${RM} ${OBJECTDIR}/config.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/config.o.d" -o ${OBJECTDIR}/config.o config.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/flashstore.o: flashstore.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flashstore.o.d 
+	@${RM} ${OBJECTDIR}/flashstore.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/flashstore.o.d" -o ${OBJECTDIR}/flashstore.o flashstore.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/typematic.o: typematic.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/typematic.o.d 
+	@${RM} ${OBJECTDIR}/typematic.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/typematic.o.d" -o ${OBJECTDIR}/typematic.o typematic.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/steno.o: steno.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/steno.o.d 
+	@${RM} ${OBJECTDIR}/steno.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/steno.o.d" -o ${OBJECTDIR}/steno.o steno.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/leader.o: leader.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/leader.o.d 
+	@${RM} ${OBJECTDIR}/leader.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/leader.o.d" -o ${OBJECTDIR}/leader.o leader.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/recorder.o: recorder.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/recorder.o.d 
+	@${RM} ${OBJECTDIR}/recorder.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/recorder.o.d" -o ${OBJECTDIR}/recorder.o recorder.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/textstream.o: textstream.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/textstream.o.d 
+	@${RM} ${OBJECTDIR}/textstream.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/textstream.o.d" -o ${OBJECTDIR}/textstream.o textstream.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/combo.o: combo.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/combo.o.d 
+	@${RM} ${OBJECTDIR}/combo.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/combo.o.d" -o ${OBJECTDIR}/combo.o combo.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/taphold.o: taphold.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/taphold.o.d 
+	@${RM} ${OBJECTDIR}/taphold.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/taphold.o.d" -o ${OBJECTDIR}/taphold.o taphold.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/keymap.o: keymap.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/keymap.o.d 
+	@${RM} ${OBJECTDIR}/keymap.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/keymap.o.d" -o ${OBJECTDIR}/keymap.o keymap.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/macros_default.o: macros_default.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/macros_default.o.d 
+	@${RM} ${OBJECTDIR}/macros_default.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/macros_default.o.d" -o ${OBJECTDIR}/macros_default.o macros_default.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/macro_image.o: macro_image.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/macro_image.o.d 
+	@${RM} ${OBJECTDIR}/macro_image.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/macro_image.o.d" -o ${OBJECTDIR}/macro_image.o macro_image.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/macro_vm.o: macro_vm.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/macro_vm.o.d 
+	@${RM} ${OBJECTDIR}/macro_vm.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/macro_vm.o.d" -o ${OBJECTDIR}/macro_vm.o macro_vm.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/keyset.o: keyset.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/keyset.o.d 
+	@${RM} ${OBJECTDIR}/keyset.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/keyset.o.d" -o ${OBJECTDIR}/keyset.o keyset.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/tick.o: tick.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/tick.o.d 
+	@${RM} ${OBJECTDIR}/tick.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/tick.o.d" -o ${OBJECTDIR}/tick.o tick.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/report_queue.o: report_queue.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/report_queue.o.d 
+	@${RM} ${OBJECTDIR}/report_queue.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/report_queue.o.d" -o ${OBJECTDIR}/report_queue.o report_queue.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/hid_reports.o: hid_reports.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/hid_reports.o.d 
+	@${RM} ${OBJECTDIR}/hid_reports.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/hid_reports.o.d" -o ${OBJECTDIR}/hid_reports.o hid_reports.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/bootloader.o: bootloader.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/bootloader.o.d 
+	@${RM} ${OBJECTDIR}/bootloader.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/bootloader.o.d" -o ${OBJECTDIR}/bootloader.o bootloader.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/crc32.o: crc32.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/crc32.o.d 
+	@${RM} ${OBJECTDIR}/crc32.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/crc32.o.d" -o ${OBJECTDIR}/crc32.o crc32.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/nvm.o: nvm.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/nvm.o.d 
+	@${RM} ${OBJECTDIR}/nvm.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/nvm.o.d" -o ${OBJECTDIR}/nvm.o nvm.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/telemetry.o: telemetry.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/telemetry.o.d 
+	@${RM} ${OBJECTDIR}/telemetry.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/telemetry.o.d" -o ${OBJECTDIR}/telemetry.o telemetry.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/diagnostics.o: diagnostics.c  .generated_files/flags/default/8e87994e2170db4877f9b1f0e786d064b756a0e5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/diagnostics.o.d 
+	@${RM} ${OBJECTDIR}/diagnostics.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE) -g -D__DEBUG   -fframe-base-loclist  -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/diagnostics.o.d" -o ${OBJECTDIR}/diagnostics.o diagnostics.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
 ${OBJECTDIR}/usb_descriptors.o: usb_descriptors.c  .generated_files/flags/default/96c6f9364f51002c5f0793845ad88d868d19e244 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
 	@${MKDIR} "${OBJECTDIR}" 
 	@${RM} ${OBJECTDIR}/usb_descriptors.o.d 
@@ -120,6 +264,150 @@ ${OBJECTDIR}/mouse.o: mouse.c  .generated_files/flags/default/abee757916e0969a1e
 	@${RM} ${OBJECTDIR}/mouse.o 
 	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/mouse.o.d" -o ${OBJECTDIR}/mouse.o mouse.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
 	
+${OBJECTDIR}/idle.o: idle.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/idle.o.d 
+	@${RM} ${OBJECTDIR}/idle.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/idle.o.d" -o ${OBJECTDIR}/idle.o idle.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/clock.o: clock.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/clock.o.d 
+	@${RM} ${OBJECTDIR}/clock.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/clock.o.d" -o ${OBJECTDIR}/clock.o clock.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/config.o: config.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/config.o.d 
+	@${RM} ${OBJECTDIR}/config.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/config.o.d" -o ${OBJECTDIR}/config.o config.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/flashstore.o: flashstore.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flashstore.o.d 
+	@${RM} ${OBJECTDIR}/flashstore.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/flashstore.o.d" -o ${OBJECTDIR}/flashstore.o flashstore.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/typematic.o: typematic.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/typematic.o.d 
+	@${RM} ${OBJECTDIR}/typematic.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/typematic.o.d" -o ${OBJECTDIR}/typematic.o typematic.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/steno.o: steno.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/steno.o.d 
+	@${RM} ${OBJECTDIR}/steno.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/steno.o.d" -o ${OBJECTDIR}/steno.o steno.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/leader.o: leader.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/leader.o.d 
+	@${RM} ${OBJECTDIR}/leader.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/leader.o.d" -o ${OBJECTDIR}/leader.o leader.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/recorder.o: recorder.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/recorder.o.d 
+	@${RM} ${OBJECTDIR}/recorder.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/recorder.o.d" -o ${OBJECTDIR}/recorder.o recorder.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/textstream.o: textstream.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/textstream.o.d 
+	@${RM} ${OBJECTDIR}/textstream.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/textstream.o.d" -o ${OBJECTDIR}/textstream.o textstream.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/combo.o: combo.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/combo.o.d 
+	@${RM} ${OBJECTDIR}/combo.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/combo.o.d" -o ${OBJECTDIR}/combo.o combo.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/taphold.o: taphold.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/taphold.o.d 
+	@${RM} ${OBJECTDIR}/taphold.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/taphold.o.d" -o ${OBJECTDIR}/taphold.o taphold.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/keymap.o: keymap.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/keymap.o.d 
+	@${RM} ${OBJECTDIR}/keymap.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/keymap.o.d" -o ${OBJECTDIR}/keymap.o keymap.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/macros_default.o: macros_default.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/macros_default.o.d 
+	@${RM} ${OBJECTDIR}/macros_default.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/macros_default.o.d" -o ${OBJECTDIR}/macros_default.o macros_default.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/macro_image.o: macro_image.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/macro_image.o.d 
+	@${RM} ${OBJECTDIR}/macro_image.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/macro_image.o.d" -o ${OBJECTDIR}/macro_image.o macro_image.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/macro_vm.o: macro_vm.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/macro_vm.o.d 
+	@${RM} ${OBJECTDIR}/macro_vm.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/macro_vm.o.d" -o ${OBJECTDIR}/macro_vm.o macro_vm.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/keyset.o: keyset.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/keyset.o.d 
+	@${RM} ${OBJECTDIR}/keyset.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/keyset.o.d" -o ${OBJECTDIR}/keyset.o keyset.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/tick.o: tick.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/tick.o.d 
+	@${RM} ${OBJECTDIR}/tick.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/tick.o.d" -o ${OBJECTDIR}/tick.o tick.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/report_queue.o: report_queue.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/report_queue.o.d 
+	@${RM} ${OBJECTDIR}/report_queue.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/report_queue.o.d" -o ${OBJECTDIR}/report_queue.o report_queue.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/hid_reports.o: hid_reports.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/hid_reports.o.d 
+	@${RM} ${OBJECTDIR}/hid_reports.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/hid_reports.o.d" -o ${OBJECTDIR}/hid_reports.o hid_reports.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/bootloader.o: bootloader.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/bootloader.o.d 
+	@${RM} ${OBJECTDIR}/bootloader.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/bootloader.o.d" -o ${OBJECTDIR}/bootloader.o bootloader.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/crc32.o: crc32.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/crc32.o.d 
+	@${RM} ${OBJECTDIR}/crc32.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/crc32.o.d" -o ${OBJECTDIR}/crc32.o crc32.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/nvm.o: nvm.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/nvm.o.d 
+	@${RM} ${OBJECTDIR}/nvm.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/nvm.o.d" -o ${OBJECTDIR}/nvm.o nvm.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/telemetry.o: telemetry.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/telemetry.o.d 
+	@${RM} ${OBJECTDIR}/telemetry.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/telemetry.o.d" -o ${OBJECTDIR}/telemetry.o telemetry.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
+${OBJECTDIR}/diagnostics.o: diagnostics.c  .generated_files/flags/default/abee757916e0969a1e76f0d719372b41da78fbd5 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/diagnostics.o.d 
+	@${RM} ${OBJECTDIR}/diagnostics.o 
+	${MP_CC}  $(MP_EXTRA_CC_PRE)  -g -x c -c -mprocessor=$(MP_PROCESSOR_OPTION)  -fno-common -MP -MMD -MF "${OBJECTDIR}/diagnostics.o.d" -o ${OBJECTDIR}/diagnostics.o diagnostics.c    -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mdfp="${DFP_DIR}"  
+	
 ${OBJECTDIR}/usb_descriptors.o: usb_descriptors.c  .generated_files/flags/default/809e253a62b0130cef9d9c1261da8658604b2a65 .generated_files/flags/default/da39a3ee5e6b4b0d3255bfef95601890afd80709
 	@${MKDIR} "${OBJECTDIR}" 
 	@${RM} ${OBJECTDIR}/usb_descriptors.o.d 
@@ -139,12 +427,12 @@ endif
 ifeq ($(TYPE_IMAGE), DEBUG_RUN)
 ${DISTDIR}/Keyboard.X.${IMAGE_TYPE}.${OUTPUT_SUFFIX}: ${OBJECTFILES}  nbproject/Makefile-${CND_CONF}.mk  PIC32_USK_USB_Device_HID_Mouse_wo_MAL.a  
 	@${MKDIR} ${DISTDIR} 
-	${MP_CC} $(MP_EXTRA_LD_PRE) -g   -mprocessor=$(MP_PROCESSOR_OPTION)  -o ${DISTDIR}/Keyboard.X.${IMAGE_TYPE}.${OUTPUT_SUFFIX} ${OBJECTFILES_QUOTED_IF_SPACED}    PIC32_USK_USB_Device_HID_Mouse_wo_MAL.a      -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)   -mreserve=data@0x0:0x1FC -mreserve=boot@0x1FC00490:0x1FC00BEF  -Wl,--defsym=__MPLAB_BUILD=1$(MP_EXTRA_LD_POST)$(MP_LINKER_FILE_OPTION),--defsym=__MPLAB_DEBUG=1,--defsym=__DEBUG=1,-D=__DEBUG_D,--no-code-in-dinit,--no-dinit-in-serial-mem,-Map="${DISTDIR}/${PROJECTNAME}.${IMAGE_TYPE}.map",--memorysummary,${DISTDIR}/memoryfile.xml -mdfp="${DFP_DIR}"
+	${MP_CC} $(MP_EXTRA_LD_PRE) -g   -mprocessor=$(MP_PROCESSOR_OPTION)  -o ${DISTDIR}/Keyboard.X.${IMAGE_TYPE}.${OUTPUT_SUFFIX} ${OBJECTFILES_QUOTED_IF_SPACED}    PIC32_USK_USB_Device_HID_Mouse_wo_MAL.a      -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mreserve=prog@0x9D01D400:0x9D03EFFF -mreserve=data@0x0:0x1FC -mreserve=boot@0x1FC00490:0x1FC00BEF  -Wl,--defsym=__MPLAB_BUILD=1$(MP_EXTRA_LD_POST)$(MP_LINKER_FILE_OPTION),--defsym=__MPLAB_DEBUG=1,--defsym=__DEBUG=1,-D=__DEBUG_D,--no-code-in-dinit,--no-dinit-in-serial-mem,-Map="${DISTDIR}/${PROJECTNAME}.${IMAGE_TYPE}.map",--memorysummary,${DISTDIR}/memoryfile.xml -mdfp="${DFP_DIR}"
 	
 else
 ${DISTDIR}/Keyboard.X.${IMAGE_TYPE}.${OUTPUT_SUFFIX}: ${OBJECTFILES}  nbproject/Makefile-${CND_CONF}.mk  PIC32_USK_USB_Device_HID_Mouse_wo_MAL.a 
 	@${MKDIR} ${DISTDIR} 
-	${MP_CC} $(MP_EXTRA_LD_PRE)  -mprocessor=$(MP_PROCESSOR_OPTION)  -o ${DISTDIR}/Keyboard.X.${IMAGE_TYPE}.${DEBUGGABLE_SUFFIX} ${OBJECTFILES_QUOTED_IF_SPACED}    PIC32_USK_USB_Device_HID_Mouse_wo_MAL.a      -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -Wl,--defsym=__MPLAB_BUILD=1$(MP_EXTRA_LD_POST)$(MP_LINKER_FILE_OPTION),--no-code-in-dinit,--no-dinit-in-serial-mem,-Map="${DISTDIR}/${PROJECTNAME}.${IMAGE_TYPE}.map",--memorysummary,${DISTDIR}/memoryfile.xml -mdfp="${DFP_DIR}"
+	${MP_CC} $(MP_EXTRA_LD_PRE)  -mprocessor=$(MP_PROCESSOR_OPTION)  -o ${DISTDIR}/Keyboard.X.${IMAGE_TYPE}.${DEBUGGABLE_SUFFIX} ${OBJECTFILES_QUOTED_IF_SPACED}    PIC32_USK_USB_Device_HID_Mouse_wo_MAL.a      -DXPRJ_default=$(CND_CONF)    $(COMPARISON_BUILD)  -mreserve=prog@0x9D01D400:0x9D03EFFF -Wl,--defsym=__MPLAB_BUILD=1$(MP_EXTRA_LD_POST)$(MP_LINKER_FILE_OPTION),--no-code-in-dinit,--no-dinit-in-serial-mem,-Map="${DISTDIR}/${PROJECTNAME}.${IMAGE_TYPE}.map",--memorysummary,${DISTDIR}/memoryfile.xml -mdfp="${DFP_DIR}"
 	${MP_CC_DIR}\\xc32-bin2hex ${DISTDIR}/Keyboard.X.${IMAGE_TYPE}.${DEBUGGABLE_SUFFIX} 
 endif
 
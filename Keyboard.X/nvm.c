@@ -0,0 +1,212 @@
+/** INCLUDES *******************************************************/
+#include <string.h>
+#include "nvm.h"
+
+#if defined(__PIC32MX__)
+#include <xc.h>
+#include <sys/attribs.h>
+#include <sys/kmem.h>
+#endif
+
+/** DEFINITIONS ****************************************************/
+#define NVMOP_WORD_PGM          0x1
+#define NVMOP_ROW_PGM           0x3
+#define NVMOP_PAGE_ERASE        0x4
+
+#define NVMCON_WR               0x8000
+#define NVMCON_WREN             0x4000
+#define NVMCON_ERR              0x3000  // WRERR | LVDERR
+
+/** DECLARATIONS ***************************************************/
+#if defined(__PIC32MX__)
+
+/********************************************************************
+ * Function:        static bool NVMUnlock(uint32_t op)
+ *
+ * Overview:        Runs one NVM operation with the unlock sequence.
+ *                  Instruction fetch from flash stalls until the
+ *                  controller finishes; the USB SIE keeps moving data
+ *                  into its buffers by DMA in the meantime.
+ *******************************************************************/
+static bool NVMUnlock(uint32_t op)
+{
+    uint32_t status;
+
+    NVMCON = NVMCON_WREN | op;
+
+    status = __builtin_disable_interrupts();
+    NVMKEY = 0xAA996655;
+    NVMKEY = 0x556699AA;
+    NVMCONSET = NVMCON_WR;
+    if (status & 0x1) __builtin_enable_interrupts();
+
+    while (NVMCON & NVMCON_WR);
+    NVMCONCLR = NVMCON_WREN;
+
+    return (NVMCON & NVMCON_ERR) == 0;
+}
+
+bool NVMErasePage(uint32_t addr)
+{
+    NVMADDR = addr;
+    return NVMUnlock(NVMOP_PAGE_ERASE);
+}
+
+bool NVMWriteRow(uint32_t addr, const void *src)
+{
+    NVMADDR = addr;
+    NVMSRCADDR = KVA_TO_PA(src);    // Source must be in RAM
+    return NVMUnlock(NVMOP_ROW_PGM);
+}
+
+bool NVMWriteWord(uint32_t addr, uint32_t data)
+{
+    NVMADDR = addr;
+    NVMDATA = data;
+    return NVMUnlock(NVMOP_WORD_PGM);
+}
+
+/********************************************************************
+ * Function:        void NVMCopyDownAndReset(const NVM_COPY *copy,
+ *                                           uint8_t count,
+ *                                           uint32_t clearPage)
+ *
+ * Overview:        Makes count flash copies, from src to dst, erases
+ *                  clearPage and resets the part.  Runs from RAM and
+ *                  touches nothing in program flash, since it erases
+ *                  the code that called it, so copy must be in RAM
+ *                  too.  Interrupts stay off until the reset.
+ *******************************************************************/
+static uint32_t copyRow[NVM_ROW_SIZE / 4];
+
+static void __longramfunc__ RamNVMOp(uint32_t addr, uint32_t op)
+{
+    NVMADDR = addr;
+    NVMCON = NVMCON_WREN | op;
+    NVMKEY = 0xAA996655;
+    NVMKEY = 0x556699AA;
+    NVMCONSET = NVMCON_WR;
+    while (NVMCON & NVMCON_WR);
+    NVMCONCLR = NVMCON_WREN;
+}
+
+void __longramfunc__ NVMCopyDownAndReset(const NVM_COPY *copy, uint8_t count, uint32_t clearPage)
+{
+    const volatile uint32_t *from;
+    uint32_t off, i;
+
+    __builtin_disable_interrupts();
+
+    for (; count; count--, copy++) {
+        for (off = 0; off < copy->length; off += NVM_ROW_SIZE) {
+            if ((off & (NVM_PAGE_SIZE - 1)) == 0) {
+                RamNVMOp(copy->dst + off, NVMOP_PAGE_ERASE);
+            }
+            from = (const volatile uint32_t*)PA_TO_KVA1(copy->src + off);  // Uncached
+            for (i = 0; i < NVM_ROW_SIZE / 4; i++) {
+                copyRow[i] = from[i];
+            }
+            NVMSRCADDR = KVA_TO_PA(copyRow);
+            RamNVMOp(copy->dst + off, NVMOP_ROW_PGM);
+        }
+    }
+    RamNVMOp(clearPage, NVMOP_PAGE_ERASE);
+
+    SYSKEY = 0;
+    SYSKEY = 0xAA996655;
+    SYSKEY = 0x556699AA;
+    RSWRSTSET = 1;
+    (void)RSWRST;
+    while (1);
+}
+
+#else   // Host simulation
+
+static uint8_t simFlash[NVM_PROGRAM_SIZE];
+static uint8_t simBoot[NVM_BOOT_SIZE];
+static bool simInit;
+uint32_t nvmSimBusyUs;
+uint32_t nvmSimPageErases;
+uint32_t nvmSimRowWrites;
+uint32_t nvmSimOpsLeft = 0xFFFFFFFF;
+
+// Power cut: once nvmSimOpsLeft runs out, operations do nothing
+static bool SimPower(void)
+{
+    if (nvmSimOpsLeft == 0) return false;
+    nvmSimOpsLeft--;
+    return true;
+}
+
+static uint8_t *SimPtr(uint32_t addr, uint32_t len)
+{
+    if (!simInit) {
+        memset(simFlash, 0xFF, sizeof(simFlash));
+        memset(simBoot, 0xFF, sizeof(simBoot));
+        simInit = true;
+    }
+    if (addr >= NVM_BOOT_BASE && addr - NVM_BOOT_BASE + len <= NVM_BOOT_SIZE) {
+        return &simBoot[addr - NVM_BOOT_BASE];
+    }
+    if (addr < NVM_PROGRAM_BASE || addr - NVM_PROGRAM_BASE + len > NVM_PROGRAM_SIZE) return NULL;
+    return &simFlash[addr - NVM_PROGRAM_BASE];
+}
+
+const void *NVMRead(uint32_t addr)
+{
+    return SimPtr(addr, 0);
+}
+
+bool NVMErasePage(uint32_t addr)
+{
+    uint8_t *p = SimPtr(addr, NVM_PAGE_SIZE);
+
+    if (p == NULL || (addr & (NVM_PAGE_SIZE - 1)) || !SimPower()) return false;
+    memset(p, 0xFF, NVM_PAGE_SIZE);
+    nvmSimBusyUs += NVM_PAGE_ERASE_US;
+    nvmSimPageErases++;
+    return true;
+}
+
+// Flash programming can only clear bits
+static void SimProgram(uint8_t *dst, const uint8_t *src, uint32_t len)
+{
+    while (len--) *dst++ &= *src++;
+}
+
+bool NVMWriteRow(uint32_t addr, const void *src)
+{
+    uint8_t *p = SimPtr(addr, NVM_ROW_SIZE);
+
+    if (p == NULL || (addr & (NVM_ROW_SIZE - 1)) || !SimPower()) return false;
+    SimProgram(p, src, NVM_ROW_SIZE);
+    nvmSimBusyUs += NVM_ROW_WRITE_US;
+    nvmSimRowWrites++;
+    return true;
+}
+
+bool NVMWriteWord(uint32_t addr, uint32_t data)
+{
+    uint8_t *p = SimPtr(addr, 4);
+
+    if (p == NULL || (addr & 3) || !SimPower()) return false;
+    SimProgram(p, (const uint8_t*)&data, 4);
+    nvmSimBusyUs += NVM_WORD_WRITE_US;
+    return true;
+}
+
+// No reset on the host: the copies are done and control returns
+void NVMCopyDownAndReset(const NVM_COPY *copy, uint8_t count, uint32_t clearPage)
+{
+    uint32_t off;
+
+    for (; count; count--, copy++) {
+        for (off = 0; off < copy->length; off += NVM_ROW_SIZE) {
+            if ((off & (NVM_PAGE_SIZE - 1)) == 0) NVMErasePage(copy->dst + off);
+            NVMWriteRow(copy->dst + off, NVMRead(copy->src + off));
+        }
+    }
+    NVMErasePage(clearPage);
+}
+
+#endif
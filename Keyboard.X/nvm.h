@@ -0,0 +1,104 @@
+/********************************************************************
+ FileName:      nvm.h
+ Dependencies:  None
+ Processor:     PIC32MX270F256D, or a Linux host (simulated NVM)
+
+ Program flash access through the NVM controller.  Addresses are
+ physical.  Flash is read through cached KSEG0 pointers (NVMRead());
+ erase and program go through the controller.
+
+ Building without __PIC32MX__ (host tools) swaps the controller for a
+ RAM-backed simulation that also keeps a running total of the time
+ the real part would spend erasing and programming.
+ *******************************************************************/
+#ifndef NVM_H
+#define NVM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** DEFINITIONS ****************************************************/
+#define NVM_PAGE_SIZE           1024    // Erase unit
+#define NVM_ROW_SIZE            128     // Row program unit
+#define NVM_PROGRAM_BASE        0x1D000000
+#define NVM_PROGRAM_SIZE        0x40000 // 256 KB
+
+// Typical PIC32MX1xx/2xx timings (DS60001168, TPE and TRW)
+#define NVM_PAGE_ERASE_US       20000
+#define NVM_ROW_WRITE_US        1500
+#define NVM_WORD_WRITE_US       20
+
+/* Flash map.  The linker may only use the application bank: everything
+   from FLASH_STAGE_BASE up to the exception vectors is reserved with
+   -mreserve=prog@0x9D01D400:0x9D03EFFF (nbproject linker options), so an
+   image that outgrows the bank fails to link.  Keep the two in step.
+   The staging bank holds a whole update: startup code, vectors and the
+   application bank (bootloader.h). */
+#define FLASH_APP_BASE          0x1D000000  // Running image
+#define FLASH_APP_SIZE          0x1D400     // 117 KB
+#define FLASH_STAGE_BASE        0x1D01D400  // Update image lands here first
+#define FLASH_STAGE_SIZE        (FLASH_STARTUP_SIZE + FLASH_VECTOR_SIZE + FLASH_APP_SIZE)
+#define FLASH_BOOT_HDR_BASE     0x1D03C000  // One page: staged image descriptor
+#define FLASH_RECORD_BASE       0x1D03C400  // Recorded macros, a page per slot (recorder.h)
+#define FLASH_RECORD_SIZE       0x800
+#define FLASH_DATA_BASE         0x1D03CC00  // Free for configuration storage
+#define FLASH_DATA_SIZE         0x2400      // 9 KB, up to the vector area
+#define FLASH_VECTOR_BASE       0x1D03F000  // exception_mem: EBASE, general exception
+#define FLASH_VECTOR_SIZE       0x1000      // and the interrupt vectors, to the top
+
+// Boot flash: reset code and crt0 below the configuration words page
+#define NVM_BOOT_BASE           0x1FC00000
+#define NVM_BOOT_SIZE           0xC00       // 3 KB
+#define FLASH_STARTUP_BASE      0x1FC00000  // kseg1_boot_mem, debug executive above it
+#define FLASH_STARTUP_SIZE      0x800       // Two pages; never the configuration page
+#define FLASH_RESET_VECTOR      0xBFC00000  // Where the core starts, KSEG1
+
+#define FLASH_RESERVED_BASE     0x1D01D400  // -mreserve=prog, physical
+
+#if FLASH_APP_BASE + FLASH_APP_SIZE > FLASH_STAGE_BASE
+    #error Application bank runs into the staging bank
+#endif
+#if FLASH_STAGE_BASE != FLASH_RESERVED_BASE
+    #error Staging bank does not start where the linker reservation does
+#endif
+#if FLASH_STAGE_BASE + FLASH_STAGE_SIZE > FLASH_BOOT_HDR_BASE || \
+    FLASH_BOOT_HDR_BASE + NVM_PAGE_SIZE > FLASH_RECORD_BASE || \
+    FLASH_RECORD_BASE + FLASH_RECORD_SIZE > FLASH_DATA_BASE
+    #error Flash map regions overlap
+#endif
+#if FLASH_DATA_BASE + FLASH_DATA_SIZE > FLASH_VECTOR_BASE
+    #error Flash data area reaches the exception vectors
+#endif
+#if FLASH_VECTOR_BASE + FLASH_VECTOR_SIZE > NVM_PROGRAM_BASE + NVM_PROGRAM_SIZE
+    #error Exception vectors run past the end of program flash
+#endif
+#if FLASH_STARTUP_BASE + FLASH_STARTUP_SIZE > NVM_BOOT_BASE + NVM_BOOT_SIZE - NVM_PAGE_SIZE
+    #error Startup code area reaches the configuration words page
+#endif
+
+typedef struct
+{
+    uint32_t dst;                   // Page aligned
+    uint32_t src;
+    uint32_t length;
+} NVM_COPY;
+
+/** PUBLIC PROTOTYPES **********************************************/
+#if defined(__PIC32MX__)
+#define NVMRead(addr)           ((const void*)((addr) | 0x80000000))  // KSEG0
+#define NVMReadUncached(addr)   ((const void*)((addr) | 0xA0000000))  // KSEG1, for just-written flash
+#else
+const void *NVMRead(uint32_t addr);
+#define NVMReadUncached(addr)   NVMRead(addr)
+extern uint32_t nvmSimBusyUs;       // Simulated erase/program time
+extern uint32_t nvmSimPageErases;
+extern uint32_t nvmSimRowWrites;
+extern uint32_t nvmSimOpsLeft;      // Erases/writes before a simulated power cut
+#endif
+
+bool NVMErasePage(uint32_t addr);
+bool NVMWriteRow(uint32_t addr, const void *src);
+bool NVMWriteWord(uint32_t addr, uint32_t data);
+void NVMCopyDownAndReset(const NVM_COPY *copy, uint8_t count, uint32_t clearPage);
+
+#endif // NVM_H
@@ -0,0 +1,235 @@
+/** INCLUDES *******************************************************/
+#include <string.h>
+#include "recorder.h"
+#include "macro_vm.h"
+#include "macro_image.h"
+#include "nvm.h"
+
+/** VARIABLES ******************************************************/
+#define RECORD_CODE_START       (sizeof(MACRO_IMAGE) + 2)  // After the one entry offset
+
+uint16_t recordArenaUsed;
+uint32_t recordOverflows;
+uint32_t recordCommits;
+
+// Word aligned: the NVM controller programs rows straight from it
+static uint32_t arenaWords[RECORD_ARENA_SIZE / 4];
+static uint8_t *const arena = (uint8_t*)arenaWords;
+static int8_t arenaSlot = -1;       // Whose recording the arena holds
+static bool recording;
+static bool recordFirst;            // Nothing captured yet, so no delay
+static uint32_t recordLastUs;
+
+static bool flashValid[RECORD_SLOTS];
+static bool commitPending;
+static uint8_t commitStep;          // 0 erases, then one row each
+
+static KEY_SET lastKeys;            // As of the last call
+static uint32_t idleSince;
+static bool idle;
+
+/** PRIVATE PROTOTYPES *********************************************/
+static void Finish(void);
+static bool Append(uint8_t op, uint16_t arg, uint8_t len);
+static void Capture(const KEY_SET *keys, uint32_t nowUs);
+
+/** DECLARATIONS ***************************************************/
+
+void RecorderInit(void)
+{
+    uint8_t slot;
+
+    for (slot = 0; slot < RECORD_SLOTS; slot++) {
+        flashValid[slot] = MacroImageValid(NVMReadUncached(FLASH_RECORD_BASE + slot * NVM_PAGE_SIZE),
+                                           NVM_PAGE_SIZE);
+    }
+    arenaSlot = -1;
+    recording = false;
+    commitPending = false;
+    recordArenaUsed = 0;
+    recordOverflows = 0;
+    recordCommits = 0;
+    KeySetClear(&lastKeys);
+    idle = false;
+}
+
+/********************************************************************
+ * Function:        void RecorderToggle(uint8_t slot)
+ *
+ * Overview:        The record key for slot: starts a recording, or
+ *                  ends the one running in that slot.  Other record
+ *                  keys do nothing while a recording runs.
+ *
+ *                  Starting one while another slot still waits for
+ *                  its flash write finishes that write first, since
+ *                  there is only one arena.  That only happens when
+ *                  two recordings come with no idle spell between.
+ *                  If the write fails RECORD_COMMIT_TRIES times the
+ *                  new recording does not start: the arena keeps the
+ *                  old one, which still plays and is written later.
+ *******************************************************************/
+void RecorderToggle(uint8_t slot)
+{
+    uint8_t tries = 0;
+
+    if (slot >= RECORD_SLOTS) return;
+    if (recording) {
+        if (slot == arenaSlot) Finish();
+        return;
+    }
+
+    if (commitPending && slot != arenaSlot) {
+        while (RecorderPending() && tries < RECORD_COMMIT_TRIES) {
+            if (!RecorderCommitTasks() && RecorderPending()) tries++;
+        }
+        if (RecorderPending()) return;
+    }
+    MacroStopImage(arena);
+    commitPending = false;
+    arenaSlot = slot;
+    recording = true;
+    recordFirst = true;
+    recordArenaUsed = RECORD_CODE_START;
+}
+
+// Ends the recording and queues it for flash
+static void Finish(void)
+{
+    MACRO_IMAGE *hdr = (MACRO_IMAGE*)arena;
+
+    arena[recordArenaUsed++] = MOP_END;
+    hdr->magic = MACRO_IMAGE_MAGIC;
+    hdr->version = MACRO_IMAGE_VERSION;
+    hdr->count = 1;
+    hdr->size = recordArenaUsed;
+    hdr->pairs = 0;
+    hdr->offset[0] = RECORD_CODE_START;
+
+    recording = false;
+    commitPending = true;
+    commitStep = 0;
+}
+
+// The recording to play for slot, or NULL if there is none
+const uint8_t *RecorderImage(uint8_t slot)
+{
+    if (slot >= RECORD_SLOTS) return NULL;
+    if (slot == arenaSlot) return recording ? NULL : arena;
+    if (!flashValid[slot]) return NULL;
+    return NVMReadUncached(FLASH_RECORD_BASE + slot * NVM_PAGE_SIZE);
+}
+
+// One instruction; a full arena ends the recording (MOP_END always fits)
+static bool Append(uint8_t op, uint16_t arg, uint8_t len)
+{
+    if (recordArenaUsed + len + 1 > RECORD_ARENA_SIZE) {
+        recordOverflows++;
+        Finish();
+        return false;
+    }
+    arena[recordArenaUsed] = op;
+    if (len > 1) arena[recordArenaUsed + 1] = arg & 0xFF;
+    if (len > 2) arena[recordArenaUsed + 2] = arg >> 8;
+    recordArenaUsed += len;
+    return true;
+}
+
+static void Capture(const KEY_SET *keys, uint32_t nowUs)
+{
+    uint32_t ms;
+    uint8_t i;
+
+    if (!recordFirst) {
+        ms = (nowUs - recordLastUs) / 1000;
+        if (ms > RECORD_GAP_MAX_MS) ms = RECORD_GAP_MAX_MS;
+        if (ms > 1) {
+            ms--;                   // Playback spends it waiting for the poll
+            if (ms <= 0xFF) {
+                if (!Append(MOP_DELAY_SHORT, ms, 2)) return;
+            } else {
+                if (!Append(MOP_DELAY, ms, 3)) return;
+            }
+        }
+    }
+    recordFirst = false;
+    recordLastUs = nowUs;
+
+    if (keys->modifiers != lastKeys.modifiers) {
+        if (!Append(MOP_MODS, keys->modifiers, 2)) return;
+    }
+    for (i = 0; i < KEYSET_KEYS && lastKeys.keys[i] != USAGE_NONE; i++) {
+        if (KeySetHas(keys, lastKeys.keys[i])) continue;
+        if (!Append(MOP_RELEASE, lastKeys.keys[i], 2)) return;
+    }
+    for (i = 0; i < KEYSET_KEYS && keys->keys[i] != USAGE_NONE; i++) {
+        if (KeySetHas(&lastKeys, keys->keys[i])) continue;
+        if (!Append(MOP_PRESS, keys->keys[i], 2)) return;
+    }
+}
+
+/********************************************************************
+ * Function:        void RecorderTasks(const KEY_SET *keys,
+ *                                     uint32_t nowUs)
+ *
+ * Overview:        Call once per main loop pass, after the report,
+ *                  with the keymap's key set.  Records a change if a
+ *                  recording runs, and writes a finished recording to
+ *                  flash once nothing has happened for RECORD_IDLE_MS.
+ *******************************************************************/
+void RecorderTasks(const KEY_SET *keys, uint32_t nowUs)
+{
+    if (memcmp(keys, &lastKeys, sizeof(KEY_SET)) != 0) {
+        if (recording) Capture(keys, nowUs);
+        lastKeys = *keys;
+    }
+
+    // The idle spell starts once the recording is finished
+    if (!commitPending || lastKeys.modifiers != 0 || lastKeys.keys[0] != USAGE_NONE || MacroBusy()) {
+        idleSince = nowUs;
+        idle = false;
+        return;
+    }
+    if (!idle && (int32_t)(nowUs - idleSince) >= (int32_t)RECORD_IDLE_MS * 1000) idle = true;
+    if (idle) RecorderCommitTasks();
+}
+
+/********************************************************************
+ * Function:        bool RecorderCommitTasks(void)
+ *
+ * Overview:        One step of the flash write: the page erase, or
+ *                  one row.  Also called while the bus is suspended.
+ *                  Returns true while there is more to do.  A failed
+ *                  step starts the write over at the next call.
+ *******************************************************************/
+bool RecorderCommitTasks(void)
+{
+    uint32_t page, row;
+    bool ok;
+
+    if (!commitPending) return false;
+    page = FLASH_RECORD_BASE + arenaSlot * NVM_PAGE_SIZE;
+    if (commitStep == 0) {
+        flashValid[arenaSlot] = false;
+        ok = NVMErasePage(page);
+    } else {
+        row = (commitStep - 1) * NVM_ROW_SIZE;
+        ok = NVMWriteRow(page + row, &arena[row]);
+    }
+    if (!ok) {
+        commitStep = 0;
+        return false;
+    }
+
+    commitStep++;
+    if ((uint32_t)(commitStep - 1) * NVM_ROW_SIZE < recordArenaUsed) return true;
+
+    commitPending = false;
+    flashValid[arenaSlot] = MacroImageValid(NVMReadUncached(page), NVM_PAGE_SIZE);
+    recordCommits++;
+    return false;
+}
+
+bool RecorderPending(void)
+{
+    return commitPending;
+}
@@ -0,0 +1,54 @@
+/********************************************************************
+ FileName:      recorder.h
+ Dependencies:  keyset.h, macro_vm.h, macro_image.h, nvm.h
+ Processor:     PIC32MX270F256D, or a Linux host (simulated NVM)
+
+ Records what the keymap types into a macro that plays back like any
+ other.  A record key (ACT_RECORD) starts and stops a recording, a
+ play key (ACT_PLAY) plays it.
+
+ The recording is bytecode in a preallocated RAM arena, laid out as a
+ one-macro MACRO_IMAGE: each change of the keymap's key set becomes
+ MOP_MODS, MOP_RELEASE and MOP_PRESS, with the time since the last
+ change in front of it.  Delays are compressed on the way in:
+
+   - the 1 ms a replayed report waits for its poll is taken off
+   - pauses longer than RECORD_GAP_MAX_MS are cut to it
+   - up to 255 ms takes MOP_DELAY_SHORT, 2 bytes instead of 3
+
+ A full arena ends the recording with what fits.
+
+ Capturing is a compare of two key sets after the report has gone.
+ The flash write waits until the keyboard is idle or the bus is
+ suspended, and then does one erase or row program per call, so it
+ never holds up a key.  Until it is done the recording plays from RAM.
+ Each slot has one flash page in the FLASH_RECORD area.
+ *******************************************************************/
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyset.h"
+
+/** DEFINITIONS ****************************************************/
+#define RECORD_SLOTS            2       // One flash page each
+#define RECORD_ARENA_SIZE       1024    // One flash page
+#define RECORD_GAP_MAX_MS       1000
+#define RECORD_IDLE_MS          2000    // No keys and no macros before a flash write
+#define RECORD_COMMIT_TRIES     3       // Flash writes a new recording waits through
+
+/** PUBLIC VARIABLES ***********************************************/
+extern uint16_t recordArenaUsed;    // Bytes of the current or last recording
+extern uint32_t recordOverflows;    // Recordings cut short by a full arena
+extern uint32_t recordCommits;      // Recordings written to flash
+
+/** PUBLIC PROTOTYPES **********************************************/
+void RecorderInit(void);
+void RecorderToggle(uint8_t slot);
+const uint8_t *RecorderImage(uint8_t slot);
+void RecorderTasks(const KEY_SET *keys, uint32_t nowUs);
+bool RecorderCommitTasks(void);
+bool RecorderPending(void);
+
+#endif // RECORDER_H
@@ -0,0 +1,186 @@
+/** INCLUDES *******************************************************/
+#include <string.h>
+#include "usb.h"
+#include "usb_function_hid.h"
+#include "report_queue.h"
+#include "hid_reports.h"
+#include "diagnostics.h"
+
+/** VARIABLES ******************************************************/
+typedef struct
+{
+    uint16_t len;
+    uint32_t posted;                // TickUs(), for the key wait statistic
+    uint8_t  data[REPORT_KEY_SIZE];
+} KEY_SLOT;
+
+typedef struct
+{
+    uint16_t len;
+    uint8_t  data[REPORT_BULK_SIZE];
+} BULK_SLOT;
+
+USB_HANDLE USBInHandle;
+uint32_t USBInStart;
+
+// Rings; the slot at the head stays put until its transfer is done
+// because the SIE reads straight out of it
+static KEY_SLOT keyQueue[REPORT_KEY_DEPTH];
+static uint8_t keyHead;
+static uint8_t keyCount;
+static BULK_SLOT bulkQueue[REPORT_BULK_DEPTH];
+static uint8_t bulkHead;
+static uint8_t bulkCount;
+
+// Transfer on the endpoint
+static bool xferActive;
+static bool xferBulk;               // Came from bulkQueue[bulkHead]
+static bool xferZlp;                // Still owes a zero-length packet
+static const uint8_t *xferData;     // Next packet
+static uint16_t xferLeft;           // Bytes not yet armed
+
+/** PRIVATE PROTOTYPES *********************************************/
+static bool ReportQueueStart(void);
+static void ReportQueueRetire(void);
+
+/** DECLARATIONS ***************************************************/
+
+void ReportQueueInit(void)
+{
+    keyHead = keyCount = 0;
+    bulkHead = bulkCount = 0;
+    xferActive = false;
+    USBInHandle = 0;
+}
+
+/********************************************************************
+ * Function:        bool ReportQueuePost(uint8_t prio,
+ *                                       const void *report,
+ *                                       uint16_t len)
+ *
+ * Overview:        Copies a report, ID byte included, into the queue
+ *                  for prio.  Returns false and counts a drop if the
+ *                  queue is full or the report too long for it.
+ *******************************************************************/
+bool ReportQueuePost(uint8_t prio, const void *report, uint16_t len)
+{
+    KEY_SLOT *key;
+    BULK_SLOT *bulk;
+
+    if (prio == REPORT_PRIO_KEY) {
+        if (len == 0 || len > REPORT_KEY_SIZE || keyCount == REPORT_KEY_DEPTH) {
+            diagReport.reportDrops++;
+            return false;
+        }
+        key = &keyQueue[(keyHead + keyCount) % REPORT_KEY_DEPTH];
+        memcpy(key->data, report, len);
+        key->len = len;
+        key->posted = TickUs();
+        keyCount++;
+    } else {
+        if (len == 0 || len > REPORT_BULK_SIZE || bulkCount == REPORT_BULK_DEPTH) {
+            diagReport.reportDrops++;
+            return false;
+        }
+        bulk = &bulkQueue[(bulkHead + bulkCount) % REPORT_BULK_DEPTH];
+        memcpy(bulk->data, report, len);
+        bulk->len = len;
+        bulkCount++;
+    }
+    return true;
+}
+
+// Picks the next transfer: key reports first
+static bool ReportQueueStart(void)
+{
+    KEY_SLOT *key;
+    uint32_t waitUs;
+
+    if (keyCount) {
+        key = &keyQueue[keyHead];
+        waitUs = TickUsSince(key->posted);
+        if (waitUs > diagReport.reportKeyWaitMaxUs) {
+            diagReport.reportKeyWaitMaxUs = waitUs;
+        }
+        xferData = key->data;
+        xferLeft = key->len;
+        xferBulk = false;
+    } else if (bulkCount) {
+        xferData = bulkQueue[bulkHead].data;
+        xferLeft = bulkQueue[bulkHead].len;
+        xferBulk = true;
+        diagReport.reportBulkTransfers++;
+    } else {
+        return false;
+    }
+
+    // A short packet ends the transfer; a read-sized transfer ends itself
+    xferZlp = (xferLeft % HID_INT_IN_EP_SIZE) == 0 && xferLeft < HID_INPUT_REPORT_MAX;
+    xferActive = true;
+    return true;
+}
+
+static void ReportQueueRetire(void)
+{
+    if (xferBulk) {
+        bulkHead = (bulkHead + 1) % REPORT_BULK_DEPTH;
+        bulkCount--;
+    } else {
+        keyHead = (keyHead + 1) % REPORT_KEY_DEPTH;
+        keyCount--;
+    }
+    xferActive = false;
+}
+
+/********************************************************************
+ * Function:        void ReportQueueTasks(void)
+ *
+ * Overview:        Arms the next packet on HID_EP once the last one
+ *                  has been taken by the host.  Call from the main
+ *                  loop while configured.
+ *******************************************************************/
+void ReportQueueTasks(void)
+{
+    uint16_t n;
+
+    if (HIDTxHandleBusy(USBInHandle)) return;
+
+    if (xferActive && xferLeft == 0 && !xferZlp) {
+        ReportQueueRetire();
+    }
+    if (!xferActive && !ReportQueueStart()) return;
+
+    n = xferLeft < HID_INT_IN_EP_SIZE ? xferLeft : HID_INT_IN_EP_SIZE;
+    if (n == 0) {
+        xferZlp = false;
+    }
+    USBInHandle = HIDTxPacket(HID_EP, (uint8_t*)xferData, n);
+    USBInStart = TickUs();
+    xferData += n;
+    xferLeft -= n;
+    diagReport.reportPackets++;
+}
+
+/********************************************************************
+ * Function:        void ReportQueueRestart(void)
+ *
+ * Overview:        Call after HID_EP has been cancelled and re-enabled.
+ *                  The transfer that was cut off is sent again from
+ *                  its first packet, after any waiting key reports.
+ *******************************************************************/
+void ReportQueueRestart(void)
+{
+    xferActive = false;
+    USBInHandle = 0;
+}
+
+// Key reports not yet taken by the host, the one on the endpoint included
+uint8_t ReportQueueKeysPending(void)
+{
+    return keyCount;
+}
+
+bool ReportQueueIdle(void)
+{
+    return !xferActive && keyCount == 0 && bulkCount == 0 && !HIDTxHandleBusy(USBInHandle);
+}
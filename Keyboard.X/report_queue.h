@@ -0,0 +1,51 @@
+/********************************************************************
+ FileName:      report_queue.h
+ Dependencies:  usb.h, usb_function_hid.h, tick.h
+ Processor:     PIC32MX270F256D
+
+ Input reports for HID_EP are posted here instead of going straight
+ to HIDTxPacket().  The queue copies each report, so callers may
+ reuse their buffer at once.
+
+ A report longer than HID_INT_IN_EP_SIZE goes out as one transfer
+ of full packets followed by a short one, each armed through the
+ handle USBTransferOnePacket() returned for the packet before it.  A
+ transfer whose length is a multiple of the packet size ends with a
+ zero-length packet unless it is as long as the host's read.
+
+ The host joins packets until a short one, so a transfer cannot be
+ interrupted once it has started.  Priority is decided between
+ transfers: every queued REPORT_PRIO_KEY report goes before the next
+ REPORT_PRIO_BULK one.  Key reports must fit one packet, so a key
+ report waits behind at most one bulk transfer, one bInterval per
+ packet.
+ *******************************************************************/
+#ifndef REPORT_QUEUE_H
+#define REPORT_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tick.h"
+
+/** DEFINITIONS ****************************************************/
+#define REPORT_PRIO_KEY         0       // Small and latency critical
+#define REPORT_PRIO_BULK        1       // Large, sent when no key report waits
+
+#define REPORT_KEY_DEPTH        8       // Enough for a macro's press/release runs
+#define REPORT_KEY_SIZE         HID_INT_IN_EP_SIZE
+#define REPORT_BULK_DEPTH       2
+#define REPORT_BULK_SIZE        256
+
+/** PUBLIC VARIABLES ***********************************************/
+extern USB_HANDLE USBInHandle;      // Last packet armed on HID_EP
+extern uint32_t USBInStart;         // TickUs() when it was armed
+
+/** PUBLIC PROTOTYPES **********************************************/
+void ReportQueueInit(void);
+bool ReportQueuePost(uint8_t prio, const void *report, uint16_t len);
+void ReportQueueTasks(void);
+void ReportQueueRestart(void);
+bool ReportQueueIdle(void);
+uint8_t ReportQueueKeysPending(void);
+
+#endif // REPORT_QUEUE_H
@@ -0,0 +1,241 @@
+/** INCLUDES *******************************************************/
+#include <stddef.h>
+#include "steno.h"
+#include "textstream.h"
+#include "hid_reports.h"
+
+/** VARIABLES ******************************************************/
+uint8_t stenoOutput = STENO_OUT_PLOVER;
+uint32_t stenoStrokes;
+uint32_t stenoDropped;
+
+static const STENO_DICT *stenoDict;
+static uint64_t held;               // Steno keys down
+static uint64_t chord;              // Every key down since the stroke began
+
+// Finished strokes, oldest at queueHead
+static uint64_t queue[STENO_QUEUE];
+static uint8_t queueHead;
+static uint8_t queueCount;
+
+static STENO_REPORT report;
+static bool reportReleased;         // The stroke's report has gone: the zero one is next
+
+static bool streaming;
+static TEXT_STREAM text;
+static char untranslated[STENO_TEXT_MAX];
+
+// Machine key -> bit in STENO_ORDER, or 0xFF for keys only Plover knows
+static const uint8_t fold[STENO_KEYS] = {
+    1, 1, 2, 3, 4, 5, 6, 7,                     // S1- S2- T- K- P- W- H- R-
+    8, 9, 10, 10, 10, 10, 11, 12,               // A- O- *1-*4 -E -U
+    13, 14, 15, 16, 17, 18, 19, 20, 21, 22,    // -F -R -P -B -L -G -T -S -D -Z
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,         // #1-#C
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/** PRIVATE PROTOTYPES *********************************************/
+static void Stroke(uint64_t keys);
+static void NextText(void);
+
+/** DECLARATIONS ***************************************************/
+
+void StenoInit(const STENO_DICT *dict, uint8_t output)
+{
+    stenoDict = dict;
+    stenoOutput = output;
+    held = 0;
+    chord = 0;
+    queueHead = 0;
+    queueCount = 0;
+    reportReleased = false;
+    streaming = false;
+}
+
+static void Stroke(uint64_t keys)
+{
+    if (queueCount == STENO_QUEUE) {
+        stenoDropped++;
+        return;
+    }
+    queue[(queueHead + queueCount) % STENO_QUEUE] = keys;
+    queueCount++;
+    stenoStrokes++;
+}
+
+/********************************************************************
+ * Function:        void StenoKey(uint8_t key, bool down)
+ *
+ * Overview:        Takes a steno key edge from the keymap.  The last
+ *                  key up queues the stroke.
+ *******************************************************************/
+void StenoKey(uint8_t key, bool down)
+{
+    uint64_t bit;
+
+    if (key == STENO_OUTPUT) {
+        if (down) stenoOutput ^= STENO_OUT_PLOVER ^ STENO_OUT_TEXT;
+        return;
+    }
+    if (key >= STENO_KEYS) return;
+    bit = 1ull << key;
+
+    if (down) {
+        held |= bit;
+        chord |= bit;
+        return;
+    }
+    if (!(held & bit)) return;
+    held &= ~bit;
+    if (held == 0) {
+        Stroke(chord);
+        chord = 0;
+    }
+}
+
+// The machine keys of a chord as a dictionary stroke
+uint32_t StenoFold(uint64_t keys)
+{
+    uint32_t stroke = 0;
+    uint8_t key;
+
+    for (key = 0; keys != 0; key++, keys >>= 1) {
+        if ((keys & 1) && fold[key] != 0xFF) stroke |= 1ul << fold[key];
+    }
+    return stroke;
+}
+
+/********************************************************************
+ * Function:        uint8_t StenoFormat(uint32_t stroke, char *text)
+ *
+ * Overview:        Writes a stroke the way steno is written, "STKPW"
+ *                  or "-FRS", and returns its length.  A hyphen marks
+ *                  the right-hand keys when there is no vowel or star
+ *                  to do it.  text needs STENO_TEXT_MAX.
+ *******************************************************************/
+uint8_t StenoFormat(uint32_t stroke, char *text)
+{
+    static const char order[] = STENO_ORDER;
+    uint8_t i, n = 0;
+
+    for (i = 0; order[i] != '\0'; i++) {
+        if (i == STENO_ORDER_RIGHT && (stroke >> STENO_ORDER_RIGHT) != 0 &&
+            (stroke & ((1ul << STENO_ORDER_RIGHT) - (1ul << STENO_ORDER_MIDDLE))) == 0) {
+            text[n++] = '-';
+        }
+        if (stroke & (1ul << i)) text[n++] = order[i];
+    }
+    text[n] = '\0';
+    return n;
+}
+
+/*
+ * The dictionary's text for a stroke, or NULL.  Branch-free halving,
+ * as in ComboLookup().
+ */
+const char *StenoLookup(uint32_t stroke)
+{
+    const uint32_t *base;
+    uint16_t n, half;
+
+    if (stenoDict == NULL || stenoDict->count == 0) return NULL;
+    base = stenoDict->strokes;
+    n = stenoDict->count;
+    while (n > 1) {
+        half = n / 2;
+        base = base[half] <= stroke ? base + half : base;
+        n -= half;
+    }
+    if (*base != stroke) return NULL;
+    return &stenoDict->strings[stenoDict->text[base - stenoDict->strokes]];
+}
+
+/********************************************************************
+ * Function:        const STENO_REPORT *StenoPendingReport(void)
+ *
+ * Overview:        The next Plover HID report, or NULL.  It stays
+ *                  pending until StenoReportSent(), so a full report
+ *                  queue only delays it.
+ *******************************************************************/
+const STENO_REPORT *StenoPendingReport(void)
+{
+    uint64_t keys;
+    uint8_t i;
+
+    if (stenoOutput != STENO_OUT_PLOVER || queueCount == 0) return NULL;
+
+    keys = reportReleased ? 0 : queue[queueHead];
+    report.reportId = REPORT_ID_STENO;
+    for (i = 0; i < sizeof(report.keys); i++, keys >>= 8) {
+        report.keys[i] = (uint8_t)keys;
+    }
+    return &report;
+}
+
+void StenoReportSent(void)
+{
+    if (queueCount == 0) return;
+    if (!reportReleased) {
+        reportReleased = true;
+        return;
+    }
+    reportReleased = false;
+    queueHead = (queueHead + 1) % STENO_QUEUE;
+    queueCount--;
+}
+
+// Starts typing the oldest stroke, following on from the keys sent last
+static void NextText(void)
+{
+    uint32_t stroke = StenoFold(queue[queueHead]);
+    const char *s = StenoLookup(stroke);
+    uint8_t n;
+
+    if (s == NULL) {
+        n = StenoFormat(stroke, untranslated);
+        untranslated[n++] = ' ';
+        untranslated[n] = '\0';
+        s = untranslated;
+    }
+    queueHead = (queueHead + 1) % STENO_QUEUE;
+    queueCount--;
+    reportReleased = false;
+
+    TextStreamBegin(&text, s, &text.sent);
+    streaming = true;
+}
+
+bool StenoBusy(void)
+{
+    return streaming || (stenoOutput == STENO_OUT_TEXT && queueCount != 0);
+}
+
+/********************************************************************
+ * Function:        void StenoTasks(void)
+ *
+ * Overview:        One report of translated text.  Call it when the
+ *                  last key report has gone, as for macros.  A stroke
+ *                  that is queued when the one before has run out of
+ *                  characters starts in the same report, without the
+ *                  release in between.
+ *******************************************************************/
+void StenoTasks(void)
+{
+    if (stenoOutput != STENO_OUT_TEXT && !streaming) return;
+
+    if (!streaming) {
+        if (queueCount == 0) return;
+        KeySetClear(&text.sent);
+        NextText();
+    }
+    while (*text.next == '\0' && queueCount != 0 && stenoOutput == STENO_OUT_TEXT) {
+        NextText();
+    }
+    if (!TextStreamStep(&text, &text.sent)) streaming = false;
+}
+
+void StenoMerge(KEY_SET *out)
+{
+    if (streaming) KeySetMerge(out, &text.sent);
+}
@@ -0,0 +1,110 @@
+/********************************************************************
+ FileName:      steno.h
+ Dependencies:  keyset.h, textstream.h, hid_reports.h
+ Processor:     PIC32MX270F256D, or a Linux host
+
+ Stenography.  Keys with an ACT_STENO action are not typed; each one
+ adds its bit to the chord, and the chord is one stroke once every
+ steno key is up again.  Strokes go out in one of two ways:
+
+   STENO_OUT_PLOVER  The Plover HID protocol: an input report with
+                     REPORT_ID_STENO and a 64-bit key map, followed by
+                     an all-zero one.  Plover does the translating.
+   STENO_OUT_TEXT    Translated here, through the dictionary macroc
+                     builds from "steno" statements, and typed with
+                     textstream.c.  A stroke that is not in the
+                     dictionary types its steno, as Plover would.
+
+ The steno keys are the 64 of the Plover HID machine, numbered as its
+ key names run; the report carries key n as Ordinal usage n, which is
+ bit n % 8 of byte n / 8.  The dictionary works on the 23 keys of
+ English steno (STENO_ORDER), to which the others fold: both S keys
+ to S-, the four stars to *, the number keys to #.  X1-X26 are only
+ seen by Plover.
+
+ Strokes wait in a queue of STENO_QUEUE, so a fast writer is not held
+ back by text that is still being typed.  Both outputs start on a
+ stroke in the main loop pass that saw its last key go up.
+ *******************************************************************/
+#ifndef STENO_H
+#define STENO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyset.h"
+
+/** DEFINITIONS ****************************************************/
+#define STENO_QUEUE             8       // Strokes not yet sent
+#define STENO_TEXT_MAX          32      // Longest untranslated stroke, "#STKPWHRAO*EUFRPBLGTSDZ "
+
+// Plover HID machine keys, ACT_STENO() arguments
+#define STENO_S1                0
+#define STENO_S2                1
+#define STENO_TL                2
+#define STENO_KL                3
+#define STENO_PL                4
+#define STENO_WL                5
+#define STENO_HL                6
+#define STENO_RL                7
+#define STENO_A                 8
+#define STENO_O                 9
+#define STENO_STAR1             10      // *1-*4: 10-13
+#define STENO_E                 14
+#define STENO_U                 15
+#define STENO_FR                16
+#define STENO_RR                17
+#define STENO_PR                18
+#define STENO_BR                19
+#define STENO_LR                20
+#define STENO_GR                21
+#define STENO_TR                22
+#define STENO_SR                23
+#define STENO_DR                24
+#define STENO_ZR                25
+#define STENO_NUM1              26      // #1-#C: 26-37
+#define STENO_X1                38      // X1-X26: 38-63
+#define STENO_KEYS              64
+#define STENO_OUTPUT            0xFF    // ACT_STENO(STENO_OUTPUT) switches the output
+
+// English steno, in stroke order; bit n of a dictionary stroke is
+// STENO_ORDER[n]
+#define STENO_ORDER             "#STKPWHRAO*EUFRPBLGTSDZ"
+#define STENO_ORDER_MIDDLE      8       // A-, first of the vowels and star
+#define STENO_ORDER_RIGHT       13      // -F, the first right-hand key
+
+#define STENO_OUT_PLOVER        0
+#define STENO_OUT_TEXT          1
+
+typedef struct __attribute__ ((packed))
+{
+    uint8_t reportId;               // REPORT_ID_STENO
+    uint8_t keys[STENO_KEYS / 8];
+} STENO_REPORT;
+
+typedef struct
+{
+    uint16_t count;
+    const uint32_t *strokes;        // Ascending
+    const uint16_t *text;           // [i]: offset of strokes[i]'s text
+    const char *strings;            // NUL-terminated texts
+} STENO_DICT;
+
+/** PUBLIC VARIABLES ***********************************************/
+extern const STENO_DICT stenoDefault;   // macros_default.c
+extern uint8_t stenoOutput;         // STENO_OUT_PLOVER or STENO_OUT_TEXT
+extern uint32_t stenoStrokes;
+extern uint32_t stenoDropped;       // Strokes that found the queue full
+
+/** PUBLIC PROTOTYPES **********************************************/
+void StenoInit(const STENO_DICT *dict, uint8_t output);
+void StenoKey(uint8_t key, bool down);
+uint32_t StenoFold(uint64_t chord);
+uint8_t StenoFormat(uint32_t stroke, char *text);
+const char *StenoLookup(uint32_t stroke);
+const STENO_REPORT *StenoPendingReport(void);
+void StenoReportSent(void);
+bool StenoBusy(void);
+void StenoTasks(void);
+void StenoMerge(KEY_SET *out);
+
+#endif // STENO_H
@@ -0,0 +1,231 @@
+/** INCLUDES *******************************************************/
+#include "taphold.h"
+#include "keymap.h"
+
+/** VARIABLES ******************************************************/
+typedef struct
+{
+    uint32_t time;                  // Microseconds
+    uint8_t  key;
+    bool     down;
+} KEY_EVENT;
+
+typedef struct
+{
+    uint8_t  key;
+    bool     down;
+    uint16_t action;
+} KEY_OUTPUT;
+
+#define OUTPUT_QUEUE            4       // One event's worth of output, plus a tap
+
+uint32_t tapHoldDrops;
+
+static uint32_t tapTermUs;
+static uint8_t tapPolicy;
+
+// Events not yet looked at, oldest first
+static KEY_EVENT input[TAPHOLD_QUEUE];
+static uint8_t inputHead, inputCount;
+
+// Events that came after the undecided key
+static KEY_EVENT held[TAPHOLD_QUEUE];
+static uint8_t heldCount;
+
+// Decided, waiting to reach the keymap
+static KEY_OUTPUT output[OUTPUT_QUEUE];
+static uint8_t outputHead, outputCount;
+
+static bool undecided;
+static uint8_t undecidedKey;
+static uint16_t undecidedAction;
+static uint32_t undecidedSince;
+
+/** PRIVATE PROTOTYPES *********************************************/
+static void Output(uint8_t key, bool down, uint16_t action);
+static bool ApplyOutput(uint64_t *pressed);
+static void PushFront(const KEY_EVENT *ev);
+static void Decide(bool hold);
+static void ProcessEvent(const KEY_EVENT *ev);
+
+/** DECLARATIONS ***************************************************/
+
+void TapHoldInit(uint32_t termUs, uint8_t policy)
+{
+    tapTermUs = termUs;
+    tapPolicy = policy;
+    inputHead = inputCount = 0;
+    heldCount = 0;
+    outputHead = outputCount = 0;
+    undecided = false;
+    tapHoldDrops = 0;
+}
+
+// Called by the key scanner for every edge
+bool TapHoldEvent(uint8_t key, bool down, uint32_t timeUs)
+{
+    KEY_EVENT *ev;
+
+    if (key >= KEYMAP_MAX_KEYS) return false;
+    if (inputCount + heldCount >= TAPHOLD_QUEUE) {
+        tapHoldDrops++;
+        return false;
+    }
+    ev = &input[(inputHead + inputCount) % TAPHOLD_QUEUE];
+    ev->time = timeUs;
+    ev->key = key;
+    ev->down = down;
+    inputCount++;
+    return true;
+}
+
+static void Output(uint8_t key, bool down, uint16_t action)
+{
+    KEY_OUTPUT *o = &output[(outputHead + outputCount) % OUTPUT_QUEUE];
+
+    o->key = key;
+    o->down = down;
+    o->action = action;
+    outputCount++;
+}
+
+/*
+ * Passes decided events to the keymap.  A release of a key pressed in
+ * the same call waits, or the host would never see the press.
+ */
+static bool ApplyOutput(uint64_t *pressed)
+{
+    KEY_OUTPUT *o;
+
+    while (outputCount) {
+        o = &output[outputHead];
+        if (o->down) {
+            KeymapPress(o->key, o->action);
+            *pressed |= 1ull << o->key;
+        } else {
+            if (*pressed & (1ull << o->key)) return false;
+            KeymapRelease(o->key);
+        }
+        outputHead = (outputHead + 1) % OUTPUT_QUEUE;
+        outputCount--;
+    }
+    return true;
+}
+
+static void PushFront(const KEY_EVENT *ev)
+{
+    inputHead = (inputHead + TAPHOLD_QUEUE - 1) % TAPHOLD_QUEUE;
+    input[inputHead] = *ev;
+    inputCount++;
+}
+
+/********************************************************************
+ * Function:        static void Decide(bool hold)
+ *
+ * Overview:        Settles the undecided key and puts the events held
+ *                  behind it back at the front of the input, so they
+ *                  are looked up under the layers the decision left.
+ *******************************************************************/
+static void Decide(bool hold)
+{
+    uint16_t action = undecidedAction;
+    uint8_t n;
+
+    if (!hold) {
+        Output(undecidedKey, true, ACT_KEY(ACT_ARG(action)));
+        Output(undecidedKey, false, 0);
+    } else if (ACT_TYPE(action) == ACT_LT(0, 0)) {
+        Output(undecidedKey, true, ACT_MO(ACT_HOLD_ARG(action)));
+    } else if (ACT_TYPE(action) == ACT_MT_R(0, 0)) {
+        Output(undecidedKey, true, ACT_MODS(ACT_HOLD_ARG(action) << 4));
+    } else {
+        Output(undecidedKey, true, ACT_MODS(ACT_HOLD_ARG(action)));
+    }
+    undecided = false;
+
+    for (n = heldCount; n > 0; n--) {
+        PushFront(&held[n - 1]);
+    }
+    heldCount = 0;
+}
+
+static void ProcessEvent(const KEY_EVENT *ev)
+{
+    uint16_t action;
+    uint8_t i;
+
+    if (undecided) {
+        if (ev->key == undecidedKey) {
+            // Let go within the term.  (A repeated press cannot happen.)
+            if (!ev->down) Decide(false);
+            return;
+        }
+        held[heldCount++] = *ev;
+
+        if (ev->down && (tapPolicy & TAPHOLD_HOLD_ON_OTHER_KEY)) {
+            Decide(true);
+        } else if (!ev->down && (tapPolicy & TAPHOLD_PERMISSIVE_HOLD)) {
+            // Only keys pressed after the tap-hold key count
+            for (i = 0; i < heldCount - 1; i++) {
+                if (held[i].key == ev->key && held[i].down) {
+                    Decide(true);
+                    break;
+                }
+            }
+        }
+        return;
+    }
+
+    if (!ev->down) {
+        Output(ev->key, false, 0);
+        return;
+    }
+
+    action = KeymapResolve(ev->key);
+    if (ACT_IS_TAP_HOLD(action)) {
+        undecided = true;
+        undecidedKey = ev->key;
+        undecidedAction = action;
+        undecidedSince = ev->time;
+        return;
+    }
+    Output(ev->key, true, action);
+}
+
+/********************************************************************
+ * Function:        void TapHoldTasks(uint32_t nowUs)
+ *
+ * Overview:        Feeds queued events to the keymap, one at a time so
+ *                  each is looked up after the ones before it have
+ *                  taken effect.  Call once per main loop pass.
+ *******************************************************************/
+void TapHoldTasks(uint32_t nowUs)
+{
+    uint64_t pressed = 0;
+    KEY_EVENT ev;
+    uint32_t t;
+
+    for (;;) {
+        if (!ApplyOutput(&pressed)) return;
+
+        // The term runs out before any event that came after it
+        if (undecided) {
+            t = inputCount ? input[inputHead].time : nowUs;
+            if ((int32_t)(t - undecidedSince) >= (int32_t)tapTermUs) {
+                Decide(true);
+                continue;
+            }
+        }
+        if (inputCount == 0) return;
+
+        ev = input[inputHead];
+        inputHead = (inputHead + 1) % TAPHOLD_QUEUE;
+        inputCount--;
+        ProcessEvent(&ev);
+    }
+}
+
+bool TapHoldBusy(void)
+{
+    return undecided || inputCount != 0 || outputCount != 0;
+}
@@ -0,0 +1,48 @@
+/********************************************************************
+ FileName:      taphold.h
+ Dependencies:  keymap.h
+ Processor:     PIC32MX270F256D, or a Linux host
+
+ Tap-hold resolver between the key scanner and the keymap.  A key
+ whose action is ACT_MT or ACT_LT sends its tap key if it is let go
+ within the tapping term and its hold action otherwise.  Policies can
+ decide a hold sooner:
+
+   TAPHOLD_PERMISSIVE_HOLD      another key is pressed and released
+                                while the tap-hold key is down
+   TAPHOLD_HOLD_ON_OTHER_KEY    another key is pressed at all
+
+ Only the events after an undecided key are held back; they are
+ replayed the moment it is decided, in their original order.  With
+ nothing undecided, events reach the keymap in the same
+ TapHoldTasks() call that sees them.
+
+ Events carry microsecond timestamps, so the decision depends on when
+ the keys moved and not on when the main loop got around to them.  A
+ key that goes down and up in one call has its release kept for the
+ next call, so the report in between shows it.
+ *******************************************************************/
+#ifndef TAPHOLD_H
+#define TAPHOLD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** DEFINITIONS ****************************************************/
+#define TAPHOLD_QUEUE           16      // Key events not yet passed on
+#define TAPHOLD_TERM_MS         200     // Default tapping term
+
+// Policies
+#define TAPHOLD_PERMISSIVE_HOLD     0x01
+#define TAPHOLD_HOLD_ON_OTHER_KEY   0x02
+
+/** PUBLIC VARIABLES ***********************************************/
+extern uint32_t tapHoldDrops;       // Events lost to a full queue
+
+/** PUBLIC PROTOTYPES **********************************************/
+void TapHoldInit(uint32_t termUs, uint8_t policy);
+bool TapHoldEvent(uint8_t key, bool down, uint32_t timeUs);
+void TapHoldTasks(uint32_t nowUs);
+bool TapHoldBusy(void);
+
+#endif // TAPHOLD_H
@@ -0,0 +1,144 @@
+/** INCLUDES *******************************************************/
+#include <string.h>
+#include "telemetry.h"
+
+#if defined(__PIC32MX__)
+#include "usb.h"
+#include "usb_function_hid.h"
+#include "tick.h"
+#endif
+
+/** VARIABLES ******************************************************/
+#define RING_MASK   (TELEMETRY_RING_SIZE - 1)
+
+uint32_t telemetryWrites;
+uint32_t telemetryDrops;
+uint32_t telemetryBytesLogged;
+uint32_t telemetryBytesSent;
+uint32_t telemetryWriteCycles;
+uint32_t telemetryWriteCyclesMax;
+
+static uint8_t ring[TELEMETRY_RING_SIZE];
+static volatile uint16_t ringHead;      // Next byte written, free running
+static volatile uint16_t ringTail;      // Next byte sent, free running
+static uint16_t eventSeq;
+
+#if defined(__PIC32MX__)
+// The SIE reads from here after the send call returns
+static uint8_t txPacket[TELEMETRY_PACKET_SIZE];
+#endif
+
+/** DECLARATIONS ***************************************************/
+
+void TelemetryInit(void)
+{
+    ringHead = 0;
+    ringTail = 0;
+    eventSeq = 0;
+    telemetryWrites = telemetryDrops = 0;
+    telemetryBytesLogged = telemetryBytesSent = 0;
+    telemetryWriteCycles = telemetryWriteCyclesMax = 0;
+}
+
+/********************************************************************
+ * Function:        bool TelemetryWrite(const void *data, uint16_t len)
+ *
+ * Overview:        Appends len bytes to the ring.  Records are never
+ *                  split: if the whole record does not fit, it is
+ *                  dropped and counted.  Returns false on a drop.
+ *******************************************************************/
+bool TelemetryWrite(const void *data, uint16_t len)
+{
+#if defined(__PIC32MX__)
+    TICK start = TickGet();
+    uint32_t cycles;
+#endif
+    const uint8_t *src = data;
+    uint16_t head = ringHead;
+    uint16_t first;
+
+    if ((uint16_t)(TELEMETRY_RING_SIZE - (uint16_t)(head - ringTail)) < len) {
+        telemetryDrops++;
+        return false;
+    }
+
+    // At most two copies: up to the end of the ring, then from the start
+    first = TELEMETRY_RING_SIZE - (head & RING_MASK);
+    if (first > len) first = len;
+    memcpy(&ring[head & RING_MASK], src, first);
+    memcpy(&ring[0], src + first, len - first);
+    ringHead = head + len;
+
+    telemetryWrites++;
+    telemetryBytesLogged += len;
+#if defined(__PIC32MX__)
+    // Core timer runs at half the CPU clock
+    cycles = TickSince(start) * 2;
+    telemetryWriteCycles += cycles;
+    if (cycles > telemetryWriteCyclesMax) telemetryWriteCyclesMax = cycles;
+#endif
+    return true;
+}
+
+bool TelemetryEvent(uint8_t id, uint32_t arg, uint32_t nowUs)
+{
+    TELEMETRY_EVENT ev;
+
+    ev.sync = TELEMETRY_SYNC;
+    ev.id = id;
+    ev.seq = eventSeq++;
+    ev.timestamp = nowUs;
+    ev.arg = arg;
+    return TelemetryWrite(&ev, sizeof(ev));
+}
+
+/********************************************************************
+ * Function:        uint16_t TelemetryRead(uint8_t *dst, uint16_t max)
+ *
+ * Overview:        Moves up to max bytes, and no more than one read
+ *                  request returns, from the ring to dst.  Returns how
+ *                  many were moved.  Records may be split between
+ *                  reads; the host re-aligns on TELEMETRY_SYNC.
+ *******************************************************************/
+uint16_t TelemetryRead(uint8_t *dst, uint16_t max)
+{
+    uint16_t tail = ringTail;
+    uint16_t count = (uint16_t)(ringHead - tail);
+    uint16_t first;
+
+    if (count > max) count = max;
+    if (count > TELEMETRY_PACKET_SIZE) count = TELEMETRY_PACKET_SIZE;
+
+    first = TELEMETRY_RING_SIZE - (tail & RING_MASK);
+    if (first > count) first = count;
+    memcpy(dst, &ring[tail & RING_MASK], first);
+    memcpy(dst + first, &ring[0], count - first);
+    ringTail = tail + count;
+
+    telemetryBytesSent += count;
+    return count;
+}
+
+#if defined(__PIC32MX__)
+
+/********************************************************************
+ * Function:        bool TelemetryCheckRequest(void)
+ *
+ * Overview:        Handles the EP0 read request.  Returns true if the
+ *                  request was claimed.
+ *******************************************************************/
+bool TelemetryCheckRequest(void)
+{
+    uint16_t n;
+
+    if (SetupPkt.RequestType != USB_SETUP_TYPE_VENDOR_BITFIELD ||
+        SetupPkt.Recipient != USB_SETUP_RECIPIENT_DEVICE_BITFIELD ||
+        SetupPkt.bRequest != TELEMETRY_REQ_READ ||
+        SetupPkt.DataDir != USB_SETUP_DEVICE_TO_HOST_BITFIELD) return false;
+
+    n = TelemetryRead(txPacket, SetupPkt.wLength);
+    USBEP0SendRAMPtr(txPacket, n, USB_EP0_NO_OPTIONS);
+    return true;
+}
+
+#endif
@@ -0,0 +1,64 @@
+/********************************************************************
+ FileName:      telemetry.h
+ Dependencies:  usb.h
+ Processor:     PIC32MX270F256D, or a Linux host (kbsim)
+
+ Non-blocking trace log.  Writers copy into a RAM ring and return at
+ once.  A full ring drops the new record rather than waiting, so
+ logging never delays a key report.
+
+ The host pulls the ring over EP0 with the TELEMETRY_REQ_READ vendor
+ request, up to 64 bytes per control transfer.  There is no streaming
+ endpoint: the bundled stack library only has buffer descriptors for
+ EP0 and EP1, and EP1 is the HID interface.  kbsim telemetry gives
+ the throughput and drops this allows at a range of event rates, and
+ the cost of an event.  On the device, DIAG_REPORT telemetryWriteCycles
+ / telemetryWrites is the measured cost per record.
+ *******************************************************************/
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** DEFINITIONS ****************************************************/
+#define TELEMETRY_RING_SIZE     1024    // Must be a power of two
+#define TELEMETRY_PACKET_SIZE   64      // Most one read request returns
+
+// Vendor request, recipient = device (numbering shared with diagnostics.h)
+#define TELEMETRY_REQ_READ      0x03    // IN: up to 64 bytes of ring data
+
+// Event ids written by TelemetryEvent()
+#define TLM_USB_ERROR           0x01    // arg = U1EIR flags
+#define TLM_EP_REARM            0x02
+#define TLM_REMOTE_WAKEUP       0x03    // arg = key-to-resume latency (us)
+#define TLM_SUSPEND             0x04
+#define TLM_RESUME              0x05
+
+typedef struct __attribute__ ((packed))
+{
+    uint8_t  sync;                  // TELEMETRY_SYNC, lets the host re-align
+    uint8_t  id;
+    uint16_t seq;                   // Gaps show dropped records
+    uint32_t timestamp;             // TickUs(), unaffected by clock switches
+    uint32_t arg;
+} TELEMETRY_EVENT;
+
+#define TELEMETRY_SYNC          0xA5
+
+/** PUBLIC VARIABLES ***********************************************/
+extern uint32_t telemetryWrites;
+extern uint32_t telemetryDrops;         // Records lost to a full ring
+extern uint32_t telemetryBytesLogged;
+extern uint32_t telemetryBytesSent;
+extern uint32_t telemetryWriteCycles;   // Device only: CPU cycles in TelemetryWrite()
+extern uint32_t telemetryWriteCyclesMax;
+
+/** PUBLIC PROTOTYPES **********************************************/
+void TelemetryInit(void);
+bool TelemetryWrite(const void *data, uint16_t len);
+bool TelemetryEvent(uint8_t id, uint32_t arg, uint32_t nowUs);
+uint16_t TelemetryRead(uint8_t *dst, uint16_t max);
+bool TelemetryCheckRequest(void);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,140 @@
+/** INCLUDES *******************************************************/
+#include <stddef.h>
+#include "textstream.h"
+
+/** PRIVATE PROTOTYPES *********************************************/
+static uint8_t Peek(TEXT_STREAM *ts);
+static void Advance(TEXT_STREAM *ts);
+static bool NextKey(TEXT_STREAM *ts, uint8_t *usage, uint8_t *modifiers);
+
+/** DECLARATIONS ***************************************************/
+
+// held = the keys already down, which count as the previous report
+void TextStreamBegin(TEXT_STREAM *ts, const char *text, const KEY_SET *held)
+{
+    ts->next = text;
+    ts->pairs = NULL;
+    ts->depth = 0;
+    ts->sent = *held;
+}
+
+// The same for packed text; pairs is the table it was packed with
+void TextStreamBeginPacked(TEXT_STREAM *ts, const uint8_t *packed, const uint8_t *pairs,
+                           const KEY_SET *held)
+{
+    TextStreamBegin(ts, (const char *)packed, held);
+    ts->pairs = pairs;
+}
+
+/********************************************************************
+ * Function:        bool TextPairsValid(const uint8_t *pairs,
+ *                                      uint32_t length)
+ *
+ * Overview:        Checks a pair table in length bytes: every pair
+ *                  made of characters and earlier pairs, none of them
+ *                  NUL, and none nested deeper than the stack.
+ *******************************************************************/
+bool TextPairsValid(const uint8_t *pairs, uint32_t length)
+{
+    uint8_t height[TEXT_PAIRS_MAX], h, i, j, c;
+
+    if (length < 1 || pairs[0] > TEXT_PAIRS_MAX || length < 1 + 2u * pairs[0]) return false;
+    for (i = 0; i < pairs[0]; i++) {
+        h = 1;
+        for (j = 1; j <= 2; j++) {
+            c = pairs[2 * i + j];
+            if (c == '\0') return false;
+            if (c < TEXT_PAIR_FIRST) continue;
+            if (c - TEXT_PAIR_FIRST >= i) return false;
+            if (height[c - TEXT_PAIR_FIRST] + 1 > h) h = height[c - TEXT_PAIR_FIRST] + 1;
+        }
+        if (h >= TEXT_PACK_DEPTH) return false;
+        height[i] = h;
+    }
+    return true;
+}
+
+/*
+ * The next character, unpacking pairs onto the stack until the top is
+ * one.  A code the table has no pair for, or one nested deeper than
+ * the stack, comes back as it is, and has no key.
+ */
+static uint8_t Peek(TEXT_STREAM *ts)
+{
+    const uint8_t *pair;
+    uint8_t code;
+
+    for (;;) {
+        code = ts->depth != 0 ? ts->stack[ts->depth - 1] : (uint8_t)*ts->next;
+        if (code < TEXT_PAIR_FIRST || ts->pairs == NULL || code - TEXT_PAIR_FIRST >= ts->pairs[0] ||
+            ts->depth == TEXT_PACK_DEPTH) {
+            return code;
+        }
+        pair = &ts->pairs[1 + 2 * (code - TEXT_PAIR_FIRST)];
+        Advance(ts);
+        ts->stack[ts->depth++] = pair[1];
+        ts->stack[ts->depth++] = pair[0];
+    }
+}
+
+static void Advance(TEXT_STREAM *ts)
+{
+    if (ts->depth != 0) ts->depth--;
+    else ts->next++;
+}
+
+// Key for the next character, skipping the ones that have none
+static bool NextKey(TEXT_STREAM *ts, uint8_t *usage, uint8_t *modifiers)
+{
+    uint8_t c;
+
+    while ((c = Peek(ts)) != '\0') {
+        if (KeyFromAscii((char)c, usage, modifiers)) return true;
+        Advance(ts);
+    }
+    return false;
+}
+
+/********************************************************************
+ * Function:        bool TextStreamStep(TEXT_STREAM *ts, KEY_SET *keys)
+ *
+ * Overview:        Writes the next report into keys.  Returns false,
+ *                  leaving keys alone, once the text is typed and
+ *                  every key is up again.
+ *******************************************************************/
+bool TextStreamStep(TEXT_STREAM *ts, KEY_SET *keys)
+{
+    KEY_SET next;
+    uint8_t usage, mods, m;
+
+    if (!NextKey(ts, &usage, &mods)) {
+        if (ts->sent.modifiers == 0 && ts->sent.keys[0] == USAGE_NONE) return false;
+        KeySetClear(&ts->sent);
+        *keys = ts->sent;
+        return true;
+    }
+
+    if (mods != ts->sent.modifiers || KeySetHas(&ts->sent, usage)) {
+        KeySetClear(&ts->sent);
+        ts->sent.modifiers = mods;
+        *keys = ts->sent;
+        return true;
+    }
+
+    // As many characters as fit; the first always does
+    KeySetClear(&next);
+    next.modifiers = mods;
+    m = mods;
+    do {
+        if (m != mods || next.keys[KEYSET_KEYS - 1] != USAGE_NONE ||
+            KeySetHas(&ts->sent, usage) || KeySetHas(&next, usage)) {
+            break;
+        }
+        KeySetPress(&next, usage);
+        Advance(ts);
+    } while (NextKey(ts, &usage, &m));
+
+    ts->sent = next;
+    *keys = next;
+    return true;
+}
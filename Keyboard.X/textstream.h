@@ -0,0 +1,61 @@
+/********************************************************************
+ FileName:      textstream.h
+ Dependencies:  keyset.h
+ Processor:     PIC32MX270F256D, or a Linux host
+
+ Types a string with as few reports as the host allows.  A host types
+ every usage that is in a report but was not in the one before, in
+ report order, with the modifiers of that report.  So one report can
+ carry up to six characters as long as they are distinct, need the
+ same shift state and were not held in the previous report.
+
+ Only two things cost a report that types nothing:
+
+   - a character whose key is still down from the previous report
+   - a change of shift state
+
+ Both are met with one report that lets go of everything and sets the
+ new modifiers; the next report presses keys again.  Modifiers never
+ change in a report that also presses a key, so it does not matter
+ which of the two the host looks at first.
+
+ Characters KeyFromAscii() has no key for are skipped.
+
+ Text can also be packed (MOP_TEXT_PACKED).  Bytes below
+ TEXT_PAIR_FIRST are characters; a byte from TEXT_PAIR_FIRST up stands
+ for the two bytes of an entry in a pair table, and either of those
+ can be a pair again.  The table is a count byte and that many pairs,
+ each made only of characters and earlier pairs.  Unpacking runs one
+ character ahead of the report with a stack of TEXT_PACK_DEPTH bytes:
+ there is no window of output to keep, and the packed text is read
+ where it is, in flash.
+ *******************************************************************/
+#ifndef TEXTSTREAM_H
+#define TEXTSTREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "keyset.h"
+
+/** DEFINITIONS ****************************************************/
+#define TEXT_PAIR_FIRST         0x80    // Lowest pair code; below it, characters
+#define TEXT_PAIRS_MAX          128
+#define TEXT_PACK_DEPTH         8       // A pair nests at most one less than this
+
+typedef struct
+{
+    const char *next;               // First character, or packed byte, not yet typed
+    const uint8_t *pairs;           // Pair table if the text is packed, else NULL
+    uint8_t  depth;
+    uint8_t  stack[TEXT_PACK_DEPTH];    // The rest of the pairs being unpacked, top last
+    KEY_SET  sent;                  // The last report produced
+} TEXT_STREAM;
+
+/** PUBLIC PROTOTYPES **********************************************/
+void TextStreamBegin(TEXT_STREAM *ts, const char *text, const KEY_SET *held);
+void TextStreamBeginPacked(TEXT_STREAM *ts, const uint8_t *packed, const uint8_t *pairs,
+                           const KEY_SET *held);
+bool TextPairsValid(const uint8_t *pairs, uint32_t length);
+bool TextStreamStep(TEXT_STREAM *ts, KEY_SET *keys);
+
+#endif // TEXTSTREAM_H
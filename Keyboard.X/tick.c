@@ -0,0 +1,27 @@
+/** INCLUDES *******************************************************/
+#include "Compiler.h"
+#include "tick.h"
+
+/** VARIABLES ******************************************************/
+static TICK lastCount;
+static TICK partialTicks;           // Left over from the last whole microsecond
+static uint32_t nowUs;
+
+/** DECLARATIONS ***************************************************/
+
+/********************************************************************
+ * Function:        uint32_t TickUs(void)
+ *
+ * Overview:        Microseconds since reset, wrapping after
+ *                  71 minutes.  Compare results by subtraction.
+ *******************************************************************/
+uint32_t TickUs(void)
+{
+    TICK count = TickGet();
+
+    partialTicks += count - lastCount;
+    lastCount = count;
+    nowUs += partialTicks / TICKS_PER_US;
+    partialTicks %= TICKS_PER_US;
+    return nowUs;
+}
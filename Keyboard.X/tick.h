@@ -0,0 +1,44 @@
+/********************************************************************
+ FileName:      tick.h
+ Dependencies:  HardwareProfile.h, clock.h
+ Processor:     PIC32MX270F256D
+
+ Time base built on the MIPS core timer (CP0 Count), which counts at
+ half the system clock.  Timestamps are free-running 32-bit values;
+ compare them by subtraction so wrap-around is harmless.
+
+ The system clock changes at run time (clock.h), and the conversions
+ below follow sysClock, so a TICK interval is only meaningful while
+ the clock stays the same: busy waits, cycle counts.  Anything that
+ may span a switch is timed in microseconds.
+
+ The core timer wraps every 214 s at 40 MHz.  TickUs() extends it to
+ a microsecond clock for the portable engines and the main loop's
+ timeouts; it must be called at least once per wrap.
+ *******************************************************************/
+#ifndef TICK_H
+#define TICK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "HardwareProfile.h"
+#include "clock.h"
+
+/** DEFINITIONS ****************************************************/
+typedef uint32_t TICK;
+
+#define TICKS_PER_SECOND        (sysClock / 2)
+#define TICKS_PER_MS            (TICKS_PER_SECOND / 1000)
+#define TICKS_PER_US            (TICKS_PER_SECOND / 1000000)
+
+#define TickGet()               ((TICK)_CP0_GET_COUNT())
+#define TickSince(start)        ((TICK)(TickGet() - (start)))
+#define TickElapsed(start, t)   (TickSince(start) >= (TICK)(t))
+
+#define TicksToUs(t)            ((t) / TICKS_PER_US)
+#define TickUsSince(startUs)    ((uint32_t)(TickUs() - (startUs)))
+
+/** PUBLIC PROTOTYPES **********************************************/
+uint32_t TickUs(void);
+
+#endif // TICK_H
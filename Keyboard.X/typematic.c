@@ -0,0 +1,81 @@
+/** INCLUDES *******************************************************/
+#include <stddef.h>
+#include "typematic.h"
+#include "macro_vm.h"
+
+/** VARIABLES ******************************************************/
+uint32_t typematicRepeats;
+uint32_t typematicSkipped;
+
+static uint32_t delayUs;
+static uint32_t periodUs;
+
+static bool armed;                  // A repeating key is down
+static bool restartTimer;           // It just went down; TypematicTasks() takes the time
+static uint8_t repeatKey;
+static const uint8_t *repeatImage;
+static uint16_t repeatEntry;
+static uint32_t dueUs;              // The next repeat
+
+/** DECLARATIONS ***************************************************/
+
+void TypematicInit(uint16_t delayMs, uint16_t rateHz)
+{
+    if (rateHz == 0) rateHz = 1;
+    if (rateHz > TYPEMATIC_RATE_MAX) rateHz = TYPEMATIC_RATE_MAX;
+    delayUs = delayMs * 1000ul;
+    periodUs = 1000000ul / rateHz;
+    armed = false;
+}
+
+// The keymap has just started the key's macro; repeats follow while it is held
+void TypematicPress(uint8_t key, const uint8_t *image, uint16_t entry)
+{
+    repeatKey = key;
+    repeatImage = image;
+    repeatEntry = entry;
+    armed = true;
+    restartTimer = true;
+}
+
+void TypematicRelease(uint8_t key)
+{
+    if (armed && key == repeatKey) armed = false;
+}
+
+// The keymap or macros are being replaced: the held key's macro may be gone
+void TypematicCancel(void)
+{
+    armed = false;
+}
+
+/********************************************************************
+ * Function:        void TypematicTasks(uint32_t nowUs)
+ *
+ * Overview:        Starts the repeat that is due, if its macro has
+ *                  finished the run before.  Call it every main loop
+ *                  pass, after the key events.
+ *******************************************************************/
+void TypematicTasks(uint32_t nowUs)
+{
+    if (!armed) return;
+    if (restartTimer) {
+        restartTimer = false;
+        dueUs = nowUs + delayUs;
+        return;
+    }
+    if ((int32_t)(nowUs - dueUs) < 0 || MacroRunning(repeatKey)) return;
+    if (MacroStart(repeatImage, repeatEntry, repeatKey) < 0) return;
+
+    typematicRepeats++;
+    dueUs += periodUs;
+    if ((int32_t)(nowUs - dueUs) >= 0) {
+        typematicSkipped += (nowUs - dueUs) / periodUs + 1;
+        dueUs = nowUs + periodUs;
+    }
+}
+
+bool TypematicBusy(void)
+{
+    return armed;
+}
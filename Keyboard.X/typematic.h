@@ -0,0 +1,44 @@
+/********************************************************************
+ FileName:      typematic.h
+ Dependencies:  macro_vm.h
+ Processor:     PIC32MX270F256D, or a Linux host
+
+ Typematic repeat for macro keys.  The host repeats a held key by
+ itself, but it cannot repeat a macro, so a key whose action is
+ ACT_MACRO_RPT starts its macro again every 1 / rate seconds once it
+ has been held for the delay.  Like the host's own repeat, only the
+ last such key pressed repeats.
+
+ Repeats are due on a fixed grid of microsecond deadlines from the
+ press, so uneven main loop passes do not add up to drift.  A repeat
+ that falls due while the previous run of the macro is still typing
+ waits for it; if a whole period goes by, the grid starts again from
+ that run.  Rates are clamped to TYPEMATIC_RATE_MAX, one repeat per
+ poll; a macro that takes n reports repeats at most once per n polls.
+
+ Letting go of the key cancels the next repeat at once.
+ *******************************************************************/
+#ifndef TYPEMATIC_H
+#define TYPEMATIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** DEFINITIONS ****************************************************/
+#define TYPEMATIC_DELAY_MS      500     // Held this long before the first repeat
+#define TYPEMATIC_RATE_HZ       30      // Repeats per second after that
+#define TYPEMATIC_RATE_MAX      1000    // One per poll at bInterval = 1 ms
+
+/** PUBLIC VARIABLES ***********************************************/
+extern uint32_t typematicRepeats;
+extern uint32_t typematicSkipped;   // Repeats the macro was too slow for
+
+/** PUBLIC PROTOTYPES **********************************************/
+void TypematicInit(uint16_t delayMs, uint16_t rateHz);
+void TypematicPress(uint8_t key, const uint8_t *image, uint16_t entry);
+void TypematicRelease(uint8_t key);
+void TypematicCancel(void);
+void TypematicTasks(uint32_t nowUs);
+bool TypematicBusy(void);
+
+#endif // TYPEMATIC_H
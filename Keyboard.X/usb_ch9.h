@@ -311,6 +311,12 @@ typedef union { //Added to allow for WORD_VAL
         uint8_t low;
         uint8_t high;
     };
+    uint16_t Val;       //GenericTypeDefs.h names, used by the stack macros
+    uint8_t v[2];
+    struct {
+        uint8_t LB;
+        uint8_t HB;
+    } byte;
 } WORD_VAL;
 
 
@@ -97,8 +97,8 @@
 #define HID_INTF_ID             0x00
 #define HID_EP                  1
 #define HID_INT_OUT_EP_SIZE     3
-#define HID_INT_IN_EP_SIZE      3
+#define HID_INT_IN_EP_SIZE      64
 #define HID_NUM_OF_DSC          1
-#define HID_RPT01_SIZE          63
+#define HID_RPT01_SIZE          111
 
 #endif // _USB_CONFIG_H_
@@ -4,6 +4,7 @@
 /** INCLUDES *******************************************************/
 #include "usb.h"
 #include "usb_function_hid.h"
+#include "diagnostics.h"
 
 /** CONSTANTS ******************************************************/
 /* Device Descriptor */
@@ -34,7 +35,7 @@ ROM uint8_t configDescriptor1[] = {
     1,                            // Number of interfaces in this cfg
     1,                            // Index value of this configuration
     0,                            // Configuration string index
-    _DEFAULT | _SELF,             // Attributes, see usb_device.h
+    _DEFAULT | _SELF | _RWU,      // Attributes, see usb_device.h
     50,                           // Max power consumption (2X mA)
 
     /* Interface Descriptor */
@@ -55,15 +56,15 @@ ROM uint8_t configDescriptor1[] = {
     0x00,                         // Country Code (0x00 for Not supported)
     HID_NUM_OF_DSC,               // Number of class descriptors, see usbcfg.h
     DSC_RPT,                      // Report descriptor type
-    DESC_CONFIG_uint16_t(45),      // Size of the report descriptor (45 bytes)
+    DESC_CONFIG_uint16_t(HID_RPT01_SIZE), // Size of the report descriptor
 
     /* Endpoint Descriptor */
     0x07,                         // Size of this descriptor in bytes
     USB_DESCRIPTOR_ENDPOINT,      // Endpoint Descriptor
     HID_EP | _EP_IN,              // Endpoint Address
     _INTERRUPT,                   // Attributes
-    DESC_CONFIG_uint16_t(0x08),   // Size of the endpoint (8 bytes)
-    0x0A                          // Interval (10 ms)
+    DESC_CONFIG_uint16_t(HID_INT_IN_EP_SIZE), // Size of the endpoint (64 bytes)
+    0x01,                         // Interval (1 ms), one packet per frame
 };
 
 /* HID Report Descriptor (Keyboard) */
@@ -72,6 +73,7 @@ ROM struct{uint8_t report[HID_RPT01_SIZE];} hid_rpt01 = {
     0x09, 0x06,        /* Usage (Keyboard)                         */
     0xA1, 0x01,        /* Collection (Application)                 */
     
+    0x85, 0x01,        /*   Report ID (REPORT_ID_KEYBOARD)         */
     0x05, 0x07,        /*   Usage Page (Key Codes)                 */
     0x19, 0xE0,        /*   Usage Minimum (Left Control)           */
     0x29, 0xE7,        /*   Usage Maximum (Right GUI)              */
@@ -94,6 +96,42 @@ ROM struct{uint8_t report[HID_RPT01_SIZE];} hid_rpt01 = {
     0x29, 0x65,        /*   Usage Maximum (101)                    */
     0x81, 0x00,        /*   Input (Data, Array)                    */
     
+    0xC0,              /* End Collection                           */
+
+    0x06, 0x00, 0xFF,  /* Usage Page (Vendor Defined 0xFF00)       */
+    0x09, 0x01,        /* Usage (Bootloader)                       */
+    0xA1, 0x01,        /* Collection (Application)                 */
+    0x85, 0x02,        /*   Report ID (REPORT_ID_BOOTLOADER)       */
+    0x15, 0x00,        /*   Logical Minimum (0)                    */
+    0x26, 0xFF, 0x00,  /*   Logical Maximum (255)                  */
+    0x75, 0x08,        /*   Report Size (8)                        */
+    0x95, 0x3F,        /*   Report Count (63)                      */
+    0x09, 0x01,        /*   Usage (Bootloader)                     */
+    0xB1, 0x02,        /*   Feature (Data, Variable, Absolute)     */
+    0xC0,              /* End Collection                           */
+
+    0x09, 0x02,        /* Usage (Diagnostics)                      */
+    0xA1, 0x01,        /* Collection (Application)                 */
+    0x85, 0x03,        /*   Report ID (REPORT_ID_DIAGNOSTICS)      */
+    0x96, (uint8_t)sizeof(DIAG_REPORT), (uint8_t)(sizeof(DIAG_REPORT) >> 8),
+                       /*   Report Count (DIAG_REPORT), 2 bytes    */
+    0x09, 0x02,        /*   Usage (Diagnostics)                    */
+    0x81, 0x02,        /*   Input (Data, Variable, Absolute)       */
+    0xC0,              /* End Collection                           */
+
+    // Plover HID: Plover finds the machine by this usage page and usage
+    0x06, 0x50, 0xFF,  /* Usage Page (Vendor Defined 0xFF50)       */
+    0x0A, 0x56, 0x4C,  /* Usage (Plover HID steno machine)         */
+    0xA1, 0x01,        /* Collection (Application)                 */
+    0x85, 0x50,        /*   Report ID (REPORT_ID_STENO)            */
+    0x15, 0x00,        /*   Logical Minimum (0)                    */
+    0x25, 0x01,        /*   Logical Maximum (1)                    */
+    0x75, 0x01,        /*   Report Size (1)                        */
+    0x95, 0x40,        /*   Report Count (64)                      */
+    0x05, 0x0A,        /*   Usage Page (Ordinal)                   */
+    0x19, 0x00,        /*   Usage Minimum (0)                      */
+    0x29, 0x3F,        /*   Usage Maximum (63)                     */
+    0x81, 0x02,        /*   Input (Data, Variable, Absolute)       */
     0xC0               /* End Collection                           */
     }
 };
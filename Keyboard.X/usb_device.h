@@ -1268,7 +1268,7 @@ void USBCtrlEPAllowStatusStage(void);
 void USBDeferStatusStage(void);
 extern volatile bool USBDeferStatusStagePacket;
 /*DOM-IGNORE-BEGIN*/
-#define USBDeferStatusStage()   {USBDeferStatusStagePacket = TRUE;}
+#define USBDeferStatusStage()   {USBDeferStatusStagePacket = true;}
 /*DOM-IGNORE-END*/
 
 
@@ -1377,7 +1377,7 @@ void USBCtrlEPAllowDataStage(void);
 void USBDeferOUTDataStage(void);
 extern volatile bool USBDeferOUTDataStagePackets;
 /*DOM-IGNORE-BEGIN*/
-#define USBDeferOUTDataStage()   {USBDeferOUTDataStagePackets = TRUE; outPipes[0].info.bits.busy = 1;}
+#define USBDeferOUTDataStage()   {USBDeferOUTDataStagePackets = true; outPipes[0].info.bits.busy = 1;}
 /*DOM-IGNORE-END*/
 
 
@@ -1513,7 +1513,7 @@ bool USBOUTDataStageDeferred(void);
 void USBDeferINDataStage(void);
 extern volatile bool USBDeferINDataStagePackets;
 /*DOM-IGNORE-BEGIN*/
-#define USBDeferINDataStage()   {USBDeferINDataStagePackets = TRUE; inPipes[0].info.bits.busy = 1;}
+#define USBDeferINDataStage()   {USBDeferINDataStagePackets = true; inPipes[0].info.bits.busy = 1;}
 /*DOM-IGNORE-END*/
 
 
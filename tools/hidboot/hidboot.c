@@ -0,0 +1,430 @@
+/********************************************************************
+ FileName:      hidboot.c
+ Dependencies:  Keyboard.X/bootloader.[ch], nvm.[ch], crc32.[ch]
+ Platform:      Linux
+
+ Host side of the HID firmware update (see Keyboard.X/bootloader.h).
+ Talks to the keyboard through /dev/hidrawN feature reports, so no
+ driver or library is needed.
+
+ --simulate runs the device's own bootloader.c against the simulated
+ NVM controller in nvm.c and reports how long the update would take.
+ It first sends PROGRAM packets with bad ranges, wrapping ones
+ included, which must be refused before they reach the flash, and
+ commits an image with no startup code, which must be refused too.
+ The model serializes USB transfers and flash operations: on the
+ PIC32MX the CPU stalls while the NVM controller is busy, so the
+ USB stack cannot make progress either.
+
+ Build:
+   gcc -O2 -I../../Keyboard.X -o hidboot hidboot.c \
+       ../../Keyboard.X/bootloader.c ../../Keyboard.X/nvm.c \
+       ../../Keyboard.X/crc32.c
+
+ Usage:
+   hidboot /dev/hidrawN firmware.hex
+   hidboot --simulate [--stop-and-wait] [--xfer-us N] firmware.hex|-
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+
+#include "bootloader.h"
+#include "nvm.h"
+#include "crc32.h"
+
+/** DEFINITIONS ****************************************************/
+#define REPORT_ID_BOOTLOADER    0x02    // Keep in step with hid_reports.h
+#define DEFAULT_XFER_US         1000    // One 64-byte control transfer per frame
+#define CRC_NS_PER_BYTE         500     // Nibble CRC at 40 MHz, about 20 cycles/byte
+#define FULL_PART_SIZE          (256u * 1024)
+#define SIM_CHECK_LENGTH        (BOOT_IMG_APP + NVM_PAGE_SIZE)
+#define MIPS_J_STARTUP          (0x08000000 | ((FLASH_RESET_VECTOR + 8) >> 2 & 0x03FFFFFF))
+
+typedef struct
+{
+    int fd;                         // hidraw, or -1 when simulating
+    bool stopAndWait;
+    uint32_t xferUs;
+    uint64_t timeUs;                // Simulated wall clock
+    uint32_t transfers;
+} LINK;
+
+static uint8_t image[FLASH_STAGE_SIZE];
+static uint32_t imageLength;
+static uint8_t seq;
+
+/** DECLARATIONS ***************************************************/
+
+static int Hex(const char *s, int n)
+{
+    char buf[9];
+
+    memcpy(buf, s, n);
+    buf[n] = 0;
+    return (int)strtol(buf, NULL, 16);
+}
+
+static bool AllErased(const uint8_t *p, uint32_t len)
+{
+    while (len--) if (*p++ != 0xFF) return false;
+    return true;
+}
+
+// Where a record goes in the image (bootloader.h), or NULL
+static uint8_t *ImageAt(uint32_t phys, uint32_t len)
+{
+    if (phys >= FLASH_STARTUP_BASE && phys + len <= FLASH_STARTUP_BASE + FLASH_STARTUP_SIZE) {
+        return &image[BOOT_IMG_STARTUP + (phys - FLASH_STARTUP_BASE)];
+    }
+    if (phys >= FLASH_VECTOR_BASE && phys + len <= FLASH_VECTOR_BASE + FLASH_VECTOR_SIZE) {
+        return &image[BOOT_IMG_VECTORS + (phys - FLASH_VECTOR_BASE)];
+    }
+    if (phys >= FLASH_APP_BASE && phys + len <= FLASH_APP_BASE + FLASH_APP_SIZE) {
+        return &image[BOOT_IMG_APP + (phys - FLASH_APP_BASE)];
+    }
+    return NULL;
+}
+
+/********************************************************************
+ * Function:        static bool LoadHex(FILE *f)
+ *
+ * Overview:        Reads an Intel HEX file into an update image: the
+ *                  boot flash startup code, the 4 KB exception vector
+ *                  area and the application bank, laid out as
+ *                  bootloader.h describes.  The configuration words
+ *                  page is skipped: the update does not touch it.
+ *                  Any other record fails the load, and so does an
+ *                  image missing one of the three parts, since the
+ *                  update replaces all of them.
+ *******************************************************************/
+static bool LoadHex(FILE *f)
+{
+    char line[600];
+    uint32_t upper = 0, addr, phys, end;
+    uint8_t *dst;
+    int len, type, i;
+
+    memset(image, 0xFF, sizeof(image));
+    imageLength = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] != ':') continue;
+        len = Hex(line + 1, 2);
+        addr = Hex(line + 3, 4);
+        type = Hex(line + 7, 2);
+
+        if (type == 1) break;
+        if (type == 4) {
+            upper = (uint32_t)Hex(line + 9, 4) << 16;
+            continue;
+        }
+        if (type != 0) continue;
+
+        phys = (upper + addr) & 0x1FFFFFFF;
+        if (phys >= FLASH_STARTUP_BASE + FLASH_STARTUP_SIZE &&
+            phys + len <= NVM_BOOT_BASE + NVM_BOOT_SIZE) continue;
+        if ((dst = ImageAt(phys, len)) == NULL) {
+            fprintf(stderr, "record at 0x%08X (%d bytes) is not in the startup code, the "
+                    "exception vectors or the application bank 0x%08X-0x%08X\n", phys, len,
+                    FLASH_APP_BASE, FLASH_APP_BASE + FLASH_APP_SIZE - 1);
+            return false;
+        }
+        for (i = 0; i < len; i++) {
+            dst[i] = (uint8_t)Hex(line + 9 + 2 * i, 2);
+        }
+        end = (uint32_t)(dst - image) + len;
+        if (end > imageLength) imageLength = end;
+    }
+
+    if (imageLength <= BOOT_IMG_APP) {
+        fprintf(stderr, "no application data\n");
+        return false;
+    }
+    if (AllErased(&image[BOOT_IMG_STARTUP], FLASH_STARTUP_SIZE) ||
+        AllErased(&image[BOOT_IMG_VECTORS], FLASH_VECTOR_SIZE)) {
+        fprintf(stderr, "no startup code or no exception vectors\n");
+        return false;
+    }
+    imageLength = (imageLength + NVM_PAGE_SIZE - 1) & ~(NVM_PAGE_SIZE - 1);
+    return true;
+}
+
+/* Simulated device: bootloader.c on the simulated NVM controller */
+static bool SimMainLoopPass(LINK *link)
+{
+    uint32_t busy = nvmSimBusyUs;
+    bool release = BootTasks();
+
+    link->timeUs += nvmSimBusyUs - busy;
+    return release;
+}
+
+// One main loop pass, or every pass until the flash is idle
+static void SimDeviceRun(LINK *link, bool drain)
+{
+    uint32_t busy;
+
+    do {
+        busy = nvmSimBusyUs;
+        SimMainLoopPass(link);
+    } while (drain && nvmSimBusyUs != busy);
+}
+
+static bool Send(LINK *link, BOOT_PACKET *pkt)
+{
+    pkt->reportId = REPORT_ID_BOOTLOADER;
+    pkt->seq = seq++;
+    link->transfers++;
+
+    if (link->fd >= 0) {
+        return ioctl(link->fd, HIDIOCSFEATURE(BOOT_PACKET_SIZE), pkt) >= 0;
+    }
+
+    link->timeUs += link->xferUs;
+    if (!BootProcessPacket(pkt)) {
+        // Status stage held until a row buffer frees up
+        while (!SimMainLoopPass(link));
+    }
+    SimDeviceRun(link, link->stopAndWait);
+    return true;
+}
+
+static bool Receive(LINK *link, BOOT_RESPONSE *rsp)
+{
+    link->transfers++;
+
+    if (link->fd >= 0) {
+        rsp->reportId = REPORT_ID_BOOTLOADER;
+        return ioctl(link->fd, HIDIOCGFEATURE(BOOT_PACKET_SIZE), rsp) >= 0;
+    }
+
+    link->timeUs += link->xferUs;
+    SimDeviceRun(link, false);
+    *rsp = bootResponse;
+    return true;
+}
+
+// Sends a command and polls until its response is final
+static bool Command(LINK *link, uint8_t cmd, uint32_t addr, uint32_t arg, BOOT_RESPONSE *rsp)
+{
+    BOOT_PACKET pkt;
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.cmd = cmd;
+    pkt.addr = addr;
+    pkt.arg = arg;
+    if (!Send(link, &pkt)) return false;
+
+    do {
+        if (!Receive(link, rsp)) return false;
+    } while (rsp->status == BOOT_PENDING);
+
+    if (rsp->status != BOOT_OK) {
+        fprintf(stderr, "command 0x%02X at 0x%05X failed, status 0x%02X (0x%08X)\n",
+                cmd, addr, rsp->status, rsp->arg);
+        return false;
+    }
+    return true;
+}
+
+static bool Update(LINK *link)
+{
+    BOOT_PACKET pkt;
+    BOOT_RESPONSE rsp;
+    uint32_t off, n, crc, page;
+
+    if (!Command(link, BOOT_CMD_QUERY, 0, 0, &rsp)) return false;
+    if (rsp.version != BOOT_PROTOCOL_VERSION || imageLength > rsp.arg) {
+        fprintf(stderr, "device protocol %u, bank %u bytes: image does not fit\n", rsp.version, rsp.arg);
+        return false;
+    }
+    if (!Command(link, BOOT_CMD_BEGIN, imageLength, 0, &rsp)) return false;
+
+    for (off = 0; off < imageLength; off += n) {
+        n = imageLength - off;
+        if (n > BOOT_DATA_SIZE) n = BOOT_DATA_SIZE;
+
+        // Erased flash already reads 0xFF; the device erases gaps at COMMIT
+        if (!AllErased(&image[off], n)) {
+            memset(&pkt, 0, sizeof(pkt));
+            pkt.cmd = BOOT_CMD_PROGRAM;
+            pkt.len = (uint8_t)n;
+            pkt.addr = off;
+            memcpy(pkt.data, &image[off], n);
+            if (!Send(link, &pkt)) return false;
+            if (link->stopAndWait) {
+                if (!Receive(link, &rsp) || rsp.status != BOOT_OK) return false;
+            }
+        }
+
+        // Check each page as soon as its last byte has gone out
+        page = (off + n) & ~(NVM_PAGE_SIZE - 1);
+        if ((off + n) % NVM_PAGE_SIZE == 0 && !AllErased(&image[page - NVM_PAGE_SIZE], NVM_PAGE_SIZE)) {
+            crc = CRC32Final(CRC32Update(CRC32_INIT, &image[page - NVM_PAGE_SIZE], NVM_PAGE_SIZE));
+            if (link->fd < 0) link->timeUs += NVM_PAGE_SIZE * CRC_NS_PER_BYTE / 1000;
+            if (!Command(link, BOOT_CMD_VERIFY, page - NVM_PAGE_SIZE, crc, &rsp)) return false;
+        }
+    }
+
+    crc = CRC32Final(CRC32Update(CRC32_INIT, image, imageLength));
+    if (link->fd < 0) link->timeUs += (uint64_t)imageLength * CRC_NS_PER_BYTE / 1000;
+    if (!Command(link, BOOT_CMD_COMMIT, imageLength, crc, &rsp)) return false;
+
+    return Command(link, BOOT_CMD_RESET, 0, 0, &rsp);
+}
+
+/*
+ * Malformed PROGRAM packets must be refused without touching flash:
+ * a range that wraps past 4 GB, one past the image, and one longer
+ * than a packet holds
+ */
+static bool SimRangeChecks(LINK *link)
+{
+    static const struct { uint32_t addr; uint8_t len; } bad[] = {
+        { 0xFFFFFFF0, 56 },
+        { 0xFFFFFFFF, 1 },
+        { SIM_CHECK_LENGTH - 8, 16 },
+        { SIM_CHECK_LENGTH + 1, 0 },
+        { 0, BOOT_DATA_SIZE + 1 },
+    };
+    BOOT_PACKET pkt;
+    BOOT_RESPONSE rsp;
+    uint32_t i, erases, writes;
+    bool ok = true;
+
+    BootInit(FLASH_STAGE_BASE, FLASH_STAGE_SIZE);
+    if (!Command(link, BOOT_CMD_BEGIN, SIM_CHECK_LENGTH, 0, &rsp)) return false;
+    erases = nvmSimPageErases;
+    writes = nvmSimRowWrites;
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        memset(&pkt, 0, sizeof(pkt));
+        pkt.cmd = BOOT_CMD_PROGRAM;
+        pkt.addr = bad[i].addr;
+        pkt.len = bad[i].len;
+        Send(link, &pkt);
+        SimDeviceRun(link, true);
+        Receive(link, &rsp);
+        if (rsp.status != BOOT_ERR_RANGE) {
+            fprintf(stderr, "PROGRAM at 0x%08X, %u bytes: status 0x%02X, not a range error\n",
+                    bad[i].addr, bad[i].len, rsp.status);
+            ok = false;
+        }
+    }
+    if (nvmSimPageErases != erases || nvmSimRowWrites != writes) {
+        fprintf(stderr, "malformed PROGRAM packets reached the flash\n");
+        ok = false;
+    }
+    link->transfers = 0;
+    link->timeUs = 0;
+    nvmSimBusyUs = 0;
+    nvmSimPageErases = nvmSimRowWrites = 0;
+    return ok;
+}
+
+/*
+ * An image whose reset vector does not lead into its own startup code
+ * must be refused at COMMIT, even with the right CRC: applying it
+ * would leave nothing to run.  This one is blank.
+ */
+static bool SimEntryCheck(LINK *link)
+{
+    static uint8_t blank[SIM_CHECK_LENGTH];
+    BOOT_PACKET pkt;
+    BOOT_RESPONSE rsp;
+
+    BootInit(FLASH_STAGE_BASE, FLASH_STAGE_SIZE);
+    if (!Command(link, BOOT_CMD_BEGIN, SIM_CHECK_LENGTH, 0, &rsp)) return false;
+
+    memset(blank, 0xFF, sizeof(blank));
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.cmd = BOOT_CMD_COMMIT;
+    pkt.addr = SIM_CHECK_LENGTH;
+    pkt.arg = CRC32Final(CRC32Update(CRC32_INIT, blank, sizeof(blank)));
+    Send(link, &pkt);
+    do {
+        Receive(link, &rsp);
+    } while (rsp.status == BOOT_PENDING);
+
+    if (rsp.status != BOOT_ERR_ENTRY) {
+        fprintf(stderr, "image without startup code: COMMIT status 0x%02X, not an entry error\n",
+                rsp.status);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    LINK link = { -1, false, DEFAULT_XFER_US, 0, 0 };
+    bool simulate = false;
+    const char *dev = NULL, *hex = NULL;
+    FILE *f;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--simulate")) simulate = true;
+        else if (!strcmp(argv[i], "--stop-and-wait")) link.stopAndWait = true;
+        else if (!strcmp(argv[i], "--xfer-us") && i + 1 < argc) link.xferUs = atoi(argv[++i]);
+        else if (!simulate && dev == NULL) dev = argv[i];
+        else hex = argv[i];
+    }
+    if (hex == NULL || (!simulate && dev == NULL)) {
+        fprintf(stderr, "usage: hidboot /dev/hidrawN firmware.hex\n"
+                        "       hidboot --simulate [--stop-and-wait] [--xfer-us N] firmware.hex|-\n");
+        return 2;
+    }
+
+    if (!strcmp(hex, "-") && simulate) {
+        // No image: fill the whole bank with a pseudo-random one
+        srand(1);
+        for (imageLength = 0; imageLength < FLASH_STAGE_SIZE; imageLength++) {
+            image[imageLength] = (uint8_t)rand();
+        }
+        // crt0's reset handler, so the image passes the entry check
+        *(uint32_t*)&image[BOOT_IMG_STARTUP] = MIPS_J_STARTUP;
+        *(uint32_t*)&image[BOOT_IMG_STARTUP + 4] = 0;
+    } else {
+        if ((f = fopen(hex, "r")) == NULL) { perror(hex); return 1; }
+        if (!LoadHex(f)) { fprintf(stderr, "%s: not a usable image\n", hex); return 1; }
+        fclose(f);
+    }
+
+    if (simulate) {
+        if (!SimEntryCheck(&link) || !SimRangeChecks(&link)) return 1;
+        BootInit(FLASH_STAGE_BASE, FLASH_STAGE_SIZE);
+    } else if ((link.fd = open(dev, O_RDWR)) < 0) {
+        perror(dev);
+        return 1;
+    }
+
+    if (!Update(&link)) return 1;
+
+    if (simulate) {
+        printf("%s: %u bytes, %u transfers, %u page erases, %u row writes\n",
+               link.stopAndWait ? "stop-and-wait" : "pipelined",
+               imageLength, link.transfers, nvmSimPageErases, nvmSimRowWrites);
+        printf("update time %.3f s (flash busy %.3f s), %.1f KB/s\n",
+               link.timeUs / 1e6, nvmSimBusyUs / 1e6,
+               imageLength / 1024.0 / (link.timeUs / 1e6));
+        printf("projected for a full %u KB part: %.3f s\n", FULL_PART_SIZE / 1024,
+               link.timeUs / 1e6 * FULL_PART_SIZE / imageLength);
+
+        // Apply the staged image the way the next reset would
+        BootApplyStagedImage();
+        if (memcmp(NVMRead(FLASH_STARTUP_BASE), &image[BOOT_IMG_STARTUP], FLASH_STARTUP_SIZE) != 0 ||
+            memcmp(NVMRead(FLASH_VECTOR_BASE), &image[BOOT_IMG_VECTORS], FLASH_VECTOR_SIZE) != 0 ||
+            memcmp(NVMRead(FLASH_APP_BASE), &image[BOOT_IMG_APP], imageLength - BOOT_IMG_APP) != 0) {
+            fprintf(stderr, "simulated startup code, vectors or application bank do not match the image\n");
+            return 1;
+        }
+    } else {
+        printf("%u bytes written, device is resetting\n", imageLength);
+        close(link.fd);
+    }
+    return 0;
+}
@@ -0,0 +1,3069 @@
+/********************************************************************
+ FileName:      kbsim.c
+ Dependencies:  Keyboard.X/macro_vm.[ch], keyset.[ch], keymap.[ch],
+                macro_image.[ch], taphold.[ch], combo.[ch], textstream.[ch],
+                recorder.[ch], nvm.[ch], leader.[ch], steno.[ch],
+                typematic.[ch], flashstore.[ch], crc32.[ch], config.[ch],
+                clock.[ch], idle.[ch], telemetry.[ch], macros_default.c
+ Platform:      Linux
+
+ Host simulator for the keyboard's portable engines.  The device side
+ runs the firmware's own sources; the USB side is modelled as the
+ report queue gate in mouse.c (a new report is only built once the
+ last one has been taken) and a host that polls HID_EP once per
+ bInterval and turns key-down edges back into characters.
+
+ Build:
+   gcc -O2 -I../../Keyboard.X -o kbsim kbsim.c \
+       ../../Keyboard.X/macro_vm.c ../../Keyboard.X/keyset.c \
+       ../../Keyboard.X/keymap.c ../../Keyboard.X/macro_image.c \
+       ../../Keyboard.X/taphold.c ../../Keyboard.X/combo.c \
+       ../../Keyboard.X/textstream.c ../../Keyboard.X/recorder.c \
+       ../../Keyboard.X/nvm.c ../../Keyboard.X/leader.c \
+       ../../Keyboard.X/steno.c ../../Keyboard.X/typematic.c \
+       ../../Keyboard.X/flashstore.c ../../Keyboard.X/crc32.c \
+       ../../Keyboard.X/config.c ../../Keyboard.X/clock.c \
+       ../../Keyboard.X/idle.c ../../Keyboard.X/telemetry.c \
+       ../../Keyboard.X/macros_default.c
+
+ Usage:
+   kbsim vm-bench          interpreter cost per bytecode instruction
+   kbsim vm-type           characters per second at 1 ms polling
+   kbsim text-stream       the same for MOP_TEXT, against MODS + TAP per character
+   kbsim keymap-bench      key lookup cost against the number of layers
+   kbsim taphold           tap-hold scenarios, checked against expected reports
+   kbsim combo             combo scenarios, the same way
+   kbsim combo-bench       combo lookup cost for 10, 100 and 1000 combos
+   kbsim record            record a macro, write it to flash when idle, play it back
+   kbsim leader <macroc>   thousands of leader sequences through macroc's trie
+   kbsim steno             random strokes to Plover HID reports and to text, with latency
+   kbsim typematic         repeat timing of a held macro key against the set rate
+   kbsim store             flash store wear, write amplification, mount cost, power cuts
+   kbsim xip               keymap and macros read in place from flash against copied to RAM
+   kbsim config            configuration changes written to flash around typing and idle
+   kbsim pack <macroc> <source.mac>
+                           a macro library played packed and plain: same reports, cost of each
+   kbsim boot              configuration image checked at reset: time against the budget,
+                           damaged images, power cuts during commits
+   kbsim suspend           current over an hour suspended, and resume latency (a model)
+   kbsim clock             CPU clock over an hour of typing with macros: time at each
+                           clock, switches, ramp-up delay, energy (a model)
+   kbsim idle              typing with waits between events against a spinning loop:
+                           every report at the same poll or earlier, CPU busy share
+   kbsim telemetry         trace events read over EP0: throughput, drops and delay
+                           against the event rate, cost per event
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "keyset.h"
+#include "macro_vm.h"
+#include "keymap.h"
+#include "taphold.h"
+#include "combo.h"
+#include "recorder.h"
+#include "nvm.h"
+#include "leader.h"
+#include "steno.h"
+#include "hid_reports.h"
+#include "typematic.h"
+#include "macro_image.h"
+#include "textstream.h"
+#include "flashstore.h"
+#include "config.h"
+#include "crc32.h"
+#include "clock.h"
+#include "idle.h"
+#include "telemetry.h"
+
+/** DEFINITIONS ****************************************************/
+#define POLL_US                 1000    // bInterval = 1 ms
+#define LOOP_US                 10      // One pass of the firmware main loop
+#define MAX_TEXT                8192
+
+typedef struct
+{
+    uint32_t nowUs;
+    bool pending;                   // A report waits for the next poll
+    KEY_SET sent;                   // Last report built by the device
+    KEY_SET host;                   // Last report the host has seen
+    uint32_t reports;
+    char typed[MAX_TEXT];           // What the host decoded
+    uint32_t typedUs[MAX_TEXT];     // When each character came in
+    uint32_t typedLen;
+} SIM;
+
+/** DECLARATIONS ***************************************************/
+
+static uint64_t CycleCount(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static double NowSeconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* US keyboard letters, digits and space: enough for the scenarios */
+static uint8_t AsciiToUsage(char c)
+{
+    if (c >= 'a' && c <= 'z') return USAGE_A + (c - 'a');
+    if (c >= '1' && c <= '9') return USAGE_1 + (c - '1');
+    if (c == '0') return USAGE_1 + 9;
+    if (c == ' ') return USAGE_SPACE;
+    return USAGE_NONE;
+}
+
+static char UsageToAscii(uint8_t u)
+{
+    if (u >= USAGE_A && u < USAGE_A + 26) return 'a' + (u - USAGE_A);
+    if (u >= USAGE_1 && u < USAGE_1 + 9) return '1' + (u - USAGE_1);
+    if (u == USAGE_1 + 9) return '0';
+    if (u == USAGE_SPACE) return ' ';
+    return '?';
+}
+
+/* The character a US layout host makes of a usage, '?' if none */
+static char HostChar(uint8_t u, uint8_t modifiers)
+{
+    uint8_t shift = USAGE_MODIFIER_BIT(USAGE_LEFT_SHIFT) | USAGE_MODIFIER_BIT(USAGE_RIGHT_SHIFT);
+    uint8_t cu, cm;
+    int c;
+
+    for (c = 1; c < 0x7F; c++) {
+        if (KeyFromAscii(c, &cu, &cm) && cu == u && !cm == !(modifiers & shift)) return c;
+    }
+    return '?';
+}
+
+/*
+ * Host: every usage that was not down in the previous report is typed,
+ * in report order, with the modifiers of the report it came in
+ */
+static void HostReceive(SIM *sim, const KEY_SET *report)
+{
+    uint8_t i;
+
+    for (i = 0; i < KEYSET_KEYS && report->keys[i] != USAGE_NONE; i++) {
+        if (!KeySetHas(&sim->host, report->keys[i]) && sim->typedLen < MAX_TEXT - 1) {
+            sim->typedUs[sim->typedLen] = sim->nowUs;
+            sim->typed[sim->typedLen++] = HostChar(report->keys[i], report->modifiers);
+        }
+    }
+    sim->host = *report;
+    sim->reports++;
+}
+
+/* One main loop pass: the same order as mouse.c */
+static void DeviceLoop(SIM *sim)
+{
+    KEY_SET keys;
+
+    if (!sim->pending) {
+        MacroTasks(sim->nowUs);
+    }
+    KeySetClear(&keys);
+    MacroMerge(&keys);
+    if (memcmp(&keys, &sim->sent, sizeof(keys)) != 0 && !sim->pending) {
+        sim->sent = keys;
+        sim->pending = true;
+    }
+}
+
+// Runs until every macro has finished and the last report is out
+static void Run(SIM *sim)
+{
+    uint32_t nextPoll = sim->nowUs + POLL_US;
+
+    while (MacroBusy() || sim->pending) {
+        DeviceLoop(sim);
+        sim->nowUs += LOOP_US;
+        if ((int32_t)(sim->nowUs - nextPoll) >= 0) {
+            nextPoll += POLL_US;
+            if (sim->pending) {
+                sim->pending = false;
+                HostReceive(sim, &sim->sent);
+            }
+        }
+    }
+}
+
+// TAP per character, then END
+static uint32_t CompileText(uint8_t *code, const char *text)
+{
+    uint32_t n = 0;
+
+    for (; *text; text++) {
+        code[n++] = MOP_TAP;
+        code[n++] = AsciiToUsage(*text);
+    }
+    code[n++] = MOP_END;
+    return n;
+}
+
+static const char sampleText[] = "the quick brown fox jumps over the lazy dog 1234567890 ";
+
+// What macroc makes of type "...": MODS and TAP per character
+static uint32_t CompileTyped(uint8_t *code, const char *text)
+{
+    uint8_t usage, mods;
+    uint32_t n = 0;
+
+    for (; *text; text++) {
+        KeyFromAscii(*text, &usage, &mods);
+        code[n++] = MOP_MODS;
+        code[n++] = mods;
+        code[n++] = MOP_TAP;
+        code[n++] = usage;
+    }
+    code[n++] = MOP_MODS;
+    code[n++] = 0;
+    code[n++] = MOP_END;
+    return n;
+}
+
+// What macroc makes of stream "...": MOP_TEXT, END, then the string
+static uint32_t CompileStream(uint8_t *code, const char *text)
+{
+    code[0] = MOP_TEXT;
+    code[1] = 4;
+    code[2] = 0;
+    code[3] = MOP_END;
+    strcpy((char *)&code[4], text);
+    return 4 + strlen(text) + 1;
+}
+
+static int VmBench(void)
+{
+    static uint8_t code[2 * MAX_TEXT];
+    static const uint8_t loop[] = {
+        MOP_REPEAT, 0,
+            MOP_MODS, 0x02, MOP_PRESS, 0x04, MOP_DELAY, 0, 0,
+            MOP_RELEASE, 0x04, MOP_MODS, 0x00,
+        MOP_NEXT,
+        MOP_END
+    };
+    const uint32_t calls = 2000000;
+    uint64_t cycles;
+    uint32_t i, steps, t = 0;
+    double secs;
+
+    // Straight-line typing: TAP is the common instruction
+    CompileText(code, sampleText);
+    MacroInit();
+    macroSteps = 0;
+    cycles = CycleCount();
+    secs = NowSeconds();
+    for (i = 0; i < calls; i++) {
+        if (!MacroBusy()) MacroStart(code, 0, MACRO_NO_TRIGGER);
+        MacroTasks(t);
+    }
+    cycles = CycleCount() - cycles;
+    secs = NowSeconds() - secs;
+    steps = macroSteps;
+    printf("tap stream: %u instructions, %.1f host cycles/instruction, %.1f ns/instruction\n",
+           steps, (double)cycles / steps, secs * 1e9 / steps);
+
+    // Loop, modifier and delay opcodes
+    MacroInit();
+    macroSteps = 0;
+    MacroStart(loop, 0, MACRO_NO_TRIGGER);
+    cycles = CycleCount();
+    secs = NowSeconds();
+    for (i = 0; i < calls; i++) {
+        MacroTasks(t++);
+    }
+    cycles = CycleCount() - cycles;
+    secs = NowSeconds() - secs;
+    steps = macroSteps;
+    printf("loop mix:   %u instructions, %.1f host cycles/instruction, %.1f ns/instruction\n",
+           steps, (double)cycles / steps, secs * 1e9 / steps);
+    printf("on the device, DIAG_REPORT macroCycles / macroSteps gives PIC32 cycles/instruction\n");
+    return 0;
+}
+
+static int VmType(void)
+{
+    static uint8_t code[MACRO_SLOTS][2 * MAX_TEXT];
+    static char expect[MAX_TEXT];
+    SIM sim;
+    uint32_t len, i;
+
+    // One macro: a tap is a press report and a release report
+    memset(&sim, 0, sizeof(sim));
+    MacroInit();
+    expect[0] = 0;
+    for (i = 0; i < 18; i++) strcat(expect, sampleText);
+    CompileText(code[0], expect);
+    MacroStart(code[0], 0, MACRO_NO_TRIGGER);
+    Run(&sim);
+    len = strlen(expect);
+    printf("1 macro:  %u chars in %u reports, %.3f s, %.0f chars/s, %s\n",
+           sim.typedLen, sim.reports, sim.nowUs / 1e6, sim.typedLen / (sim.nowUs / 1e6),
+           sim.typedLen == len && memcmp(sim.typed, expect, len) == 0 ? "exact" : "MISMATCH");
+
+    // Every slot at once, each with its own letter: the interleaving is
+    // up to the round robin, but no slot may lose a character
+    memset(&sim, 0, sizeof(sim));
+    MacroInit();
+    for (i = 0; i < MACRO_SLOTS; i++) {
+        memset(expect, 'a' + i, 250);
+        expect[250] = 0;
+        CompileText(code[i], expect);
+        MacroStart(code[i], 0, MACRO_NO_TRIGGER);
+    }
+    Run(&sim);
+    printf("%u macros: %u chars in %u reports, %.3f s, %.0f chars/s\n",
+           MACRO_SLOTS, sim.typedLen, sim.reports, sim.nowUs / 1e6, sim.typedLen / (sim.nowUs / 1e6));
+    for (i = 0; i < MACRO_SLOTS; i++) {
+        len = 0;
+        for (uint32_t j = 0; j < sim.typedLen; j++) len += sim.typed[j] == (char)('a' + i);
+        if (len != 250) {
+            printf("slot %u typed %u of 250\n", i, len);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Prose with capitals, punctuation, doubled letters and line ends, then
+ * the cases that need a report that types nothing
+ */
+static const struct
+{
+    const char *name;
+    const char *text;
+    uint32_t copies;
+} streamTexts[] = {
+    { "prose",   "Hello, World! The quick brown fox jumps over the lazy dog.\n"
+                 "Bookkeeper Ann added 1,234.56 + 7 = 1,241.56 (see #42).\n", 60 },
+    { "repeats", "aaaa", 1000 },
+    { "shifts",  "aAbB", 1000 },
+};
+
+static uint32_t TypeWith(uint8_t *code, const char *text, bool stream, SIM *sim)
+{
+    uint32_t len = strlen(text);
+
+    if (stream) {
+        CompileStream(code, text);
+    } else {
+        CompileTyped(code, text);
+    }
+    memset(sim, 0, sizeof(*sim));
+    MacroInit();
+    MacroStart(code, 0, MACRO_NO_TRIGGER);
+    Run(sim);
+    printf("  %-6s %5u chars in %5u reports, %6.3f s, %5.0f chars/s, %s\n",
+           stream ? "stream" : "tap", sim->typedLen, sim->reports, sim->nowUs / 1e6,
+           sim->typedLen / (sim->nowUs / 1e6),
+           sim->typedLen == len && memcmp(sim->typed, text, len) == 0 ? "exact" : "MISMATCH");
+    return sim->typedLen == len && memcmp(sim->typed, text, len) == 0;
+}
+
+static int TextStream(void)
+{
+    static uint8_t code[4 * MAX_TEXT];
+    static char text[MAX_TEXT];
+    SIM sim;
+    uint32_t i, j;
+    bool ok = true;
+
+    for (i = 0; i < sizeof(streamTexts) / sizeof(streamTexts[0]); i++) {
+        text[0] = 0;
+        for (j = 0; j < streamTexts[i].copies && strlen(text) + strlen(streamTexts[i].text) < 4000; j++) {
+            strcat(text, streamTexts[i].text);
+        }
+        printf("%s:\n", streamTexts[i].name);
+        ok &= TypeWith(code, text, false, &sim);
+        ok &= TypeWith(code, text, true, &sim);
+        // Prose is the case that has to beat 500 chars/s
+        if (i == 0 && sim.typedLen / (sim.nowUs / 1e6) <= 500) ok = false;
+    }
+    return ok ? 0 : 1;
+}
+
+/*
+ * Keymap with keys 0-31 to look up and keys 32+ that toggle layer
+ * key - 32 from the base layer.  Upper layers define a quarter of the
+ * lookup keys, so most lookups fall through to lower layers.
+ */
+#define BENCH_KEYS              32
+
+static uint16_t benchActions[KEYMAP_MAX_KEYS * KEYMAP_MAX_LAYERS];
+static uint32_t benchDefined[KEYMAP_MAX_KEYS];
+
+static void BuildBenchKeymap(KEYMAP *map, uint8_t layers)
+{
+    uint8_t key, layer;
+    uint16_t a;
+
+    memset(benchActions, 0, sizeof(benchActions));
+    memset(benchDefined, 0, sizeof(benchDefined));
+    map->keys = KEYMAP_MAX_KEYS;
+    map->layers = layers;
+    map->defined = benchDefined;
+    map->actions = benchActions;
+
+    for (key = 0; key < KEYMAP_MAX_KEYS; key++) {
+        for (layer = 0; layer < layers; layer++) {
+            if (key >= BENCH_KEYS) {
+                a = layer != 0 ? ACT_TRANSPARENT : key - BENCH_KEYS < layers ? ACT_TG(key - BENCH_KEYS) : ACT_NO;
+            } else if (layer == 0) {
+                a = ACT_KEY(USAGE_A + key % 26);
+            } else {
+                a = rand() % 4 == 0 ? ACT_KEY(USAGE_A + rand() % 26) : ACT_TRANSPARENT;
+            }
+            benchActions[key * layers + layer] = a;
+            if (a != ACT_TRANSPARENT) benchDefined[key] |= 1u << layer;
+        }
+    }
+}
+
+// What the flattened table replaces: walk down from the top layer
+static __attribute__ ((noinline)) uint16_t WalkLayers(const KEYMAP *map, uint32_t active, uint8_t key)
+{
+    int layer;
+    uint16_t a;
+
+    for (layer = map->layers - 1; layer >= 0; layer--) {
+        if (!(active & (1u << layer))) continue;
+        a = map->actions[key * map->layers + layer];
+        if (a != ACT_TRANSPARENT) return a;
+    }
+    return ACT_NO;
+}
+
+static void ToggleLayer(uint8_t layer)
+{
+    KeymapEvent(BENCH_KEYS + layer, true);
+    KeymapEvent(BENCH_KEYS + layer, false);
+}
+
+static int KeymapBench(void)
+{
+    static const uint8_t layerCounts[] = { 1, 2, 4, 8, 16, 32 };
+    const uint32_t lookups = 20000000;
+    volatile uint32_t sink = 0;
+    KEYMAP map;
+    uint32_t i, n, sum;
+    uint8_t layer, key, c;
+    double flat, walk;
+
+    srand(1);
+    printf("layers  flattened ns/lookup  layer walk ns/lookup\n");
+    for (c = 0; c < sizeof(layerCounts); c++) {
+        BuildBenchKeymap(&map, layerCounts[c]);
+        KeymapInit(&map, NULL);
+
+        // Random layer states: both lookups must agree on every key
+        for (n = 0; n < 1000; n++) {
+            ToggleLayer(1 + rand() % 31);
+            for (key = 0; key < BENCH_KEYS; key++) {
+                if (KeymapResolve(key) != WalkLayers(&map, KeymapLayers(), key)) {
+                    printf("%u layers: key %u resolves differently\n", layerCounts[c], key);
+                    return 1;
+                }
+            }
+        }
+
+        // Timing with every layer on: the walk's worst case
+        KeymapInit(&map, NULL);
+        for (layer = 1; layer < layerCounts[c]; layer++) ToggleLayer(layer);
+
+        sum = 0;
+        flat = NowSeconds();
+        for (i = 0; i < lookups; i++) sum += KeymapResolve(i % BENCH_KEYS);
+        flat = NowSeconds() - flat;
+        sink += sum;
+
+        sum = 0;
+        walk = NowSeconds();
+        for (i = 0; i < lookups; i++) sum += WalkLayers(&map, KeymapLayers(), i % BENCH_KEYS);
+        walk = NowSeconds() - walk;
+        sink += sum;
+
+        printf("%6u  %19.2f  %20.2f\n", layerCounts[c], flat * 1e9 / lookups, walk * 1e9 / lookups);
+    }
+    return 0;
+}
+
+/*
+ * Key event scenarios.  Key events carry exact microsecond timestamps;
+ * the main loop sees them at its next pass (LOOP_US) and runs them
+ * through combo.c, taphold.c and keymap.c as mouse.c does.  The
+ * expected column lists every change of the keymap's report as
+ * "time keys".
+ */
+static const uint16_t simActions[] = {
+    // layer 0               layer 1
+    ACT_MT(0x01, 0x04),      ACT_TRANSPARENT,    // key 0: a, Ctrl on hold
+    ACT_KEY(0x05),           ACT_KEY(0x1B),      // key 1: b, x on layer 1
+    ACT_LT(1, 0x06),         ACT_TRANSPARENT,    // key 2: c, layer 1 on hold
+    ACT_MT_R(0x02, 0x07),    ACT_TRANSPARENT,    // key 3: d, right Shift on hold
+    ACT_KEY(0x08),           ACT_TRANSPARENT,    // key 4: e
+    ACT_KEY(0x09),           ACT_TRANSPARENT,    // key 5: f
+    ACT_KEY(0x0A),           ACT_TRANSPARENT,    // key 6: g
+    ACT_KEY(0x1D),           ACT_TRANSPARENT,    // key 7: z, combo 4+5
+    ACT_KEY(0x1C),           ACT_TRANSPARENT,    // key 8: y, combo 4+5+6
+};
+static const uint32_t simDefined[] = { 0x1, 0x3, 0x1, 0x1, 0x1, 0x1, 0x1, 0x1, 0x1 };
+static const KEYMAP simKeymap = { 9, 2, simDefined, simActions };
+
+// As macroc writes it for "combo 4+5 = 7" and "combo 4+5+6 = 8"
+static const COMBO simComboTable[] = {
+    { 0x30, 7, COMBO_FIRES | COMBO_PREFIX },
+    { 0x50, 0, COMBO_PREFIX },
+    { 0x60, 0, COMBO_PREFIX },
+    { 0x70, 8, COMBO_FIRES },
+};
+static const COMBO_TABLE simCombos = { 4, 0x70, simComboTable };
+static const COMBO_TABLE noCombos = { 0, 0, NULL };
+
+typedef struct
+{
+    uint32_t t;
+    uint8_t key;
+    bool down;
+} SIM_EDGE;
+
+typedef struct
+{
+    const char *name;
+    uint8_t policy;
+    SIM_EDGE edges[8];              // Unused ones are zero; only the first may be at t = 0
+    const char *expect;
+    const COMBO_TABLE *combos;      // NULL: none
+} SCENARIO;
+
+#define TERM_US                 200000
+#define COMBO_TERM_US           30000
+#define P_PERMISSIVE            TAPHOLD_PERMISSIVE_HOLD
+#define P_OTHER_KEY             TAPHOLD_HOLD_ON_OTHER_KEY
+
+static const SCENARIO tapHoldScenarios[] = {
+    { .name = "plain key, no added latency", .policy = 0,
+      .edges = { { 5000, 1, 1 }, { 6000, 1, 0 } },
+      .expect = "5000 b, 6000 -" },
+    { .name = "mod-tap tapped", .policy = 0,
+      .edges = { { 0, 0, 1 }, { 100000, 0, 0 } },
+      .expect = "100000 a, 100010 -" },
+    { .name = "mod-tap held", .policy = 0,
+      .edges = { { 0, 0, 1 }, { 300000, 0, 0 } },
+      .expect = "200000 lctrl, 300000 -" },
+    { .name = "released 1 us inside the term", .policy = 0,
+      .edges = { { 0, 0, 1 }, { 199999, 0, 0 } },
+      .expect = "200000 a, 200010 -" },
+    { .name = "released exactly at the term", .policy = 0,
+      .edges = { { 0, 0, 1 }, { 200000, 0, 0 } },
+      .expect = "200000 lctrl, 200010 -" },
+    { .name = "right-hand mod-tap held", .policy = 0,
+      .edges = { { 0, 3, 1 }, { 250000, 3, 0 } },
+      .expect = "200000 rshift, 250000 -" },
+    { .name = "roll, no policy: tap", .policy = 0,
+      .edges = { { 0, 0, 1 }, { 50000, 1, 1 }, { 80000, 0, 0 }, { 120000, 1, 0 } },
+      .expect = "80000 a, 80010 b, 120000 -" },
+    { .name = "roll, hold on other key", .policy = P_OTHER_KEY,
+      .edges = { { 0, 0, 1 }, { 50000, 1, 1 }, { 80000, 0, 0 }, { 120000, 1, 0 } },
+      .expect = "50000 lctrl+b, 80000 b, 120000 -" },
+    { .name = "nested, no policy: tap", .policy = 0,
+      .edges = { { 0, 0, 1 }, { 50000, 1, 1 }, { 70000, 1, 0 }, { 90000, 0, 0 } },
+      .expect = "90000 a, 90010 b, 90020 -" },
+    { .name = "nested, permissive hold", .policy = P_PERMISSIVE,
+      .edges = { { 0, 0, 1 }, { 50000, 1, 1 }, { 70000, 1, 0 }, { 90000, 0, 0 } },
+      .expect = "70000 lctrl+b, 70010 lctrl, 90000 -" },
+    { .name = "nested within one pass, permissive", .policy = P_PERMISSIVE,
+      .edges = { { 0, 0, 1 }, { 199990, 1, 1 }, { 199995, 1, 0 }, { 250000, 0, 0 } },
+      .expect = "200000 lctrl+b, 200010 lctrl, 250000 -" },
+    { .name = "layer-tap held: b becomes x", .policy = 0,
+      .edges = { { 0, 2, 1 }, { 250000, 1, 1 }, { 260000, 1, 0 }, { 300000, 2, 0 } },
+      .expect = "250000 x, 260000 -" },
+    { .name = "layer-tap tapped", .policy = 0,
+      .edges = { { 0, 2, 1 }, { 50000, 2, 0 } },
+      .expect = "50000 c, 50010 -" },
+    { .name = "layer-tap, permissive: layer applies to the held key", .policy = P_PERMISSIVE,
+      .edges = { { 0, 2, 1 }, { 10000, 1, 1 }, { 20000, 1, 0 }, { 30000, 2, 0 } },
+      .expect = "20000 x, 20010 -" },
+};
+
+static const SCENARIO comboScenarios[] = {
+    { .name = "key in no combo, no added latency", .policy = 0,
+      .edges = { { 1000, 1, 1 }, { 2000, 1, 0 } },
+      .expect = "1000 b, 2000 -", .combos = &simCombos },
+    { .name = "two-key combo, waits out the term for a third", .policy = 0,
+      .edges = { { 0, 4, 1 }, { 10000, 5, 1 }, { 50000, 4, 0 }, { 60000, 5, 0 } },
+      .expect = "30000 z, 50000 -", .combos = &simCombos },
+    { .name = "three-key combo fires on the last key", .policy = 0,
+      .edges = { { 0, 4, 1 }, { 5000, 5, 1 }, { 10000, 6, 1 }, { 40000, 4, 0 }, { 41000, 5, 0 }, { 42000, 6, 0 } },
+      .expect = "10000 y, 40000 -", .combos = &simCombos },
+    { .name = "second key too late: both plain", .policy = 0,
+      .edges = { { 0, 4, 1 }, { 40000, 5, 1 }, { 100000, 4, 0 }, { 110000, 5, 0 } },
+      .expect = "30000 e, 70000 e+f, 100000 f, 110000 -", .combos = &simCombos },
+    { .name = "other key settles a waiting key", .policy = 0,
+      .edges = { { 0, 4, 1 }, { 5000, 1, 1 }, { 20000, 4, 0 }, { 30000, 1, 0 } },
+      .expect = "5000 e+b, 20000 b, 30000 -", .combos = &simCombos },
+    { .name = "combo key tapped alone", .policy = 0,
+      .edges = { { 0, 4, 1 }, { 10000, 4, 0 } },
+      .expect = "10000 e, 10010 -", .combos = &simCombos },
+    { .name = "no completion: partial set goes through", .policy = 0,
+      .edges = { { 0, 5, 1 }, { 5000, 6, 1 }, { 50000, 5, 0 }, { 60000, 6, 0 } },
+      .expect = "30000 f+g, 50000 g, 60000 -", .combos = &simCombos },
+};
+
+static void KeysName(const KEY_SET *keys, char *out)
+{
+    static const char *modNames[] = { "lctrl", "lshift", "lalt", "lgui", "rctrl", "rshift", "ralt", "rgui" };
+    uint8_t i;
+
+    out[0] = 0;
+    for (i = 0; i < 8; i++) {
+        if (keys->modifiers & (1 << i)) sprintf(out + strlen(out), "%s%s", out[0] ? "+" : "", modNames[i]);
+    }
+    for (i = 0; i < KEYSET_KEYS && keys->keys[i] != USAGE_NONE; i++) {
+        sprintf(out + strlen(out), "%s%c", out[0] ? "+" : "", UsageToAscii(keys->keys[i]));
+    }
+    if (out[0] == 0) strcpy(out, "-");
+}
+
+static int RunScenarios(const SCENARIO *list, uint32_t count)
+{
+    const SCENARIO *sc;
+    KEY_SET keys, last;
+    char got[512], name[64];
+    uint32_t now, end, failed = 0;
+    uint8_t i, next;
+
+    for (sc = list; sc < list + count; sc++) {
+        KeymapInit(&simKeymap, NULL);
+        TapHoldInit(TERM_US, sc->policy);
+        ComboInit(sc->combos ? sc->combos : &noCombos, COMBO_TERM_US);
+        KeySetClear(&last);
+        got[0] = 0;
+        next = 0;
+        end = 0;
+        for (i = 0; i < 8 && (i == 0 || sc->edges[i].t); i++) end = sc->edges[i].t;
+        end += 2 * TERM_US;
+
+        for (now = 0; now < end; now += LOOP_US) {
+            // The scanner timestamps edges when they happen
+            while (next < 8 && (next == 0 || sc->edges[next].t) && sc->edges[next].t <= now) {
+                ComboEvent(sc->edges[next].key, sc->edges[next].down, sc->edges[next].t);
+                next++;
+            }
+            ComboTasks(now);
+            TapHoldTasks(now);
+            KeySetClear(&keys);
+            KeymapMerge(&keys);
+            if (memcmp(&keys, &last, sizeof(keys)) != 0) {
+                KeysName(&keys, name);
+                sprintf(got + strlen(got), "%s%u %s", got[0] ? ", " : "", now, name);
+                last = keys;
+            }
+        }
+
+        if (strcmp(got, sc->expect) != 0) {
+            printf("FAIL %s\n     expected %s\n     got      %s\n", sc->name, sc->expect, got);
+            failed++;
+        } else {
+            printf("ok   %s\n", sc->name);
+        }
+    }
+    printf("%u of %u scenarios passed\n", count - failed, count);
+    return failed != 0;
+}
+
+/*
+ * Random combo tables of 2-4 keys out of 48, expanded the way macroc
+ * does it: every key set of two or more that some combo contains,
+ * sorted.
+ */
+#define BENCH_PHYSICAL          48
+
+static COMBO benchCombos[1000 << COMBO_MAX_KEYS];
+static uint64_t benchComboKeys[1000];
+
+static int CompareCombo(const void *x, const void *y)
+{
+    const COMBO *a = x, *b = y;
+
+    return a->keys < b->keys ? -1 : a->keys > b->keys;
+}
+
+static void BuildBenchCombos(COMBO_TABLE *table, uint32_t count)
+{
+    uint32_t n = 0, i, j, k;
+    uint64_t keys, sub;
+    uint8_t size;
+
+    table->members = 0;
+    for (i = 0; i < count; i++) {
+        // Distinct key sets
+        do {
+            keys = 0;
+            size = 2 + rand() % (COMBO_MAX_KEYS - 1);
+            while (__builtin_popcountll(keys) < size) keys |= 1ull << (rand() % BENCH_PHYSICAL);
+            for (j = 0; j < i && benchComboKeys[j] != keys; j++);
+        } while (j < i);
+        benchComboKeys[i] = keys;
+        table->members |= keys;
+
+        for (sub = keys; sub != 0; sub = (sub - 1) & keys) {
+            if (__builtin_popcountll(sub) < 2) continue;
+            for (k = 0; k < n && benchCombos[k].keys != sub; k++);
+            if (k == n) {
+                benchCombos[n].keys = sub;
+                benchCombos[n].key = 0;
+                benchCombos[n].flags = 0;
+                n++;
+            }
+            if (sub == keys) {
+                benchCombos[k].key = KEYMAP_MAX_KEYS - 1;
+                benchCombos[k].flags |= COMBO_FIRES;
+            } else {
+                benchCombos[k].flags |= COMBO_PREFIX;
+            }
+        }
+    }
+    qsort(benchCombos, n, sizeof(COMBO), CompareCombo);
+    table->count = n;
+    table->table = benchCombos;
+}
+
+static __attribute__ ((noinline)) const COMBO *ScanCombos(const COMBO_TABLE *table, uint64_t keys)
+{
+    uint32_t i;
+
+    for (i = 0; i < table->count; i++) {
+        if (table->table[i].keys == keys) return &table->table[i];
+    }
+    return NULL;
+}
+
+static int ComboBench(void)
+{
+    static const uint32_t sizes[] = { 10, 100, 1000 };
+    static uint64_t probes[4096];
+    const uint32_t lookups = 4000000, events = 2000000;
+    volatile uintptr_t sink = 0;
+    COMBO_TABLE table;
+    uint32_t c, i, t;
+    uint8_t key, held[BENCH_PHYSICAL];
+    double secs, scan, event;
+
+    srand(1);
+    printf("combos  entries  lookup ns  linear scan ns  ns/key event\n");
+    for (c = 0; c < sizeof(sizes) / sizeof(sizes[0]); c++) {
+        BuildBenchCombos(&table, sizes[c]);
+        ComboInit(&table, COMBO_TERM_US);
+
+        // Half the probes are in the table, half are random pairs
+        for (i = 0; i < 4096; i++) {
+            probes[i] = i & 1 ? table.table[rand() % table.count].keys
+                              : (1ull << (rand() % BENCH_PHYSICAL)) | (1ull << (rand() % BENCH_PHYSICAL));
+            if (ComboLookup(probes[i]) != ScanCombos(&table, probes[i])) {
+                printf("%u combos: lookup and scan disagree\n", sizes[c]);
+                return 1;
+            }
+        }
+
+        secs = NowSeconds();
+        for (i = 0; i < lookups; i++) sink += (uintptr_t)ComboLookup(probes[i & 4095]);
+        secs = NowSeconds() - secs;
+        scan = NowSeconds();
+        for (i = 0; i < lookups / 10; i++) sink += (uintptr_t)ScanCombos(&table, probes[i & 4095]);
+        scan = (NowSeconds() - scan) * 10;
+
+        // Random typing through the whole chain, keys 0.5-5 ms apart
+        KeymapInit(NULL, NULL);
+        TapHoldInit(TERM_US, 0);
+        memset(held, 0, sizeof(held));
+        t = 0;
+        event = NowSeconds();
+        for (i = 0; i < events; i++) {
+            t += 500 + rand() % 4500;
+            key = rand() % BENCH_PHYSICAL;
+            held[key] = !held[key];
+            ComboEvent(key, held[key], t);
+            ComboTasks(t);
+            TapHoldTasks(t);
+        }
+        event = NowSeconds() - event;
+
+        printf("%6u  %7u  %9.2f  %14.2f  %12.2f\n", sizes[c], table.count,
+               secs * 1e9 / lookups, scan * 1e9 / lookups, event * 1e9 / events);
+    }
+    return 0;
+}
+
+static int TapHoldScenarios(void)
+{
+    return RunScenarios(tapHoldScenarios, sizeof(tapHoldScenarios) / sizeof(tapHoldScenarios[0]));
+}
+
+static int ComboScenarios(void)
+{
+    return RunScenarios(comboScenarios, sizeof(comboScenarios) / sizeof(comboScenarios[0]));
+}
+
+/*
+ * Recorder: keys 0-3 type h, e, l and o, key 4 records and key 5
+ * plays.  "helloh" is typed at human speed with a long pause in it,
+ * then the device is left idle, played back, reset and played again.
+ */
+static const uint16_t recActions[6] = {
+    ACT_KEY(USAGE_A + 'h' - 'a'), ACT_KEY(USAGE_A + 'e' - 'a'), ACT_KEY(USAGE_A + 'l' - 'a'),
+    ACT_KEY(USAGE_A + 'o' - 'a'), ACT_RECORD(0), ACT_PLAY(0),
+};
+static const uint32_t recDefined[6] = { 1, 1, 1, 1, 1, 1 };
+static const KEYMAP recKeymap = { 6, 1, recDefined, recActions };
+
+typedef struct
+{
+    uint32_t t;
+    uint8_t key;
+    bool down;
+} REC_EDGE;
+
+static const REC_EDGE recTyping[] = {
+    { 0, 4, 1 }, { 60000, 4, 0 },                       // Record
+    { 500000, 0, 1 }, { 580000, 0, 0 },                 // h
+    { 640000, 1, 1 }, { 700000, 1, 0 },                 // e
+    { 790000, 2, 1 }, { 850000, 2, 0 },                 // l
+    { 4850000, 2, 1 }, { 4920000, 2, 0 },               // l, after a 4 s pause
+    { 5010000, 3, 1 }, { 5030000, 0, 1 },               // o rolled into h
+    { 5100000, 3, 0 }, { 5120000, 0, 0 },
+    { 5600000, 4, 1 }, { 5660000, 4, 0 },               // Stop
+};
+
+// One main loop pass, as in mouse.c, with the recorder after the report
+static void RecordLoop(SIM *sim, double *recorderSecs)
+{
+    KEY_SET keys, typed;
+    uint32_t busy = nvmSimBusyUs;
+    double start;
+
+    if (!sim->pending) MacroTasks(sim->nowUs);
+    KeySetClear(&keys);
+    KeymapMerge(&keys);
+    MacroMerge(&keys);
+    if (memcmp(&keys, &sim->sent, sizeof(keys)) != 0 && !sim->pending) {
+        sim->sent = keys;
+        sim->pending = true;
+    }
+
+    KeySetClear(&typed);
+    KeymapMerge(&typed);
+    start = NowSeconds();
+    RecorderTasks(&typed, sim->nowUs);
+    *recorderSecs += NowSeconds() - start;
+    sim->nowUs += nvmSimBusyUs - busy;  // The CPU stalls while flash is written
+}
+
+static void RecordRun(SIM *sim, const REC_EDGE *edges, uint32_t count, uint32_t until, double *recorderSecs)
+{
+    uint32_t next = 0, nextPoll = sim->nowUs + POLL_US, base = sim->nowUs;
+
+    while ((int32_t)(sim->nowUs - (base + until)) < 0 || sim->pending) {
+        while (next < count && edges[next].t + base <= sim->nowUs) {
+            KeymapEvent(edges[next].key, edges[next].down);
+            next++;
+        }
+        RecordLoop(sim, recorderSecs);
+        sim->nowUs += LOOP_US;
+        while ((int32_t)(sim->nowUs - nextPoll) >= 0) {
+            nextPoll += POLL_US;
+            if (sim->pending) {
+                sim->pending = false;
+                HostReceive(sim, &sim->sent);
+            }
+        }
+    }
+}
+
+// When each character came in, relative to the first
+static void PrintTimes(const char *label, const uint32_t *times, uint32_t n)
+{
+    uint32_t i;
+
+    printf("  %-10s", label);
+    for (i = 0; i < n; i++) printf(" %7.1f", (times[i] - times[0]) / 1000.0);
+    printf(" ms\n");
+}
+
+static int Record(void)
+{
+    static const REC_EDGE play[] = { { 0, 5, 1 }, { 30000, 5, 0 } };
+    static SIM sim;
+    uint32_t recordedUs[8], i, cut;
+    double typingSecs = 0, idleSecs = 0;
+    uint32_t commitAt = 0, erases, commits;
+    int32_t error;
+    bool ok = true, refused;
+
+    memset(&sim, 0, sizeof(sim));
+    MacroInit();
+    RecorderInit();
+    KeymapInit(&recKeymap, NULL);
+
+    RecordRun(&sim, recTyping, sizeof(recTyping) / sizeof(recTyping[0]), 5700000, &typingSecs);
+    sim.typed[sim.typedLen] = 0;
+    printf("recorded \"%s\": %u of %u arena bytes, %u overflows\n",
+           sim.typed, recordArenaUsed, RECORD_ARENA_SIZE, recordOverflows);
+    printf("  RecorderTasks() %.1f ns per pass on the host while typing, nothing written to flash: %s\n",
+           typingSecs * 1e9 / (5700000 / LOOP_US), nvmSimBusyUs == 0 ? "yes" : "NO");
+    ok &= strcmp(sim.typed, "helloh") == 0 && nvmSimBusyUs == 0;
+    memcpy(recordedUs, sim.typedUs, sizeof(recordedUs));
+
+    // Idle: the flash write starts RECORD_IDLE_MS after the last key
+    erases = nvmSimPageErases;
+    while (recordCommits == 0 && sim.nowUs < 20000000) {
+        RecordRun(&sim, NULL, 0, 1000, &idleSecs);
+        if (commitAt == 0 && nvmSimPageErases != erases) commitAt = sim.nowUs;
+    }
+    printf("  written to flash %.0f ms after the stop key: %u erase, %u rows, %u us of stalls\n",
+           (commitAt - 5600000) / 1000.0, nvmSimPageErases - erases, nvmSimRowWrites, nvmSimBusyUs);
+    ok &= recordCommits == 1;
+
+    // Play from the arena, then from flash after a reset.  The gaps
+    // must match the typing, except for the pause cut to RECORD_GAP_MAX_MS.
+    PrintTimes("typed", recordedUs, 6);
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t reports = sim.reports;
+
+        if (pass == 1) {
+            MacroInit();
+            RecorderInit();
+            KeymapInit(&recKeymap, NULL);
+        }
+        sim.typedLen = 0;
+        RecordRun(&sim, play, 2, 100000, &idleSecs);
+        while (MacroBusy() || sim.pending) RecordRun(&sim, NULL, 0, 1000, &idleSecs);
+        sim.typed[sim.typedLen] = 0;
+        PrintTimes(pass ? "flash" : "RAM", sim.typedUs, sim.typedLen);
+        ok &= strcmp(sim.typed, "helloh") == 0;
+        for (i = 1, cut = 0; i < 6 && sim.typedLen == 6; i++) {
+            error = (int32_t)(sim.typedUs[i] - sim.typedUs[i - 1]) - (int32_t)(recordedUs[i] - recordedUs[i - 1]);
+            if (error < -3000000 - 3000 || error > 3000) ok = false;
+            if (error < -3000) cut++;
+        }
+        printf("    \"%s\" in %u reports, %s\n", sim.typed, sim.reports - reports,
+               cut == 1 ? "gaps within 3 ms, one pause cut" : "TIMING WRONG");
+        ok &= cut == 1;
+    }
+
+    // A new recording while the flash will not take the old one: refused,
+    // and the old one stays in the arena until the flash works again
+    RecorderInit();
+    RecorderToggle(0);
+    RecorderToggle(0);
+    nvmSimOpsLeft = 0;
+    RecorderToggle(1);
+    refused = RecorderPending() && RecorderImage(0) != NULL && RecorderImage(1) == NULL;
+    nvmSimOpsLeft = 0xFFFFFFFF;
+    commits = recordCommits;
+    RecorderToggle(1);
+    RecorderToggle(1);
+    refused &= recordCommits == commits + 1 && RecorderImage(0) != NULL && RecorderImage(1) != NULL;
+    printf("  new recording while the flash write fails: refused, old one kept: %s\n",
+           refused ? "yes" : "NO");
+    ok &= refused;
+    return ok ? 0 : 1;
+}
+
+/*
+ * Leader: random sequences of 1-4 letters, each starting one of 250
+ * macros, compiled by macroc and walked by leader.c.  Every sequence
+ * must start its own macro, and random keys must do what a plain
+ * search of the list says they should.
+ */
+#define LEADER_SEQ_MAX          4000
+#define LEADER_SEQ_KEYS         4
+
+typedef struct
+{
+    uint8_t len;
+    char keys[LEADER_SEQ_KEYS + 1];
+    uint8_t macro;
+} LEADER_SEQ;
+
+static LEADER_SEQ leaderSeqs[LEADER_SEQ_MAX];
+static uint8_t leaderTrieBuf[0x10000], leaderImageBuf[0x10000];
+
+static bool LeaderHas(uint32_t count, const char *keys)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        if (!strcmp(leaderSeqs[i].keys, keys)) return true;
+    }
+    return false;
+}
+
+/*
+ * Reference by linear search: a sequence fires when no longer one
+ * starts with it, or at the timeout after the last key; a key that
+ * leaves every sequence behind ends it with nothing
+ */
+static uint8_t LeaderExpect(uint32_t count, const char *keys)
+{
+    uint32_t i, k, len = strlen(keys);
+    int exact;
+    bool longer;
+
+    for (k = 1; k <= len; k++) {
+        exact = -1;
+        longer = false;
+        for (i = 0; i < count; i++) {
+            if (strncmp(leaderSeqs[i].keys, keys, k)) continue;
+            if (leaderSeqs[i].len == k) exact = i;
+            else longer = true;
+        }
+        if (exact < 0 && !longer) return LEADER_NO_MACRO;
+        if (exact >= 0 && (!longer || k == len)) return leaderSeqs[exact].macro;
+    }
+    return LEADER_NO_MACRO;         // Stopped on a prefix of a sequence
+}
+
+static size_t ReadFile(const char *path, uint8_t *buf, size_t size)
+{
+    FILE *f = fopen(path, "rb");
+    size_t n;
+
+    if (!f) return 0;
+    n = fread(buf, 1, size, f);
+    fclose(f);
+    return n;
+}
+
+// Builds count random sequences with macroc; false if it fails
+static bool LeaderBuild(const char *macroc, uint32_t count)
+{
+    char cmd[512], keys[LEADER_SEQ_KEYS + 1];
+    FILE *f;
+    uint32_t i, j, len;
+
+    srand(count);
+    for (i = 0; i < count; ) {
+        len = 1 + rand() % LEADER_SEQ_KEYS;
+        for (j = 0; j < len; j++) keys[j] = 'a' + rand() % 26;
+        keys[len] = 0;
+        if (LeaderHas(i, keys)) continue;
+        leaderSeqs[i].len = len;
+        strcpy(leaderSeqs[i].keys, keys);
+        leaderSeqs[i].macro = i % 250;
+        i++;
+    }
+
+    if ((f = fopen("/tmp/kbsim_leader.mac", "w")) == NULL) return false;
+    for (i = 0; i < 250; i++) fprintf(f, "macro %u { tap a }\n", i);
+    for (i = 0; i < count; i++) {
+        fprintf(f, "leader");
+        for (j = 0; j < leaderSeqs[i].len; j++) fprintf(f, " %c", leaderSeqs[i].keys[j]);
+        fprintf(f, " = macro %u\n", leaderSeqs[i].macro);
+    }
+    fclose(f);
+
+    snprintf(cmd, sizeof(cmd), "%s -o /tmp/kbsim_leader.img --leader /tmp/kbsim_leader.trie "
+             "/tmp/kbsim_leader.mac", macroc);
+    if (system(cmd) != 0) return false;
+    return ReadFile("/tmp/kbsim_leader.img", leaderImageBuf, sizeof(leaderImageBuf)) != 0 &&
+           ReadFile("/tmp/kbsim_leader.trie", leaderTrieBuf, sizeof(leaderTrieBuf)) != 0;
+}
+
+// Leader, then keys, then the timeout; the macro it started or LEADER_NO_MACRO
+static uint8_t LeaderType(const char *keys)
+{
+    uint32_t fires = leaderFires, t;
+
+    MacroInit();
+    LeaderStart();
+    LeaderTasks(0);
+    for (t = 0; *keys && LeaderActive(); keys++) {
+        LeaderKey(USAGE_A + *keys - 'a');
+        LeaderTasks(t += 100000);
+    }
+    while (LeaderActive()) LeaderTasks(t += 100000);
+    return leaderFires != fires ? leaderLastMacro : LEADER_NO_MACRO;
+}
+
+static int LeaderCheck(const char *macroc)
+{
+    static const uint32_t counts[] = { 10, 100, 1000, LEADER_SEQ_MAX };
+    char keys[LEADER_SEQ_KEYS + 1];
+    uint32_t c, i, j, n, len, wrong, randomWrong, calls;
+    uint64_t cycles;
+    double secs;
+
+    for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        n = counts[c];
+        if (!LeaderBuild(macroc, n)) {
+            printf("macroc failed for %u sequences\n", n);
+            return 1;
+        }
+        LeaderInit(leaderTrieBuf, leaderImageBuf);
+
+        wrong = 0;
+        for (i = 0; i < n; i++) {
+            if (LeaderType(leaderSeqs[i].keys) != leaderSeqs[i].macro) wrong++;
+        }
+        randomWrong = 0;
+        for (i = 0; i < LEADER_SEQ_MAX; i++) {
+            len = 1 + rand() % LEADER_SEQ_KEYS;
+            for (j = 0; j < len; j++) keys[j] = 'a' + rand() % 26;
+            keys[len] = 0;
+            if (LeaderType(keys) != LeaderExpect(n, keys)) randomWrong++;
+        }
+
+        // Cost of one key: a walk down the longest sequences
+        calls = 0;
+        cycles = CycleCount();
+        secs = NowSeconds();
+        for (j = 0; j < 200; j++) {
+            for (i = 0; i < n; i++) {
+                LeaderStart();
+                for (const char *k = leaderSeqs[i].keys; *k && LeaderActive(); k++) {
+                    LeaderKey(USAGE_A + *k - 'a');
+                    calls++;
+                }
+            }
+        }
+        cycles = CycleCount() - cycles;
+        secs = NowSeconds() - secs;
+        printf("%5u sequences, %5u trie bytes: %u/%u sequences and %u/%u random keys wrong, "
+               "%.1f ns (%.0f cycles) per key\n",
+               n, ((const LEADER_TRIE*)leaderTrieBuf)->size, wrong, n, randomWrong, LEADER_SEQ_MAX,
+               secs * 1e9 / calls, (double)cycles / calls);
+        if (wrong || randomWrong) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Steno: keys 0-22 are the keys of English steno and key 23 switches
+ * the output.  Random strokes are written with rolled presses and
+ * releases; the device runs as in mouse.c against a model of the
+ * report queue that holds REPORT_KEY_DEPTH reports, one of which the
+ * host takes per poll.  Every stroke must reach the host intact and
+ * in order, one poll after its last key went up when nothing else
+ * was waiting.
+ */
+#define STENO_SIM_KEYS          23
+#define STENO_SIM_STROKES       2000
+#define STENO_SIM_DEPTH         8       // REPORT_KEY_DEPTH
+
+static const uint8_t stenoSimKeys[STENO_SIM_KEYS] = {
+    STENO_S1, STENO_TL, STENO_KL, STENO_PL, STENO_WL, STENO_HL, STENO_RL, STENO_A, STENO_O,
+    STENO_STAR1, STENO_E, STENO_U, STENO_FR, STENO_RR, STENO_PR, STENO_BR, STENO_LR, STENO_GR,
+    STENO_TR, STENO_SR, STENO_DR, STENO_ZR, STENO_NUM1,
+};
+static uint16_t stenoSimActions[STENO_SIM_KEYS + 1];
+static const uint32_t stenoSimDefined[STENO_SIM_KEYS + 1] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+static const KEYMAP stenoSimKeymap = { STENO_SIM_KEYS + 1, 1, stenoSimDefined, stenoSimActions };
+
+// "T", "SKP", "-T", "KW-PL", "STKPW": sorted by stroke
+static const uint32_t stenoSimStrokes[] = { 0x000004, 0x00001A, 0x00003E, 0x028028, 0x080000 };
+static const uint16_t stenoSimText[] = { 0, 4, 9, 11, 21 };
+static const char stenoSimStrings[] = "it \0and \0z\0question \0the ";
+static const STENO_DICT stenoSimDict = { 5, stenoSimStrokes, stenoSimText, stenoSimStrings };
+
+typedef struct
+{
+    bool steno;
+    STENO_REPORT report;
+    KEY_SET keys;
+} SIM_REPORT;
+
+typedef struct
+{
+    SIM sim;
+    SIM_REPORT queue[STENO_SIM_DEPTH];
+    uint8_t queued;
+    uint32_t nextPoll;
+    uint64_t strokes[STENO_SIM_STROKES];    // As the host got them
+    uint32_t strokesUs[STENO_SIM_STROKES];
+    uint32_t strokeCount;
+    bool zeroNext;                  // A stroke report must be followed by an empty one
+    bool badPair;
+    uint32_t keyReports;            // Keyboard reports the host has taken
+    uint32_t markReports;           // The count when the last stroke ended
+    uint32_t firstReportUs;         // When the report after that came in
+} STENO_SIM;
+
+static bool StenoSimPost(STENO_SIM *st, const SIM_REPORT *r)
+{
+    if (st->queued == STENO_SIM_DEPTH) return false;
+    st->queue[st->queued++] = *r;
+    return true;
+}
+
+// One pass of mouse.c's loop: SendSteno(), StenoTasks(), BuildReport(), SendReport()
+static void StenoSimLoop(STENO_SIM *st)
+{
+    const STENO_REPORT *pending;
+    SIM_REPORT r;
+
+    memset(&r, 0, sizeof(r));
+    r.steno = true;
+    while ((pending = StenoPendingReport()) != NULL) {
+        r.report = *pending;
+        if (!StenoSimPost(st, &r)) break;
+        StenoReportSent();
+    }
+    if (st->queued == 0) StenoTasks();
+
+    r.steno = false;
+    KeySetClear(&r.keys);
+    KeymapMerge(&r.keys);
+    StenoMerge(&r.keys);
+    if (memcmp(&r.keys, &st->sim.sent, sizeof(r.keys)) != 0 && StenoSimPost(st, &r)) {
+        st->sim.sent = r.keys;
+    }
+}
+
+static void StenoSimPoll(STENO_SIM *st)
+{
+    SIM_REPORT r;
+    uint64_t keys = 0;
+    int i;
+
+    if (st->queued == 0) return;
+    r = st->queue[0];
+    memmove(&st->queue[0], &st->queue[1], --st->queued * sizeof(r));
+    if (!r.steno) {
+        if (st->keyReports++ == st->markReports) st->firstReportUs = st->sim.nowUs;
+        HostReceive(&st->sim, &r.keys);
+        return;
+    }
+    for (i = sizeof(r.report.keys) - 1; i >= 0; i--) keys = keys << 8 | r.report.keys[i];
+    if (r.report.reportId != REPORT_ID_STENO || (keys == 0) != st->zeroNext) st->badPair = true;
+    st->zeroNext = keys != 0;
+    if (keys != 0 && st->strokeCount < STENO_SIM_STROKES) {
+        st->strokesUs[st->strokeCount] = st->sim.nowUs;
+        st->strokes[st->strokeCount++] = keys;
+    }
+}
+
+static void StenoSimRun(STENO_SIM *st, uint32_t us)
+{
+    uint32_t end = st->sim.nowUs + us;
+
+    while ((int32_t)(st->sim.nowUs - end) < 0) {
+        StenoSimLoop(st);
+        st->sim.nowUs += LOOP_US;
+        if ((int32_t)(st->sim.nowUs - st->nextPoll) >= 0) {
+            st->nextPoll += POLL_US;
+            StenoSimPoll(st);
+        }
+    }
+}
+
+typedef struct
+{
+    uint32_t count, late;
+    uint32_t worstUs;               // Of the strokes that found the device idle
+    uint32_t charLate, charWorstUs; // The same for the first character
+    uint32_t backlogged;            // Released while earlier text was still going out
+} STENO_LATENCY;
+
+// A stroke with the keys rolled on and off; returns the machine keys
+static uint64_t StenoSimStroke(STENO_SIM *st, uint32_t keys, uint32_t rollUs, uint32_t *releaseUs, bool *idle)
+{
+    uint8_t order[STENO_SIM_KEYS];
+    uint64_t chord = 0;
+    uint32_t n = 0, i, j;
+    uint8_t t;
+
+    for (i = 0; i < STENO_SIM_KEYS; i++) {
+        if (keys & (1ul << i)) order[n++] = i;
+    }
+    for (i = n; i > 1; i--) {
+        j = rand() % i;
+        t = order[i - 1], order[i - 1] = order[j], order[j] = t;
+    }
+    for (i = 0; i < n; i++) {
+        KeymapEvent(order[i], true);
+        chord |= 1ull << stenoSimKeys[order[i]];
+        StenoSimRun(st, rand() % rollUs);
+    }
+    StenoSimRun(st, rollUs + rand() % (5 * rollUs));
+    for (i = n; i > 1; i--) {
+        j = rand() % i;
+        t = order[i - 1], order[i - 1] = order[j], order[j] = t;
+    }
+    for (i = 0; i < n; i++) {
+        if (i == n - 1) {
+            *idle = !StenoBusy() && st->queued == 0;
+            *releaseUs = st->sim.nowUs;
+            st->markReports = st->keyReports;
+        }
+        KeymapEvent(order[i], false);
+        if (i < n - 1) StenoSimRun(st, rand() % rollUs);
+    }
+    return chord;
+}
+
+// The text a stroke types: the dictionary's, or its steno and a space
+static void StenoSimExpect(uint64_t chord, char *out)
+{
+    const char *text = StenoLookup(StenoFold(chord));
+    size_t n;
+
+    if (text != NULL) {
+        strcat(out, text);
+        return;
+    }
+    n = strlen(out);
+    n += StenoFormat(StenoFold(chord), out + n);
+    strcpy(out + n, " ");
+}
+
+static int StenoCheck(void)
+{
+    static const struct { uint32_t stroke; const char *text; } formats[] = {
+        { 0x00003E, "STKPW" }, { 0x136000, "-FRBLS" }, { 0x080003, "#S-T" },
+        { 0x000C00, "*E" }, { 0x000001, "#" }, { 0x7FFFFF, "#STKPWHRAO*EUFRPBLGTSDZ" },
+    };
+    static STENO_SIM st;
+    static char expect[MAX_TEXT];
+    STENO_LATENCY lat;
+    uint32_t i, keys, releaseUs = 0, gapUs, strokesUs[STENO_SIM_STROKES];
+    uint64_t chords[STENO_SIM_STROKES];
+    char text[STENO_TEXT_MAX];
+    bool idle = false, fast, ok = true;
+    int out;
+
+    for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        StenoFormat(formats[i].stroke, text);
+        if (strcmp(text, formats[i].text)) {
+            printf("stroke 0x%06X written \"%s\", not \"%s\"\n", formats[i].stroke, text, formats[i].text);
+            ok = false;
+        }
+    }
+    for (i = 0; i < STENO_SIM_KEYS; i++) stenoSimActions[i] = ACT_STENO(stenoSimKeys[i]);
+    stenoSimActions[STENO_SIM_KEYS] = ACT_STENO(STENO_OUTPUT);
+
+    for (out = STENO_OUT_PLOVER; out <= STENO_OUT_TEXT; out++) {
+        memset(&st, 0, sizeof(st));
+        memset(&lat, 0, sizeof(lat));
+        KeymapInit(&stenoSimKeymap, NULL);
+        StenoInit(&stenoSimDict, STENO_OUT_PLOVER);
+        if (out == STENO_OUT_TEXT) {
+            KeymapEvent(STENO_SIM_KEYS, true);
+            KeymapEvent(STENO_SIM_KEYS, false);
+        }
+        expect[0] = 0;
+        srand(39);
+
+        // Half the strokes are briefs; a tenth come straight after the
+        // one before and are rolled ten times as fast
+        fast = false;
+        for (i = 0; i < STENO_SIM_STROKES; i++) {
+            // Keys 0-21 are STENO_ORDER bits 1-22
+            keys = rand() % 2 ? stenoSimStrokes[rand() % 5] >> 1 : rand() & ((1ul << STENO_SIM_KEYS) - 1);
+            if (keys == 0) keys = 1ul << (rand() % STENO_SIM_KEYS);
+            chords[i] = StenoSimStroke(&st, keys, fast ? 1000 : 8000, &releaseUs, &idle);
+            if (out == STENO_OUT_TEXT && strlen(expect) < MAX_TEXT - 64) StenoSimExpect(chords[i], expect);
+            fast = rand() % 10 == 0;
+            gapUs = fast ? rand() % 1000 : 30000 + rand() % 150000;
+
+            // Wait for the stroke to come in, then for the gap
+            strokesUs[i] = releaseUs;
+            if (out == STENO_OUT_PLOVER) {
+                StenoSimRun(&st, gapUs);
+            } else {
+                uint32_t before = st.sim.typedLen, reportUs, charUs;
+
+                StenoSimRun(&st, gapUs);
+                if (idle && st.sim.typedLen > before) {
+                    reportUs = st.firstReportUs - releaseUs;
+                    charUs = st.sim.typedUs[before] - releaseUs;
+                    lat.count++;
+                    if (reportUs > lat.worstUs) lat.worstUs = reportUs;
+                    if (reportUs > POLL_US + LOOP_US) lat.late++;
+                    if (charUs > lat.charWorstUs) lat.charWorstUs = charUs;
+                    if (charUs > POLL_US + LOOP_US) lat.charLate++;
+                } else if (!idle) {
+                    lat.backlogged++;
+                }
+            }
+        }
+        StenoSimRun(&st, 2000000);
+
+        if (out == STENO_OUT_PLOVER) {
+            for (i = 0; i < STENO_SIM_STROKES && i < st.strokeCount; i++) {
+                if (st.strokes[i] != chords[i]) break;
+                lat.count++;
+                if (st.strokesUs[i] - strokesUs[i] > lat.worstUs) lat.worstUs = st.strokesUs[i] - strokesUs[i];
+                if (st.strokesUs[i] - strokesUs[i] > POLL_US + LOOP_US) lat.late++;
+            }
+            printf("Plover HID: %u/%u strokes intact and in order%s, %u dropped; "
+                   "%u later than one poll, worst %u us after the last key up\n",
+                   lat.count, STENO_SIM_STROKES, st.badPair ? ", BAD REPORT PAIRS" : "",
+                   stenoDropped, lat.late, lat.worstUs);
+            ok &= lat.count == STENO_SIM_STROKES && st.strokeCount == STENO_SIM_STROKES &&
+                  !st.badPair && lat.late == 0;
+        } else {
+            // The host's buffer holds the first MAX_TEXT characters
+            i = strlen(expect);
+            printf("text:       first %u characters %s, %u dropped; of the %u strokes that found the device idle, "
+                   "%u got their first report later than one poll, worst %u us; first character worst %u us, "
+                   "%u after the poll a Shift change takes; %u queued behind earlier text\n",
+                   i, st.sim.typedLen >= i && !strncmp(st.sim.typed, expect, i) ? "exact" : "WRONG",
+                   stenoDropped, lat.count, lat.late, lat.worstUs, lat.charWorstUs, lat.charLate, lat.backlogged);
+            ok &= st.sim.typedLen >= i && !strncmp(st.sim.typed, expect, i) && lat.late == 0 &&
+                  lat.charWorstUs <= 2 * POLL_US + LOOP_US && stenoDropped == 0;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+/*
+ * Typematic: key 0 repeats macro 0, a tap of 'a', and is held for
+ * TM_HOLD_US at each rate.  Main loop passes take a random 5-60 us,
+ * as they do when other work comes and goes.  The repeats must land
+ * on the rate's grid to within the poll they are reported in, and
+ * none may start once the key is up.
+ */
+#define TM_DELAY_MS             250
+#define TM_HOLD_US              2000000
+#define TM_AFTER_US             100000
+
+static const uint8_t tmImage[] __attribute__ ((aligned(4))) = {
+    0x43, 0x4D, MACRO_IMAGE_VERSION, 1, 13, 0, 0, 0,   // MACRO_IMAGE, one macro
+    10, 0,
+    MOP_TAP, USAGE_A, MOP_END,
+};
+static const uint16_t tmActions[1] = { ACT_MACRO_RPT(0) };
+static const uint32_t tmDefined[1] = { 1 };
+static const KEYMAP tmKeymap = { 1, 1, tmDefined, tmActions };
+
+static void TypematicRun(SIM *sim, uint32_t until, uint32_t *nextPoll)
+{
+    KEY_SET keys;
+
+    while ((int32_t)(sim->nowUs - until) < 0) {
+        TypematicTasks(sim->nowUs);
+        if (!sim->pending) MacroTasks(sim->nowUs);
+        KeySetClear(&keys);
+        KeymapMerge(&keys);
+        MacroMerge(&keys);
+        if (memcmp(&keys, &sim->sent, sizeof(keys)) != 0 && !sim->pending) {
+            sim->sent = keys;
+            sim->pending = true;
+        }
+        sim->nowUs += 5 + rand() % 56;
+        while ((int32_t)(sim->nowUs - *nextPoll) >= 0) {
+            *nextPoll += POLL_US;
+            if (sim->pending) {
+                sim->pending = false;
+                HostReceive(sim, &sim->sent);
+            }
+        }
+    }
+}
+
+static int Typematic(void)
+{
+    static const uint16_t rates[] = { 10, 30, 100, 250, 500, 1000 };
+    static SIM sim;
+    uint32_t r, i, nextPoll, period, expected, late, skipped;
+    int32_t dev, worst;
+    double sum, first;
+    bool slack, ok = true;
+
+    printf("rate/s  period   chars expected  first repeat  mean |error|  worst   after release  skipped\n");
+    for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        memset(&sim, 0, sizeof(sim));
+        MacroInit();
+        KeymapInit(&tmKeymap, tmImage);
+        TypematicInit(TM_DELAY_MS, rates[r]);
+        srand(40 + r);
+        skipped = typematicSkipped;
+        nextPoll = POLL_US / 3;         // The host's frame clock is not ours
+
+        sim.nowUs = 0;
+        KeymapEvent(0, true);
+        TypematicRun(&sim, TM_HOLD_US, &nextPoll);
+        KeymapEvent(0, false);
+        TypematicRun(&sim, TM_HOLD_US + TM_AFTER_US, &nextPoll);
+
+        // A tap needs two reports, so the effective period is at least
+        // two polls; past that the grid restarts from each run and the
+        // count can be one out
+        period = 1000000 / rates[r];
+        slack = period < 2 * POLL_US;
+        if (slack) period = 2 * POLL_US;
+        expected = 2 + (TM_HOLD_US - TM_DELAY_MS * 1000 - 1) / period;
+
+        // Repeat n is due at delay + (n - 1) * period after the first character
+        sum = 0;
+        worst = 0;
+        late = 0;
+        first = sim.typedLen > 1 ? (sim.typedUs[1] - sim.typedUs[0]) / 1000.0 : 0;
+        for (i = 1; i < sim.typedLen; i++) {
+            dev = (int32_t)(sim.typedUs[i] - sim.typedUs[0]) - (int32_t)(TM_DELAY_MS * 1000 + (i - 1) * period);
+            sum += abs(dev);
+            if (abs(dev) > abs(worst)) worst = dev;
+            if (sim.typedUs[i] > TM_HOLD_US + 2 * POLL_US) late++;
+        }
+        i = sim.typedLen > 1 ? sim.typedLen - 1 : 1;
+        printf("%6u %7u us %6u %8u  %9.2f ms %8.0f us %6d us %8u %12u\n",
+               rates[r], period, sim.typedLen, expected, first,
+               sum / i, worst, late, typematicSkipped - skipped);
+        ok &= abs((int32_t)(sim.typedLen - expected)) <= slack && late == 0 && abs(worst) <= POLL_US;
+    }
+    return ok ? 0 : 1;
+}
+
+/*
+ * Flash store: a skewed stream of updates to a few small hot keys and
+ * a keymap and macro image that rarely change, with and without bulk
+ * values that never do.  Reports write amplification, the spread of
+ * erases over the pages, stalls and the cost of a mount, then cuts the
+ * power at random points of random writes: after each remount every
+ * key must hold its old value or its new one.
+ */
+#define ST_KEYS                 16
+#define ST_KEY_KEYMAP           0
+#define ST_KEY_MACROS           1
+#define ST_HOT                  8       // Keys 2-9
+#define ST_WRITES               50000
+#define ST_CUTS                 5000
+#define ST_CUT_OPS              600     // More than a write with a collection takes
+
+typedef struct
+{
+    uint16_t length;                // 0: absent
+    uint8_t data[FSTORE_VALUE_MAX];
+} ST_VALUE;
+
+static ST_VALUE stModel[ST_KEYS];
+
+static void StoreWipe(void)
+{
+    uint8_t page;
+
+    for (page = 0; page < FSTORE_PAGES; page++) NVMErasePage(FSTORE_BASE + page * NVM_PAGE_SIZE);
+    FlashStoreInit();
+    flashStoreUserBytes = flashStoreFlashBytes = flashStoreErases = 0;
+    memset(stModel, 0, sizeof(stModel));
+}
+
+static void StoreValue(uint8_t key, ST_VALUE *v)
+{
+    uint16_t i;
+
+    if (key == ST_KEY_KEYMAP) v->length = KEYMAP_BLOB_SIZE(48, 4);
+    else if (key == ST_KEY_MACROS) v->length = 600 + rand() % 360;
+    else if (key < 2 + ST_HOT) v->length = 4 + rand() % 120;
+    else v->length = 500;
+    for (i = 0; i < v->length; i++) v->data[i] = rand();
+}
+
+// Half the writes go to one key, most of the rest to the other hot ones
+static uint8_t StorePick(void)
+{
+    uint32_t r = rand() % 1000;
+
+    if (r < 500) return 2;
+    if (r < 985) return 3 + r % (ST_HOT - 1);
+    return r < 995 ? ST_KEY_MACROS : ST_KEY_KEYMAP;
+}
+
+static bool StoreHolds(uint8_t key, const ST_VALUE *v)
+{
+    uint16_t length;
+    const void *data = FlashStoreRead(key, &length);
+
+    if (v->length == 0) return data == NULL;
+    return data != NULL && length == v->length && memcmp(data, v->data, length) == 0;
+}
+
+static bool StoreCheckAll(void)
+{
+    uint8_t key;
+
+    for (key = 0; key < ST_KEYS; key++) {
+        if (!StoreHolds(key, &stModel[key])) return false;
+    }
+    return true;
+}
+
+static bool StoreWorkload(const char *label, uint8_t bulk)
+{
+    static ST_VALUE v;
+    uint32_t i, busy, worst = 0, failed = 0, lo = ~0u, hi = 0, n, reps;
+    uint8_t key, page;
+    double t;
+    bool ok = true;
+
+    StoreWipe();
+    for (key = 0; key < 2 + ST_HOT + bulk; key++) {
+        StoreValue(key, &stModel[key]);
+        ok &= FlashStoreWrite(key, stModel[key].data, stModel[key].length);
+    }
+    flashStoreUserBytes = flashStoreFlashBytes = flashStoreErases = 0;
+    busy = nvmSimBusyUs;
+
+    for (i = 0; i < ST_WRITES; i++) {
+        uint32_t before = nvmSimBusyUs;
+
+        key = StorePick();
+        StoreValue(key, &v);
+        if (FlashStoreWrite(key, v.data, v.length)) stModel[key] = v;
+        else failed++;
+        if (nvmSimBusyUs - before > worst) worst = nvmSimBusyUs - before;
+        if (i % 1000 == 999) {
+            FlashStoreInit();
+            ok &= StoreCheckAll();
+        }
+    }
+    for (page = 0; page < FSTORE_PAGES; page++) {
+        n = FlashStorePageErases(page);
+        if (n < lo) lo = n;
+        if (n > hi) hi = n;
+    }
+
+    reps = 2000;
+    t = NowSeconds();
+    for (i = 0; i < reps; i++) FlashStoreInit();
+    t = NowSeconds() - t;
+    ok &= StoreCheckAll() && failed == 0;
+
+    printf("%s: %u of %u bytes live\n", label, flashStoreLiveBytes, (uint32_t)FSTORE_CAPACITY);
+    printf("  %u writes, %u failed: %u value bytes, %u programmed, write amplification %.2f\n",
+           ST_WRITES, failed, flashStoreUserBytes, flashStoreFlashBytes,
+           (double)flashStoreFlashBytes / flashStoreUserBytes);
+    printf("  %u erases, %.1f writes each; per page min %u max %u\n",
+           flashStoreErases, (double)ST_WRITES / flashStoreErases, lo, hi);
+    printf("  stall per write mean %.0f us, worst %.1f ms\n",
+           (double)(nvmSimBusyUs - busy) / ST_WRITES, worst / 1000.0);
+    printf("  mount reads %u bytes, %.1f us on the host\n", flashStoreMountBytes, t * 1e6 / reps);
+    printf("  remount every 1000 writes matches: %s\n", ok ? "yes" : "NO");
+    return ok;
+}
+
+static bool StorePowerCuts(void)
+{
+    static ST_VALUE v;
+    uint32_t i, kept = 0, took = 0, bad = 0;
+    uint8_t key;
+    bool deleting;
+
+    for (i = 0; i < ST_CUTS; i++) {
+        key = StorePick();
+        deleting = rand() % 20 == 0;
+        if (deleting) v.length = 0;
+        else StoreValue(key, &v);
+
+        nvmSimOpsLeft = rand() % ST_CUT_OPS;
+        if (deleting) FlashStoreDelete(key);
+        else FlashStoreWrite(key, v.data, v.length);
+        nvmSimOpsLeft = 0xFFFFFFFF;
+
+        // Reset: everything else unchanged, the key old or new
+        FlashStoreInit();
+        if (StoreHolds(key, &v)) {
+            took++;
+            stModel[key] = v;
+        } else if (StoreHolds(key, &stModel[key])) {
+            kept++;
+        } else {
+            bad++;
+        }
+        if (!StoreCheckAll()) bad++;
+    }
+    printf("power cut in %u writes: %u kept the old value, %u the new, %u anything else\n",
+           ST_CUTS, kept, took, bad);
+    return bad == 0;
+}
+
+// A keymap through the store comes back as the same keymap
+static bool StoreKeymap(void)
+{
+    static uint8_t blob[KEYMAP_BLOB_SIZE(6, 1)] __attribute__ ((aligned(4)));
+    static uint8_t bad[sizeof(blob)] __attribute__ ((aligned(4)));
+    static const uint16_t badActions[] = { ACT_MO(1), ACT_TG(5), ACT_OSL(31), ACT_LT(1, 0x04) };
+    KEYMAP_BLOB *hdr = (KEYMAP_BLOB*)blob;
+    uint16_t *actions = (uint16_t*)(bad + sizeof(KEYMAP_BLOB) + sizeof(recDefined));
+    uint8_t i;
+    KEYMAP map;
+    const void *stored;
+    uint16_t length;
+    uint8_t key;
+    bool ok;
+
+    hdr->keys = recKeymap.keys;
+    hdr->layers = recKeymap.layers;
+    hdr->reserved = 0;
+    memcpy(hdr + 1, recDefined, sizeof(recDefined));
+    memcpy(blob + sizeof(KEYMAP_BLOB) + sizeof(recDefined), recActions, sizeof(recActions));
+    ok = FlashStoreWrite(ST_KEY_KEYMAP, blob, sizeof(blob));
+    stModel[ST_KEY_KEYMAP].length = 0;     // Not the model's any more
+
+    FlashStoreInit();
+    stored = FlashStoreRead(ST_KEY_KEYMAP, &length);
+    ok &= KeymapFromBlob(&map, stored, length);
+    KeymapInit(&map, NULL);
+    for (key = 0; ok && key < recKeymap.keys; key++) ok = KeymapResolve(key) == recActions[key];
+    ok &= !KeymapFromBlob(&map, blob, sizeof(blob) - 2);
+
+    // Layers the blob does not have: a defined bit, then each layer action
+    memcpy(bad, blob, sizeof(bad));
+    ((uint32_t*)(bad + sizeof(KEYMAP_BLOB)))[2] |= 1u << 1;
+    ok &= !KeymapFromBlob(&map, bad, sizeof(bad));
+    for (i = 0; i < sizeof(badActions) / sizeof(badActions[0]); i++) {
+        memcpy(bad, blob, sizeof(bad));
+        actions[3] = badActions[i];
+        ok &= !KeymapFromBlob(&map, bad, sizeof(bad));
+    }
+    printf("keymap blob stored and resolved after a remount, bad layers refused: %s\n", ok ? "yes" : "NO");
+    return ok;
+}
+
+static int Store(void)
+{
+    bool ok = true;
+
+    srand(41);
+    ok &= StoreWorkload("hot keys, keymap and macros", 0);
+    ok &= StoreWorkload("plus two 500-byte values that never change", 2);
+    ok &= StorePowerCuts();
+    ok &= StoreKeymap();
+    return ok ? 0 : 1;
+}
+
+/*
+ * Execute in place: a 48-key, 8-layer keymap and a macro library are
+ * written to the flash store, then used where they are (as ConfigInit()
+ * does) and, for comparison, copied to RAM first.  The host cannot see
+ * flash timing, so the device cost is counted instead: every load from
+ * flash, and every change of 16-byte line, which is all the prefetch
+ * module has to fetch for straight-line bytecode.
+ */
+#define XIP_KEYS                48
+#define XIP_LAYERS              8
+#define XIP_MACROS              32
+#define XIP_LOOKUPS             20000000
+#define XIP_PLAYS               200000
+#define XIP_SYS_FREQ            40000000
+#define XIP_FLASH_WS            1       // Wait states at XIP_SYS_FREQ
+#define XIP_LINE                16
+#define XIP_DESCRIPTOR          12      // KEYMAP on the PIC32: two bytes, two pointers
+
+static uint8_t xipBlob[FSTORE_VALUE_MAX] __attribute__ ((aligned(4)));
+static uint8_t xipImage[FSTORE_VALUE_MAX] __attribute__ ((aligned(4)));
+static uint8_t xipRamBlob[FSTORE_VALUE_MAX] __attribute__ ((aligned(4)));
+static uint8_t xipRamImage[FSTORE_VALUE_MAX] __attribute__ ((aligned(4)));
+
+static uint16_t XipBuildKeymap(void)
+{
+    KEYMAP_BLOB *hdr = (KEYMAP_BLOB*)xipBlob;
+    uint32_t *defined = (uint32_t*)(hdr + 1);
+    uint16_t *actions = (uint16_t*)(defined + XIP_KEYS), a;
+    uint8_t key, layer;
+
+    hdr->keys = XIP_KEYS;
+    hdr->layers = XIP_LAYERS;
+    hdr->reserved = 0;
+    for (key = 0; key < XIP_KEYS; key++) {
+        defined[key] = 0;
+        for (layer = 0; layer < XIP_LAYERS; layer++) {
+            a = layer == 0 ? ACT_KEY(USAGE_A + key % 26)
+              : rand() % 3 == 0 ? ACT_KEY(USAGE_A + rand() % 26) : ACT_TRANSPARENT;
+            actions[key * XIP_LAYERS + layer] = a;
+            if (a != ACT_TRANSPARENT) defined[key] |= 1u << layer;
+        }
+    }
+    return KEYMAP_BLOB_SIZE(XIP_KEYS, XIP_LAYERS);
+}
+
+// Macros of 6-14 taps, a few with a modifier: bytecode, not text
+static uint16_t XipBuildImage(uint32_t *codeBytes)
+{
+    MACRO_IMAGE *hdr = (MACRO_IMAGE*)xipImage;
+    uint16_t at = sizeof(MACRO_IMAGE) + 2 * XIP_MACROS;
+    uint8_t id, n, i;
+
+    *codeBytes = 0;
+    for (id = 0; id < XIP_MACROS; id++) {
+        hdr->offset[id] = at;
+        n = 6 + rand() % 9;
+        if (id % 4 == 0) {
+            xipImage[at++] = MOP_MODS;
+            xipImage[at++] = 0x02;
+        }
+        for (i = 0; i < n; i++) {
+            xipImage[at++] = MOP_TAP;
+            xipImage[at++] = USAGE_A + rand() % 26;
+        }
+        xipImage[at++] = MOP_END;
+        *codeBytes += at - hdr->offset[id];
+    }
+    hdr->magic = MACRO_IMAGE_MAGIC;
+    hdr->version = MACRO_IMAGE_VERSION;
+    hdr->count = XIP_MACROS;
+    hdr->size = at;
+    hdr->pairs = 0;
+    return at;
+}
+
+static double XipLookups(const KEYMAP *map)
+{
+    volatile uint32_t sink;
+    uint32_t i, sum = 0;
+    double t;
+
+    KeymapInit(map, NULL);
+    t = NowSeconds();
+    for (i = 0; i < XIP_LOOKUPS; i++) sum += KeymapResolve((i * 7) % XIP_KEYS);
+    t = NowSeconds() - t;
+    sink = sum;
+    (void)sink;
+    return t * 1e9 / XIP_LOOKUPS;
+}
+
+static double XipPlay(const uint8_t *image, uint32_t *steps)
+{
+    KEY_SET keys;
+    uint32_t i;
+    double t;
+
+    MacroInit();
+    macroSteps = 0;
+    t = NowSeconds();
+    for (i = 0; i < XIP_PLAYS; i++) {
+        MacroStart(image, MacroImageEntry(image, i % XIP_MACROS), MACRO_NO_TRIGGER);
+        while (MacroBusy()) {
+            MacroTasks(0);
+            KeySetClear(&keys);
+            MacroMerge(&keys);
+        }
+    }
+    t = NowSeconds() - t;
+    *steps = macroSteps;
+    return t * 1e9 / macroSteps;
+}
+
+// Line changes reading the macro's code front to back
+static uint32_t XipLines(const uint8_t *image)
+{
+    const MACRO_IMAGE *hdr = (const MACRO_IMAGE*)image;
+    uint32_t lines = 0, id, at, last;
+
+    for (id = 0; id < hdr->count; id++) {
+        last = ~0u;
+        for (at = hdr->offset[id]; ; at++) {
+            if (at / XIP_LINE != last) lines++;
+            last = at / XIP_LINE;
+            if (image[at] == MOP_END) break;
+            if (image[at] == MOP_MODS || image[at] == MOP_TAP) at++;
+        }
+    }
+    return lines;
+}
+
+static int Xip(void)
+{
+    const double cyclesNs = 1e9 / XIP_SYS_FREQ;
+    uint16_t blobLength, imageLength, length;
+    uint32_t codeBytes, steps, lines, copyWords;
+    const void *blob, *image;
+    KEYMAP flash, ram;
+    double xipNs, ramNs, copyUs;
+    bool ok = true;
+
+    srand(42);
+    blobLength = XipBuildKeymap();
+    imageLength = XipBuildImage(&codeBytes);
+    ok &= FlashStoreWrite(ST_KEY_KEYMAP, xipBlob, blobLength);
+    ok &= FlashStoreWrite(ST_KEY_MACROS, xipImage, imageLength);
+    FlashStoreInit();
+
+    // In place, as ConfigInit() does it
+    blob = FlashStoreRead(ST_KEY_KEYMAP, &length);
+    ok &= KeymapFromBlob(&flash, blob, length);
+    image = FlashStoreRead(ST_KEY_MACROS, &length);
+    ok &= MacroImageValid(image, length);
+
+    // Copied: buffers for the largest value the store can give back
+    memcpy(xipRamBlob, blob, blobLength);
+    memcpy(xipRamImage, image, imageLength);
+    ok &= KeymapFromBlob(&ram, xipRamBlob, blobLength);
+    copyWords = (blobLength + imageLength + 3) / 4;
+    copyUs = copyWords * (2 + XIP_FLASH_WS) * cyclesNs / 1000;
+
+    printf("keymap %u keys x %u layers, %u bytes; %u macros, %u bytes\n",
+           XIP_KEYS, XIP_LAYERS, blobLength, XIP_MACROS, imageLength);
+    printf("RAM: in place %u bytes (the KEYMAP descriptor), copied %u bytes, %u reserved for the largest values\n",
+           XIP_DESCRIPTOR, XIP_DESCRIPTOR + blobLength + imageLength, (uint32_t)(XIP_DESCRIPTOR + 2 * FSTORE_VALUE_MAX));
+    printf("boot: in place nothing to copy, copied %u words, ~%.1f us at %u MHz\n",
+           copyWords, copyUs, XIP_SYS_FREQ / 1000000);
+
+    xipNs = XipLookups(&flash);
+    ramNs = XipLookups(&ram);
+    printf("lookup: host %.2f ns in place, %.2f ns copied; on the device 2 flash loads,"
+           " +%u cycles (%.0f ns) at %u wait state%s\n",
+           xipNs, ramNs, 2 * XIP_FLASH_WS, 2 * XIP_FLASH_WS * cyclesNs,
+           XIP_FLASH_WS, XIP_FLASH_WS == 1 ? "" : "s");
+
+    xipNs = XipPlay(image, &steps);
+    ramNs = XipPlay(xipRamImage, &steps);
+    lines = XipLines(image);
+    printf("macros: host %.2f ns/instruction in place, %.2f ns copied; %u bytes of code in %u lines,"
+           " a new line every %.1f bytes\n",
+           xipNs, ramNs, codeBytes, lines, (double)codeBytes / lines);
+    printf("  on the device +%.2f cycles/instruction if every byte waits, +%.2f if only a new line does\n",
+           (double)codeBytes * XIP_FLASH_WS / (steps / (XIP_PLAYS / XIP_MACROS)),
+           (double)lines * XIP_FLASH_WS / (steps / (XIP_PLAYS / XIP_MACROS)));
+    return ok ? 0 : 1;
+}
+
+/*
+ * Packed stream text: a macro library is built by macroc packed and
+ * with --no-pack, and each macro is played from both images through
+ * the report queue model.  Both must type the same characters in the
+ * same number of reports at the same times, so unpacking keeps up
+ * with the 1 ms poll; the host cost of a report is timed both ways.
+ */
+#define PACK_PLAYS              200
+#define PACK_TRIGGER_UP_US      250000  // When wait_release lets go
+#define PACK_LIMIT_US           10000000    // Endless macros are stopped here
+
+static uint8_t packImage[2][0x10000];
+static SIM packSim[2];
+
+static uint32_t PackBuild(const char *macroc, const char *source, bool pack, uint8_t *image)
+{
+    char cmd[512];
+
+    snprintf(cmd, sizeof(cmd), "%s %s-o /tmp/kbsim_pack.img %s", macroc, pack ? "" : "--no-pack ", source);
+    if (system(cmd) != 0) return 0;
+    return ReadFile("/tmp/kbsim_pack.img", image, 0x10000);
+}
+
+// As Run(), with the trigger key let go and endless macros stopped
+static void PackRun(SIM *sim, const uint8_t *image, uint8_t id)
+{
+    uint32_t nextPoll = POLL_US;
+
+    memset(sim, 0, sizeof(*sim));
+    MacroInit();
+    MacroStart(image, MacroImageEntry(image, id), 0);
+    while (MacroBusy() || sim->pending) {
+        if (sim->nowUs == PACK_TRIGGER_UP_US) MacroTriggerUp(0);
+        if (sim->nowUs == PACK_LIMIT_US) MacroStop(0);
+        DeviceLoop(sim);
+        sim->nowUs += LOOP_US;
+        if ((int32_t)(sim->nowUs - nextPoll) >= 0) {
+            nextPoll += POLL_US;
+            if (sim->pending) {
+                sim->pending = false;
+                HostReceive(sim, &sim->sent);
+            }
+        }
+    }
+}
+
+// Deepest pair in the image's table, 0 if it has none
+static uint8_t PackDepth(const uint8_t *image)
+{
+    const uint8_t *pairs = MacroImagePairs(image);
+    uint8_t height[TEXT_PAIRS_MAX], deepest = 0, h, i, j, c;
+
+    for (i = 0; pairs != NULL && i < pairs[0]; i++) {
+        h = 1;
+        for (j = 1; j <= 2; j++) {
+            c = pairs[2 * i + j];
+            if (c >= TEXT_PAIR_FIRST && height[c - TEXT_PAIR_FIRST] + 1 > h) h = height[c - TEXT_PAIR_FIRST] + 1;
+        }
+        height[i] = h;
+        if (h > deepest) deepest = h;
+    }
+    return deepest;
+}
+
+// Host time per report over every macro in the image, played PACK_PLAYS times
+static double PackCost(const uint8_t *image, uint32_t *reports)
+{
+    const MACRO_IMAGE *hdr = (const MACRO_IMAGE*)image;
+    uint32_t t, n = 0, i;
+    uint8_t id;
+    double secs = NowSeconds();
+
+    for (i = 0; i < PACK_PLAYS; i++) {
+        for (id = 0; id < hdr->count; id++) {
+            if (hdr->offset[id] == MACRO_NONE) continue;
+            MacroInit();
+            MacroStart(image, hdr->offset[id], 0);
+            for (t = POLL_US; MacroBusy(); t += POLL_US) {
+                if (t == PACK_TRIGGER_UP_US) MacroTriggerUp(0);
+                if (t == PACK_LIMIT_US) MacroStop(0);
+                n += MacroTasks(t);
+            }
+        }
+    }
+    *reports = n / PACK_PLAYS;
+    return (NowSeconds() - secs) * 1e9 / n;
+}
+
+static int PackCheck(const char *macroc, const char *source)
+{
+    const MACRO_IMAGE *hdr = (const MACRO_IMAGE*)packImage[1];
+    uint32_t size[2], chars = 0, reports, differ = 0, us = 0;
+    uint8_t id, k;
+    double ns[2];
+
+    size[0] = PackBuild(macroc, source, false, packImage[0]);
+    size[1] = PackBuild(macroc, source, true, packImage[1]);
+    if (size[0] == 0 || size[1] == 0) {
+        printf("macroc failed for %s\n", source);
+        return 1;
+    }
+
+    for (id = 0; id < hdr->count; id++) {
+        if (hdr->offset[id] == MACRO_NONE) continue;
+        for (k = 0; k < 2; k++) PackRun(&packSim[k], packImage[k], id);
+        if (packSim[0].typedLen != packSim[1].typedLen || packSim[0].reports != packSim[1].reports ||
+            packSim[0].nowUs != packSim[1].nowUs ||
+            memcmp(packSim[0].typed, packSim[1].typed, packSim[0].typedLen) != 0 ||
+            memcmp(packSim[0].typedUs, packSim[1].typedUs, packSim[0].typedLen * 4) != 0) {
+            differ++;
+        }
+        chars += packSim[1].typedLen;
+        us += packSim[1].nowUs;
+    }
+
+    printf("%s: image %u bytes plain, %u packed (%.1f%%), pairs nested %u deep\n",
+           source, size[0], size[1], 100.0 * size[1] / size[0], PackDepth(packImage[1]));
+    printf("  %u chars in %.3f s; %u macros play differently packed\n", chars, us / 1e6, differ);
+    ns[0] = PackCost(packImage[0], &reports);
+    ns[1] = PackCost(packImage[1], &reports);
+    if (reports != 0) {
+        printf("  host time per report %.1f ns plain, %.1f ns packed (%u reports, the poll is 1 ms)\n",
+               ns[0], ns[1], reports);
+    }
+    return differ == 0 ? 0 : 1;
+}
+
+/*
+ * Batched configuration writes: a new keymap and a new macro image are
+ * set while someone types.  ConfigTasks() runs every main loop pass of
+ * CFG_PASS_US, told of a frame start each millisecond, and each pass
+ * takes as long again as the NVM kept the CPU.  While typing no step
+ * may erase a page or run into the next frame.  After the last key both
+ * sections must reach flash, under one header, once the keyboard has
+ * been idle, and a third change must reach it during a suspend.
+ */
+#define CFG_PASS_US             10
+#define CFG_TYPE_MS             3000
+#define CFG_KEY_MS              40      // Each key down this long, then up as long
+#define CFG_HISTORY             12      // Keymaps and macro images written before
+
+typedef struct
+{
+    uint32_t nowUs;
+    uint32_t frame;
+    uint32_t steps;                 // Passes that programmed or erased
+    uint32_t worstUs;               // Longest of them
+    uint32_t worstWordsUs;          // Longest that only programmed
+    uint32_t worstEndUs;            // Latest a step ended, from its frame start
+    uint32_t erases;
+} CFG_SIM;
+
+static void ConfigRun(CFG_SIM *cs, uint32_t untilUs, bool typing)
+{
+    KEY_SET keys;
+    uint32_t busy, erases, stall;
+    bool frameStart;
+
+    memset(&keys, 0, sizeof(keys));
+    while (cs->nowUs < untilUs) {
+        frameStart = cs->nowUs / 1000 != cs->frame;
+        cs->frame = cs->nowUs / 1000;
+        keys.keys[0] = typing && cs->nowUs / 1000 / CFG_KEY_MS % 2 == 0 ? USAGE_A : USAGE_NONE;
+
+        busy = nvmSimBusyUs;
+        erases = nvmSimPageErases;
+        ConfigTasks(&keys, frameStart, cs->nowUs);
+        stall = nvmSimBusyUs - busy;
+        if (stall != 0) {
+            cs->steps++;
+            cs->erases += nvmSimPageErases - erases;
+            if (stall > cs->worstUs) cs->worstUs = stall;
+            if (nvmSimPageErases == erases && stall > cs->worstWordsUs) cs->worstWordsUs = stall;
+            if (cs->nowUs % 1000 + stall > cs->worstEndUs) cs->worstEndUs = cs->nowUs % 1000 + stall;
+        }
+        cs->nowUs += CFG_PASS_US + stall;
+    }
+}
+
+// The section the header in flash names for tag holds data
+static bool ConfigStored(uint16_t tag, const void *data, uint16_t length)
+{
+    const CONFIG_HEADER *hdr = FlashStoreRead(FSTORE_KEY_CONFIG, NULL);
+    const CONFIG_SECTION *sec;
+    const void *value;
+    uint16_t stored;
+    uint8_t i;
+
+    if (hdr == NULL) return false;
+    sec = (const CONFIG_SECTION*)(hdr + 1);
+    for (i = 0; i < hdr->sections && sec[i].tag != tag; i++);
+    if (i == hdr->sections) return false;
+    value = FlashStoreRead(sec[i].key, &stored);
+    return value != NULL && stored == length && memcmp(value, data, length) == 0;
+}
+
+static int Config(void)
+{
+    CFG_SIM cs;
+    uint16_t blobLength, imageLength, action;
+    uint32_t codeBytes, busy, steps, t;
+    uint8_t page, i;
+    bool ok = true;
+
+    srand(43);
+    for (page = 0; page < FSTORE_PAGES; page++) NVMErasePage(FSTORE_BASE + page * NVM_PAGE_SIZE);
+    FlashStoreInit();
+    ConfigInit();
+    for (i = 0; i < CFG_HISTORY; i++) {
+        blobLength = XipBuildKeymap();
+        imageLength = XipBuildImage(&codeBytes);
+        ok &= ConfigSet(CONFIG_TAG_KEYMAP, xipBlob, blobLength);
+        ok &= ConfigSet(CONFIG_TAG_MACROS, xipImage, imageLength);
+        while (ConfigCommitTasks());
+    }
+    ConfigInit();
+    configCommits = 0;
+    blobLength = XipBuildKeymap();
+    imageLength = XipBuildImage(&codeBytes);
+
+    memset(&cs, 0, sizeof(cs));
+    ConfigRun(&cs, 500000, true);
+    ok &= ConfigSet(CONFIG_TAG_KEYMAP, xipBlob, blobLength);
+    ok &= KeymapResolve(0) == ACT_KEY(USAGE_A);     // The shadow, at once
+    ConfigRun(&cs, 1500000, true);
+    ok &= ConfigSet(CONFIG_TAG_MACROS, xipImage, imageLength);
+    ConfigRun(&cs, CFG_TYPE_MS * 1000, true);
+    ok &= cs.erases == 0 && cs.worstEndUs < 1000;
+    printf("typing %u ms, keymap (%u bytes) set at 500 ms, macros (%u bytes) at 1500 ms\n",
+           CFG_TYPE_MS, blobLength, imageLength);
+    printf("  %u steps at frame starts, worst stall %u us, ending %u us into its frame; %u erases\n",
+           cs.steps, cs.worstUs, cs.worstEndUs, cs.erases);
+    printf("  when typing stops: %u commits, %s\n",
+           configCommits, ConfigPending() ? "the rest waiting for idle" : "nothing pending");
+
+    t = cs.nowUs;
+    memset(&cs.steps, 0, sizeof(cs) - offsetof(CFG_SIM, steps));
+    while (ConfigPending() && cs.nowUs < t + 10 * CONFIG_IDLE_MS * 1000) ConfigRun(&cs, cs.nowUs + 1000, false);
+    ok &= !ConfigPending() && configFailures == 0;
+    printf("idle: in flash %.1f ms after the last key, %u steps, %u erases; worst stall %.1f ms,"
+           " %u us without an erase\n",
+           (cs.nowUs - t) / 1000.0, cs.steps, cs.erases, cs.worstUs / 1000.0, cs.worstWordsUs);
+
+    // Suspended: the main loop only commits
+    action = ACT_KEY(USAGE_1);
+    memcpy(xipBlob + sizeof(KEYMAP_BLOB) + 4 * XIP_KEYS, &action, 2);     // Key 0, layer 0
+    ok &= ConfigSet(CONFIG_TAG_KEYMAP, xipBlob, blobLength);
+    busy = nvmSimBusyUs;
+    for (steps = 1; ConfigCommitTasks(); steps++);
+    ok &= !ConfigPending();
+    printf("suspended: another keymap in flash after %u steps, %.1f ms\n",
+           steps, (nvmSimBusyUs - busy) / 1000.0);
+
+    // Reset
+    ConfigInit();
+    ok &= ConfigStored(CONFIG_TAG_KEYMAP, xipBlob, blobLength);
+    ok &= ConfigStored(CONFIG_TAG_MACROS, xipImage, imageLength);
+    ok &= KeymapResolve(0) == ACT_KEY(USAGE_1);
+    printf("after a reset flash holds both, %u commits, %u failures: %s\n",
+           configCommits, configFailures, ok ? "yes" : "NO");
+    return ok ? 0 : 1;
+}
+
+/*
+ * Boot: ConfigInit() runs on every reset before the keymap is ready,
+ * so its worst case is held against CONFIG_READY_BUDGET_US.  The host
+ * cannot time the device, so every byte the CRC reads is counted at
+ * BOOT_CRC_CYCLES, the loop in crc32.c with its data and table in flash,
+ * and every section byte once more at BOOT_CHECK_CYCLES for the content
+ * checks.  The bound is a store with every page but the erased one full
+ * and three sections of the largest size.  Then the image is damaged
+ * in each way the loader must catch, and the power is cut at random
+ * points of commits: after each reset the keyboard must run either the
+ * old configuration or the new one, whole.
+ */
+#define BOOT_SYS_FREQ           40000000
+#define BOOT_CRC_CYCLES         20      // 17 instructions, 3 loads from flash at 1 wait state
+#define BOOT_CHECK_CYCLES       4
+#define BOOT_LEAVES             198     // Leader sequences: a 996-byte trie
+#define BOOT_FILLER_KEY         20      // Other values in the store
+#define BOOT_FOREIGN_KEY        30      // A newer firmware's section
+#define BOOT_CUTS               2000
+#define BOOT_CUT_OPS            1000
+#define BOOT_CUT_STEPS          20000   // Commit steps before giving up on a dead flash
+
+static uint8_t bootTrie[FSTORE_VALUE_MAX] __attribute__ ((aligned(4)));
+static uint8_t bootHeader[sizeof(CONFIG_HEADER) + CONFIG_SECTIONS_MAX * sizeof(CONFIG_SECTION)]
+    __attribute__ ((aligned(4)));
+static uint16_t bootBlobLength, bootImageLength, bootTrieLength;
+
+// One leader sequence per leaf under the root, each a single key
+static uint16_t BootBuildTrie(void)
+{
+    LEADER_TRIE *hdr = (LEADER_TRIE*)bootTrie;
+    uint16_t at = LEADER_ROOT, leaf = LEADER_ROOT + 2 + BOOT_LEAVES * LEADER_EDGE_SIZE;
+    uint8_t i;
+
+    bootTrie[at++] = BOOT_LEAVES;
+    bootTrie[at++] = LEADER_NO_MACRO;
+    for (i = 0; i < BOOT_LEAVES; i++, leaf += 2) {
+        bootTrie[at++] = USAGE_A + i;
+        bootTrie[at++] = leaf & 0xFF;
+        bootTrie[at++] = leaf >> 8;
+        bootTrie[leaf] = 0;
+        bootTrie[leaf + 1] = i % XIP_MACROS;
+    }
+    hdr->magic = LEADER_TRIE_MAGIC;
+    hdr->size = leaf;
+    return leaf;
+}
+
+// A wiped store holding one committed configuration: key 0 types a 1
+static bool BootGood(void)
+{
+    uint16_t action = ACT_KEY(USAGE_1);
+    uint32_t codeBytes;
+    uint8_t page;
+    bool ok = true;
+
+    for (page = 0; page < FSTORE_PAGES; page++) NVMErasePage(FSTORE_BASE + page * NVM_PAGE_SIZE);
+    ConfigInit();
+    bootBlobLength = XipBuildKeymap();
+    memcpy(xipBlob + sizeof(KEYMAP_BLOB) + 4 * XIP_KEYS, &action, 2);
+    bootImageLength = XipBuildImage(&codeBytes);
+    bootTrieLength = BootBuildTrie();
+    ok &= ConfigSet(CONFIG_TAG_KEYMAP, xipBlob, bootBlobLength);
+    ok &= ConfigSet(CONFIG_TAG_MACROS, xipImage, bootImageLength);
+    ok &= ConfigSet(CONFIG_TAG_LEADER, bootTrie, bootTrieLength);
+    while (ConfigCommitTasks());
+    ConfigInit();
+    return ok && configSource == CONFIG_SOURCE_STORED && KeymapResolve(0) == ACT_KEY(USAGE_1);
+}
+
+// The header in flash, for a scenario to change
+static uint16_t BootHeader(void)
+{
+    uint16_t length = 0;
+    const void *hdr = FlashStoreRead(FSTORE_KEY_CONFIG, &length);
+
+    memcpy(bootHeader, hdr, length);
+    return length;
+}
+
+// Writes the changed header back, its CRC made to match or not, and resets
+static void BootReset(uint16_t length, bool sealed)
+{
+    CONFIG_HEADER *hdr = (CONFIG_HEADER*)bootHeader;
+
+    if (sealed) {
+        hdr->crc = CRC32Final(CRC32Update(CRC32Update(CRC32_INIT, hdr, offsetof(CONFIG_HEADER, crc)),
+                                          hdr + 1, length - sizeof(CONFIG_HEADER)));
+    }
+    FlashStoreWrite(FSTORE_KEY_CONFIG, bootHeader, length);
+    ConfigInit();
+}
+
+static bool BootScenario(const char *label, uint8_t expect, bool ok)
+{
+    static const char *const sources[] = { "defaults, none stored", "stored", "defaults, invalid" };
+    uint16_t wanted = expect == CONFIG_SOURCE_STORED ? ACT_KEY(USAGE_1) : KeymapResolve(0);
+
+    ok &= configSource == expect;
+    if (expect == CONFIG_SOURCE_STORED) ok &= KeymapResolve(0) == wanted;
+    else ok &= KeymapResolve(0) != ACT_KEY(USAGE_1);
+    printf("  %-40s %-22s %s\n", label, sources[configSource], ok ? "ok" : "WRONG");
+    return ok;
+}
+
+static bool BootDamage(void)
+{
+    CONFIG_HEADER *hdr = (CONFIG_HEADER*)bootHeader;
+    CONFIG_SECTION *sec = (CONFIG_SECTION*)(hdr + 1);
+    static uint8_t data[FSTORE_VALUE_MAX] __attribute__ ((aligned(4)));
+    uint16_t length, dataLength;
+    uint8_t page;
+    bool ok = true, kept;
+
+    printf("damaged images:\n");
+    for (page = 0; page < FSTORE_PAGES; page++) NVMErasePage(FSTORE_BASE + page * NVM_PAGE_SIZE);
+    ConfigInit();
+    ok &= BootScenario("empty store", CONFIG_SOURCE_DEFAULT, true);
+
+    ok &= BootGood();
+    ok &= BootScenario("good image", CONFIG_SOURCE_STORED, true);
+
+    ok &= BootGood();
+    length = BootHeader();
+    sec[0].length--;
+    BootReset(length, false);
+    ok &= BootScenario("header CRC wrong", CONFIG_SOURCE_INVALID, true);
+
+    ok &= BootGood();
+    length = BootHeader();
+    memcpy(data, FlashStoreRead(sec[1].key, &dataLength), dataLength);
+    data[dataLength / 2] ^= 0x10;
+    FlashStoreWrite(sec[1].key, data, dataLength);
+    ConfigInit();
+    ok &= BootScenario("section CRC wrong", CONFIG_SOURCE_INVALID, true);
+
+    ok &= BootGood();
+    length = BootHeader();
+    hdr->major = CONFIG_MAJOR + 1;
+    BootReset(length, true);
+    ok &= BootScenario("newer major version", CONFIG_SOURCE_INVALID, true);
+
+    ok &= BootGood();
+    length = BootHeader();
+    hdr->minor = CONFIG_MINOR + 1;
+    BootReset(length, true);
+    ok &= BootScenario("newer minor version", CONFIG_SOURCE_STORED, true);
+
+    // A section this firmware does not know, optional: loads, and survives a commit
+    ok &= BootGood();
+    memset(data, 0x5A, 100);
+    FlashStoreWrite(BOOT_FOREIGN_KEY, data, 100);
+    length = BootHeader();
+    sec[hdr->sections].tag = 0x5858;
+    sec[hdr->sections].flags = 0;
+    sec[hdr->sections].key = BOOT_FOREIGN_KEY;
+    sec[hdr->sections].length = 100;
+    sec[hdr->sections].reserved = 0;
+    sec[hdr->sections].crc = CRC32Final(CRC32Update(CRC32_INIT, data, 100));
+    hdr->sections++;
+    length += sizeof(CONFIG_SECTION);
+    BootReset(length, true);
+    xipBlob[sizeof(KEYMAP_BLOB) + 4 * XIP_KEYS + 2 * XIP_LAYERS]++;   // Key 1, layer 0
+    ok &= ConfigSet(CONFIG_TAG_KEYMAP, xipBlob, bootBlobLength);
+    while (ConfigCommitTasks());
+    ConfigInit();
+    length = BootHeader();
+    kept = hdr->sections == 4 && sec[3].tag == 0x5858 && sec[3].key == BOOT_FOREIGN_KEY;
+    ok &= BootScenario("unknown optional section, then a commit", CONFIG_SOURCE_STORED, kept);
+
+    ok &= BootGood();
+    length = BootHeader();
+    sec[hdr->sections] = sec[0];
+    sec[hdr->sections].tag = 0x5858;
+    sec[hdr->sections].flags = CONFIG_SECTION_REQUIRED;
+    sec[hdr->sections].key = BOOT_FOREIGN_KEY;
+    hdr->sections++;
+    length += sizeof(CONFIG_SECTION);
+    BootReset(length, true);
+    ok &= BootScenario("unknown required section", CONFIG_SOURCE_INVALID, true);
+
+    // CRCs right, contents not: a leader edge into the middle of a node
+    ok &= BootGood();
+    length = BootHeader();
+    memcpy(data, FlashStoreRead(sec[2].key, &dataLength), dataLength);
+    data[LEADER_ROOT + 3]++;
+    FlashStoreWrite(sec[2].key, data, dataLength);
+    sec[2].crc = CRC32Final(CRC32Update(CRC32_INIT, data, dataLength));
+    BootReset(length, true);
+    ok &= BootScenario("leader trie with a bad edge", CONFIG_SOURCE_INVALID, true);
+
+    ok &= BootGood();
+    length = BootHeader();
+    sec[0].key = sec[1].key;
+    BootReset(length, true);
+    ok &= BootScenario("section in another's key", CONFIG_SOURCE_INVALID, true);
+    return ok;
+}
+
+static bool BootPowerCuts(void)
+{
+    static uint8_t oldBlob[FSTORE_VALUE_MAX], oldImage[FSTORE_VALUE_MAX];
+    uint16_t oldBlobLength, oldImageLength, action;
+    uint32_t i, n, kept = 0, took = 0, bad = 0, codeBytes;
+    bool old, now;
+
+    BootGood();
+    for (i = 0; i < BOOT_CUTS; i++) {
+        memcpy(oldBlob, xipBlob, bootBlobLength);
+        memcpy(oldImage, xipImage, bootImageLength);
+        oldBlobLength = bootBlobLength;
+        oldImageLength = bootImageLength;
+
+        // A new keymap and macros, set together; key 0 tells them apart
+        action = ACT_KEY(USAGE_1 + i % 9);
+        bootBlobLength = XipBuildKeymap();
+        memcpy(xipBlob + sizeof(KEYMAP_BLOB) + 4 * XIP_KEYS, &action, 2);
+        bootImageLength = XipBuildImage(&codeBytes);
+        ConfigSet(CONFIG_TAG_KEYMAP, xipBlob, bootBlobLength);
+        ConfigSet(CONFIG_TAG_MACROS, xipImage, bootImageLength);
+        nvmSimOpsLeft = rand() % BOOT_CUT_OPS;
+        for (n = 0; n < BOOT_CUT_STEPS && ConfigCommitTasks(); n++);
+        nvmSimOpsLeft = 0xFFFFFFFF;
+
+        ConfigInit();
+        old = ConfigStored(CONFIG_TAG_KEYMAP, oldBlob, oldBlobLength)
+           && ConfigStored(CONFIG_TAG_MACROS, oldImage, oldImageLength);
+        now = ConfigStored(CONFIG_TAG_KEYMAP, xipBlob, bootBlobLength)
+           && ConfigStored(CONFIG_TAG_MACROS, xipImage, bootImageLength);
+        if (configSource != CONFIG_SOURCE_STORED || (!old && !now)) {
+            bad++;
+            BootGood();
+        } else if (now) {
+            took++;
+        } else {
+            kept++;
+            memcpy(xipBlob, oldBlob, oldBlobLength);
+            memcpy(xipImage, oldImage, oldImageLength);
+            bootBlobLength = oldBlobLength;
+            bootImageLength = oldImageLength;
+        }
+    }
+    printf("power cut in %u commits: %u kept the old configuration, %u the new, %u anything else\n",
+           BOOT_CUTS, kept, took, bad);
+    return bad == 0;
+}
+
+static int Boot(void)
+{
+    static uint8_t filler[500];
+    const double usPerCycle = 1e6 / BOOT_SYS_FREQ;
+    uint32_t crcBytes, checkBytes, boundCrc, boundCheck, reps, i;
+    double t, us, boundUs;
+    uint8_t key;
+    bool ok = true;
+
+    srand(45);
+    ok &= BootGood();
+
+    // Fill the store with other values until no more fit
+    for (key = BOOT_FILLER_KEY; key < FSTORE_KEYS; key++) {
+        memset(filler, key, sizeof(filler));
+        if (!FlashStoreWrite(key, filler, sizeof(filler))) break;
+    }
+    ConfigInit();
+    ok &= configSource == CONFIG_SOURCE_STORED;
+
+    reps = 2000;
+    t = NowSeconds();
+    for (i = 0; i < reps; i++) ConfigInit();
+    t = NowSeconds() - t;
+
+    crcBytes = flashStoreMountBytes + configCheckedBytes;
+    checkBytes = configCheckedBytes;
+    us = (crcBytes * BOOT_CRC_CYCLES + checkBytes * BOOT_CHECK_CYCLES) * usPerCycle;
+    boundCrc = (FSTORE_PAGES - 1) * NVM_PAGE_SIZE + sizeof(bootHeader) + 3 * FSTORE_VALUE_MAX;
+    boundCheck = 3 * FSTORE_VALUE_MAX;
+    boundUs = (boundCrc * BOOT_CRC_CYCLES + boundCheck * BOOT_CHECK_CYCLES) * usPerCycle;
+    ok &= boundUs < CONFIG_READY_BUDGET_US;
+
+    printf("image: keymap %u, macros %u, leader trie %u bytes; store %u of %u bytes live\n",
+           bootBlobLength, bootImageLength, bootTrieLength, flashStoreLiveBytes, (uint32_t)FSTORE_CAPACITY);
+    printf("ConfigInit(): mount reads %u bytes, the image %u; host %.1f us\n",
+           flashStoreMountBytes, configCheckedBytes, t * 1e6 / reps);
+    printf("  device ~%.2f ms at %u MHz; bound, every page full and 3 sections of %u bytes, %.2f ms;"
+           " budget %.1f ms\n",
+           us / 1000, BOOT_SYS_FREQ / 1000000, (uint32_t)FSTORE_VALUE_MAX, boundUs / 1000,
+           CONFIG_READY_BUDGET_US / 1000.0);
+
+    ok &= BootDamage();
+    ok &= BootPowerCuts();
+    return ok ? 0 : 1;
+}
+
+/*
+ * Suspend current and resume latency.  The device cannot be measured
+ * from here, so the current comes from a model: currents of the order
+ * the PIC32MX1xx/2xx data sheet gives (3.3 V, 25 C; check them on the
+ * board).  What the main loop does while the bus is suspended is not
+ * modelled: every pass runs the real IdleSuspendTasks(), which runs
+ * the flash writes the suspend started with through the real
+ * ConfigCommitTasks(), and the hour only sleeps where it says so.
+ * Stray wakes (the button bouncing, bus noise) each cost the
+ * oscillator start, the PLL lock and the passes until it says Sleep
+ * again.  The average must stay under the 2.5 mA USB 2.0 allows a
+ * suspended device.
+ *
+ * Remote wakeup: key presses at random times of the hour, with the
+ * host allowing it, must each get IDLE_SUSPEND_RESUME within a wake
+ * and a pass, or at the end of the bus idle window for a key pressed
+ * inside it.  A key pressed inside the window, then a host that
+ * resumes by itself, must not leave the key pending.  Resume is the
+ * oscillator start-up and PLL lock, then one pass to scanning; the
+ * host drives RESUME for at least 20 ms and allows 10 ms after it.
+ */
+#define SUS_RUN_MA              18.0    // CPU at 40 MHz, spinning in the main loop
+#define SUS_NVM_MA              10.0    // On top, while the NVM programs or erases
+#define SUS_SLEEP_MA            0.05    // Sleep, regulator on, nothing else running
+#define SUS_BUS_MA              0.2     // D+ pull-up into the host's 15 kohm, transceiver suspended
+#define SUS_LIMIT_MA            2.5
+#define SUS_HOUR_US             3600000000ull
+#define SUS_STRAY_WAKES         3600    // One a second: far more than a quiet bus gives
+#define SUS_KEY_WAKES           20      // Keys pressed to wake the host
+#define SUS_PASS_US             10      // One main loop pass
+#define SUS_OST_US              128     // 1024 cycles of the 8 MHz crystal
+#define SUS_PLL_LOCK_US         2000    // TLOCK, the data sheet's maximum
+#define SUS_WAKE_US             (SUS_OST_US + SUS_PLL_LOCK_US)
+#define SUS_RESUME_BUDGET_US    10000   // USB 2.0 TRSMRCY
+
+static int Suspend(void)
+{
+    static uint64_t wakes[SUS_STRAY_WAKES + SUS_KEY_WAKES];
+    static bool keyWake[SUS_STRAY_WAKES + SUS_KEY_WAKES];
+    uint64_t t = 0, awakeUs = 0, nvmUs = 0, keyAt = 0;
+    uint32_t codeBytes, busy, sleeps = 0, resumes = 0, worstKeyUs = 0, keyUs, resumeUs, i, j, n;
+    uint16_t blobLength, imageLength;
+    uint8_t page, action;
+    double avg, spin;
+    bool ok = true, keyDown = false, early;
+
+    // Suspended right after a keymap and macros were set: they go first
+    srand(46);
+    for (page = 0; page < FSTORE_PAGES; page++) NVMErasePage(FSTORE_BASE + page * NVM_PAGE_SIZE);
+    ConfigInit();
+    RecorderInit();
+    blobLength = XipBuildKeymap();
+    imageLength = XipBuildImage(&codeBytes);
+    ok &= ConfigSet(CONFIG_TAG_KEYMAP, xipBlob, blobLength);
+    ok &= ConfigSet(CONFIG_TAG_MACROS, xipImage, imageLength);
+
+    // The wakes of the hour, in order: stray ones, and key presses
+    n = SUS_STRAY_WAKES + SUS_KEY_WAKES;
+    for (i = 0; i < n; i++) {
+        wakes[i] = 1000000 + (uint64_t)rand() * rand() % (SUS_HOUR_US - 2000000);
+        keyWake[i] = i >= SUS_STRAY_WAKES;
+    }
+    for (i = 1; i < n; i++) {
+        for (j = i; j > 0 && wakes[j - 1] > wakes[j]; j--) {
+            uint64_t w = wakes[j];
+            bool k = keyWake[j];
+
+            wakes[j] = wakes[j - 1];
+            keyWake[j] = keyWake[j - 1];
+            wakes[j - 1] = w;
+            keyWake[j - 1] = k;
+        }
+    }
+
+    // EVENT_SUSPEND; each key wake resumes the host, which suspends again
+    IdleSuspendStart(0);
+    for (i = 0; t < SUS_HOUR_US; ) {
+        busy = nvmSimBusyUs;
+        action = IdleSuspendTasks(keyDown, true, (uint32_t)t);
+        nvmUs += nvmSimBusyUs - busy;
+        t += SUS_PASS_US + (nvmSimBusyUs - busy);
+        awakeUs += SUS_PASS_US + (nvmSimBusyUs - busy);
+
+        if (action == IDLE_SUSPEND_RESUME) {
+            keyUs = (uint32_t)(t - keyAt);
+            if (keyUs > worstKeyUs) worstKeyUs = keyUs;
+            resumes++;
+            IdleSuspendEnd();
+            keyDown = false;
+            IdleSuspendStart((uint32_t)t);  // The host suspends again at once
+        } else if (action == IDLE_SUSPEND_SLEEP) {
+            sleeps++;
+            if (i == n) break;
+            t = wakes[i] > t ? wakes[i] : t;
+            keyDown = keyWake[i++];
+            if (keyDown) keyAt = t;
+            t += SUS_WAKE_US;
+            awakeUs += SUS_WAKE_US;
+        }
+    }
+    ok &= !ConfigPending() && resumes == SUS_KEY_WAKES;
+    ok &= worstKeyUs <= SUS_WAKE_US + 2 * SUS_PASS_US;
+
+    // A key inside the bus idle window waits for its end; a host that
+    // resumes first leaves nothing pending
+    IdleSuspendStart(0);
+    action = IdleSuspendTasks(true, true, 2000);
+    for (t = 2000; action == IDLE_SUSPEND_AWAKE && t < 100000; t += SUS_PASS_US) {
+        action = IdleSuspendTasks(false, true, (uint32_t)t);
+    }
+    early = action == IDLE_SUSPEND_RESUME && t - SUS_PASS_US >= IDLE_RESUME_BUS_IDLE_MS * 1000;
+    IdleSuspendStart(0);
+    IdleSuspendTasks(true, true, 2000);
+    IdleSuspendEnd();
+    early &= !idleWakeKeyPending && IdleSuspendTasks(false, true, 10000) == IDLE_SUSPEND_SLEEP;
+    ok &= early;
+
+    avg = (awakeUs * SUS_RUN_MA + nvmUs * SUS_NVM_MA + (SUS_HOUR_US - awakeUs) * SUS_SLEEP_MA) / SUS_HOUR_US
+          + SUS_BUS_MA;
+    spin = SUS_RUN_MA + SUS_BUS_MA;
+    ok &= avg < SUS_LIMIT_MA;
+    printf("an hour suspended: flash writes first, %.1f ms of NVM; %u stray wakes, %u sleeps;"
+           " awake %.2f s in all\n", nvmUs / 1000.0, SUS_STRAY_WAKES, sleeps, awakeUs / 1e6);
+    printf("  average %.3f mA sleeping, %.1f mA spinning; USB allows %.1f mA\n",
+           avg, spin, SUS_LIMIT_MA);
+    printf("  energy at 3.3 V: %.1f mWh sleeping, %.1f mWh spinning\n", avg * 3.3, spin * 3.3);
+    printf("remote wakeup: %u of %u key presses resumed the host, worst %.2f ms from the key;"
+           " in the bus idle window: waits for its end, forgotten on a host resume: %s\n",
+           resumes, SUS_KEY_WAKES, worstKeyUs / 1000.0, early ? "yes" : "NO");
+
+    resumeUs = SUS_WAKE_US + SUS_PASS_US;
+    ok &= resumeUs < SUS_RESUME_BUDGET_US;
+    printf("resume: oscillator %u us + PLL lock %u us + a pass %u us = %.2f ms, inside the host's"
+           " 20 ms RESUME\n", SUS_OST_US, SUS_PLL_LOCK_US, SUS_PASS_US, resumeUs / 1000.0);
+    return ok ? 0 : 1;
+}
+
+/*
+ * Run-time clock switching.  An hour of office use: a macro now and
+ * then, each a burst of full-speed work, and nothing in between but
+ * scanning, which the FRC does as well.  The real ClockTasks() runs
+ * once per main loop pass.  Energy comes from a model of the core's
+ * current, linear in the clock like the PIC32MX1xx/2xx data sheet's
+ * IDD figures (3.3 V, 25 C; check them on the board).  A macro that
+ * starts while the clock is low runs at 8 MHz until the PLL locks;
+ * that delay is what the first characters wait at most.
+ */
+#define CLK_IDD_BASE_MA         1.0     // IDD at 0 Hz, extrapolated
+#define CLK_IDD_MA_PER_MHZ      0.42
+#define CLK_HOUR_US             3600000000ull
+#define CLK_PASS_US             50      // One main loop pass at 8 MHz; shorter at full speed
+#define CLK_MACRO_EVERY_S       60      // One macro a minute on average
+#define CLK_MACRO_MS            400     // Each busy this long
+
+static double ClockMa(uint32_t hz)
+{
+    return CLK_IDD_BASE_MA + CLK_IDD_MA_PER_MHZ * hz / 1e6;
+}
+
+static int Clock(void)
+{
+    uint64_t t, busyUntil = 0, macroStart = 0;
+    uint32_t macros = 0, rampUs, rampMaxUs = 0, rampCount = 0, busyMs = 0;
+    bool waiting = false, ok = true;
+    double fixedMah, switchedMah;
+
+    srand(47);
+    ClockInit();
+    for (t = 0; t < CLK_HOUR_US; t += CLK_PASS_US) {
+        bool busy;
+
+        if (t >= busyUntil && rand() % (CLK_MACRO_EVERY_S * 1000000 / CLK_PASS_US) == 0) {
+            busyUntil = t + CLK_MACRO_MS * 1000;
+            macroStart = t;
+            waiting = sysClock != CLOCK_FULL_HZ;
+            macros++;
+        }
+        busy = t < busyUntil;
+        if (busy) busyMs += CLK_PASS_US;
+        ClockTasks(busy, (uint32_t)t);
+        if (waiting && sysClock == CLOCK_FULL_HZ) {
+            rampUs = (uint32_t)(t - macroStart);
+            if (rampUs > rampMaxUs) rampMaxUs = rampUs;
+            rampCount++;
+            waiting = false;
+        }
+    }
+    busyMs /= 1000;
+
+    ok &= clockFullMs >= busyMs;        // Every busy moment at full speed, ramps aside
+    ok &= rampMaxUs <= CLOCK_LOCK_US + CLK_PASS_US;
+    ok &= clockFullMs + clockLowMs + 1 >= CLK_HOUR_US / 1000;
+    fixedMah = ClockMa(CLOCK_FULL_HZ);
+    switchedMah = (clockFullMs * ClockMa(CLOCK_FULL_HZ) + clockLowMs * ClockMa(CLOCK_LOW_HZ)) /
+                  (CLK_HOUR_US / 1000);
+    printf("an hour, %u macros of %u ms: busy %.1f s, at %u MHz %.1f s, at %u MHz %.1f s, %u switches\n",
+           macros, CLK_MACRO_MS, busyMs / 1000.0, CLOCK_FULL_HZ / 1000000, clockFullMs / 1000.0,
+           CLOCK_LOW_HZ / 1000000, clockLowMs / 1000.0, clockSwitches);
+    printf("  ramp up: %u macros started at %u MHz, each ran there for at most %u us (PLL lock %u us)\n",
+           rampCount, CLOCK_LOW_HZ / 1000000, rampMaxUs, CLOCK_LOCK_US);
+    printf("  CPU energy at 3.3 V: %.1f mWh switching, %.1f mWh always at %u MHz (%.0f%% less)\n",
+           switchedMah * 3.3, fixedMah * 3.3, CLOCK_FULL_HZ / 1000000,
+           100.0 * (1 - switchedMah / fixedMah));
+    return ok ? 0 : 1;
+}
+
+/*
+ * Tickless idle.  Ten minutes of typing in bursts, with mod-taps,
+ * a layer-tap, combos, a macro with a delay and a repeating macro key,
+ * through the real engines twice: once with a pass every LOOP_US as
+ * the loop ran before, once waiting whenever IdleReady() holds and no
+ * report is pending, as mouse.c now does.  A wait ends at the next key
+ * edge (the change notification, IDLE_EXIT_US to leave Idle) or after
+ * IDLE_MAX_MS; the host's polls cannot end it, since it only waits
+ * with nothing to send.  Every report must reach the host with the
+ * same keys, at the same poll as the spinning loop delivered it or an
+ * earlier one.
+ */
+#define IDLE_RUN_US             600000000u
+#define IDLE_EXIT_US            1       // A few cycles at 8 MHz, rounded up
+#define IDLE_EDGES              100000
+#define IDLE_REPORTS            100000
+
+static const uint16_t idleActions[] = {
+    // layer 0               layer 1
+    ACT_MT(0x01, 0x04),      ACT_TRANSPARENT,    // key 0: a, Ctrl on hold
+    ACT_KEY(0x05),           ACT_KEY(0x1B),      // key 1: b, x on layer 1
+    ACT_LT(1, 0x06),         ACT_TRANSPARENT,    // key 2: c, layer 1 on hold
+    ACT_MT_R(0x02, 0x07),    ACT_TRANSPARENT,    // key 3: d, right Shift on hold
+    ACT_KEY(0x08),           ACT_TRANSPARENT,    // key 4: e
+    ACT_KEY(0x09),           ACT_TRANSPARENT,    // key 5: f
+    ACT_KEY(0x0A),           ACT_TRANSPARENT,    // key 6: g
+    ACT_KEY(0x1D),           ACT_TRANSPARENT,    // key 7: z, combo 4+5
+    ACT_KEY(0x1C),           ACT_TRANSPARENT,    // key 8: y, combo 4+5+6
+    ACT_MACRO(0),            ACT_TRANSPARENT,    // key 9: "h", 20 ms, "i"
+    ACT_MACRO_RPT(1),        ACT_TRANSPARENT,    // key 10: "a", repeating
+};
+static const uint32_t idleDefined[] = { 0x1, 0x3, 0x1, 0x1, 0x1, 0x1, 0x1, 0x1, 0x1, 0x1, 0x1 };
+static const KEYMAP idleKeymap = { 11, 2, idleDefined, idleActions };
+
+static const uint8_t idleImage[] __attribute__ ((aligned(4))) = {
+    0x43, 0x4D, MACRO_IMAGE_VERSION, 2, 22, 0, 0, 0,   // MACRO_IMAGE, two macros
+    12, 0, 19, 0,
+    MOP_TAP, USAGE_A + 7, MOP_DELAY_SHORT, 20, MOP_TAP, USAGE_A + 8, MOP_END,
+    MOP_TAP, USAGE_A, MOP_END,
+};
+
+typedef struct
+{
+    uint32_t t;
+    KEY_SET keys;
+} IDLE_REPORT;
+
+typedef struct
+{
+    uint32_t passes;
+    uint32_t waits;
+    uint32_t edgeMaxUs;             // Key edge to the pass that sees it
+    uint32_t reports;
+    IDLE_REPORT report[IDLE_REPORTS];
+} IDLE_RUN;
+
+static SIM_EDGE idleEdges[IDLE_EDGES];
+static uint32_t idleEdgeCount;
+static IDLE_RUN idleSpin, idleTickless;
+
+static void IdlePush(uint32_t t, uint8_t key, bool down)
+{
+    if (idleEdgeCount < IDLE_EDGES) {
+        idleEdges[idleEdgeCount].t = t;
+        idleEdges[idleEdgeCount].key = key;
+        idleEdges[idleEdgeCount].down = down;
+        idleEdgeCount++;
+    }
+}
+
+// Bursts of 10-80 keystrokes, 1-15 s apart; edges come out in time order
+static void IdleWorkload(void)
+{
+    uint32_t t = 0, n, hold, pick;
+
+    idleEdgeCount = 0;
+    while (t < IDLE_RUN_US - 20000000u) {
+        t += 1000000 + rand() % 14000000;
+        for (n = 10 + rand() % 71; n > 0; n--) {
+            hold = 40000 + rand() % 100000;
+            pick = rand() % 100;
+            if (pick < 55) {                        // Plain key
+                static const uint8_t plain[] = { 1, 4, 5, 6 };
+                uint8_t key = plain[rand() % 4];
+                IdlePush(t, key, true);
+                IdlePush(t + hold, key, false);
+            } else if (pick < 70) {                 // Mod-tap, tapped or held past the term
+                uint8_t key = rand() % 2 ? 0 : 3;
+                if (rand() % 3 == 0) hold = TERM_US + 50000;
+                IdlePush(t, key, true);
+                IdlePush(t + hold, key, false);
+            } else if (pick < 76) {                 // Layer-tap with b inside
+                IdlePush(t, 2, true);
+                IdlePush(t + 30000, 1, true);
+                IdlePush(t + 90000, 1, false);
+                hold = 120000;
+                IdlePush(t + hold, 2, false);
+            } else if (pick < 86) {                 // Combo 4+5
+                IdlePush(t, 4, true);
+                IdlePush(t + 5000, 5, true);
+                IdlePush(t + hold, 4, false);
+                hold += 5000;
+                IdlePush(t + hold, 5, false);
+            } else if (pick < 95) {                 // Macro with a delay
+                IdlePush(t, 9, true);
+                IdlePush(t + hold, 9, false);
+            } else {                                // Repeating macro, held past the delay
+                hold = 400000 + rand() % 400000;
+                IdlePush(t, 10, true);
+                IdlePush(t + hold, 10, false);
+            }
+            t += hold + 30000 + rand() % 170000;
+        }
+    }
+}
+
+static void IdleRun(bool tickless, IDLE_RUN *run)
+{
+    uint32_t now = 0, next = 0, nextPoll = POLL_US / 3, then, lat;
+    KEY_SET keys, sent;
+    bool pending = false;
+
+    MacroInit();
+    KeymapInit(&idleKeymap, idleImage);
+    TapHoldInit(TERM_US, 0);
+    ComboInit(&simCombos, COMBO_TERM_US);
+    TypematicInit(250, 30);
+    KeySetClear(&sent);
+    run->passes = run->waits = run->edgeMaxUs = run->reports = 0;
+
+    while (now < IDLE_RUN_US) {
+        // One pass, in mouse.c's order
+        while (next < idleEdgeCount && idleEdges[next].t <= now) {
+            lat = now - idleEdges[next].t;
+            if (lat > run->edgeMaxUs) run->edgeMaxUs = lat;
+            ComboEvent(idleEdges[next].key, idleEdges[next].down, idleEdges[next].t);
+            next++;
+        }
+        ComboTasks(now);
+        TapHoldTasks(now);
+        TypematicTasks(now);
+        if (!pending) MacroTasks(now);
+        KeySetClear(&keys);
+        KeymapMerge(&keys);
+        MacroMerge(&keys);
+        if (!pending && memcmp(&keys, &sent, sizeof(keys)) != 0) {
+            sent = keys;
+            pending = true;
+        }
+        run->passes++;
+
+        // The next pass: after an event, or straight away
+        then = now - now % LOOP_US + LOOP_US;
+        if (tickless && !pending && IdleReady()) {
+            run->waits++;
+            then = now - now % LOOP_US + IDLE_MAX_MS * 1000;
+            if (next < idleEdgeCount && idleEdges[next].t + IDLE_EXIT_US < then) {
+                then = idleEdges[next].t + IDLE_EXIT_US;
+            }
+        }
+        while ((int32_t)(then - nextPoll) >= 0) {
+            if (pending && run->reports < IDLE_REPORTS) {
+                run->report[run->reports].t = nextPoll;
+                run->report[run->reports].keys = sent;
+                run->reports++;
+            }
+            pending = false;
+            nextPoll += POLL_US;
+        }
+        now = then;
+    }
+}
+
+static int Idle(void)
+{
+    uint32_t i, late = 0, early = 0, differ = 0;
+    bool ok;
+
+    srand(49);
+    IdleWorkload();
+    IdleRun(false, &idleSpin);
+    IdleRun(true, &idleTickless);
+
+    for (i = 0; i < idleSpin.reports && i < idleTickless.reports; i++) {
+        if (memcmp(&idleSpin.report[i].keys, &idleTickless.report[i].keys, sizeof(KEY_SET)) != 0) differ++;
+        else if (idleTickless.report[i].t > idleSpin.report[i].t) late++;
+        else if (idleTickless.report[i].t < idleSpin.report[i].t) early++;
+    }
+    ok = idleSpin.reports == idleTickless.reports && differ == 0 && late == 0 &&
+         idleSpin.reports < IDLE_REPORTS;
+
+    printf("%.0f min, %u key edges, %u reports spinning, %u waiting\n",
+           IDLE_RUN_US / 60e6, idleEdgeCount, idleSpin.reports, idleTickless.reports);
+    printf("  reports with other keys: %u; at a later poll: %u; at an earlier poll: %u\n",
+           differ, late, early);
+    printf("  passes: %u spinning, %u waiting (%u waits, %.1f wakes/s)\n",
+           idleSpin.passes, idleTickless.passes, idleTickless.waits,
+           idleTickless.waits / (IDLE_RUN_US / 1e6));
+    printf("  CPU busy at %u us a pass: 100%% spinning, %.2f%% waiting\n",
+           LOOP_US, 100.0 * idleTickless.passes * LOOP_US / IDLE_RUN_US);
+    printf("  key edge to the pass that sees it: at most %u us spinning, %u us waiting\n",
+           idleSpin.edgeMaxUs, idleTickless.edgeMaxUs);
+    return ok ? 0 : 1;
+}
+
+/*
+ * Trace events read over EP0.  The device logs one event every
+ * 1/rate s through the real TelemetryEvent() for TLM_RUN_US, and the
+ * host reads up to 64 bytes with TELEMETRY_REQ_READ once per
+ * TLM_READ_US: a read loop gets about one control transfer a frame.
+ * The events are out of phase with the reads.  Afterwards the host
+ * reads until the ring is empty, parsing the stream as a host tool
+ * would, re-aligning on TELEMETRY_SYNC: every record written must
+ * arrive whole and in order, and the gaps in the sequence numbers
+ * must match the drops before the last record.
+ * The delay is from TelemetryEvent() to the read that completes the
+ * record.  The cost per event is host time, measured in batches small
+ * enough for the ring.
+ */
+#define TLM_RUN_US              10000000u
+#define TLM_READ_US             1000
+#define TLM_PHASE_US            137
+#define TLM_BENCH_EVENTS        1000000
+#define TLM_BENCH_BATCH         (TELEMETRY_RING_SIZE / sizeof(TELEMETRY_EVENT))
+
+static const uint32_t tlmRates[] = { 100, 1000, 5000, 10000, 20000 };
+
+typedef struct
+{
+    uint8_t buf[sizeof(TELEMETRY_EVENT)];
+    uint8_t fill;
+    uint32_t records;
+    uint32_t gaps;                  // Sequence numbers skipped
+    uint32_t resyncs;               // Bytes thrown away looking for a sync
+    uint16_t nextSeq;
+    uint32_t lastTime;
+    bool outOfOrder;
+} TLM_PARSER;
+
+static void TelemetryParse(TLM_PARSER *p, const uint8_t *data, uint16_t len)
+{
+    TELEMETRY_EVENT ev;
+
+    while (len--) {
+        if (p->fill == 0 && *data != TELEMETRY_SYNC) {
+            p->resyncs++;
+            data++;
+            continue;
+        }
+        p->buf[p->fill++] = *data++;
+        if (p->fill < sizeof(ev)) continue;
+
+        memcpy(&ev, p->buf, sizeof(ev));
+        p->fill = 0;
+        if (p->records && (int32_t)(ev.timestamp - p->lastTime) < 0) p->outOfOrder = true;
+        p->gaps += (uint16_t)(ev.seq - p->nextSeq);
+        p->nextSeq = ev.seq + 1;
+        p->lastTime = ev.timestamp;
+        p->records++;
+    }
+}
+
+static bool TelemetryRate(uint32_t rate)
+{
+    static uint32_t endAt[TLM_RUN_US / 50 + 1], loggedAt[TLM_RUN_US / 50 + 1];  // 20000/s at most
+    uint8_t packet[TELEMETRY_PACKET_SIZE];
+    TLM_PARSER parser;
+    uint32_t t, nextEvent = TLM_PHASE_US, nextRead = 0, head = 0, tail = 0;
+    uint32_t delay, delayMax = 0, dropsBefore = 0, sent = 0;
+    uint64_t delaySum = 0;
+    uint16_t n;
+    bool ok;
+
+    memset(&parser, 0, sizeof(parser));
+    TelemetryInit();
+    for (t = 0; t < TLM_RUN_US || tail < head; t = nextEvent < nextRead ? nextEvent : nextRead) {
+        if (t == nextEvent) {
+            if (TelemetryEvent(TLM_USB_ERROR, rate, t)) {
+                endAt[head] = telemetryBytesLogged;
+                loggedAt[head++] = t;
+                dropsBefore = telemetryDrops;
+            }
+            nextEvent = TLM_PHASE_US + (uint32_t)((uint64_t)(head + telemetryDrops) * 1000000 / rate);
+            if (nextEvent >= TLM_RUN_US) nextEvent = 0xFFFFFFFF;
+        }
+        if (t == nextRead) {
+            n = TelemetryRead(packet, TELEMETRY_PACKET_SIZE);
+            TelemetryParse(&parser, packet, n);
+            while (tail < head && endAt[tail] <= telemetryBytesSent) {
+                delay = t - loggedAt[tail++];
+                delaySum += delay;
+                if (delay > delayMax) delayMax = delay;
+            }
+            nextRead += TLM_READ_US;
+            if (t < TLM_RUN_US) sent = telemetryBytesSent;
+        }
+    }
+
+    ok = parser.records == telemetryWrites && parser.gaps == dropsBefore &&
+         parser.resyncs == 0 && parser.fill == 0 && !parser.outOfOrder;
+    printf("%6u/s  %8.0f B/s  %7.0f/s  %8u  %8.2f  %7.2f%s\n",
+           rate, sent / (TLM_RUN_US / 1e6), sent / sizeof(TELEMETRY_EVENT) / (TLM_RUN_US / 1e6),
+           telemetryDrops, tail ? delaySum / 1000.0 / tail : 0.0, delayMax / 1000.0,
+           ok ? "" : "  stream does not match the log");
+    return ok;
+}
+
+static int Telemetry(void)
+{
+    uint8_t packet[TELEMETRY_PACKET_SIZE];
+    uint64_t cycles = 0;
+    double secs = 0, start;
+    uint32_t i, j;
+    bool ok = true;
+
+    printf("EP0 reads of %u bytes every %u us, %u-byte records, %u-byte ring, %.0f s at each rate\n",
+           TELEMETRY_PACKET_SIZE, TLM_READ_US, (unsigned)sizeof(TELEMETRY_EVENT),
+           TELEMETRY_RING_SIZE, TLM_RUN_US / 1e6);
+    printf("  events       bytes/s  records/s     drops   mean ms  max ms\n");
+    for (i = 0; i < sizeof(tlmRates) / sizeof(tlmRates[0]); i++) {
+        ok &= TelemetryRate(tlmRates[i]);
+    }
+
+    TelemetryInit();
+    for (i = 0; i < TLM_BENCH_EVENTS; i += TLM_BENCH_BATCH) {
+        start = NowSeconds();
+        cycles -= CycleCount();
+        for (j = 0; j < TLM_BENCH_BATCH; j++) TelemetryEvent(TLM_EP_REARM, j, i);
+        cycles += CycleCount();
+        secs += NowSeconds() - start;
+        while (TelemetryRead(packet, sizeof(packet)));
+    }
+    ok &= telemetryDrops == 0;
+    printf("cost: %.1f ns (%.0f host cycles) per event\n",
+           secs * 1e9 / telemetryWrites, (double)cycles / telemetryWrites);
+    printf("on the device, DIAG_REPORT telemetryWriteCycles / telemetryWrites gives PIC32 cycles/event\n");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && !strcmp(argv[1], "vm-bench")) return VmBench();
+    if (argc == 2 && !strcmp(argv[1], "vm-type")) return VmType();
+    if (argc == 2 && !strcmp(argv[1], "text-stream")) return TextStream();
+    if (argc == 2 && !strcmp(argv[1], "keymap-bench")) return KeymapBench();
+    if (argc == 2 && !strcmp(argv[1], "taphold")) return TapHoldScenarios();
+    if (argc == 2 && !strcmp(argv[1], "combo")) return ComboScenarios();
+    if (argc == 2 && !strcmp(argv[1], "combo-bench")) return ComboBench();
+    if (argc == 2 && !strcmp(argv[1], "record")) return Record();
+    if (argc == 3 && !strcmp(argv[1], "leader")) return LeaderCheck(argv[2]);
+    if (argc == 2 && !strcmp(argv[1], "steno")) return StenoCheck();
+    if (argc == 2 && !strcmp(argv[1], "typematic")) return Typematic();
+    if (argc == 2 && !strcmp(argv[1], "store")) return Store();
+    if (argc == 2 && !strcmp(argv[1], "xip")) return Xip();
+    if (argc == 2 && !strcmp(argv[1], "config")) return Config();
+    if (argc == 4 && !strcmp(argv[1], "pack")) return PackCheck(argv[2], argv[3]);
+    if (argc == 2 && !strcmp(argv[1], "boot")) return Boot();
+    if (argc == 2 && !strcmp(argv[1], "suspend")) return Suspend();
+    if (argc == 2 && !strcmp(argv[1], "clock")) return Clock();
+    if (argc == 2 && !strcmp(argv[1], "idle")) return Idle();
+    if (argc == 2 && !strcmp(argv[1], "telemetry")) return Telemetry();
+
+    fprintf(stderr, "usage: kbsim vm-bench | vm-type | text-stream | keymap-bench | taphold | combo | combo-bench | record | leader <macroc> | steno | typematic | store | xip | config | pack <macroc> <source.mac> | boot | suspend | clock | idle | telemetry\n");
+    return 2;
+}
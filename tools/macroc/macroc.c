@@ -0,0 +1,2043 @@
+/********************************************************************
+ FileName:      macroc.c
+ Dependencies:  Keyboard.X/macro_vm.[ch], macro_image.[ch], keyset.[ch],
+                textstream.[ch], leader.h, steno.h
+ Platform:      Linux
+
+ Compiles macro source into the image macro_vm.c runs (see
+ Keyboard.X/macro_image.h), the keymap layers into the flattened
+ tables keymap.c looks keys up in, leader sequences into the trie
+ leader.c walks, and steno strokes into the dictionary steno.c
+ searches.  On top of a straight translation
+ of the macros it
+
+   - folds constant delay expressions, merges adjacent delays and
+     flattens loops that only wait
+   - drops MODS that cannot change the modifier byte
+   - moves instruction runs that occur more than once into shared
+     subroutines (MOP_CALL/MOP_RET), for as long as that saves bytes
+   - lays each macro out followed by the shared code it reaches
+     first, so playing a macro reads flash front to back
+   - stores each stream string once, right after its first user, and
+     points a string that ends another one into it
+   - packs stream text with pairs (MOP_TEXT_PACKED, see textstream.h)
+     when that is smaller: the most frequent pair of adjacent bytes gets
+     a code of its own, over and over, for as long as a pair is used
+     three times or more
+
+ Every optimized macro is checked against its naive encoding: both
+ are run through macro_vm.c with a simulated 1 ms poll and the timed
+ report streams must match.
+
+ Source format (see samples/):
+   layer <n> [name] { <key number>: <action> ... }
+     <key> | none | trans | mo <n> | tg <n> | osl <n> | macro <id>
+     | macro <id> repeat                starts again while held, typematic.h
+     | mods <mod>[+<mod>] | mt <mod>[+<mod>] <key> | lt <n> <key>
+     | record <slot> | play <slot>      on-device recordings, recorder.h
+     | leader                           starts a leader sequence
+     | steno "<key>" | steno output     steno.h; keys as Plover HID names
+                                        them ("S1-", "-E", "*3", "#1",
+                                        "X1"), or "S-", "*", "#", "A"
+     Layer 0 is the base; its missing keys do nothing.
+   combo <key>+<key>[+...] = <key>
+     Keys pressed within COMBO_TERM_MS act as the keymap key after '='.
+   leader <key> [<key>...] = macro <id>
+     The leader key, then these keys, starts the macro.
+   steno "<stroke>" = "text"
+     One stroke, written as Plover writes it ("STKPW", "-FRS", "1-9"),
+     and what it types when steno.c translates.
+   macro <id> [name] { statements }
+     press|release|tap <key>    name, letter, digit or usage number (0x2D)
+     type "text"                taps with Shift as needed (US layout)
+     stream "text" ["more"...]  types up to six characters per report (MOP_TEXT);
+                                releases the macro's keys and modifiers first
+     delay <expr>               ms; 1s = 1000; + and * are allowed
+     repeat <expr> { ... }      forever { ... } repeats until stopped
+     mods <mod>[+<mod>] | none  e.g. mods ctrl+shift
+     wait_release               until the key that started the macro is up
+   # starts a comment.
+
+ Build:
+   gcc -O2 -I../../Keyboard.X -o macroc macroc.c \
+       ../../Keyboard.X/macro_vm.c ../../Keyboard.X/macro_image.c \
+       ../../Keyboard.X/keyset.c ../../Keyboard.X/textstream.c
+
+ Usage:
+   macroc [-o image.bin] [-c image.c] [--leader trie.bin] [--report] [--no-pack] source.mac
+   macroc --selftest        compiles fixed sources, checks the image bytes and report
+ *******************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+
+#include "keyset.h"
+#include "macro_vm.h"
+#include "macro_image.h"
+#include "textstream.h"
+#include "keymap.h"
+#include "combo.h"
+#include "recorder.h"
+#include "leader.h"
+#include "steno.h"
+
+/** DEFINITIONS ****************************************************/
+#define MAX_MACROS              255     // MACRO_IMAGE.count is 8 bits
+#define MAX_SUBS                1024
+#define MAX_COMBOS              1024
+#define MAX_STRINGS             1024
+#define MAX_STRING              4096    // Characters in one stream statement
+#define MAX_LEADER_KEYS         32
+#define MAX_STENO               4096    // Dictionary entries
+#define MAX_WINDOW              128     // Longest run considered for sharing
+#define SIM_POLL_US             1000
+#define SIM_TRIGGER_UP_US       250000  // When wait_release lets go
+#define SIM_LIMIT_US            120000000
+
+typedef struct
+{
+    uint8_t  op;
+    uint32_t arg;                   // Usage, ms, count, mask, subroutine or string
+} INSN;
+
+typedef struct
+{
+    INSN *code;
+    int len, cap;
+} SEQ;
+
+typedef struct
+{
+    bool defined;
+    char name[32];
+    SEQ naive;                      // Straight translation
+    SEQ opt;
+} MACRO_SRC;
+
+typedef struct
+{
+    uint32_t t;
+    KEY_SET keys;
+} EVENT;
+
+typedef struct
+{
+    EVENT *ev;
+    int len, cap;
+    bool finished;
+} TRACE;
+
+static MACRO_SRC src[MAX_MACROS];
+static int maxId = -1;
+
+// Keymap, by layer as written
+static uint16_t layerAction[KEYMAP_MAX_LAYERS][KEYMAP_MAX_KEYS];
+static bool layerDefined[KEYMAP_MAX_LAYERS];
+static int maxLayer = -1, maxLayerRef = -1, maxKey = -1;
+
+// Combos as written, then every key set some combo contains, sorted
+typedef struct
+{
+    uint64_t keys;
+    uint8_t key;
+    uint8_t flags;
+} COMBO_SRC;
+
+static COMBO_SRC comboSrc[MAX_COMBOS];
+static int comboCount;
+static COMBO_SRC comboTable[MAX_COMBOS << COMBO_MAX_KEYS];
+static int comboTableCount;
+
+// Stream text; a string that ends a longer one is stored inside it
+typedef struct
+{
+    char *text;
+    int len;
+    int host;                       // The longest string it ends, or itself
+} STRING_SRC;
+
+static STRING_SRC strs[MAX_STRINGS];
+static STRING_SRC packedStrs[MAX_STRINGS];  // The same strings packed, by index
+static int strCount;
+
+// Pair table as the image holds it: count, then the pairs
+static uint8_t pairTable[1 + 2 * TEXT_PAIRS_MAX];
+static int pairHeight[256];         // By code; characters are 0
+static bool packing;                // The optimized image streams packed text
+
+// Leader sequences as a trie, children kept sorted by usage
+typedef struct
+{
+    uint8_t macro;                  // LEADER_NO_MACRO if no sequence ends here
+    int line;                       // Where that sequence was defined
+    int count, cap;
+    uint8_t *usage;
+    int *child;
+    uint16_t offset;                // In the written trie
+} LEADER_NODE;
+
+static LEADER_NODE *leaderNodes;
+static int leaderNodeCount, leaderNodeCap;
+static int leaderCount;
+static uint8_t leaderTrie[0x10000];
+static int leaderTrieSize;
+
+// Steno dictionary, sorted by stroke once parsed
+typedef struct
+{
+    uint32_t stroke;
+    char *text;
+    int line;
+} STENO_SRC;
+
+static STENO_SRC steno[MAX_STENO];
+static int stenoCount;
+
+static SEQ subs[MAX_SUBS];
+static int subDepth[MAX_SUBS];      // Call levels it needs, itself included
+static int subCount;
+
+// Lexer
+static const char *fileName;
+static char *text, *cur;
+static int line = 1;
+static char tok[256];
+static int tokType;                 // 0 end, 'i' ident, 'n' number, 's' string, else punct
+static long tokNum;
+static bool tokDigit;               // A lone decimal digit, which as a key is that digit
+
+/** DECLARATIONS ***************************************************/
+
+static void Fail(const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "%s:%d: ", fileName, line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+static void Emit(SEQ *s, uint8_t op, uint32_t arg)
+{
+    if (s->len == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 64;
+        s->code = realloc(s->code, s->cap * sizeof(INSN));
+    }
+    s->code[s->len].op = op;
+    s->code[s->len].arg = arg;
+    s->len++;
+}
+
+static int InsnSize(uint8_t op)
+{
+    switch (op)
+    {
+        case MOP_DELAY:
+        case MOP_CALL:
+        case MOP_TEXT:
+        case MOP_TEXT_PACKED:
+            return 3;
+        case MOP_PRESS:
+        case MOP_RELEASE:
+        case MOP_TAP:
+        case MOP_REPEAT:
+        case MOP_MODS:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+static int SeqSize(const INSN *code, int len)
+{
+    int n = 0;
+
+    while (len--) n += InsnSize((code++)->op);
+    return n;
+}
+
+/* ---------------------------------------------------------------- */
+/* Lexer and parser                                                 */
+/* ---------------------------------------------------------------- */
+
+static void Next(void)
+{
+    int n = 0;
+
+    for (;;) {
+        while (isspace((unsigned char)*cur)) {
+            if (*cur == '\n') line++;
+            cur++;
+        }
+        if (*cur != '#') break;
+        while (*cur && *cur != '\n') cur++;
+    }
+
+    if (*cur == 0) {
+        tokType = 0;
+        tok[0] = 0;
+    } else if (*cur == '"') {
+        cur++;
+        while (*cur && *cur != '"') {
+            char c = *cur++;
+            if (c == '\n') Fail("unterminated string");
+            if (c == '\\') {
+                c = *cur++;
+                if (c == 'n') c = '\n';
+                else if (c == 't') c = '\t';
+            }
+            if (n < (int)sizeof(tok) - 1) tok[n++] = c;
+        }
+        if (*cur != '"') Fail("unterminated string");
+        cur++;
+        tok[n] = 0;
+        tokType = 's';
+    } else if (isdigit((unsigned char)*cur)) {
+        tokDigit = !isalnum((unsigned char)cur[1]);
+        tokNum = strtol(cur, &cur, 0);
+        tokType = 'n';
+        // Units stick to the number
+        if (!strncmp(cur, "ms", 2) && !isalnum((unsigned char)cur[2])) {
+            cur += 2;
+        } else if (*cur == 's' && !isalnum((unsigned char)cur[1])) {
+            cur++;
+            tokNum *= 1000;
+        }
+    } else if (isalpha((unsigned char)*cur) || *cur == '_') {
+        while (isalnum((unsigned char)*cur) || *cur == '_') {
+            if (n < (int)sizeof(tok) - 1) tok[n++] = *cur;
+            cur++;
+        }
+        tok[n] = 0;
+        tokType = 'i';
+    } else {
+        tok[0] = *cur++;
+        tok[1] = 0;
+        tokType = tok[0];
+    }
+}
+
+static void Expect(int type, const char *what)
+{
+    if (tokType != type) Fail("expected %s, found '%s'", what, tok);
+    Next();
+}
+
+static long Expr(void);
+
+static long Factor(void)
+{
+    long v;
+
+    if (tokType == 'n') {
+        v = tokNum;
+        Next();
+        return v;
+    }
+    if (tokType == '(') {
+        Next();
+        v = Expr();
+        Expect(')', "')'");
+        return v;
+    }
+    Fail("expected a number, found '%s'", tok);
+    return 0;
+}
+
+static long Term(void)
+{
+    long v = Factor();
+
+    while (tokType == '*') {
+        Next();
+        v *= Factor();
+    }
+    return v;
+}
+
+// Constant expressions are folded here, before any code exists
+static long Expr(void)
+{
+    long v = Term();
+
+    while (tokType == '+') {
+        Next();
+        v += Term();
+    }
+    return v;
+}
+
+static const struct { const char *name; uint8_t usage; } keyNames[] = {
+    { "enter", 0x28 }, { "esc", 0x29 }, { "escape", 0x29 }, { "backspace", 0x2A },
+    { "tab", 0x2B }, { "space", 0x2C }, { "minus", 0x2D }, { "equal", 0x2E },
+    { "lbracket", 0x2F }, { "rbracket", 0x30 }, { "backslash", 0x31 },
+    { "semicolon", 0x33 }, { "quote", 0x34 }, { "grave", 0x35 }, { "comma", 0x36 },
+    { "dot", 0x37 }, { "slash", 0x38 }, { "capslock", 0x39 },
+    { "f1", 0x3A }, { "f2", 0x3B }, { "f3", 0x3C }, { "f4", 0x3D }, { "f5", 0x3E },
+    { "f6", 0x3F }, { "f7", 0x40 }, { "f8", 0x41 }, { "f9", 0x42 }, { "f10", 0x43 },
+    { "f11", 0x44 }, { "f12", 0x45 }, { "printscreen", 0x46 }, { "scrolllock", 0x47 },
+    { "pause", 0x48 }, { "insert", 0x49 }, { "home", 0x4A }, { "pageup", 0x4B },
+    { "delete", 0x4C }, { "end", 0x4D }, { "pagedown", 0x4E }, { "right", 0x4F },
+    { "left", 0x50 }, { "down", 0x51 }, { "up", 0x52 },
+    { "lctrl", 0xE0 }, { "lshift", 0xE1 }, { "lalt", 0xE2 }, { "lgui", 0xE3 },
+    { "rctrl", 0xE4 }, { "rshift", 0xE5 }, { "ralt", 0xE6 }, { "rgui", 0xE7 },
+    { "ctrl", 0xE0 }, { "shift", 0xE1 }, { "alt", 0xE2 }, { "gui", 0xE3 },
+};
+
+static uint8_t Key(void)
+{
+    uint8_t usage, mods;
+    unsigned i;
+
+    if (tokType == 'n' && tokDigit) {
+        KeyFromAscii('0' + tokNum, &usage, &mods);
+        Next();
+        return usage;
+    }
+    if (tokType == 'n') {
+        if (tokNum <= 0 || tokNum > 0xFF) Fail("usage 0x%lX out of range", tokNum);
+        usage = (uint8_t)tokNum;
+        Next();
+        return usage;
+    }
+    if (tokType == 'i' && strlen(tok) == 1 && KeyFromAscii(tolower((unsigned char)tok[0]), &usage, &mods)) {
+        Next();
+        return usage;
+    }
+    if (tokType == 'i') {
+        for (i = 0; i < sizeof(keyNames) / sizeof(keyNames[0]); i++) {
+            if (!strcmp(tok, keyNames[i].name)) {
+                Next();
+                return keyNames[i].usage;
+            }
+        }
+    }
+    Fail("unknown key '%s'", tok);
+    return 0;
+}
+
+static uint8_t ModMask(void)
+{
+    uint8_t mask = 0, usage;
+
+    if (tokType == 'i' && !strcmp(tok, "none")) {
+        Next();
+        return 0;
+    }
+    for (;;) {
+        usage = Key();
+        if (!USAGE_IS_MODIFIER(usage)) Fail("not a modifier");
+        mask |= USAGE_MODIFIER_BIT(usage);
+        if (tokType != '+') return mask;
+        Next();
+    }
+}
+
+// Index of the string, shared with an earlier identical one
+static int AddString(const char *t, int len)
+{
+    int i;
+
+    for (i = 0; i < strCount; i++) {
+        if (strs[i].len == len && !memcmp(strs[i].text, t, len)) return i;
+    }
+    if (strCount == MAX_STRINGS) Fail("more than %d strings", MAX_STRINGS);
+    strs[strCount].text = malloc(len + 1);
+    memcpy(strs[strCount].text, t, len);
+    strs[strCount].text[len] = 0;
+    strs[strCount].len = len;
+    strs[strCount].host = strCount;
+    return strCount++;
+}
+
+static void EmitDelay(SEQ *s, long ms)
+{
+    if (ms < 0) Fail("negative delay");
+    // Longer than one operand holds: split
+    while (ms > 0xFFFF) {
+        Emit(s, MOP_DELAY, 0xFFFF);
+        ms -= 0xFFFF;
+    }
+    Emit(s, MOP_DELAY, (uint32_t)ms);
+}
+
+/*
+ * mods is lexical: type shifts on top of the mask set by the last mods
+ * statement above it in the same macro.
+ */
+static void Statements(SEQ *s, uint8_t *mods, int depth)
+{
+    static char buf[MAX_STRING];
+    uint8_t usage, shift;
+    long n;
+    int len;
+    const char *p;
+
+    while (tokType == 'i') {
+        if (!strcmp(tok, "press") || !strcmp(tok, "release") || !strcmp(tok, "tap")) {
+            uint8_t op = tok[0] == 'p' ? MOP_PRESS : tok[0] == 'r' ? MOP_RELEASE : MOP_TAP;
+            Next();
+            Emit(s, op, Key());
+        } else if (!strcmp(tok, "type")) {
+            Next();
+            if (tokType != 's') Fail("type needs a string");
+            for (p = tok; *p; p++) {
+                if (!KeyFromAscii(*p, &usage, &shift)) Fail("no key types '%c'", *p);
+                Emit(s, MOP_MODS, *mods | shift);
+                Emit(s, MOP_TAP, usage);
+            }
+            Emit(s, MOP_MODS, *mods);
+            Next();
+        } else if (!strcmp(tok, "stream")) {
+            Next();
+            if (tokType != 's') Fail("stream needs a string");
+            // Adjacent strings join up, for text longer than a token
+            for (len = 0; tokType == 's'; Next()) {
+                for (p = tok; *p; p++) {
+                    if (!KeyFromAscii(*p, &usage, &shift)) Fail("no key types '%c'", *p);
+                    if (len == MAX_STRING - 1) Fail("stream text is over %d characters", MAX_STRING - 1);
+                    buf[len++] = *p;
+                }
+            }
+            if (len == 0) Fail("empty stream");
+            Emit(s, MOP_TEXT, AddString(buf, len));
+            if (*mods) Emit(s, MOP_MODS, *mods);
+        } else if (!strcmp(tok, "delay")) {
+            Next();
+            EmitDelay(s, Expr());
+        } else if (!strcmp(tok, "repeat") || !strcmp(tok, "forever")) {
+            if (tok[0] == 'r') {
+                Next();
+                n = Expr();
+                if (n < 1 || n > 255) Fail("repeat count must be 1-255");
+            } else {
+                Next();
+                n = 0;
+            }
+            if (depth == MACRO_LOOP_DEPTH) Fail("loops nest at most %d deep", MACRO_LOOP_DEPTH);
+            Expect('{', "'{'");
+            Emit(s, MOP_REPEAT, (uint32_t)n);
+            Statements(s, mods, depth + 1);
+            Emit(s, MOP_NEXT, 0);
+            Expect('}', "'}'");
+        } else if (!strcmp(tok, "mods")) {
+            Next();
+            *mods = ModMask();
+            Emit(s, MOP_MODS, *mods);
+        } else if (!strcmp(tok, "wait_release")) {
+            Next();
+            Emit(s, MOP_WAIT_RELEASE, 0);
+        } else {
+            Fail("unknown statement '%s'", tok);
+        }
+    }
+}
+
+/*
+ * A steno key for ACT_STENO(): the Plover HID machine's name for it, or
+ * the plain steno letter, which is the first key of that name.
+ */
+static uint8_t StenoKeyName(void)
+{
+    static const char *const names[STENO_X1] = {
+        "S1-", "S2-", "T-", "K-", "P-", "W-", "H-", "R-", "A-", "O-",
+        "*1", "*2", "*3", "*4", "-E", "-U",
+        "-F", "-R", "-P", "-B", "-L", "-G", "-T", "-S", "-D", "-Z",
+        "#1", "#2", "#3", "#4", "#5", "#6", "#7", "#8", "#9", "#A", "#B", "#C"
+    };
+    static const struct { const char *name; uint8_t key; } plain[] = {
+        { "S-", STENO_S1 }, { "A", STENO_A }, { "O", STENO_O }, { "*", STENO_STAR1 },
+        { "E", STENO_E }, { "U", STENO_U }, { "E-", STENO_E }, { "U-", STENO_U },
+        { "-A", STENO_A }, { "-O", STENO_O }, { "#", STENO_NUM1 },
+    };
+    unsigned i;
+    char *end;
+    long n;
+
+    if (tokType != 's') Fail("expected a steno key name in quotes");
+    for (i = 0; i < STENO_X1; i++) {
+        if (!strcmp(tok, names[i])) break;
+    }
+    if (i == STENO_X1) {
+        for (i = 0; i < sizeof(plain) / sizeof(plain[0]); i++) {
+            if (!strcmp(tok, plain[i].name)) break;
+        }
+        if (i < sizeof(plain) / sizeof(plain[0])) {
+            i = plain[i].key;
+        } else if (tok[0] == 'X' && (n = strtol(tok + 1, &end, 10)) >= 1 &&
+                   n <= STENO_KEYS - STENO_X1 && *end == 0) {
+            i = STENO_X1 + n - 1;
+        } else {
+            Fail("no steno key '%s'", tok);
+        }
+    }
+    Next();
+    return (uint8_t)i;
+}
+
+static uint16_t Action(void)
+{
+    static const struct { const char *name; uint16_t type; } layerOps[] = {
+        { "mo", ACT_MO(0) }, { "tg", ACT_TG(0) }, { "osl", ACT_OSL(0) },
+    };
+    unsigned i;
+    uint8_t mask;
+    long n;
+
+    if (tokType == 'i') {
+        if (!strcmp(tok, "trans")) {
+            Next();
+            return ACT_TRANSPARENT;
+        }
+        if (!strcmp(tok, "none")) {
+            Next();
+            return ACT_NO;
+        }
+        if (!strcmp(tok, "macro")) {
+            Next();
+            n = Expr();
+            if (n < 0 || n >= MAX_MACROS) Fail("no macro %ld", n);
+            if (tokType == 'i' && !strcmp(tok, "repeat")) {
+                Next();
+                return ACT_MACRO_RPT(n);
+            }
+            return ACT_MACRO(n);
+        }
+        if (!strcmp(tok, "mods")) {
+            Next();
+            return ACT_MODS(ModMask());
+        }
+        if (!strcmp(tok, "leader")) {
+            Next();
+            return ACT_LEADER;
+        }
+        if (!strcmp(tok, "steno")) {
+            Next();
+            if (tokType == 'i' && !strcmp(tok, "output")) {
+                Next();
+                return ACT_STENO(STENO_OUTPUT);
+            }
+            return ACT_STENO(StenoKeyName());
+        }
+        if (!strcmp(tok, "record") || !strcmp(tok, "play")) {
+            mask = tok[0] == 'r';
+            Next();
+            n = Expr();
+            if (n < 0 || n >= RECORD_SLOTS) Fail("recording slots are 0-%d", RECORD_SLOTS - 1);
+            return mask ? ACT_RECORD(n) : ACT_PLAY(n);
+        }
+        if (!strcmp(tok, "mt")) {
+            Next();
+            mask = ModMask();
+            if (mask & 0xF0) {
+                if (mask & 0x0F) Fail("mt mixes left and right modifiers");
+                return ACT_MT_R(mask >> 4, Key());
+            }
+            return ACT_MT(mask, Key());
+        }
+        if (!strcmp(tok, "lt")) {
+            Next();
+            n = Expr();
+            if (n < 0 || n > 15) Fail("lt reaches layers 0-15");
+            if (n > maxLayerRef) maxLayerRef = (int)n;
+            return ACT_LT(n, Key());
+        }
+        for (i = 0; i < sizeof(layerOps) / sizeof(layerOps[0]); i++) {
+            if (strcmp(tok, layerOps[i].name)) continue;
+            Next();
+            n = Expr();
+            if (n < 0 || n >= KEYMAP_MAX_LAYERS) Fail("layers are 0-%d", KEYMAP_MAX_LAYERS - 1);
+            if (n > maxLayerRef) maxLayerRef = (int)n;
+            return layerOps[i].type | n;
+        }
+    }
+    return ACT_KEY(Key());
+}
+
+static void Layer(void)
+{
+    long layer, key;
+
+    layer = Expr();
+    if (layer < 0 || layer >= KEYMAP_MAX_LAYERS) Fail("layers are 0-%d", KEYMAP_MAX_LAYERS - 1);
+    if (layerDefined[layer]) Fail("layer %ld defined twice", layer);
+    layerDefined[layer] = true;
+    if (layer > maxLayer) maxLayer = (int)layer;
+    if (tokType == 'i') Next();     // Name, for the reader
+    Expect('{', "'{'");
+    while (tokType == 'n') {
+        key = Expr();
+        if (key < 0 || key >= KEYMAP_MAX_KEYS) Fail("keys are 0-%d", KEYMAP_MAX_KEYS - 1);
+        if (key > maxKey) maxKey = (int)key;
+        Expect(':', "':'");
+        layerAction[layer][key] = Action();
+    }
+    Expect('}', "'}'");
+}
+
+static void Combo(void)
+{
+    COMBO_SRC *c;
+    long key;
+    int n = 0;
+
+    if (comboCount == MAX_COMBOS) Fail("more than %d combos", MAX_COMBOS);
+    c = &comboSrc[comboCount++];
+    for (;;) {
+        // Not Expr(): '+' joins keys here
+        if (tokType != 'n') Fail("expected a key number");
+        key = tokNum;
+        Next();
+        if (key < 0 || key >= KEYMAP_MAX_KEYS) Fail("keys are 0-%d", KEYMAP_MAX_KEYS - 1);
+        if (c->keys & (1ull << key)) Fail("key %ld twice in one combo", key);
+        c->keys |= 1ull << key;
+        n++;
+        if (tokType != '+') break;
+        Next();
+    }
+    if (n < 2 || n > COMBO_MAX_KEYS) Fail("a combo has 2-%d keys", COMBO_MAX_KEYS);
+    Expect('=', "'='");
+    key = Expr();
+    if (key < 0 || key >= KEYMAP_MAX_KEYS) Fail("keys are 0-%d", KEYMAP_MAX_KEYS - 1);
+    c->key = (uint8_t)key;
+}
+
+static int LeaderNode(void)
+{
+    LEADER_NODE *n;
+
+    if (leaderNodeCount == leaderNodeCap) {
+        leaderNodeCap = leaderNodeCap ? leaderNodeCap * 2 : 64;
+        leaderNodes = realloc(leaderNodes, leaderNodeCap * sizeof(LEADER_NODE));
+    }
+    n = &leaderNodes[leaderNodeCount];
+    memset(n, 0, sizeof(*n));
+    n->macro = LEADER_NO_MACRO;
+    return leaderNodeCount++;
+}
+
+// The child of node for usage, made if it is not there yet
+static int LeaderChild(int node, uint8_t usage)
+{
+    LEADER_NODE *n = &leaderNodes[node];
+    int i, child;
+
+    for (i = 0; i < n->count && n->usage[i] < usage; i++);
+    if (i < n->count && n->usage[i] == usage) return n->child[i];
+
+    child = LeaderNode();
+    n = &leaderNodes[node];         // LeaderNode() may have moved it
+    if (n->count == n->cap) {
+        n->cap = n->cap ? n->cap * 2 : 4;
+        n->usage = realloc(n->usage, n->cap);
+        n->child = realloc(n->child, n->cap * sizeof(int));
+    }
+    memmove(&n->usage[i + 1], &n->usage[i], n->count - i);
+    memmove(&n->child[i + 1], &n->child[i], (n->count - i) * sizeof(int));
+    n->usage[i] = usage;
+    n->child[i] = child;
+    n->count++;
+    return child;
+}
+
+static void Leader(void)
+{
+    int node, n = 0;
+    long id;
+
+    if (leaderNodeCount == 0) LeaderNode();     // The root
+    node = 0;
+    while (tokType != '=') {
+        if (tokType == 0) Fail("expected '='");
+        if (++n > MAX_LEADER_KEYS) Fail("a leader sequence has at most %d keys", MAX_LEADER_KEYS);
+        node = LeaderChild(node, Key());
+    }
+    if (n == 0) Fail("a leader sequence needs at least one key");
+    Next();
+    if (tokType != 'i' || strcmp(tok, "macro")) Fail("expected 'macro'");
+    Next();
+    id = Expr();
+    if (id < 0 || id >= MAX_MACROS || id == LEADER_NO_MACRO) Fail("no macro %ld", id);
+    if (leaderNodes[node].macro != LEADER_NO_MACRO) Fail("leader sequence defined twice");
+    leaderNodes[node].macro = (uint8_t)id;
+    leaderNodes[node].line = line;
+    leaderCount++;
+}
+
+// A stroke in Plover's notation as STENO_ORDER bits, or 0 if it is not one
+static uint32_t StenoStroke(const char *s)
+{
+    static const char order[] = STENO_ORDER;
+    static const char digits[] = "OSTPHAFPLT";  // 0-9, each with #
+    uint32_t stroke = 0;
+    int at = 0, i;
+    char c;
+
+    for (; *s; s++) {
+        c = *s;
+        if (c == '-') {
+            if (at > STENO_ORDER_RIGHT) return 0;
+            at = STENO_ORDER_RIGHT;
+            continue;
+        }
+        if (isdigit((unsigned char)c)) {
+            stroke |= 1;
+            if (c >= '6' && at < STENO_ORDER_RIGHT) at = STENO_ORDER_RIGHT;
+            c = digits[c - '0'];
+        }
+        for (i = at; order[i] != 0 && order[i] != c; i++);
+        if (order[i] == 0) return 0;
+        stroke |= 1ul << i;
+        at = i + 1;
+    }
+    return stroke;
+}
+
+static void Steno(void)
+{
+    STENO_SRC *e;
+
+    if (stenoCount == MAX_STENO) Fail("more than %d steno entries", MAX_STENO);
+    if (tokType != 's') Fail("expected a steno stroke in quotes");
+    if (strchr(tok, '/')) Fail("'%s': only single strokes can be defined", tok);
+    e = &steno[stenoCount++];
+    e->stroke = StenoStroke(tok);
+    if (e->stroke == 0) Fail("'%s' is not a steno stroke", tok);
+    e->line = line;
+    Next();
+    Expect('=', "'='");
+    if (tokType != 's') Fail("expected the text in quotes");
+    e->text = strdup(tok);
+    Next();
+}
+
+static int StenoCompare(const void *a, const void *b)
+{
+    const STENO_SRC *x = a, *y = b;
+
+    return x->stroke < y->stroke ? -1 : x->stroke > y->stroke;
+}
+
+static void Parse(void)
+{
+    MACRO_SRC *m;
+    long id;
+    uint8_t mods;
+    int key, layer;
+
+    Next();
+    while (tokType != 0) {
+        if (tokType == 'i' && !strcmp(tok, "layer")) {
+            Next();
+            Layer();
+            continue;
+        }
+        if (tokType == 'i' && !strcmp(tok, "combo")) {
+            Next();
+            Combo();
+            continue;
+        }
+        if (tokType == 'i' && !strcmp(tok, "leader")) {
+            Next();
+            Leader();
+            continue;
+        }
+        if (tokType == 'i' && !strcmp(tok, "steno")) {
+            Next();
+            Steno();
+            continue;
+        }
+        if (tokType != 'i' || strcmp(tok, "macro")) {
+            Fail("expected 'macro', 'layer', 'combo', 'leader' or 'steno', found '%s'", tok);
+        }
+        Next();
+        if (tokType != 'n') Fail("expected a macro id");
+        id = tokNum;
+        if (id < 0 || id >= MAX_MACROS) Fail("macro id must be 0-%d", MAX_MACROS - 1);
+        m = &src[id];
+        if (m->defined) Fail("macro %ld defined twice", id);
+        m->defined = true;
+        if (id > maxId) maxId = (int)id;
+        Next();
+        if (tokType == 'i') {
+            snprintf(m->name, sizeof(m->name), "%.31s", tok);
+            Next();
+        }
+        Expect('{', "'{'");
+        mods = 0;
+        Statements(&m->naive, &mods, 0);
+        Expect('}', "'}'");
+    }
+
+    if (maxLayerRef > maxLayer) Fail("layer %d is switched to but never defined", maxLayerRef);
+    for (layer = 0; layer <= maxLayer; layer++) {
+        for (key = 0; key <= maxKey; key++) {
+            if ((ACT_TYPE(layerAction[layer][key]) == ACT_MACRO(0) ||
+                 ACT_TYPE(layerAction[layer][key]) == ACT_MACRO_RPT(0)) &&
+                !src[ACT_ARG(layerAction[layer][key])].defined) {
+                Fail("layer %d key %d: macro %d is not defined", layer, key, ACT_ARG(layerAction[layer][key]));
+            }
+        }
+    }
+    for (key = 0; key < leaderNodeCount; key++) {
+        if (leaderNodes[key].macro != LEADER_NO_MACRO && !src[leaderNodes[key].macro].defined) {
+            line = leaderNodes[key].line;
+            Fail("leader sequence: macro %d is not defined", leaderNodes[key].macro);
+        }
+    }
+    qsort(steno, stenoCount, sizeof(steno[0]), StenoCompare);
+    for (key = 1; key < stenoCount; key++) {
+        if (steno[key].stroke == steno[key - 1].stroke) {
+            line = steno[key].line;
+            Fail("steno stroke defined twice");
+        }
+    }
+}
+
+/* ---------------------------------------------------------------- */
+/* Optimizer                                                        */
+/* ---------------------------------------------------------------- */
+
+static void SeqCopy(SEQ *dst, const SEQ *s)
+{
+    int i;
+
+    dst->len = 0;
+    for (i = 0; i < s->len; i++) Emit(dst, s->code[i].op, s->code[i].arg);
+}
+
+// Merges and removes delays; true if anything changed
+static bool FoldDelays(SEQ *s)
+{
+    SEQ out = { 0 };
+    INSN *c = s->code;
+    bool changed = false;
+    uint32_t total;
+    int i, j;
+
+    for (i = 0; i < s->len; i++) {
+        if (c[i].op == MOP_DELAY && c[i].arg == 0) {
+            changed = true;
+            continue;
+        }
+        if (c[i].op == MOP_DELAY && out.len && out.code[out.len - 1].op == MOP_DELAY &&
+            out.code[out.len - 1].arg + c[i].arg <= 0xFFFF) {
+            out.code[out.len - 1].arg += c[i].arg;
+            changed = true;
+            continue;
+        }
+        // repeat n { delay... } waits n times as long
+        if (c[i].op == MOP_REPEAT && c[i].arg != 0) {
+            total = 0;
+            for (j = i + 1; j < s->len && c[j].op == MOP_DELAY; j++) total += c[j].arg;
+            if (j < s->len && c[j].op == MOP_NEXT && (uint64_t)total * c[i].arg <= 0xFFFF) {
+                Emit(&out, MOP_DELAY, total * c[i].arg);
+                i = j;
+                changed = true;
+                continue;
+            }
+        }
+        Emit(&out, c[i].op, c[i].arg);
+    }
+    free(s->code);
+    *s = out;
+    return changed;
+}
+
+// Drops MODS that write the value the modifier byte already has
+static void DropRedundantMods(SEQ *s)
+{
+    SEQ out = { 0 };
+    INSN *c = s->code;
+    bool known = true;              // A fresh slot starts with no modifiers
+    uint8_t mods = 0;
+    int i;
+
+    for (i = 0; i < s->len; i++) {
+        switch (c[i].op)
+        {
+            case MOP_MODS:
+                if (known && mods == c[i].arg) continue;
+                known = true;
+                mods = (uint8_t)c[i].arg;
+                break;
+            case MOP_PRESS:
+                if (USAGE_IS_MODIFIER(c[i].arg)) mods |= USAGE_MODIFIER_BIT(c[i].arg);
+                break;
+            case MOP_RELEASE:
+                if (USAGE_IS_MODIFIER(c[i].arg)) mods &= ~USAGE_MODIFIER_BIT(c[i].arg);
+                break;
+            case MOP_TEXT:
+                known = true;
+                mods = 0;
+                break;
+            case MOP_REPEAT:
+            case MOP_NEXT:
+                // Loop heads are reached from two places
+                known = false;
+                break;
+        }
+        Emit(&out, c[i].op, c[i].arg);
+    }
+    free(s->code);
+    *s = out;
+}
+
+/* Shared code: runs are looked for in the macro bodies */
+typedef struct
+{
+    SEQ *seq;
+    int at;
+} POS;
+
+static SEQ *allSeq[MAX_MACROS];
+static int allCount;
+
+static int Compare(const INSN *a, int an, const INSN *b, int bn, int limit)
+{
+    int i;
+
+    for (i = 0; i < limit; i++) {
+        if (i == an || i == bn) return (i == an) - (i == bn);
+        if (a[i].op != b[i].op) return a[i].op - b[i].op;
+        if (a[i].arg != b[i].arg) return a[i].arg < b[i].arg ? -1 : 1;
+    }
+    return 0;
+}
+
+static int ComparePos(const void *x, const void *y)
+{
+    const POS *a = x, *b = y;
+
+    return Compare(&a->seq->code[a->at], a->seq->len - a->at,
+                   &b->seq->code[b->at], b->seq->len - b->at, MAX_WINDOW);
+}
+
+static int Common(const POS *a, const POS *b)
+{
+    int n = 0;
+
+    while (n < MAX_WINDOW && a->at + n < a->seq->len && b->at + n < b->seq->len &&
+           a->seq->code[a->at + n].op == b->seq->code[b->at + n].op &&
+           a->seq->code[a->at + n].arg == b->seq->code[b->at + n].arg) {
+        n++;
+    }
+    return n;
+}
+
+// A window can become a subroutine if its loops are whole and calls stay shallow
+static int WindowDepth(const INSN *w, int len)
+{
+    int i, loops = 0, depth = 1;
+
+    for (i = 0; i < len; i++) {
+        if (w[i].op == MOP_REPEAT) loops++;
+        if (w[i].op == MOP_NEXT && --loops < 0) return -1;
+        if (w[i].op == MOP_CALL && subDepth[w[i].arg] + 1 > depth) depth = subDepth[w[i].arg] + 1;
+    }
+    if (loops != 0 || depth > MACRO_CALL_DEPTH) return -1;
+    return depth;
+}
+
+static int ComparePosAt(const void *x, const void *y)
+{
+    const POS *a = x, *b = y;
+
+    if (a->seq != b->seq) return a->seq < b->seq ? -1 : 1;
+    return a->at - b->at;
+}
+
+/*
+ * Finds the window whose extraction saves the most bytes.  Suffixes are
+ * sorted so that equal windows sit next to each other.
+ */
+static int FindBest(POS *pos, int npos, POS *best, int *bestLen)
+{
+    static POS group[1 << 16];
+    int *lcp = malloc(npos * sizeof(int));
+    int L, i, j, k, g, n, size, saving, bestSaving = 0, end;
+
+    for (i = 1; i < npos; i++) lcp[i] = Common(&pos[i - 1], &pos[i]);
+
+    for (L = 1; L <= MAX_WINDOW; L++) {
+        for (i = 1; i < npos; i = j) {
+            if (lcp[i] < L) {
+                j = i + 1;
+                continue;
+            }
+            // pos[i-1 .. j-1] share a window of L instructions
+            for (j = i + 1; j < npos && lcp[j] >= L; j++);
+            if (WindowDepth(&pos[i - 1].seq->code[pos[i - 1].at], L) < 0) continue;
+
+            n = 0;
+            for (k = i - 1; k < j && n < (int)(sizeof(group) / sizeof(group[0])); k++) group[n++] = pos[k];
+            qsort(group, n, sizeof(POS), ComparePosAt);
+
+            // Count occurrences that do not overlap
+            k = 0;
+            end = -1;
+            for (g = 0; g < n; g++) {
+                if (g > 0 && group[g].seq == group[g - 1].seq && group[g].at < end) continue;
+                end = group[g].at + L;
+                k++;
+            }
+            size = SeqSize(&group[0].seq->code[group[0].at], L);
+            // k copies become k calls plus one body with a return
+            saving = k * size - (size + 1) - 3 * k;
+            if (saving > bestSaving) {
+                bestSaving = saving;
+                *best = group[0];
+                *bestLen = L;
+            }
+        }
+    }
+    free(lcp);
+    return bestSaving;
+}
+
+static void Replace(SEQ *s, const INSN *w, int len, int sub)
+{
+    SEQ out = { 0 };
+    int i = 0;
+
+    while (i < s->len) {
+        if (i + len <= s->len && Compare(&s->code[i], s->len - i, w, len, len) == 0) {
+            Emit(&out, MOP_CALL, sub);
+            i += len;
+        } else {
+            Emit(&out, s->code[i].op, s->code[i].arg);
+            i++;
+        }
+    }
+    free(s->code);
+    *s = out;
+}
+
+static void ShareCode(void)
+{
+    POS *pos = NULL, best;
+    INSN window[MAX_WINDOW];
+    int npos, id, i, j, len;
+
+    for (;;) {
+        allCount = 0;
+        // Subroutines are never rewritten, so their depth is fixed once made
+        for (id = 0; id <= maxId; id++) if (src[id].defined) allSeq[allCount++] = &src[id].opt;
+
+        npos = 0;
+        for (i = 0; i < allCount; i++) npos += allSeq[i]->len;
+        pos = realloc(pos, (npos + 1) * sizeof(POS));
+        npos = 0;
+        for (i = 0; i < allCount; i++) {
+            for (j = 0; j < allSeq[i]->len; j++) {
+                pos[npos].seq = allSeq[i];
+                pos[npos].at = j;
+                npos++;
+            }
+        }
+        qsort(pos, npos, sizeof(POS), ComparePos);
+
+        if (subCount == MAX_SUBS || FindBest(pos, npos, &best, &len) <= 0) break;
+
+        memcpy(window, &best.seq->code[best.at], len * sizeof(INSN));
+        subs[subCount].len = subs[subCount].cap = 0;
+        subs[subCount].code = NULL;
+        for (i = 0; i < len; i++) Emit(&subs[subCount], window[i].op, window[i].arg);
+        subDepth[subCount] = WindowDepth(window, len);
+        for (i = 0; i < allCount; i++) Replace(allSeq[i], window, len, subCount);
+        subCount++;
+    }
+    free(pos);
+}
+
+/* ---------------------------------------------------------------- */
+/* Layout and encoding                                              */
+/* ---------------------------------------------------------------- */
+
+static uint8_t image[0x10000];
+static int imageSize;
+static uint16_t subOffset[MAX_SUBS];
+static bool subPlaced[MAX_SUBS];
+static int subOrder[MAX_SUBS], subOrdered;
+static uint16_t strOffset[MAX_STRINGS];
+static bool strPlaced[MAX_STRINGS];
+
+// Shared code goes right after the first body that calls it
+static void PlaceCallees(const SEQ *s)
+{
+    int i, sub;
+
+    for (i = 0; i < s->len; i++) {
+        if (s->code[i].op != MOP_CALL) continue;
+        sub = s->code[i].arg;
+        if (subPlaced[sub]) continue;
+        subPlaced[sub] = true;
+        subOrder[subOrdered++] = sub;
+        PlaceCallees(&subs[sub]);
+    }
+}
+
+// Each string gets the longest string that ends with it as its host
+static void FindHosts(STRING_SRC *set)
+{
+    int i, j, h;
+
+    for (i = 0; i < strCount; i++) {
+        h = i;
+        for (j = 0; j < strCount; j++) {
+            if (set[j].len > set[h].len &&
+                !memcmp(set[j].text + set[j].len - set[i].len, set[i].text, set[i].len)) {
+                h = j;
+            }
+        }
+        set[i].host = h;
+    }
+}
+
+// Every pair a b, left to right, becomes code; returns the new length
+static int ReplacePair(char *t, int len, char a, char b, char code)
+{
+    int i, n = 0;
+
+    for (i = 0; i < len; i++) {
+        if (i + 1 < len && t[i] == a && t[i + 1] == b) {
+            t[n++] = code;
+            i++;
+        } else {
+            t[n++] = t[i];
+        }
+    }
+    t[n] = 0;
+    return n;
+}
+
+/*
+ * Re-Pair over the strings that are stored, the hosts: count the
+ * adjacent pairs, give the most frequent one the next code, replace it
+ * everywhere, count again.  A pair costs two bytes of table and saves
+ * one per use, so it has to be used three times.  Strings stored
+ * inside others are packed by the same replacements, which may or may
+ * not leave them ending their host; FindHosts() sorts that out again.
+ */
+static void Pack(void)
+{
+    static int count[256][256];
+    uint8_t a, b, *t;
+    int i, j, n, best, bestA = 0, bestB = 0, h;
+
+    for (i = 0; i < strCount; i++) {
+        packedStrs[i].text = malloc(strs[i].len + 1);
+        memcpy(packedStrs[i].text, strs[i].text, strs[i].len + 1);
+        packedStrs[i].len = strs[i].len;
+    }
+    pairTable[0] = 0;
+    memset(pairHeight, 0, sizeof(pairHeight));
+
+    while (pairTable[0] < TEXT_PAIRS_MAX) {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < strCount; i++) {
+            if (strs[i].host != i) continue;
+            t = (uint8_t *)packedStrs[i].text;
+            for (j = 0; j + 1 < packedStrs[i].len; j++) {
+                count[t[j]][t[j + 1]]++;
+                // A run of three holds one pair that can be replaced, not two
+                if (t[j] == t[j + 1] && j + 2 < packedStrs[i].len && t[j + 2] == t[j]) j++;
+            }
+        }
+        best = 0;
+        for (i = 1; i < 256; i++) {
+            for (j = 1; j < 256; j++) {
+                h = (pairHeight[i] > pairHeight[j] ? pairHeight[i] : pairHeight[j]) + 1;
+                if (count[i][j] > best && h < TEXT_PACK_DEPTH) {
+                    best = count[i][j];
+                    bestA = i;
+                    bestB = j;
+                }
+            }
+        }
+        if (best < 3) break;
+
+        n = pairTable[0]++;
+        a = bestA;
+        b = bestB;
+        pairTable[1 + 2 * n] = a;
+        pairTable[2 + 2 * n] = b;
+        pairHeight[TEXT_PAIR_FIRST + n] = (pairHeight[a] > pairHeight[b] ? pairHeight[a] : pairHeight[b]) + 1;
+        for (i = 0; i < strCount; i++) {
+            packedStrs[i].len = ReplacePair(packedStrs[i].text, packedStrs[i].len, a, b, TEXT_PAIR_FIRST + n);
+        }
+    }
+    FindHosts(packedStrs);
+}
+
+// Bytes the stored strings take, plain or packed with the pair table
+static int TextBytes(const STRING_SRC *set, bool packed)
+{
+    int i, n = packed ? 1 + 2 * pairTable[0] : 0;
+
+    for (i = 0; i < strCount; i++) {
+        if (set[i].host == i) n += set[i].len + 1;
+    }
+    return n;
+}
+
+static void UsePacked(SEQ *s)
+{
+    int i;
+
+    for (i = 0; i < s->len; i++) {
+        if (s->code[i].op == MOP_TEXT) s->code[i].op = MOP_TEXT_PACKED;
+    }
+}
+
+/*
+ * Strings go after the code that first streams them, in the same order
+ * in both passes.  Returns the next free offset.
+ */
+static int PlaceStrings(const SEQ *s, int at, bool write)
+{
+    const STRING_SRC *set;
+    int i, str, h;
+
+    for (i = 0; i < s->len; i++) {
+        if (s->code[i].op != MOP_TEXT && s->code[i].op != MOP_TEXT_PACKED) continue;
+        set = s->code[i].op == MOP_TEXT ? strs : packedStrs;
+        str = s->code[i].arg;
+        h = set[str].host;
+        if (!strPlaced[h]) {
+            strPlaced[h] = true;
+            strOffset[h] = at;
+            if (write) memcpy(&image[at], set[h].text, set[h].len + 1);
+            at += set[h].len + 1;
+        }
+        strOffset[str] = strOffset[h] + set[h].len - set[str].len;
+    }
+    return at;
+}
+
+static void Put(int at, const INSN *c)
+{
+    image[at] = c->op;
+    switch (InsnSize(c->op))
+    {
+        case 3:
+            if (c->op == MOP_CALL) {
+                image[at + 1] = subOffset[c->arg] & 0xFF;
+                image[at + 2] = subOffset[c->arg] >> 8;
+            } else if (c->op == MOP_TEXT || c->op == MOP_TEXT_PACKED) {
+                image[at + 1] = strOffset[c->arg] & 0xFF;
+                image[at + 2] = strOffset[c->arg] >> 8;
+            } else {
+                image[at + 1] = c->arg & 0xFF;
+                image[at + 2] = (c->arg >> 8) & 0xFF;
+            }
+            break;
+        case 2:
+            image[at + 1] = (uint8_t)c->arg;
+            break;
+    }
+}
+
+static int PutSeq(int at, const SEQ *s, uint8_t last)
+{
+    INSN end = { last, 0 };
+    int i;
+
+    for (i = 0; i < s->len; i++) {
+        Put(at, &s->code[i]);
+        at += InsnSize(s->code[i].op);
+    }
+    Put(at, &end);
+    return at + 1;
+}
+
+static int Build(bool naive)
+{
+    MACRO_IMAGE *hdr = (MACRO_IMAGE*)image;
+    int id, i, first, at, pairs = 0, count = maxId + 1;
+    int entry[MAX_MACROS];
+
+    memset(image, 0, sizeof(image));
+    memset(subPlaced, 0, sizeof(subPlaced));
+    memset(strPlaced, 0, sizeof(strPlaced));
+    subOrdered = 0;
+
+    // Pass 1: offsets
+    at = sizeof(MACRO_IMAGE) + 2 * count;
+    for (id = 0; id <= maxId; id++) {
+        if (!src[id].defined) {
+            entry[id] = MACRO_NONE;
+            continue;
+        }
+        entry[id] = at;
+        if (naive) {
+            at += SeqSize(src[id].naive.code, src[id].naive.len) + 1;
+            at = PlaceStrings(&src[id].naive, at, false);
+            continue;
+        }
+        at += SeqSize(src[id].opt.code, src[id].opt.len) + 1;
+        first = subOrdered;
+        PlaceCallees(&src[id].opt);
+        for (i = first; i < subOrdered; i++) {
+            subOffset[subOrder[i]] = at;
+            at += SeqSize(subs[subOrder[i]].code, subs[subOrder[i]].len) + 1;
+        }
+        at = PlaceStrings(&src[id].opt, at, false);
+        for (i = first; i < subOrdered; i++) {
+            at = PlaceStrings(&subs[subOrder[i]], at, false);
+        }
+    }
+    // The pair table last: it is read a pair at a time, from anywhere
+    if (!naive && packing) {
+        pairs = at;
+        at += 1 + 2 * pairTable[0];
+    }
+    if (at > 0xFFFF) {
+        fprintf(stderr, "image is %d bytes, the limit is 65535\n", at);
+        exit(1);
+    }
+
+    // Pass 2: bytes, in the same order
+    hdr->magic = MACRO_IMAGE_MAGIC;
+    hdr->version = MACRO_IMAGE_VERSION;
+    hdr->count = count;
+    hdr->size = at;
+    hdr->pairs = pairs;
+    for (id = 0; id <= maxId; id++) hdr->offset[id] = entry[id];
+    if (pairs != 0) memcpy(&image[pairs], pairTable, 1 + 2 * pairTable[0]);
+
+    subOrdered = 0;
+    memset(subPlaced, 0, sizeof(subPlaced));
+    memset(strPlaced, 0, sizeof(strPlaced));
+    for (id = 0; id <= maxId; id++) {
+        if (!src[id].defined) continue;
+        if (naive) {
+            at = PutSeq(entry[id], &src[id].naive, MOP_END);
+            PlaceStrings(&src[id].naive, at, true);
+            continue;
+        }
+        at = PutSeq(entry[id], &src[id].opt, MOP_END);
+        first = subOrdered;
+        PlaceCallees(&src[id].opt);
+        for (i = first; i < subOrdered; i++) {
+            at = PutSeq(at, &subs[subOrder[i]], MOP_RET);
+        }
+        at = PlaceStrings(&src[id].opt, at, true);
+        for (i = first; i < subOrdered; i++) {
+            at = PlaceStrings(&subs[subOrder[i]], at, true);
+        }
+    }
+    imageSize = hdr->size;
+    return imageSize;
+}
+
+/* ---------------------------------------------------------------- */
+/* Check: run both encodings through the firmware's interpreter     */
+/* ---------------------------------------------------------------- */
+
+static void Trace(const uint8_t *img, uint16_t entry, TRACE *tr)
+{
+    KEY_SET keys, last;
+    uint32_t t;
+
+    tr->len = 0;
+    tr->finished = false;
+    KeySetClear(&last);
+    MacroInit();
+    MacroStart(img, entry, 0);
+
+    for (t = 0; t < SIM_LIMIT_US; t += SIM_POLL_US) {
+        if (t == SIM_TRIGGER_UP_US) MacroTriggerUp(0);
+        MacroTasks(t);
+        KeySetClear(&keys);
+        MacroMerge(&keys);
+        if (memcmp(&keys, &last, sizeof(keys)) != 0) {
+            if (tr->len == tr->cap) {
+                tr->cap = tr->cap ? tr->cap * 2 : 256;
+                tr->ev = realloc(tr->ev, tr->cap * sizeof(EVENT));
+            }
+            tr->ev[tr->len].t = t;
+            tr->ev[tr->len].keys = keys;
+            tr->len++;
+            last = keys;
+        }
+        if (!MacroBusy()) {
+            tr->finished = true;
+            break;
+        }
+    }
+}
+
+static bool SameTrace(const TRACE *a, const TRACE *b)
+{
+    int i;
+
+    if (a->finished != b->finished || a->len != b->len) return false;
+    for (i = 0; i < a->len; i++) {
+        if (a->ev[i].t != b->ev[i].t || memcmp(&a->ev[i].keys, &b->ev[i].keys, sizeof(KEY_SET))) return false;
+    }
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
+static int CompareCombo(const void *x, const void *y)
+{
+    const COMBO_SRC *a = x, *b = y;
+
+    return a->keys < b->keys ? -1 : a->keys > b->keys;
+}
+
+static COMBO_SRC *FindCombo(uint64_t keys)
+{
+    int i;
+
+    for (i = 0; i < comboTableCount; i++) {
+        if (comboTable[i].keys == keys) return &comboTable[i];
+    }
+    return NULL;
+}
+
+/*
+ * One entry per key set of two or more keys that some combo contains:
+ * COMBO_FIRES if it is a combo, COMBO_PREFIX if a larger one contains
+ * it.  Sorted, for ComboLookup()'s binary search.
+ */
+static void BuildComboTable(void)
+{
+    COMBO_SRC *e;
+    uint64_t sub;
+    int i;
+
+    comboTableCount = 0;
+    for (i = 0; i < comboCount; i++) {
+        e = FindCombo(comboSrc[i].keys);
+        if (e != NULL && (e->flags & COMBO_FIRES)) Fail("two combos use the same keys");
+        if (e == NULL) {
+            e = &comboTable[comboTableCount++];
+            e->keys = comboSrc[i].keys;
+            e->flags = 0;
+        }
+        e->key = comboSrc[i].key;
+        e->flags |= COMBO_FIRES;
+
+        // Every proper subset with at least two keys
+        for (sub = (comboSrc[i].keys - 1) & comboSrc[i].keys; sub != 0; sub = (sub - 1) & comboSrc[i].keys) {
+            if (__builtin_popcountll(sub) < 2) continue;
+            e = FindCombo(sub);
+            if (e == NULL) {
+                e = &comboTable[comboTableCount++];
+                e->keys = sub;
+                e->key = 0;
+                e->flags = 0;
+            }
+            e->flags |= COMBO_PREFIX;
+        }
+    }
+    qsort(comboTable, comboTableCount, sizeof(COMBO_SRC), CompareCombo);
+}
+
+/*
+ * Depth first, so a node's first child follows it and a sequence reads
+ * forward through flash.  Returns the next free offset.
+ */
+static int PlaceLeader(int node, int at)
+{
+    LEADER_NODE *n = &leaderNodes[node];
+    int i;
+
+    n->offset = at;
+    at += 2 + LEADER_EDGE_SIZE * n->count;
+    for (i = 0; i < n->count; i++) at = PlaceLeader(n->child[i], at);
+    return at;
+}
+
+static void BuildLeaderTrie(void)
+{
+    LEADER_TRIE *hdr = (LEADER_TRIE*)leaderTrie;
+    LEADER_NODE *n, *c;
+    int node, i, at;
+
+    if (leaderNodeCount == 0) LeaderNode();     // An empty root
+    leaderTrieSize = PlaceLeader(0, LEADER_ROOT);
+    if (leaderTrieSize > 0xFFFF) {
+        fprintf(stderr, "leader trie is %d bytes, the limit is 65535\n", leaderTrieSize);
+        exit(1);
+    }
+    hdr->magic = LEADER_TRIE_MAGIC;
+    hdr->size = leaderTrieSize;
+    for (node = 0; node < leaderNodeCount; node++) {
+        n = &leaderNodes[node];
+        at = n->offset;
+        leaderTrie[at++] = n->count;
+        leaderTrie[at++] = n->macro;
+        for (i = 0; i < n->count; i++) {
+            c = &leaderNodes[n->child[i]];
+            leaderTrie[at++] = n->usage[i];
+            leaderTrie[at++] = c->offset & 0xFF;
+            leaderTrie[at++] = c->offset >> 8;
+        }
+    }
+}
+
+// The base layer hides nothing below it, so its holes become ACT_NO
+static uint16_t KeymapAction(int layer, int key)
+{
+    if (layer == 0 && layerAction[0][key] == ACT_TRANSPARENT) return ACT_NO;
+    return layerAction[layer][key];
+}
+
+static uint32_t KeymapDefined(int key)
+{
+    uint32_t mask = 0;
+    int layer;
+
+    for (layer = 0; layer <= maxLayer; layer++) {
+        if (KeymapAction(layer, key) != ACT_TRANSPARENT) mask |= 1u << layer;
+    }
+    return mask;
+}
+
+// The dictionary as STENO_DICT: strokes, offsets, then the texts
+static void WriteSteno(FILE *f)
+{
+    int i, at = 0;
+    const char *c;
+
+    if (stenoCount == 0) {
+        fprintf(f, "const STENO_DICT stenoDefault = { 0, NULL, NULL, NULL };\n\n");
+        return;
+    }
+    fprintf(f, "static const uint32_t stenoStrokes[%d] = {", stenoCount);
+    for (i = 0; i < stenoCount; i++) {
+        fprintf(f, "%s0x%06X,", i % 8 ? " " : "\n    ", steno[i].stroke);
+    }
+    fprintf(f, "\n};\n\n");
+    fprintf(f, "static const uint16_t stenoText[%d] = {", stenoCount);
+    for (i = 0; i < stenoCount; i++) {
+        fprintf(f, "%s%d,", i % 12 ? " " : "\n    ", at);
+        at += strlen(steno[i].text) + 1;
+    }
+    fprintf(f, "\n};\n\n");
+    if (at > 0xFFFF) {
+        fprintf(stderr, "steno texts are %d bytes, the limit is 65535\n", at);
+        exit(1);
+    }
+    fprintf(f, "static const char stenoStrings[%d] = {", at);
+    at = 0;
+    for (i = 0; i < stenoCount; i++) {
+        for (c = steno[i].text; ; c++, at++) {
+            fprintf(f, "%s0x%02X,", at % 12 ? " " : "\n    ", (uint8_t)*c);
+            if (*c == 0) break;
+        }
+        at++;
+    }
+    fprintf(f, "\n};\n\n");
+    fprintf(f, "const STENO_DICT stenoDefault = { %d, stenoStrokes, stenoText, stenoStrings };\n\n", stenoCount);
+}
+
+static void WriteC(const char *path, const char *source)
+{
+    FILE *f = fopen(path, "w");
+    uint64_t members;
+    int i, key, layer;
+
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(f, "/* Generated by tools/macroc from %s.  Do not edit. */\n", source);
+    fprintf(f, "#include <stddef.h>\n");
+    fprintf(f, "#include \"macro_image.h\"\n");
+    fprintf(f, "#include \"keymap.h\"\n");
+    fprintf(f, "#include \"combo.h\"\n");
+    fprintf(f, "#include \"leader.h\"\n");
+    fprintf(f, "#include \"steno.h\"\n\n");
+    fprintf(f, "const uint8_t macroImageDefault[] __attribute__ ((aligned(4))) = {");
+    for (i = 0; i < imageSize; i++) {
+        fprintf(f, "%s0x%02X,", i % 12 ? " " : "\n    ", image[i]);
+    }
+    fprintf(f, "\n};\n\n");
+
+    fprintf(f, "const uint8_t leaderTrieDefault[] = {");
+    for (i = 0; i < leaderTrieSize; i++) {
+        fprintf(f, "%s0x%02X,", i % 12 ? " " : "\n    ", leaderTrie[i]);
+    }
+    fprintf(f, "\n};\n\n");
+
+    WriteSteno(f);
+
+    BuildComboTable();
+    members = 0;
+    if (comboTableCount != 0) {
+        fprintf(f, "static const COMBO comboTable[%d] = {\n", comboTableCount);
+        for (i = 0; i < comboTableCount; i++) {
+            fprintf(f, "    { 0x%016llXull, %d, %s },\n", (unsigned long long)comboTable[i].keys, comboTable[i].key,
+                    comboTable[i].flags == (COMBO_FIRES | COMBO_PREFIX) ? "COMBO_FIRES | COMBO_PREFIX" :
+                    comboTable[i].flags == COMBO_FIRES ? "COMBO_FIRES" : "COMBO_PREFIX");
+            members |= comboTable[i].keys;
+        }
+        fprintf(f, "};\n\n");
+        fprintf(f, "const COMBO_TABLE comboDefault = { %d, 0x%016llXull, comboTable };\n\n",
+                comboTableCount, (unsigned long long)members);
+    } else {
+        fprintf(f, "const COMBO_TABLE comboDefault = { 0, 0, NULL };\n\n");
+    }
+
+    if (maxLayer < 0 || maxKey < 0) {
+        fprintf(f, "const KEYMAP keymapDefault = { 0, 1, NULL, NULL };\n");
+        fclose(f);
+        return;
+    }
+
+    // Flattened: one row per key, one column per layer
+    fprintf(f, "static const uint32_t keymapDefined[%d] = {", maxKey + 1);
+    for (key = 0; key <= maxKey; key++) {
+        fprintf(f, "%s0x%08X,", key % 6 ? " " : "\n    ", KeymapDefined(key));
+    }
+    fprintf(f, "\n};\n\n");
+    fprintf(f, "static const uint16_t keymapActions[%d] = {\n", (maxKey + 1) * (maxLayer + 1));
+    for (key = 0; key <= maxKey; key++) {
+        fprintf(f, "   ");
+        for (layer = 0; layer <= maxLayer; layer++) fprintf(f, " 0x%04X,", KeymapAction(layer, key));
+        fprintf(f, "     // key %d\n", key);
+    }
+    fprintf(f, "};\n\n");
+    fprintf(f, "const KEYMAP keymapDefault = { %d, %d, keymapDefined, keymapActions };\n", maxKey + 1, maxLayer + 1);
+    fclose(f);
+}
+
+/* ---------------------------------------------------------------- */
+/* Driver                                                           */
+/* ---------------------------------------------------------------- */
+
+// Back to the state before any source was read
+static void Reset(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_MACROS; i++) {
+        free(src[i].naive.code);
+        free(src[i].opt.code);
+    }
+    for (i = 0; i < subCount; i++) free(subs[i].code);
+    for (i = 0; i < strCount; i++) {
+        free(strs[i].text);
+        free(packedStrs[i].text);
+    }
+    for (i = 0; i < stenoCount; i++) free(steno[i].text);
+    for (i = 0; i < leaderNodeCount; i++) {
+        free(leaderNodes[i].usage);
+        free(leaderNodes[i].child);
+    }
+    free(leaderNodes);
+
+    memset(src, 0, sizeof(src));
+    maxId = -1;
+    memset(layerAction, 0, sizeof(layerAction));
+    memset(layerDefined, 0, sizeof(layerDefined));
+    maxLayer = maxLayerRef = maxKey = -1;
+    comboCount = comboTableCount = 0;
+    memset(strs, 0, sizeof(strs));
+    memset(packedStrs, 0, sizeof(packedStrs));
+    strCount = 0;
+    memset(pairTable, 0, sizeof(pairTable));
+    packing = false;
+    leaderNodes = NULL;
+    leaderNodeCount = leaderNodeCap = leaderCount = leaderTrieSize = 0;
+    stenoCount = 0;
+    memset(subs, 0, sizeof(subs));
+    subCount = 0;
+    line = 1;
+}
+
+/*
+ * Parses, optimizes and lays out source into image[] and checks every
+ * macro against its naive encoding.  With report set, writes the size
+ * report there.  Returns the image size, or -1 after an error.
+ */
+static int Compile(const char *name, char *source, bool noPack, FILE *report)
+{
+    static uint8_t naiveImage[sizeof(image)];
+    TRACE naiveTrace = { 0 }, optTrace = { 0 };
+    int naiveSize, optSize, id, i, rawTotal = 0, naiveTotal = 0, optTotal = 0, subTotal = 0;
+    int plainText, packedText;
+
+    fileName = name;
+    text = cur = source;
+    Parse();
+    if (maxId < 0 && maxLayer < 0 && comboCount == 0 && leaderCount == 0 &&
+        stenoCount == 0) {
+        fprintf(stderr, "%s: nothing to compile\n", name);
+        return -1;
+    }
+
+    for (id = 0; id <= maxId; id++) {
+        if (!src[id].defined) continue;
+        SeqCopy(&src[id].opt, &src[id].naive);
+        while (FoldDelays(&src[id].opt));
+        DropRedundantMods(&src[id].opt);
+    }
+    ShareCode();
+    FindHosts(strs);
+    Pack();
+    plainText = TextBytes(strs, false);
+    packedText = TextBytes(packedStrs, true);
+    packing = !noPack && packedText < plainText;
+    if (packing) {
+        for (id = 0; id <= maxId; id++) UsePacked(&src[id].opt);
+        for (i = 0; i < subCount; i++) UsePacked(&subs[i]);
+    }
+    BuildLeaderTrie();
+
+    naiveSize = Build(true);
+    memcpy(naiveImage, image, naiveSize);
+    optSize = Build(false);
+
+    if (!MacroImageValid(image, optSize)) {
+        fprintf(stderr, "internal error: image does not validate\n");
+        return -1;
+    }
+
+    if (report) {
+        fprintf(report, "%-4s %-16s %8s %8s %8s\n", "id", "name", "reports", "naive", "macroc");
+    }
+    for (id = 0; id <= maxId; id++) {
+        if (!src[id].defined) continue;
+        Trace(naiveImage, MacroImageEntry(naiveImage, id), &naiveTrace);
+        Trace(image, MacroImageEntry(image, id), &optTrace);
+        if (!SameTrace(&naiveTrace, &optTrace)) {
+            fprintf(stderr, "internal error: macro %d plays differently once optimized\n", id);
+            return -1;
+        }
+        naiveTotal += SeqSize(src[id].naive.code, src[id].naive.len) + 1;
+        optTotal += SeqSize(src[id].opt.code, src[id].opt.len) + 1;
+        // A recorded report stream: 8-byte boot report plus a 16-bit delay each
+        if (naiveTrace.finished) rawTotal += naiveTrace.len * 10;
+        if (report) {
+            fprintf(report, "%-4d %-16s %8d %8d %8d%s\n", id, src[id].name[0] ? src[id].name : "-",
+                    naiveTrace.len * 10, SeqSize(src[id].naive.code, src[id].naive.len) + 1,
+                    SeqSize(src[id].opt.code, src[id].opt.len) + 1,
+                    naiveTrace.finished ? "" : "  (endless, reports cut at 120 s)");
+        }
+    }
+    free(naiveTrace.ev);
+    free(optTrace.ev);
+    for (i = 0; i < subCount; i++) subTotal += SeqSize(subs[i].code, subs[i].len) + 1;
+
+    if (report) {
+        fprintf(report, "%-21s %8d %8d %8d  + %d bytes in %d shared blocks\n", "code",
+                rawTotal, naiveTotal, optTotal, subTotal, subCount);
+        if (strCount && pairTable[0] == 0) {
+            fprintf(report, "%-21s %8s %8d %8d  stream text; nothing repeats enough to pack\n", "text", "",
+                    plainText, plainText);
+        } else if (strCount) {
+            fprintf(report, "%-21s %8s %8d %8d  stream text; packed with %d pairs it takes %.1f%%%s\n", "text", "",
+                    plainText, packing ? packedText : plainText, pairTable[0],
+                    100.0 * packedText / plainText, packing ? "" : ", so it is not");
+        }
+        fprintf(report, "%-21s %8s %8d %8d  (%.1f%% of naive bytecode, %.1f%% of raw reports)\n", "image", "",
+                naiveSize, optSize, 100.0 * optSize / naiveSize, rawTotal ? 100.0 * optSize / rawTotal : 0.0);
+        if (leaderCount) {
+            fprintf(report, "leader                %d sequences, %d trie nodes, %d bytes\n",
+                    leaderCount, leaderNodeCount, leaderTrieSize);
+        }
+    }
+    return optSize;
+}
+
+/* ---------------------------------------------------------------- */
+/* Self test                                                        */
+/* ---------------------------------------------------------------- */
+
+/*
+ * Fixed sources, each with the exact image and size report macroc
+ * must produce:
+ *   fold    constant delay expressions, adjacent delays and a loop
+ *           that only waits become one MOP_DELAY
+ *   dedup   a run two macros share becomes one subroutine, placed
+ *           right after the first macro that calls it
+ *   layout  macros in id order, each followed by the shared code it
+ *           reaches first and then its strings; a string that ends
+ *           another points into it
+ */
+static const uint8_t selfFold[] = {
+    0x43, 0x4D, 0x02, 0x01, 0x12, 0x00, 0x00, 0x00, 0x0A, 0x00,
+    0x03, 0x04,                         // 10: tap a
+    0x04, 0xCE, 0x04,                   //     delay 1230
+    0x03, 0x05,                         //     tap b
+    0x00,
+};
+
+static const uint8_t selfDedup[] = {
+    0x43, 0x4D, 0x02, 0x02, 0x2D, 0x00, 0x00, 0x00, 0x0C, 0x00, 0x27, 0x00,
+    0x03, 0x1B,                         // 12: tap x
+    0x09, 0x12, 0x00,                   //     call 18
+    0x00,
+    0x08, 0x02, 0x03, 0x0B, 0x08, 0x00, // 18: "Hi there"
+    0x03, 0x0C, 0x03, 0x2C, 0x03, 0x17, 0x03, 0x0B,
+    0x03, 0x08, 0x03, 0x15, 0x03, 0x08,
+    0x0A,
+    0x09, 0x12, 0x00,                   // 39: call 18
+    0x03, 0x1C,                         //     tap y
+    0x00,
+};
+
+static const uint8_t selfLayout[] = {
+    0x43, 0x4D, 0x02, 0x03, 0x31, 0x00, 0x00, 0x00, 0x0E, 0x00, 0x11, 0x00, 0x28, 0x00,
+    0x03, 0x04, 0x00,                   // 14: macro 0
+    0x09, 0x18, 0x00,                   // 17: macro 1, call 24
+    0x0B, 0x21, 0x00,                   //     stream 33
+    0x00,
+    0x03, 0x05, 0x03, 0x06, 0x03, 0x07, // 24: tap b c d e
+    0x03, 0x08, 0x0A,
+    'x', 'y', 'z', 'a', 'b', 'c', 0,    // 33
+    0x03, 0x09,                         // 40: macro 2, tap f
+    0x09, 0x18, 0x00,                   //     call 24
+    0x0B, 0x24, 0x00,                   //     stream 36, inside "xyzabc"
+    0x00,
+};
+
+static const struct
+{
+    const char *name;
+    const char *source;
+    const uint8_t *image;
+    int size;
+    const char *report;
+} selfTests[] = {
+    { "fold",
+      "macro 0 fold {\n"
+      "    tap a\n"
+      "    delay 2 * 50 + 100\n"
+      "    delay 1s\n"
+      "    repeat 3 { delay 10 }\n"
+      "    tap b\n"
+      "}\n",
+      selfFold, sizeof(selfFold),
+      "id   name              reports    naive   macroc\n"
+      "0    fold                   40       17        8\n"
+      "code                        40       17        8  + 0 bytes in 0 shared blocks\n"
+      "image                                27       18  (66.7% of naive bytecode, 45.0% of raw reports)\n" },
+    { "dedup",
+      "macro 0 first { tap x type \"Hi there\" }\n"
+      "macro 1 second { type \"Hi there\" tap y }\n",
+      selfDedup, sizeof(selfDedup),
+      "id   name              reports    naive   macroc\n"
+      "0    first                 200       37        6\n"
+      "1    second                200       37        6\n"
+      "code                       400       74       12  + 21 bytes in 1 shared blocks\n"
+      "image                                86       45  (52.3% of naive bytecode, 11.2% of raw reports)\n" },
+    { "layout",
+      "macro 0 { tap a }\n"
+      "macro 1 later { tap b tap c tap d tap e stream \"xyzabc\" }\n"
+      "macro 2 { tap f tap b tap c tap d tap e stream \"abc\" }\n",
+      selfLayout, sizeof(selfLayout),
+      "id   name              reports    naive   macroc\n"
+      "0    -                      20        3        3\n"
+      "1    later                 100       12        7\n"
+      "2    -                     120       14        9\n"
+      "code                       240       29       19  + 9 bytes in 1 shared blocks\n"
+      "text                                  7        7  stream text; nothing repeats enough to pack\n"
+      "image                                50       49  (98.0% of naive bytecode, 20.4% of raw reports)\n" },
+};
+
+static int SelfTest(void)
+{
+    char source[1024], *report;
+    size_t reportLen;
+    int t, i, size, failed = 0;
+    FILE *f;
+
+    for (t = 0; t < (int)(sizeof(selfTests) / sizeof(selfTests[0])); t++) {
+        Reset();
+        snprintf(source, sizeof(source), "%s", selfTests[t].source);
+        if ((f = open_memstream(&report, &reportLen)) == NULL) {
+            perror("open_memstream");
+            return 1;
+        }
+        size = Compile(selfTests[t].name, source, false, f);
+        fclose(f);
+
+        if (size != selfTests[t].size) {
+            printf("%s: image is %d bytes, expected %d\n", selfTests[t].name, size, selfTests[t].size);
+            failed++;
+        } else if (memcmp(image, selfTests[t].image, size) != 0) {
+            for (i = 0; image[i] == selfTests[t].image[i]; i++);
+            printf("%s: image byte %d is 0x%02X, expected 0x%02X\n", selfTests[t].name, i,
+                   image[i], selfTests[t].image[i]);
+            failed++;
+        } else if (strcmp(report, selfTests[t].report) != 0) {
+            printf("%s: size report differs, expected\n%sgot\n%s", selfTests[t].name,
+                   selfTests[t].report, report);
+            failed++;
+        } else {
+            printf("%s: ok\n", selfTests[t].name);
+        }
+        free(report);
+    }
+    Reset();
+    return failed ? 1 : 0;
+}
+int main(int argc, char **argv)
+{
+    const char *out = NULL, *cOut = NULL, *leaderOut = NULL, *in = NULL;
+    bool report = false, noPack = false;
+    int optSize, i;
+    long length;
+    FILE *f;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) out = argv[++i];
+        else if (!strcmp(argv[i], "-c") && i + 1 < argc) cOut = argv[++i];
+        else if (!strcmp(argv[i], "--leader") && i + 1 < argc) leaderOut = argv[++i];
+        else if (!strcmp(argv[i], "--report")) report = true;
+        else if (!strcmp(argv[i], "--no-pack")) noPack = true;
+        else if (!strcmp(argv[i], "--selftest")) return SelfTest();
+        else in = argv[i];
+    }
+    if (!in) {
+        fprintf(stderr, "usage: macroc [-o image.bin] [-c image.c] [--leader trie.bin] [--report] [--no-pack] source.mac\n"
+                        "       macroc --selftest\n");
+        return 2;
+    }
+
+    if ((f = fopen(in, "rb")) == NULL) {
+        perror(in);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    length = ftell(f);
+    rewind(f);
+    text = malloc(length + 1);
+    if (fread(text, 1, length, f) != (size_t)length) {
+        perror(in);
+        return 1;
+    }
+    text[length] = 0;
+    fclose(f);
+    if ((optSize = Compile(in, text, noPack, report ? stdout : NULL)) < 0) return 1;
+
+    if (out) {
+        if ((f = fopen(out, "wb")) == NULL || fwrite(image, 1, optSize, f) != (size_t)optSize) {
+            perror(out);
+            return 1;
+        }
+        fclose(f);
+    }
+    if (leaderOut) {
+        if ((f = fopen(leaderOut, "wb")) == NULL ||
+            fwrite(leaderTrie, 1, leaderTrieSize, f) != (size_t)leaderTrieSize) {
+            perror(leaderOut);
+            return 1;
+        }
+        fclose(f);
+    }
+    if (cOut) WriteC(cOut, in);
+    return 0;
+}